@@ -0,0 +1,31 @@
+#ifndef WFREST_BENCH_ROUTES_H_
+#define WFREST_BENCH_ROUTES_H_
+
+#include "wfrest/HttpServer.h"
+
+// The routes of wfrest_bench, also served in-process by wfrest_loadgen --scenario
+inline void add_bench_routes(wfrest::HttpServer &svr)
+{
+    using namespace wfrest;
+
+    // wrk -t100 -c1000 -d30s  --latency http://ip:port/
+    svr.GET("/", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("");
+    });
+
+    // wrk -t100 -c1000 -d30s  --latency http://ip:port/ping
+    svr.GET("/ping", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("pong");
+    });
+
+    // wrk -t100 -c1000 -d30s -s post.lua --latency http://ip:port/echo
+    svr.POST("/echo", [](const HttpReq *req, HttpResp *resp)
+    {
+        std::string &body = req->body();
+        resp->String(std::move(body));
+    });
+}
+
+#endif // WFREST_BENCH_ROUTES_H_
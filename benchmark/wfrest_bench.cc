@@ -1,6 +1,7 @@
 #include "workflow/WFFacilities.h"
 #include <csignal>
 #include "wfrest/HttpServer.h"
+#include "bench_routes.h"
 
 using namespace wfrest;
 
@@ -28,24 +29,7 @@ int main(int argc, char** argv)
 
     HttpServer svr;
 
-    // wrk -t100 -c1000 -d30s  --latency http://ip:port/
-    svr.GET("/", [](const HttpReq *req, HttpResp *resp)
-    {
-        resp->String("");
-    });
-
-    // wrk -t100 -c1000 -d30s  --latency http://ip:port/ping
-    svr.GET("/ping", [](const HttpReq *req, HttpResp *resp)
-    {
-        resp->String("pong");
-    });
-
-    // wrk -t100 -c1000 -d30s -s post.lua --latency http://ip:port/echo
-    svr.POST("/echo", [](const HttpReq *req, HttpResp *resp)
-    {
-        std::string &body = req->body();
-        resp->String(std::move(body));
-    });
+    add_bench_routes(svr);
 
     if (svr.start(8888) == 0)
     {
@@ -0,0 +1,751 @@
+// A load generator built on the workflow http client.
+//
+// closed loop, 64 connections sending back to back for 10s :
+//   ./wfrest_loadgen -u http://127.0.0.1:8888 -c 64 -d 10 -r GET:/ping
+// open loop, 20000 req/s whatever the latency, POST with a 1KB body :
+//   ./wfrest_loadgen -u http://127.0.0.1:8888 -R 20000 -r POST:/echo -p 1024
+// route mix, 9 pings for 1 echo :
+//   ./wfrest_loadgen -r GET:/ping:9 -r POST:/echo:1
+// start wfrest_bench in-process on loopback and run the standard scenarios :
+//   ./wfrest_loadgen --scenario --json result.json
+// h2c with prior knowledge, one blocking thread per connection, closed loop only :
+//   ./wfrest_loadgen --h2 -c 16 -r GET:/ping
+//
+// In open loop a request's latency is counted from when it was due to be sent,
+// not from when it was actually sent, so a stalled server is not hidden by the
+// requests which were not sent while waiting for it (coordinated omission).
+
+#include "workflow/WFFacilities.h"
+#include <getopt.h>
+#include <time.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <memory>
+#include <vector>
+#include <string>
+
+#include "wfrest/HttpServer.h"
+#include "wfrest/Histogram.h"
+#include "wfrest/Http2.h"
+#include "bench_routes.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+namespace
+{
+
+struct Route
+{
+    std::string method;
+    std::string path;
+    int weight;
+};
+
+struct Options
+{
+    std::string url = "http://127.0.0.1:8888";
+    int connections = 64;
+    int duration = 10;              // seconds
+    double rate = 0;                // req/s, 0 means closed loop
+    size_t payload = 0;             // body bytes of POST / PUT
+    bool keep_alive = true;
+    bool h2 = false;                // h2c with prior knowledge
+    std::vector<Route> routes;
+    bool scenario = false;
+    unsigned short port = 8888;     // of the in-process server
+    std::string json_out;
+};
+
+long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+long long cpu_us()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Written by one callback thread, merged at the end of the run.
+struct ThreadStats
+{
+    Histogram latency;
+    uint64_t ok = 0;
+    uint64_t errors = 0;
+};
+
+struct Report
+{
+    std::string name;
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    double seconds = 0;
+    double rps = 0;
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+    double cpu_per_req = 0;     // us, the whole process
+};
+
+class LoadGen
+{
+public:
+    LoadGen(const Options &opts) : opts_(opts), id_(next_id_++)
+    {
+        for (const Route &route : opts_.routes)
+            total_weight_ += route.weight;
+        body_.assign(opts_.payload, 'x');
+    }
+
+    Report run(const std::string &name);
+
+private:
+    ThreadStats *local_stats();
+
+    const Route &pick_route();
+
+    WFHttpTask *create_task(long long due_us);
+
+    void record(WFHttpTask *task, long long due_us);
+
+    void record(bool ok, long long due_us);
+
+    void run_closed_loop();
+
+    void send_next(SeriesWork *series);
+
+    void run_open_loop();
+
+    void run_h2();
+
+    void run_h2_connection();
+
+    void task_done();
+
+private:
+    const Options &opts_;
+    const unsigned int id_;
+    int total_weight_ = 0;
+    std::string body_;
+    long long deadline_us_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<std::unique_ptr<ThreadStats>> stats_;
+    int outstanding_ = 0;
+
+    static std::atomic<unsigned int> next_id_;
+};
+
+std::atomic<unsigned int> LoadGen::next_id_{1};
+
+thread_local std::pair<unsigned int, ThreadStats *> local_stats_of_run{0, nullptr};
+
+ThreadStats *LoadGen::local_stats()
+{
+    if (local_stats_of_run.first != id_)
+    {
+        auto *stats = new ThreadStats;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.emplace_back(stats);
+        }
+        local_stats_of_run = std::make_pair(id_, stats);
+    }
+    return local_stats_of_run.second;
+}
+
+const Route &LoadGen::pick_route()
+{
+    if (opts_.routes.size() == 1)
+        return opts_.routes[0];
+
+    thread_local std::mt19937 rng(std::random_device{}());
+    int n = static_cast<int>(rng() % total_weight_);
+    for (const Route &route : opts_.routes)
+    {
+        n -= route.weight;
+        if (n < 0)
+            return route;
+    }
+    return opts_.routes.back();
+}
+
+WFHttpTask *LoadGen::create_task(long long due_us)
+{
+    const Route &route = this->pick_route();
+    WFHttpTask *task = WFTaskFactory::create_http_task(opts_.url + route.path, 0, 0,
+    [this, due_us](WFHttpTask *task)
+    {
+        this->record(task, due_us);
+        if (opts_.rate > 0)
+            this->task_done();
+        else
+            this->send_next(series_of(task));
+    });
+
+    HttpRequest *req = task->get_req();
+    req->set_method(route.method);
+    if (!opts_.keep_alive)
+        req->set_header_pair("Connection", "close");
+    if (route.method == "POST" || route.method == "PUT")
+    {
+        req->set_header_pair("Content-Type", "application/octet-stream");
+        req->append_output_body_nocopy(body_.data(), body_.size());
+    }
+    return task;
+}
+
+void LoadGen::record(WFHttpTask *task, long long due_us)
+{
+    const char *code = task->get_resp()->get_status_code();
+    this->record(task->get_state() == WFT_STATE_SUCCESS && code && code[0] < '4', due_us);
+}
+
+void LoadGen::record(bool ok, long long due_us)
+{
+    ThreadStats *stats = this->local_stats();
+    long long latency = now_us() - due_us;
+    stats->latency.record(latency > 0 ? latency : 0);
+
+    if (ok)
+        stats->ok++;
+    else
+        stats->errors++;
+}
+
+void LoadGen::task_done()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--outstanding_ == 0)
+        cond_.notify_one();
+}
+
+// Every connection sends its next request as soon as the previous one is replied.
+void LoadGen::run_closed_loop()
+{
+    outstanding_ = opts_.connections;
+    for (int i = 0; i < opts_.connections; i++)
+    {
+        SeriesWork *series = Workflow::create_series_work(this->create_task(now_us()),
+        [this](const SeriesWork *)
+        {
+            this->task_done();
+        });
+        series->start();
+    }
+}
+
+void LoadGen::send_next(SeriesWork *series)
+{
+    long long due_us = now_us();
+    if (due_us < deadline_us_)
+        series->push_back(this->create_task(due_us));
+}
+
+// Requests are sent at a constant rate, whether the previous ones are replied or not.
+void LoadGen::run_open_loop()
+{
+    double interval_us = 1e6 / opts_.rate;
+    long long start_us = now_us();
+    for (uint64_t i = 0;; i++)
+    {
+        long long due_us = start_us + static_cast<long long>(i * interval_us);
+        if (due_us >= deadline_us_)
+            break;
+
+        long long wait_us = due_us - now_us();
+        if (wait_us > 50)
+        {
+            struct timespec ts = { static_cast<time_t>(wait_us / 1000000),
+                                   static_cast<long>(wait_us % 1000000) * 1000 };
+            nanosleep(&ts, nullptr);
+        }
+
+        WFHttpTask *task = this->create_task(due_us);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            outstanding_++;
+        }
+        task->start();
+    }
+}
+
+// the receive windows of the h2 client
+const uint32_t k_h2_window = 1U << 30;
+
+// The server writes its frames as it reads the ones of the client, a client
+// which waits for a reply pings it this often, up to as much added latency.
+const int k_h2_ping_ms = 1;
+
+// Blocking h2c client : the server serves the streams of a connection one at a time.
+class H2Connection
+{
+public:
+    ~H2Connection()
+    {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    // the preface, and the ack of the server settings
+    bool open(const std::string &url)
+    {
+        std::string host = url.compare(0, 7, "http://") == 0 ? url.substr(7) : url;
+        std::string port = "80";
+        size_t pos = host.rfind(':');
+        if (pos != std::string::npos)
+        {
+            port = host.substr(pos + 1);
+            host.resize(pos);
+        }
+        authority_ = host + ":" + port;
+
+        struct addrinfo hints = {};
+        struct addrinfo *res;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+            return false;
+        fd_ = socket(res->ai_family, SOCK_STREAM, 0);
+        bool connected = fd_ >= 0 && connect(fd_, res->ai_addr, res->ai_addrlen) == 0;
+        freeaddrinfo(res);
+        if (!connected)
+            return false;
+
+        // windows large enough for any reply, the connection one is refilled per reply
+        std::string out(Http2Frame::k_preface, Http2Frame::k_preface_size);
+        Http2Frame::append_settings(&out, { { 0x4, k_h2_window } });
+        Http2Frame::append_window_update(&out, 0, k_h2_window - 65535);
+        return this->send_all(out);
+    }
+
+    // false once the connection is lost, *status is empty if the stream was reset
+    bool request(const Route &route, const std::string &body, std::string *status)
+    {
+        uint32_t stream_id = next_stream_id_;
+        next_stream_id_ += 2;
+
+        std::string block;
+        HpackEncoder::encode(":method", route.method, &block);
+        HpackEncoder::encode(":scheme", "http", &block);
+        HpackEncoder::encode(":path", route.path, &block);
+        HpackEncoder::encode(":authority", authority_, &block);
+        if (!body.empty())
+            HpackEncoder::encode("content-type", "application/octet-stream", &block);
+
+        // the body within the windows of the server, which refills them as it reads
+        std::string out;
+        uint8_t flags = Http2Frame::k_end_headers | (body.empty() ? Http2Frame::k_end_stream : 0);
+        Http2Frame::append(&out, block.size(), Http2FrameType::HEADERS, flags, stream_id);
+        out += block;
+        for (size_t off = 0; off < body.size(); off += max_frame_size_)
+        {
+            size_t length = std::min(body.size() - off, static_cast<size_t>(max_frame_size_));
+            flags = off + length == body.size() ? Http2Frame::k_end_stream : 0;
+            Http2Frame::append(&out, length, Http2FrameType::DATA, flags, stream_id);
+            out.append(body, off, length);
+        }
+        if (!this->send_all(out))
+            return false;
+
+        status->clear();
+        size_t received = 0;
+        Http2Frame frame;
+        std::string payload;
+        while (this->read_frame(&frame, &payload))
+        {
+            if (frame.type == Http2FrameType::SETTINGS && !(frame.flags & Http2Frame::k_ack))
+            {
+                out.clear();
+                Http2Frame::append(&out, 0, Http2FrameType::SETTINGS, Http2Frame::k_ack, 0);
+                if (!this->send_all(out))
+                    return false;
+            }
+            else if (frame.type == Http2FrameType::GOAWAY)
+                going_away_ = true;
+            if (frame.stream_id != stream_id)
+                continue;
+
+            if (frame.type == Http2FrameType::RST_STREAM)
+                return true;
+            if (frame.type == Http2FrameType::DATA)
+                received += frame.length;
+            if (frame.type == Http2FrameType::HEADERS)
+            {
+                Http2Headers headers;
+                if (decoder_.decode(payload.data(), payload.size(), 65536, &headers) != 0)
+                    return false;
+                for (const auto &header : headers)
+                {
+                    if (header.first == ":status")
+                        *status = header.second;
+                }
+            }
+            if (frame.flags & Http2Frame::k_end_stream)
+            {
+                if (received == 0)
+                    return true;
+                out.clear();
+                Http2Frame::append_window_update(&out, 0, received);
+                return this->send_all(out);
+            }
+        }
+        return false;
+    }
+
+    // the server closes the connection after the current reply
+    bool going_away() const { return going_away_; }
+
+private:
+    bool send_all(const std::string &data)
+    {
+        const char *p = data.data();
+        size_t size = data.size();
+        while (size > 0)
+        {
+            ssize_t n = send(fd_, p, size, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool wait_readable()
+    {
+        struct pollfd pfd = { fd_, POLLIN, 0 };
+        while (true)
+        {
+            int ret = poll(&pfd, 1, k_h2_ping_ms);
+            if (ret != 0)
+                return ret > 0;
+            std::string out;
+            Http2Frame::append(&out, 8, Http2FrameType::PING, 0, 0);
+            out.append(8, '\0');
+            if (!this->send_all(out))
+                return false;
+        }
+    }
+
+    bool read_all(char *buf, size_t size)
+    {
+        while (size > 0)
+        {
+            if (!this->wait_readable())
+                return false;
+            ssize_t n = read(fd_, buf, size);
+            if (n <= 0)
+                return false;
+            buf += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool read_frame(Http2Frame *frame, std::string *payload)
+    {
+        char header[Http2Frame::k_header_size];
+        if (!this->read_all(header, sizeof header))
+            return false;
+        frame->parse(header);
+        payload->resize(frame->length);
+        return frame->length == 0 || this->read_all(&(*payload)[0], frame->length);
+    }
+
+private:
+    int fd_ = -1;
+    std::string authority_;
+    uint32_t next_stream_id_ = 1;
+    uint32_t max_frame_size_ = 16384;     // the default, the server never sends a larger one
+    HpackDecoder decoder_;
+    bool going_away_ = false;
+};
+
+// One thread and one connection per --connections, each sending its next
+// stream once the previous one is replied, reconnecting after a GOAWAY.
+void LoadGen::run_h2()
+{
+    outstanding_ = opts_.connections;
+    for (int i = 0; i < opts_.connections; i++)
+    {
+        std::thread([this]
+        {
+            this->run_h2_connection();
+            this->task_done();
+        }).detach();
+    }
+}
+
+void LoadGen::run_h2_connection()
+{
+    std::unique_ptr<H2Connection> conn;
+    std::string status;
+    for (long long due_us = now_us(); due_us < deadline_us_; due_us = now_us())
+    {
+        if (!conn)
+        {
+            conn.reset(new H2Connection);
+            if (!conn->open(opts_.url))
+            {
+                this->record(false, due_us);
+                conn.reset();
+                continue;
+            }
+        }
+
+        const Route &route = this->pick_route();
+        bool has_body = route.method == "POST" || route.method == "PUT";
+        bool alive = conn->request(route, has_body ? body_ : std::string(), &status);
+        // the stream sent after the GOAWAY of the last reply goes to a new connection
+        if (alive || !conn->going_away() || !status.empty())
+            this->record(alive && !status.empty() && status[0] < '4', due_us);
+        if (!alive || conn->going_away())
+            conn.reset();
+    }
+}
+
+Report LoadGen::run(const std::string &name)
+{
+    long long cpu_start = cpu_us();
+    long long start_us = now_us();
+    deadline_us_ = start_us + opts_.duration * 1000000LL;
+
+    if (opts_.h2)
+        this->run_h2();
+    else if (opts_.rate > 0)
+        this->run_open_loop();
+    else
+        this->run_closed_loop();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return outstanding_ == 0; });
+    }
+
+    Report report;
+    report.name = name;
+    report.seconds = (now_us() - start_us) / 1e6;
+
+    std::vector<uint64_t> counts(Histogram::k_bucket_count, 0);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &stats : stats_)
+    {
+        stats->latency.merge_to(counts);
+        report.requests += stats->ok + stats->errors;
+        report.errors += stats->errors;
+    }
+    report.rps = report.requests / report.seconds;
+    report.p50 = Histogram::quantile(counts, 0.5);
+    report.p99 = Histogram::quantile(counts, 0.99);
+    report.p999 = Histogram::quantile(counts, 0.999);
+    report.max = Histogram::quantile(counts, 1);
+    if (report.requests > 0)
+        report.cpu_per_req = static_cast<double>(cpu_us() - cpu_start) / report.requests;
+    return report;
+}
+
+void print_report(const Report &report)
+{
+    fprintf(stderr, "== %s\n", report.name.c_str());
+    fprintf(stderr, "  requests   %llu (%llu errors) in %.2fs\n",
+            (unsigned long long)report.requests, (unsigned long long)report.errors, report.seconds);
+    fprintf(stderr, "  throughput %.1f req/s\n", report.rps);
+    fprintf(stderr, "  latency    p50 %lluus  p99 %lluus  p999 %lluus  max %lluus\n",
+            (unsigned long long)report.p50, (unsigned long long)report.p99,
+            (unsigned long long)report.p999, (unsigned long long)report.max);
+    fprintf(stderr, "  cpu/req    %.1fus\n", report.cpu_per_req);
+}
+
+void write_json(const std::string &path, const std::vector<Report> &reports)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (!fp)
+    {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "[\n");
+    for (size_t i = 0; i < reports.size(); i++)
+    {
+        const Report &r = reports[i];
+        fprintf(fp, "  {\"name\": \"%s\", \"requests\": %llu, \"errors\": %llu, \"seconds\": %.3f, "
+                    "\"rps\": %.1f, \"p50_us\": %llu, \"p99_us\": %llu, \"p999_us\": %llu, "
+                    "\"max_us\": %llu, \"cpu_per_req_us\": %.2f}%s\n",
+                r.name.c_str(), (unsigned long long)r.requests, (unsigned long long)r.errors,
+                r.seconds, r.rps, (unsigned long long)r.p50, (unsigned long long)r.p99,
+                (unsigned long long)r.p999, (unsigned long long)r.max, r.cpu_per_req,
+                i + 1 < reports.size() ? "," : "");
+    }
+    fprintf(fp, "]\n");
+    fclose(fp);
+}
+
+// METHOD:/path[:weight]
+bool parse_route(const std::string &arg, Route &route)
+{
+    size_t pos = arg.find(':');
+    if (pos == std::string::npos || pos + 1 >= arg.size() || arg[pos + 1] != '/')
+        return false;
+    route.method = arg.substr(0, pos);
+    size_t weight_pos = arg.find(':', pos + 1);
+    route.path = arg.substr(pos + 1, weight_pos == std::string::npos ? std::string::npos : weight_pos - pos - 1);
+    route.weight = weight_pos == std::string::npos ? 1 : atoi(arg.c_str() + weight_pos + 1);
+    return route.weight > 0;
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -u, --url URL            server, default http://127.0.0.1:8888\n"
+            "  -r, --route M:/path[:w]  route and weight, may be repeated, default GET:/ping\n"
+            "  -c, --connections N      closed loop concurrency and max connections, default 64\n"
+            "  -R, --rate N             open loop at N req/s instead of closed loop\n"
+            "  -d, --duration S         seconds, default 10\n"
+            "  -p, --payload N          body bytes of POST and PUT, default 0\n"
+            "  -k, --no-keepalive       send Connection: close\n"
+            "  -2, --h2                 h2c with prior knowledge, closed loop\n"
+            "  -s, --scenario           serve wfrest_bench in-process and run the standard scenarios\n"
+            "  -P, --port N             port of the in-process server, default 8888\n"
+            "  -j, --json FILE          write the results as json\n",
+            prog);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    static const struct option long_options[] = {
+        { "url", required_argument, nullptr, 'u' },
+        { "route", required_argument, nullptr, 'r' },
+        { "connections", required_argument, nullptr, 'c' },
+        { "rate", required_argument, nullptr, 'R' },
+        { "duration", required_argument, nullptr, 'd' },
+        { "payload", required_argument, nullptr, 'p' },
+        { "no-keepalive", no_argument, nullptr, 'k' },
+        { "h2", no_argument, nullptr, '2' },
+        { "scenario", no_argument, nullptr, 's' },
+        { "port", required_argument, nullptr, 'P' },
+        { "json", required_argument, nullptr, 'j' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "u:r:c:R:d:p:k2sP:j:h", long_options, nullptr)) != -1)
+    {
+        Route route;
+        switch (opt)
+        {
+        case 'u': opts.url = optarg; break;
+        case 'r':
+            if (!parse_route(optarg, route))
+            {
+                fprintf(stderr, "Bad route %s, expect METHOD:/path[:weight]\n", optarg);
+                return 1;
+            }
+            opts.routes.push_back(route);
+            break;
+        case 'c': opts.connections = atoi(optarg); break;
+        case 'R': opts.rate = atof(optarg); break;
+        case 'd': opts.duration = atoi(optarg); break;
+        case 'p': opts.payload = strtoul(optarg, nullptr, 10); break;
+        case 'k': opts.keep_alive = false; break;
+        case '2': opts.h2 = true; break;
+        case 's': opts.scenario = true; break;
+        case 'P': opts.port = atoi(optarg); break;
+        case 'j': opts.json_out = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (opts.connections <= 0 || opts.duration <= 0 || (opts.h2 && opts.rate > 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opts.routes.empty())
+        opts.routes.push_back(Route{"GET", "/ping", 1});
+    while (!opts.url.empty() && opts.url.back() == '/')
+        opts.url.pop_back();
+
+    struct WFGlobalSettings settings = GLOBAL_SETTINGS_DEFAULT;
+    settings.endpoint_params.max_connections = opts.connections;
+    WORKFLOW_library_init(&settings);
+
+    std::vector<Report> reports;
+    if (!opts.scenario)
+    {
+        LoadGen loadgen(opts);
+        std::string name = opts.h2 ? "h2 closed loop" : opts.rate > 0 ? "open loop" : "closed loop";
+        reports.push_back(loadgen.run(name));
+        print_report(reports.back());
+    }
+    else
+    {
+        HttpServer svr;
+        svr.http2();
+        add_bench_routes(svr);
+        if (svr.start("127.0.0.1", opts.port) != 0)
+        {
+            fprintf(stderr, "Cannot start server on port %d\n", opts.port);
+            return 1;
+        }
+        opts.url = "http://127.0.0.1:" + std::to_string(opts.port);
+
+        // server and load generator share the process, cpu/req is for both
+        Options ping = opts;
+        ping.routes = { Route{"GET", "/ping", 1} };
+        ping.rate = 0;
+        ping.h2 = false;
+        reports.push_back(LoadGen(ping).run("ping closed loop"));
+        print_report(reports.back());
+
+        // against the HTTP/1.1 keep-alive one, the same connection count
+        Options h2 = ping;
+        h2.h2 = true;
+        reports.push_back(LoadGen(h2).run("ping closed loop h2"));
+        print_report(reports.back());
+
+        Options echo = ping;
+        echo.routes = { Route{"POST", "/echo", 1} };
+        echo.payload = opts.payload > 0 ? opts.payload : 1024;
+        reports.push_back(LoadGen(echo).run("echo closed loop"));
+        print_report(reports.back());
+
+        // half of the closed loop throughput, latency without queueing
+        Options open = ping;
+        open.rate = opts.rate > 0 ? opts.rate : reports[0].rps / 2;
+        if (open.rate > 0)
+        {
+            reports.push_back(LoadGen(open).run("ping open loop " +
+                                                std::to_string(static_cast<long long>(open.rate)) +
+                                                " req/s"));
+            print_report(reports.back());
+        }
+        svr.stop();
+    }
+
+    if (!opts.json_out.empty())
+        write_json(opts.json_out, reports);
+    return 0;
+}
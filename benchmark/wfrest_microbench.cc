@@ -0,0 +1,466 @@
+// Microbenchmarks of the wfrest hot paths, built on Google Benchmark.
+// Results for tracking across commits :
+//   ./wfrest_microbench --benchmark_out=microbench.json --benchmark_out_format=json
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+
+#include "wfrest/HttpServer.h"
+#include "wfrest/HttpServerTask.h"
+#include "wfrest/RouteTable.h"
+#include "wfrest/UriUtil.h"
+#include "wfrest/CodeUtil.h"
+#include "wfrest/StrUtil.h"
+#include "wfrest/base64.h"
+#include "wfrest/Simd.h"
+#include "wfrest/HttpCookie.h"
+#include "wfrest/HttpContent.h"
+#include "wfrest/Compress.h"
+#include "wfrest/JsonView.h"
+#include "wfrest/JsonStruct.h"
+#include "wfrest/json.hpp"
+
+using namespace wfrest;
+
+// ---------------------------------------------------------------- route table
+
+struct RouteSet
+{
+    RouteTable table;
+    std::deque<std::string> routes;     // the table keeps pieces of the routes
+    std::vector<std::string> lookups;
+};
+
+// n routes, one out of four with a param, one out of sixteen with a wildcard
+static RouteSet *make_route_set(int n)
+{
+    auto *set = new RouteSet;
+    for (int i = 0; i < n; i++)
+    {
+        std::string route;
+        if (i % 16 == 0)
+            route = "/static" + std::to_string(i) + "/*";
+        else if (i % 4 == 0)
+            route = "/api/v1/res" + std::to_string(i) + "/{id}/detail";
+        else
+            route = "/api/v1/res" + std::to_string(i) + "/list";
+        set->routes.push_back(route);
+        set->table.find_or_create(set->routes.back().c_str());
+    }
+
+    std::mt19937 rng(n);
+    for (int i = 0; i < 1024; i++)
+    {
+        int idx = rng() % n;
+        if (idx % 16 == 0)
+            set->lookups.push_back("/static" + std::to_string(idx) + "/css/site.css");
+        else if (idx % 4 == 0)
+            set->lookups.push_back("/api/v1/res" + std::to_string(idx) + "/12345/detail");
+        else
+            set->lookups.push_back("/api/v1/res" + std::to_string(idx) + "/list");
+    }
+    return set;
+}
+
+static void BM_RouteTableFind(benchmark::State &state)
+{
+    static std::map<int, std::unique_ptr<RouteSet>> sets;
+    int n = static_cast<int>(state.range(0));
+    auto &set = sets[n];
+    if (!set)
+        set.reset(make_route_set(n));
+
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        std::map<std::string, std::string> route_params;
+        std::string route_match_path;
+        const std::string &route = set->lookups[i++ & 1023];
+        auto it = set->table.find(route, route_params, route_match_path);
+        benchmark::DoNotOptimize(it.ptr);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RouteTableFind)->Arg(10)->Arg(1000)->Arg(100000);
+
+// ---------------------------------------------------------------- uri / codec
+
+static void BM_SplitQuery(benchmark::State &state)
+{
+    std::string query = "page=3&size=20&sort=created_at&order=desc&q=wfrest%20benchmark&flag";
+    for (auto _ : state)
+    {
+        auto params = UriUtil::split_query(query);
+        benchmark::DoNotOptimize(params);
+    }
+    state.SetBytesProcessed(state.iterations() * query.size());
+}
+BENCHMARK(BM_SplitQuery);
+
+static void BM_UrlEncode(benchmark::State &state)
+{
+    std::string value = "/api/v1/search/中文路径/{id}?q=a b&c=d";
+    for (auto _ : state)
+    {
+        std::string res = CodeUtil::url_encode(value);
+        benchmark::DoNotOptimize(res);
+    }
+    state.SetBytesProcessed(state.iterations() * value.size());
+}
+BENCHMARK(BM_UrlEncode);
+
+static void BM_UrlDecode(benchmark::State &state)
+{
+    std::string value = CodeUtil::url_encode("/api/v1/search/中文路径/{id}?q=a b&c=d");
+    for (auto _ : state)
+    {
+        std::string res = CodeUtil::url_decode(value);
+        benchmark::DoNotOptimize(res);
+    }
+    state.SetBytesProcessed(state.iterations() * value.size());
+}
+BENCHMARK(BM_UrlDecode);
+
+static void BM_CookieSplit(benchmark::State &state)
+{
+    std::string cookie = "session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; lang=en-US; "
+                         "_ga=GA1.2.1234567890.1234567890; csrftoken=abcdef0123456789";
+    for (auto _ : state)
+    {
+        auto cookies = HttpCookie::split(cookie);
+        benchmark::DoNotOptimize(cookies);
+    }
+    state.SetBytesProcessed(state.iterations() * cookie.size());
+}
+BENCHMARK(BM_CookieSplit);
+
+// ---------------------------------------------------------------- simd kernels
+
+static std::string make_text(size_t size)
+{
+    std::string text;
+    std::mt19937 rng(42);
+    static const char *words[] = { "wfrest ", "workflow ", "route ", "{\"id\":", "123, ", "\"name\":\"abc\"}, " };
+    while (text.size() < size)
+        text += words[rng() % 6];
+    text.resize(size);
+    return text;
+}
+
+
+// the kernels at the level of the arg, skipped above the one of the cpu
+static bool use_level(benchmark::State &state)
+{
+    SimdLevel level = static_cast<SimdLevel>(state.range(0));
+    if (Simd::set_level(level) != level)
+    {
+        state.SkipWithError("level not supported by the cpu");
+        return false;
+    }
+    state.SetLabel(Simd::level_name(level));
+    return true;
+}
+
+static void BM_SimdSplit(benchmark::State &state)
+{
+    if (!use_level(state))
+        return;
+    std::string query = "page=3&size=20&sort=created_at&order=desc&q=wfrest%20benchmark"
+                        "&filter=status%3Aopen%20label%3Abug&fields=id,title,created_at,author&flag";
+    for (auto _ : state)
+    {
+        auto pieces = StrUtil::split_piece<StringPiece>(query, '&');
+        benchmark::DoNotOptimize(pieces);
+    }
+    state.SetBytesProcessed(state.iterations() * query.size());
+    Simd::set_level(Simd::detected());
+}
+BENCHMARK(BM_SimdSplit)->DenseRange(0, 2);
+
+static void BM_SimdUrlEncode(benchmark::State &state)
+{
+    if (!use_level(state))
+        return;
+    std::string value = "/api/v1/search/product-catalog/electronics/{id}/reviews?q=a b&sort=date";
+    for (auto _ : state)
+    {
+        std::string res = CodeUtil::url_encode(value);
+        benchmark::DoNotOptimize(res);
+    }
+    state.SetBytesProcessed(state.iterations() * value.size());
+    Simd::set_level(Simd::detected());
+}
+BENCHMARK(BM_SimdUrlEncode)->DenseRange(0, 2);
+
+static void BM_SimdUrlDecode(benchmark::State &state)
+{
+    if (!use_level(state))
+        return;
+    std::string value = CodeUtil::url_encode("/api/v1/search/product-catalog/electronics/{id}/reviews?q=a b&sort=date");
+    for (auto _ : state)
+    {
+        std::string res = CodeUtil::url_decode(value);
+        benchmark::DoNotOptimize(res);
+    }
+    state.SetBytesProcessed(state.iterations() * value.size());
+    Simd::set_level(Simd::detected());
+}
+BENCHMARK(BM_SimdUrlDecode)->DenseRange(0, 2);
+
+static void BM_SimdBase64Encode(benchmark::State &state)
+{
+    if (!use_level(state))
+        return;
+    std::string bytes = make_text(4096);
+    for (auto _ : state)
+    {
+        std::string res = Base64::encode(reinterpret_cast<const unsigned char *>(bytes.data()), bytes.size());
+        benchmark::DoNotOptimize(res);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes.size());
+    Simd::set_level(Simd::detected());
+}
+BENCHMARK(BM_SimdBase64Encode)->DenseRange(0, 2);
+
+static void BM_SimdBase64Decode(benchmark::State &state)
+{
+    if (!use_level(state))
+        return;
+    std::string bytes = make_text(4096);
+    std::string encoded = Base64::encode(reinterpret_cast<const unsigned char *>(bytes.data()), bytes.size());
+    for (auto _ : state)
+    {
+        std::string res = Base64::decode(encoded);
+        benchmark::DoNotOptimize(res);
+    }
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+    Simd::set_level(Simd::detected());
+}
+BENCHMARK(BM_SimdBase64Decode)->DenseRange(0, 2);
+
+// the lookups of a header map, names which share a prefix
+static void BM_SimdHeaderMap(benchmark::State &state)
+{
+    if (!use_level(state))
+        return;
+    static const char *names[] = {
+        "Accept", "Accept-Encoding", "Accept-Language", "Access-Control-Request-Headers",
+        "Access-Control-Request-Method", "Authorization", "Cache-Control", "Connection",
+        "Content-Length", "Content-Type", "Cookie", "Host", "User-Agent", "X-Forwarded-For",
+    };
+    std::map<std::string, std::string, MapStringCaseLess> headers;
+    for (const char *name : names)
+        headers[name] = "value";
+    std::vector<std::string> lookups;
+    for (const char *name : names)
+    {
+        std::string lower = name;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        lookups.push_back(lower);
+    }
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        auto it = headers.find(lookups[i++ % lookups.size()]);
+        benchmark::DoNotOptimize(it);
+    }
+    state.SetItemsProcessed(state.iterations());
+    Simd::set_level(Simd::detected());
+}
+BENCHMARK(BM_SimdHeaderMap)->DenseRange(0, 2);
+
+// ---------------------------------------------------------------- multipart
+
+static void BM_ParseMultipart(benchmark::State &state)
+{
+    std::string boundary = "----wfrestbench";
+    std::string body;
+    for (int i = 0; i < 4; i++)
+    {
+        body += "--" + boundary + "\r\n";
+        body += "Content-Disposition: form-data; name=\"field" + std::to_string(i) + "\"\r\n\r\n";
+        body += "value" + std::to_string(i) + "\r\n";
+    }
+    body += "--" + boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"file\"; filename=\"a.bin\"\r\n";
+    body += "Content-Type: application/octet-stream\r\n\r\n";
+    body += std::string(state.range(0), 'x') + "\r\n";
+    body += "--" + boundary + "--\r\n";
+
+    MultiPartForm form;
+    form.set_boundary(boundary);
+    for (auto _ : state)
+    {
+        Form res = form.parse_multipart(body);
+        benchmark::DoNotOptimize(res);
+    }
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+BENCHMARK(BM_ParseMultipart)->Arg(1 << 10)->Arg(1 << 20);
+
+// ---------------------------------------------------------------- gzip
+
+static void BM_Gzip(benchmark::State &state)
+{
+    std::string text = make_text(state.range(0));
+    for (auto _ : state)
+    {
+        std::string out;
+        Compressor::gzip(&text, &out);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Gzip)->Arg(1 << 10)->Arg(64 << 10);
+
+static void BM_Ungzip(benchmark::State &state)
+{
+    std::string text = make_text(state.range(0));
+    std::string compressed;
+    Compressor::gzip(&text, &compressed);
+    for (auto _ : state)
+    {
+        std::string out;
+        Compressor::ungzip(&compressed, &out);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Ungzip)->Arg(1 << 10)->Arg(64 << 10);
+
+// ---------------------------------------------------------------- message_out
+
+// Never started, only message_out() is called.
+class BenchServerTask : public HttpServerTask
+{
+public:
+    explicit BenchServerTask(ProcFunc &proc) : HttpServerTask(nullptr, proc) {}
+
+    ~BenchServerTask() = default;
+
+    CommMessageOut *message_out() override { return HttpServerTask::message_out(); }
+};
+
+static void BM_MessageOut(benchmark::State &state)
+{
+    HttpServerTask::ProcFunc proc = [](HttpTask *) {};
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto *task = new BenchServerTask(proc);
+        HttpResp *resp = task->get_resp();
+        resp->headers["Cache-Control"] = "no-cache";
+        resp->headers["X-Request-Id"] = "8f14e45fceea167a";
+        resp->String("{\"code\":0,\"msg\":\"ok\"}");
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(task->message_out());
+
+        state.PauseTiming();
+        delete task;
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_MessageOut);
+
+// ---------------------------------------------------------------- json
+
+struct BenchItem
+{
+    int id;
+    std::string name;
+    double price;
+    std::vector<std::string> tags;
+};
+WFREST_JSON_STRUCT(BenchItem, id, name, price, tags)
+
+struct BenchOrder
+{
+    long long order_id;
+    std::string user;
+    std::vector<BenchItem> items;
+};
+WFREST_JSON_STRUCT(BenchOrder, order_id, user, items)
+
+static BenchOrder make_order(int items)
+{
+    BenchOrder order;
+    order.order_id = 1234567890123LL;
+    order.user = "wfrest \"bench\" user";
+    for (int i = 0; i < items; i++)
+        order.items.push_back(BenchItem{i, "item" + std::to_string(i), i * 1.25, {"a", "b", "c"}});
+    return order;
+}
+
+static void BM_JsonParseDom(benchmark::State &state)
+{
+    std::string text = json_dump(make_order(state.range(0)));
+    for (auto _ : state)
+    {
+        Json json = Json::parse(text, nullptr, false);
+        benchmark::DoNotOptimize(json);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_JsonParseDom)->Arg(8)->Arg(256);
+
+static void BM_JsonViewLookup(benchmark::State &state)
+{
+    std::string text = json_dump(make_order(state.range(0)));
+    for (auto _ : state)
+    {
+        JsonView view(text);
+        long long id = view["order_id"].as_int();
+        std::string name = view["items"][static_cast<size_t>(state.range(0) - 1)]["name"].as_string();
+        benchmark::DoNotOptimize(id);
+        benchmark::DoNotOptimize(name);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_JsonViewLookup)->Arg(8)->Arg(256);
+
+static void BM_JsonStructRead(benchmark::State &state)
+{
+    std::string text = json_dump(make_order(state.range(0)));
+    for (auto _ : state)
+    {
+        BenchOrder order;
+        bool ok = json_read(JsonView(text), order);
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(order);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_JsonStructRead)->Arg(8)->Arg(256);
+
+static void BM_JsonStructDump(benchmark::State &state)
+{
+    BenchOrder order = make_order(state.range(0));
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        std::string text = json_dump(order);
+        bytes += text.size();
+        benchmark::DoNotOptimize(text);
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_JsonStructDump)->Arg(8)->Arg(256);
+
+static void BM_JsonDomDump(benchmark::State &state)
+{
+    Json json = Json::parse(json_dump(make_order(state.range(0))), nullptr, false);
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        std::string text = json.dump();
+        bytes += text.size();
+        benchmark::DoNotOptimize(text);
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_JsonDomDump)->Arg(8)->Arg(256);
+
+BENCHMARK_MAIN();
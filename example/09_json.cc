@@ -39,6 +39,7 @@ int main()
         resp->Json(valid_text);
     });
 
+    // the text is sent as is, it is not checked
     // curl -v http://ip:port/json3
     svr.GET("/json3", [](const HttpReq *req, HttpResp *resp)
     {
@@ -0,0 +1,74 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "CycleClock.h"
+
+namespace wfrest
+{
+
+namespace
+{
+
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool has_invariant_tsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+        return false;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return edx & (1U << 8);
+#else
+    return false;
+#endif
+}
+
+double calibrate()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+#if defined(__aarch64__)
+    uint64_t freq;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    if (freq > 0)
+        return 1e9 / freq;
+#else
+    if (!has_invariant_tsc())
+        return 1.0;
+#endif
+    // spin for 10ms against CLOCK_MONOTONIC
+    uint64_t start_ns = monotonic_ns();
+    uint64_t start_ticks = CycleClock::now();
+    uint64_t end_ns;
+    do
+    {
+        end_ns = monotonic_ns();
+    } while (end_ns - start_ns < 10000000);
+    uint64_t end_ticks = CycleClock::now();
+    if (end_ticks > start_ticks)
+        return static_cast<double>(end_ns - start_ns) / (end_ticks - start_ticks);
+#endif
+    return 1.0;
+}
+
+}  // namespace
+
+bool CycleClock::use_tsc()
+{
+    static const bool tsc = has_invariant_tsc();
+    return tsc;
+}
+
+double CycleClock::ns_per_tick()
+{
+    static const double ns = calibrate();
+    return ns;
+}
+
+}  // namespace wfrest
@@ -0,0 +1,51 @@
+#ifndef WFREST_CYCLECLOCK_H_
+#define WFREST_CYCLECLOCK_H_
+
+#include <cstdint>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace wfrest
+{
+
+/*
+A cheap monotonic clock for timing short intervals.
+On x86 with an invariant TSC it reads the time stamp counter (a few ns),
+on aarch64 the virtual counter, elsewhere CLOCK_MONOTONIC in nanoseconds.
+Ticks are only meaningful as differences, see to_ns().
+*/
+class CycleClock
+{
+public:
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_expect(use_tsc(), 1))
+            return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t cnt;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(cnt));
+        return cnt;
+#endif
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    static double to_ns(uint64_t ticks) { return ticks * ns_per_tick(); }
+
+    static double to_us(uint64_t ticks) { return ticks * ns_per_tick() / 1000; }
+
+    // calibrated once, on the first call
+    static double ns_per_tick();
+
+private:
+    static bool use_tsc();
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_CYCLECLOCK_H_
@@ -0,0 +1,127 @@
+#ifndef WFREST_HISTOGRAM_H_
+#define WFREST_HISTOGRAM_H_
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+namespace wfrest
+{
+
+/*
+Log-linear (HDR style) histogram of non negative integers, such as latencies in microseconds.
+Values below 16 have their own bucket, above that every power of two is split into
+8 buckets, so the relative error is at most 12.5%, up to 2^40.
+
+record() must be called by a single thread, any thread may read it.
+Counters are atomics only to make the concurrent reads well defined,
+a record is a few plain loads and stores.
+record_shared() may be called by several threads, at the cost of atomic adds.
+*/
+class Histogram
+{
+public:
+    enum
+    {
+        k_sub_bits = 3,
+        k_sub_count = 1 << k_sub_bits,
+        k_linear = 2 * k_sub_count,
+        k_max_msb = 40,
+        k_bucket_count = (k_max_msb - k_sub_bits + 1) * k_sub_count + k_sub_count,
+    };
+
+    Histogram()
+    {
+        for (auto &bucket : buckets_)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+
+    static int bucket_of(uint64_t value)
+    {
+        if (value < k_linear)
+            return static_cast<int>(value);
+
+        int msb = 63 - __builtin_clzll(value);
+        if (msb > k_max_msb)
+            return k_bucket_count - 1;
+
+        int shift = msb - k_sub_bits;
+        return (shift + 1) * k_sub_count + static_cast<int>(value >> shift) - k_sub_count;
+    }
+
+    // the largest value which falls in the bucket
+    static uint64_t upper_bound(int idx)
+    {
+        if (idx < k_linear)
+            return idx;
+
+        int shift = idx / k_sub_count - 1;
+        uint64_t top = idx % k_sub_count + k_sub_count;
+        return ((top + 1) << shift) - 1;
+    }
+
+    void record(uint64_t value)
+    {
+        add(buckets_[bucket_of(value)], 1);
+        add(count_, 1);
+        add(sum_, value);
+    }
+
+    void record_shared(uint64_t value)
+    {
+        buckets_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    // add the buckets into counts, which has k_bucket_count elements
+    void merge_to(std::vector<uint64_t> &counts) const
+    {
+        for (int i = 0; i < k_bucket_count; i++)
+            counts[i] += buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    // value at quantile q (0 ~ 1) of merged counts
+    static uint64_t quantile(const std::vector<uint64_t> &counts, double q);
+
+private:
+    static void add(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets_[k_bucket_count];
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+inline uint64_t Histogram::quantile(const std::vector<uint64_t> &counts, double q)
+{
+    uint64_t total = 0;
+    for (uint64_t cnt : counts)
+        total += cnt;
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(q * total);
+    if (rank >= total)
+        rank = total - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < k_bucket_count; i++)
+    {
+        seen += counts[i];
+        if (seen > rank)
+            return upper_bound(i);
+    }
+    return upper_bound(k_bucket_count - 1);
+}
+
+}  // namespace wfrest
+
+#endif // WFREST_HISTOGRAM_H_
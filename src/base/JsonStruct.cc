@@ -0,0 +1,93 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "JsonStruct.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+// 0 : no escape, otherwise the char after '\', 'u' for \u00XX
+const char kEscape[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+const char kHex[] = "0123456789abcdef";
+
+}  // namespace
+
+void JsonWriter::put_string(const char *str, size_t len)
+{
+    out_.push_back('"');
+    const char *end = str + len;
+    const char *run = str;
+    for (const char *p = str; p < end; ++p)
+    {
+        char esc = kEscape[static_cast<unsigned char>(*p)];
+        if (!esc)
+            continue;
+
+        out_.append(run, p - run);
+        out_.push_back('\\');
+        out_.push_back(esc);
+        if (esc == 'u')
+        {
+            unsigned char c = static_cast<unsigned char>(*p);
+            out_.append("00", 2);
+            out_.push_back(kHex[c >> 4]);
+            out_.push_back(kHex[c & 0xF]);
+        }
+        run = p + 1;
+    }
+    out_.append(run, end - run);
+    out_.push_back('"');
+}
+
+void JsonWriter::put_uint(unsigned long long val)
+{
+    char buf[24];
+    char *p = buf + sizeof buf;
+    do
+    {
+        *--p = static_cast<char>('0' + val % 10);
+        val /= 10;
+    } while (val);
+    out_.append(p, buf + sizeof buf - p);
+}
+
+void JsonWriter::put_int(long long val)
+{
+    if (val < 0)
+    {
+        out_.push_back('-');
+        // avoid overflow on LLONG_MIN
+        put_uint(0ULL - static_cast<unsigned long long>(val));
+    }
+    else
+    {
+        put_uint(static_cast<unsigned long long>(val));
+    }
+}
+
+void JsonWriter::put_double(double val)
+{
+    if (!std::isfinite(val))
+    {
+        out_.append("null", 4);
+        return;
+    }
+
+    // the shortest of %.15g and %.17g which reads back the same value
+    char buf[32];
+    int len = snprintf(buf, sizeof buf, "%.15g", val);
+    if (strtod(buf, nullptr) != val)
+        len = snprintf(buf, sizeof buf, "%.17g", val);
+    out_.append(buf, len);
+}
@@ -0,0 +1,299 @@
+#ifndef WFREST_JSONSTRUCT_H_
+#define WFREST_JSONSTRUCT_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+
+#include "StringPiece.h"
+#include "JsonView.h"
+
+/*
+Bind a plain struct to json without going through a nlohmann::json DOM :
+
+    struct Reply
+    {
+        int id;
+        std::string name;
+        std::vector<Item> items;
+    };
+    WFREST_JSON_STRUCT(Reply, id, name, items)
+
+    resp->Json(reply);                  // serialized straight into the body
+    Reply reply = req->json_as<Reply>(); // parsed from the body with JsonView
+
+The macro has to be used in the namespace of the struct, at most 32 fields.
+Fields may be bool, numbers, std::string, std::vector, std::map / std::unordered_map
+with std::string keys and other bound structs. Unknown keys are ignored and
+missing keys keep their default value.
+*/
+
+namespace wfrest
+{
+
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::string &out) : out_(out) {}
+
+    void put(char c) { out_.push_back(c); }
+
+    void put(const char *str, size_t len) { out_.append(str, len); }
+
+    // quoted and escaped
+    void put_string(const char *str, size_t len);
+
+    void put_int(long long val);
+
+    void put_uint(unsigned long long val);
+
+    // nan and inf are written as null
+    void put_double(double val);
+
+    std::string &out() { return out_; }
+
+private:
+    std::string &out_;
+};
+
+namespace detail
+{
+
+template<typename T>
+struct is_json_number
+    : std::integral_constant<bool, std::is_arithmetic<T>::value &&
+                                   !std::is_same<T, bool>::value>
+{};
+
+}  // namespace detail
+
+// T has been bound with WFREST_JSON_STRUCT
+template<typename T, typename = void>
+struct is_json_struct : std::false_type {};
+
+template<typename T>
+struct is_json_struct<T, decltype(wfrest_json_write(std::declval<JsonWriter &>(),
+                                                    std::declval<const T &>()))>
+    : std::true_type {};
+
+// Declare all the overloads first, so that the containers can nest each other.
+
+// Upper bound of the serialized size, used to reserve the output buffer.
+inline size_t json_estimate(bool) { return 5; }
+
+inline size_t json_estimate(const std::string &str) { return str.size() + str.size() / 8 + 2; }
+
+template<typename T>
+typename std::enable_if<detail::is_json_number<T>::value, size_t>::type
+json_estimate(T) { return 24; }
+
+template<typename T, typename A>
+size_t json_estimate(const std::vector<T, A> &vec);
+
+template<typename T, typename C, typename A>
+size_t json_estimate(const std::map<std::string, T, C, A> &map);
+
+template<typename T, typename H, typename E, typename A>
+size_t json_estimate(const std::unordered_map<std::string, T, H, E, A> &map);
+
+template<typename T>
+typename std::enable_if<is_json_struct<T>::value, size_t>::type
+json_estimate(const T &obj);
+
+inline void json_write(JsonWriter &w, bool val)
+{
+    if (val)
+        w.put("true", 4);
+    else
+        w.put("false", 5);
+}
+
+inline void json_write(JsonWriter &w, const std::string &str) { w.put_string(str.data(), str.size()); }
+
+inline void json_write(JsonWriter &w, const char *str) { w.put_string(str, strlen(str)); }
+
+inline void json_write(JsonWriter &w, const StringPiece &str) { w.put_string(str.data(), str.size()); }
+
+template<typename T>
+typename std::enable_if<detail::is_json_number<T>::value>::type
+json_write(JsonWriter &w, T val)
+{
+    if (std::is_floating_point<T>::value)
+        w.put_double(static_cast<double>(val));
+    else if (std::is_signed<T>::value)
+        w.put_int(static_cast<long long>(val));
+    else
+        w.put_uint(static_cast<unsigned long long>(val));
+}
+
+template<typename T, typename A>
+void json_write(JsonWriter &w, const std::vector<T, A> &vec);
+
+template<typename T, typename C, typename A>
+void json_write(JsonWriter &w, const std::map<std::string, T, C, A> &map);
+
+template<typename T, typename H, typename E, typename A>
+void json_write(JsonWriter &w, const std::unordered_map<std::string, T, H, E, A> &map);
+
+template<typename T>
+typename std::enable_if<is_json_struct<T>::value>::type
+json_write(JsonWriter &w, const T &obj);
+
+// Return false if the json type does not match.
+inline bool json_read(const JsonView &val, bool &out)
+{
+    if (!val.is_bool())
+        return false;
+    out = val.as_bool();
+    return true;
+}
+
+inline bool json_read(const JsonView &val, std::string &out)
+{
+    if (!val.is_string())
+        return false;
+    out = val.as_string();
+    return true;
+}
+
+template<typename T>
+typename std::enable_if<detail::is_json_number<T>::value, bool>::type
+json_read(const JsonView &val, T &out)
+{
+    if (!val.is_number())
+        return false;
+    if (std::is_floating_point<T>::value)
+        out = static_cast<T>(val.as_double());
+    else if (std::is_signed<T>::value)
+        out = static_cast<T>(val.as_int());
+    else
+        out = static_cast<T>(val.as_uint());
+    return true;
+}
+
+template<typename T, typename A>
+bool json_read(const JsonView &val, std::vector<T, A> &vec);
+
+template<typename T, typename C, typename A>
+bool json_read(const JsonView &val, std::map<std::string, T, C, A> &map);
+
+template<typename T, typename H, typename E, typename A>
+bool json_read(const JsonView &val, std::unordered_map<std::string, T, H, E, A> &map);
+
+template<typename T>
+typename std::enable_if<is_json_struct<T>::value, bool>::type
+json_read(const JsonView &val, T &obj);
+
+// Serialize obj into a buffer reserved from its estimated size.
+template<typename T>
+std::string json_dump(const T &obj)
+{
+    std::string out;
+    out.reserve(json_estimate(obj));
+    JsonWriter writer(out);
+    json_write(writer, obj);
+    return out;
+}
+
+}  // namespace wfrest
+
+#include "JsonStruct.inl"
+
+#define WFREST_JSON_EXPAND(x) x
+
+#define WFREST_JSON_FE_1(F, x) F(x)
+#define WFREST_JSON_FE_2(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_1(F, __VA_ARGS__))
+#define WFREST_JSON_FE_3(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_2(F, __VA_ARGS__))
+#define WFREST_JSON_FE_4(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_3(F, __VA_ARGS__))
+#define WFREST_JSON_FE_5(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_4(F, __VA_ARGS__))
+#define WFREST_JSON_FE_6(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_5(F, __VA_ARGS__))
+#define WFREST_JSON_FE_7(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_6(F, __VA_ARGS__))
+#define WFREST_JSON_FE_8(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_7(F, __VA_ARGS__))
+#define WFREST_JSON_FE_9(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_8(F, __VA_ARGS__))
+#define WFREST_JSON_FE_10(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_9(F, __VA_ARGS__))
+#define WFREST_JSON_FE_11(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_10(F, __VA_ARGS__))
+#define WFREST_JSON_FE_12(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_11(F, __VA_ARGS__))
+#define WFREST_JSON_FE_13(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_12(F, __VA_ARGS__))
+#define WFREST_JSON_FE_14(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_13(F, __VA_ARGS__))
+#define WFREST_JSON_FE_15(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_14(F, __VA_ARGS__))
+#define WFREST_JSON_FE_16(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_15(F, __VA_ARGS__))
+#define WFREST_JSON_FE_17(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_16(F, __VA_ARGS__))
+#define WFREST_JSON_FE_18(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_17(F, __VA_ARGS__))
+#define WFREST_JSON_FE_19(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_18(F, __VA_ARGS__))
+#define WFREST_JSON_FE_20(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_19(F, __VA_ARGS__))
+#define WFREST_JSON_FE_21(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_20(F, __VA_ARGS__))
+#define WFREST_JSON_FE_22(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_21(F, __VA_ARGS__))
+#define WFREST_JSON_FE_23(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_22(F, __VA_ARGS__))
+#define WFREST_JSON_FE_24(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_23(F, __VA_ARGS__))
+#define WFREST_JSON_FE_25(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_24(F, __VA_ARGS__))
+#define WFREST_JSON_FE_26(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_25(F, __VA_ARGS__))
+#define WFREST_JSON_FE_27(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_26(F, __VA_ARGS__))
+#define WFREST_JSON_FE_28(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_27(F, __VA_ARGS__))
+#define WFREST_JSON_FE_29(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_28(F, __VA_ARGS__))
+#define WFREST_JSON_FE_30(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_29(F, __VA_ARGS__))
+#define WFREST_JSON_FE_31(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_30(F, __VA_ARGS__))
+#define WFREST_JSON_FE_32(F, x, ...) F(x) WFREST_JSON_EXPAND(WFREST_JSON_FE_31(F, __VA_ARGS__))
+
+#define WFREST_JSON_FE_SELECT(_1, _2, _3, _4, _5, _6, _7, _8,                   \
+                              _9, _10, _11, _12, _13, _14, _15, _16,            \
+                              _17, _18, _19, _20, _21, _22, _23, _24,           \
+                              _25, _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+
+#define WFREST_JSON_FOR_EACH(F, ...)                                            \
+    WFREST_JSON_EXPAND(WFREST_JSON_FE_SELECT(__VA_ARGS__,                       \
+        WFREST_JSON_FE_32, WFREST_JSON_FE_31, WFREST_JSON_FE_30, WFREST_JSON_FE_29, \
+        WFREST_JSON_FE_28, WFREST_JSON_FE_27, WFREST_JSON_FE_26, WFREST_JSON_FE_25, \
+        WFREST_JSON_FE_24, WFREST_JSON_FE_23, WFREST_JSON_FE_22, WFREST_JSON_FE_21, \
+        WFREST_JSON_FE_20, WFREST_JSON_FE_19, WFREST_JSON_FE_18, WFREST_JSON_FE_17, \
+        WFREST_JSON_FE_16, WFREST_JSON_FE_15, WFREST_JSON_FE_14, WFREST_JSON_FE_13, \
+        WFREST_JSON_FE_12, WFREST_JSON_FE_11, WFREST_JSON_FE_10, WFREST_JSON_FE_9,  \
+        WFREST_JSON_FE_8, WFREST_JSON_FE_7, WFREST_JSON_FE_6, WFREST_JSON_FE_5,     \
+        WFREST_JSON_FE_4, WFREST_JSON_FE_3, WFREST_JSON_FE_2, WFREST_JSON_FE_1)(F, __VA_ARGS__))
+
+// The key of every field is a literal, its length is known at compile time.
+#define WFREST_JSON_KEY(field) ",\"" #field "\":"
+
+#define WFREST_JSON_ESTIMATE_FIELD(field)                                       \
+    size += sizeof(WFREST_JSON_KEY(field)) - 1 + ::wfrest::json_estimate(obj.field);
+
+#define WFREST_JSON_WRITE_FIELD(field)                                          \
+    w.put(WFREST_JSON_KEY(field), sizeof(WFREST_JSON_KEY(field)) - 1);          \
+    ::wfrest::json_write(w, obj.field);
+
+#define WFREST_JSON_READ_FIELD(field)                                           \
+    if (key == ::wfrest::StringPiece(#field, sizeof(#field) - 1))               \
+    {                                                                           \
+        ok = ::wfrest::json_read(val, obj.field) && ok;                         \
+        return;                                                                 \
+    }
+
+#define WFREST_JSON_STRUCT(Type, ...)                                           \
+inline size_t wfrest_json_estimate(const Type &obj)                             \
+{                                                                               \
+    size_t size = 2;                                                            \
+    WFREST_JSON_FOR_EACH(WFREST_JSON_ESTIMATE_FIELD, __VA_ARGS__)               \
+    return size;                                                                \
+}                                                                               \
+inline void wfrest_json_write(::wfrest::JsonWriter &w, const Type &obj)         \
+{                                                                               \
+    /* every key starts with ',', the first one is turned into '{' */           \
+    size_t pos = w.out().size();                                                \
+    WFREST_JSON_FOR_EACH(WFREST_JSON_WRITE_FIELD, __VA_ARGS__)                  \
+    w.out()[pos] = '{';                                                         \
+    w.put('}');                                                                 \
+}                                                                               \
+inline bool wfrest_json_read(const ::wfrest::JsonView &view, Type &obj)         \
+{                                                                               \
+    bool ok = true;                                                             \
+    bool well_formed = view.for_each_member(                                    \
+        [&obj, &ok](const ::wfrest::StringPiece &key, const ::wfrest::JsonView &val) \
+    {                                                                           \
+        WFREST_JSON_FOR_EACH(WFREST_JSON_READ_FIELD, __VA_ARGS__)               \
+    });                                                                         \
+    return ok && well_formed;                                                   \
+}
+
+#endif // WFREST_JSONSTRUCT_H_
@@ -0,0 +1,144 @@
+namespace wfrest
+{
+
+template<typename T, typename A>
+size_t json_estimate(const std::vector<T, A> &vec)
+{
+    size_t size = 2;
+    for (const auto &val : vec)
+        size += json_estimate(val) + 1;
+    return size;
+}
+
+template<typename T, typename C, typename A>
+size_t json_estimate(const std::map<std::string, T, C, A> &map)
+{
+    size_t size = 2;
+    for (const auto &kv : map)
+        size += json_estimate(kv.first) + json_estimate(kv.second) + 2;
+    return size;
+}
+
+template<typename T, typename H, typename E, typename A>
+size_t json_estimate(const std::unordered_map<std::string, T, H, E, A> &map)
+{
+    size_t size = 2;
+    for (const auto &kv : map)
+        size += json_estimate(kv.first) + json_estimate(kv.second) + 2;
+    return size;
+}
+
+template<typename T>
+typename std::enable_if<is_json_struct<T>::value, size_t>::type
+json_estimate(const T &obj)
+{
+    return wfrest_json_estimate(obj);
+}
+
+template<typename T, typename A>
+void json_write(JsonWriter &w, const std::vector<T, A> &vec)
+{
+    w.put('[');
+    bool first = true;
+    for (const auto &val : vec)
+    {
+        if (!first)
+            w.put(',');
+        first = false;
+        json_write(w, val);
+    }
+    w.put(']');
+}
+
+namespace detail
+{
+
+template<typename Map>
+void json_write_map(JsonWriter &w, const Map &map)
+{
+    w.put('{');
+    bool first = true;
+    for (const auto &kv : map)
+    {
+        if (!first)
+            w.put(',');
+        first = false;
+        w.put_string(kv.first.data(), kv.first.size());
+        w.put(':');
+        json_write(w, kv.second);
+    }
+    w.put('}');
+}
+
+template<typename Map>
+bool json_read_map(const JsonView &val, Map &map)
+{
+    if (!val.is_object())
+        return false;
+    bool ok = true;
+    bool well_formed = val.for_each_member([&map, &ok](const StringPiece &key,
+                                                       const JsonView &member)
+    {
+        ok = json_read(member, map[key.as_string()]) && ok;
+    });
+    return ok && well_formed;
+}
+
+}  // namespace detail
+
+template<typename T, typename C, typename A>
+void json_write(JsonWriter &w, const std::map<std::string, T, C, A> &map)
+{
+    detail::json_write_map(w, map);
+}
+
+template<typename T, typename H, typename E, typename A>
+void json_write(JsonWriter &w, const std::unordered_map<std::string, T, H, E, A> &map)
+{
+    detail::json_write_map(w, map);
+}
+
+template<typename T>
+typename std::enable_if<is_json_struct<T>::value>::type
+json_write(JsonWriter &w, const T &obj)
+{
+    wfrest_json_write(w, obj);
+}
+
+template<typename T, typename A>
+bool json_read(const JsonView &val, std::vector<T, A> &vec)
+{
+    if (!val.is_array())
+        return false;
+    bool ok = true;
+    vec.clear();
+    bool well_formed = val.for_each_element([&vec, &ok](const JsonView &elem)
+    {
+        vec.emplace_back();
+        ok = json_read(elem, vec.back()) && ok;
+    });
+    return ok && well_formed;
+}
+
+template<typename T, typename C, typename A>
+bool json_read(const JsonView &val, std::map<std::string, T, C, A> &map)
+{
+    return detail::json_read_map(val, map);
+}
+
+template<typename T, typename H, typename E, typename A>
+bool json_read(const JsonView &val, std::unordered_map<std::string, T, H, E, A> &map)
+{
+    return detail::json_read_map(val, map);
+}
+
+template<typename T>
+typename std::enable_if<is_json_struct<T>::value, bool>::type
+json_read(const JsonView &val, T &obj)
+{
+    if (!val.is_object())
+        return false;
+    return wfrest_json_read(val, obj);
+}
+
+}  // namespace wfrest
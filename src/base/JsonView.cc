@@ -0,0 +1,426 @@
+#include <cstring>
+#include <cstdlib>
+
+#include "JsonView.h"
+#include "json.hpp"
+
+using namespace wfrest;
+
+namespace
+{
+
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && is_space(*p))
+        ++p;
+    return p;
+}
+
+// p points to the opening quote, return the position after the closing quote.
+const char *skip_string(const char *p, const char *end)
+{
+    ++p;
+    while (p < end)
+    {
+        const char *quote = static_cast<const char *>(memchr(p, '"', end - p));
+        if (!quote)
+            return nullptr;
+        // the quote is escaped if it follows an odd number of backslashes
+        const char *bs = quote;
+        while (bs > p && *(bs - 1) == '\\')
+            --bs;
+        if (((quote - bs) & 1) == 0)
+            return quote + 1;
+        p = quote + 1;
+    }
+    return nullptr;
+}
+
+const char *skip_container(const char *p, const char *end)
+{
+    int depth = 0;
+    while (p < end)
+    {
+        char c = *p;
+        if (c == '"')
+        {
+            p = skip_string(p, end);
+            if (!p)
+                return nullptr;
+            continue;
+        }
+        if (c == '{' || c == '[')
+        {
+            depth++;
+        } else if (c == '}' || c == ']')
+        {
+            if (--depth == 0)
+                return p + 1;
+        }
+        ++p;
+    }
+    return nullptr;
+}
+
+const char *skip_scalar(const char *p, const char *end)
+{
+    const char *begin = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && !is_space(*p))
+        ++p;
+    return p == begin ? nullptr : p;
+}
+
+const char *skip_value(const char *p, const char *end)
+{
+    if (p >= end)
+        return nullptr;
+    switch (*p)
+    {
+    case '"':
+        return skip_string(p, end);
+    case '{':
+    case '[':
+        return skip_container(p, end);
+    default:
+        return skip_scalar(p, end);
+    }
+}
+
+// p points to '{', func(raw_key, value) returns false to stop.
+// Return false if the object is malformed.
+template<typename Func>
+bool scan_object(const char *p, const char *end, const Func &func)
+{
+    p = skip_space(p + 1, end);
+    if (p < end && *p == '}')
+        return true;
+
+    while (p < end)
+    {
+        if (*p != '"')
+            return false;
+        const char *key_end = skip_string(p, end);
+        if (!key_end)
+            return false;
+        StringPiece key(p + 1, key_end - p - 2);
+
+        p = skip_space(key_end, end);
+        if (p >= end || *p != ':')
+            return false;
+        p = skip_space(p + 1, end);
+        if (p >= end)
+            return false;
+        if (!func(key, p))
+            return true;
+
+        p = skip_space(skip_value(p, end), end);
+        if (p == nullptr || p >= end)
+            return false;
+        if (*p == '}')
+            return true;
+        if (*p != ',')
+            return false;
+        p = skip_space(p + 1, end);
+    }
+    return false;
+}
+
+// p points to '[', func(value) returns false to stop.
+template<typename Func>
+bool scan_array(const char *p, const char *end, const Func &func)
+{
+    p = skip_space(p + 1, end);
+    if (p < end && *p == ']')
+        return true;
+
+    while (p < end)
+    {
+        if (!func(p))
+            return true;
+
+        p = skip_space(skip_value(p, end), end);
+        if (p == nullptr || p >= end)
+            return false;
+        if (*p == ']')
+            return true;
+        if (*p != ',')
+            return false;
+        p = skip_space(p + 1, end);
+    }
+    return false;
+}
+
+inline int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// read XXXX of \uXXXX, return -1 if invalid
+long read_hex4(const char *p, const char *end)
+{
+    if (end - p < 4)
+        return -1;
+    long code = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int v = hex_value(p[i]);
+        if (v < 0)
+            return -1;
+        code = (code << 4) | v;
+    }
+    return code;
+}
+
+void append_utf8(long code, std::string &out)
+{
+    if (code < 0x80)
+    {
+        out += static_cast<char>(code);
+    } else if (code < 0x800)
+    {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000)
+    {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else
+    {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+void unescape(const char *p, const char *end, std::string &out)
+{
+    out.reserve(end - p);
+    while (p < end)
+    {
+        const char *bs = static_cast<const char *>(memchr(p, '\\', end - p));
+        if (!bs)
+        {
+            out.append(p, end - p);
+            return;
+        }
+        out.append(p, bs - p);
+        p = bs + 1;
+        if (p >= end)
+            return;
+        char c = *p++;
+        switch (c)
+        {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+        {
+            long code = read_hex4(p, end);
+            if (code < 0)
+                return;
+            p += 4;
+            // surrogate pair
+            if (code >= 0xD800 && code <= 0xDBFF && end - p >= 6 &&
+                p[0] == '\\' && p[1] == 'u')
+            {
+                long low = read_hex4(p + 2, end);
+                if (low >= 0xDC00 && low <= 0xDFFF)
+                {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+            }
+            append_utf8(code, out);
+            break;
+        }
+        default:    // " \ /
+            out += c;
+            break;
+        }
+    }
+}
+
+bool key_equal(const StringPiece &raw_key, const StringPiece &key)
+{
+    if (!memchr(raw_key.data(), '\\', raw_key.size()))
+        return raw_key == key;
+
+    std::string unescaped;
+    unescape(raw_key.begin(), raw_key.end(), unescaped);
+    return StringPiece(unescaped) == key;
+}
+
+}  // namespace
+
+JsonView::JsonView(const StringPiece &text)
+    : begin_(nullptr), limit_(text.end())
+{
+    const char *p = skip_space(text.begin(), text.end());
+    if (p < text.end())
+        begin_ = p;
+}
+
+const char *JsonView::end() const
+{
+    if (!valid())
+        return nullptr;
+    return skip_value(begin_, limit_);
+}
+
+bool JsonView::is_number() const
+{
+    return valid() && (*begin_ == '-' || (*begin_ >= '0' && *begin_ <= '9'));
+}
+
+JsonView JsonView::operator[](const StringPiece &key) const
+{
+    if (!is_object())
+        return JsonView();
+
+    const char *found = nullptr;
+    scan_object(begin_, limit_, [&found, &key](const StringPiece &raw_key, const char *value)
+    {
+        if (!key_equal(raw_key, key))
+            return true;
+        found = value;
+        return false;
+    });
+    return found ? JsonView(found, limit_) : JsonView();
+}
+
+JsonView JsonView::operator[](size_t idx) const
+{
+    if (!is_array())
+        return JsonView();
+
+    const char *found = nullptr;
+    size_t cur = 0;
+    scan_array(begin_, limit_, [&found, &cur, idx](const char *value)
+    {
+        if (cur++ != idx)
+            return true;
+        found = value;
+        return false;
+    });
+    return found ? JsonView(found, limit_) : JsonView();
+}
+
+size_t JsonView::size() const
+{
+    size_t cnt = 0;
+    if (is_object())
+    {
+        scan_object(begin_, limit_, [&cnt](const StringPiece &, const char *)
+        {
+            cnt++;
+            return true;
+        });
+    } else if (is_array())
+    {
+        scan_array(begin_, limit_, [&cnt](const char *)
+        {
+            cnt++;
+            return true;
+        });
+    }
+    return cnt;
+}
+
+bool JsonView::for_each_member(const MemberFunc &func) const
+{
+    if (!is_object())
+        return false;
+
+    const char *limit = limit_;
+    return scan_object(begin_, limit_, [&func, limit](const StringPiece &raw_key, const char *value)
+    {
+        func(raw_key, JsonView(value, limit));
+        return true;
+    });
+}
+
+bool JsonView::for_each_element(const ElementFunc &func) const
+{
+    if (!is_array())
+        return false;
+
+    const char *limit = limit_;
+    return scan_array(begin_, limit_, [&func, limit](const char *value)
+    {
+        func(JsonView(value, limit));
+        return true;
+    });
+}
+
+std::string JsonView::as_string() const
+{
+    std::string res;
+    if (!is_string())
+        return res;
+    const char *e = end();
+    if (!e)
+        return res;
+    unescape(begin_ + 1, e - 1, res);
+    return res;
+}
+
+long long JsonView::as_int() const
+{
+    StringPiece num = is_number() ? raw() : StringPiece();
+    if (num.empty() || num.size() >= 64)
+        return 0;
+    char buf[64];
+    memcpy(buf, num.data(), num.size());
+    buf[num.size()] = '\0';
+    return strtoll(buf, nullptr, 10);
+}
+
+unsigned long long JsonView::as_uint() const
+{
+    StringPiece num = is_number() ? raw() : StringPiece();
+    if (num.empty() || num.size() >= 64 || num[0] == '-')
+        return 0;
+    char buf[64];
+    memcpy(buf, num.data(), num.size());
+    buf[num.size()] = '\0';
+    return strtoull(buf, nullptr, 10);
+}
+
+double JsonView::as_double() const
+{
+    StringPiece num = is_number() ? raw() : StringPiece();
+    if (num.empty() || num.size() >= 64)
+        return 0.0;
+    char buf[64];
+    memcpy(buf, num.data(), num.size());
+    buf[num.size()] = '\0';
+    return strtod(buf, nullptr);
+}
+
+StringPiece JsonView::raw() const
+{
+    const char *e = end();
+    if (!e)
+        return StringPiece();
+    return StringPiece(begin_, e - begin_);
+}
+
+nlohmann::json JsonView::materialize() const
+{
+    StringPiece text = raw();
+    if (text.empty())
+        return nlohmann::json(nlohmann::json::value_t::discarded);
+    return nlohmann::json::parse(text.begin(), text.end(), nullptr, false);
+}
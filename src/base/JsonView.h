@@ -0,0 +1,104 @@
+#ifndef WFREST_JSONVIEW_H_
+#define WFREST_JSONVIEW_H_
+
+#include <string>
+#include <functional>
+
+#include "StringPiece.h"
+#include "json_fwd.hpp"
+
+namespace wfrest
+{
+
+// A lazily evaluated, read only view of a json text.
+// Nothing is parsed until it is asked for : looking up a member only scans
+// the text up to that member and skips every other value without building it.
+// The view does not own the text, which must outlive it.
+// The document is not validated as a whole, a malformed path gives an invalid view.
+class JsonView
+{
+public:
+    using MemberFunc = std::function<void(const StringPiece &key, const JsonView &value)>;
+
+    using ElementFunc = std::function<void(const JsonView &value)>;
+
+public:
+    JsonView() : begin_(nullptr), limit_(nullptr) {}
+
+    explicit JsonView(const StringPiece &text);
+
+    // the value at this position exists
+    bool valid() const
+    { return begin_ != nullptr; }
+
+    bool is_object() const { return valid() && *begin_ == '{'; }
+
+    bool is_array() const { return valid() && *begin_ == '['; }
+
+    bool is_string() const { return valid() && *begin_ == '"'; }
+
+    bool is_number() const;
+
+    bool is_bool() const { return valid() && (*begin_ == 't' || *begin_ == 'f'); }
+
+    bool is_null() const { return valid() && *begin_ == 'n'; }
+
+    // object member, invalid view if not found
+    JsonView operator[](const StringPiece &key) const;
+
+    JsonView operator[](const char *key) const
+    { return (*this)[StringPiece(key)]; }
+
+    JsonView operator[](const std::string &key) const
+    { return (*this)[StringPiece(key)]; }
+
+    // array element, invalid view if out of range
+    JsonView operator[](size_t idx) const;
+
+    JsonView operator[](int idx) const
+    { return idx < 0 ? JsonView() : (*this)[static_cast<size_t>(idx)]; }
+
+    bool has(const StringPiece &key) const
+    { return (*this)[key].valid(); }
+
+    // number of members / elements
+    size_t size() const;
+
+    // return false if the container is malformed
+    bool for_each_member(const MemberFunc &func) const;
+
+    bool for_each_element(const ElementFunc &func) const;
+
+    // unescaped string value
+    std::string as_string() const;
+
+    long long as_int() const;
+
+    unsigned long long as_uint() const;
+
+    double as_double() const;
+
+    bool as_bool() const
+    { return valid() && *begin_ == 't'; }
+
+    // the raw json text of this value
+    StringPiece raw() const;
+
+    // Build a DOM of this value only.
+    nlohmann::json materialize() const;
+
+private:
+    JsonView(const char *begin, const char *limit)
+        : begin_(begin), limit_(limit)
+    {}
+
+    const char *end() const;
+
+private:
+    const char *begin_;     // first char of the value
+    const char *limit_;     // end of the whole text
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_JSONVIEW_H_
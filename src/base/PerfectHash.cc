@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+
+#include "PerfectHash.h"
+#include "Simd.h"
+
+namespace wfrest
+{
+
+namespace
+{
+
+inline unsigned char ascii_lower(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+// splitmix64 finalizer
+inline uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// each displacement is tried up to this, then the seed changes
+const uint32_t k_max_displacement = 1 << 16;
+
+}  // namespace
+
+// FNV-1a of the lowercase bytes, mixed : its high bits barely change with
+// the last bytes of a short key, and they pick the bucket
+uint64_t PerfectHash::hash(const StringPiece &key, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ mix(seed);
+    for (char c : key)
+    {
+        h ^= ascii_lower(c);
+        h *= 0x100000001b3ULL;
+    }
+    return mix(h);
+}
+
+size_t PerfectHash::slot_of(uint64_t h, uint32_t displacement) const
+{
+    return mix(h + displacement * 0x9e3779b97f4a7c15ULL) & mask_;
+}
+
+void PerfectHash::build(const std::vector<StringPiece> &keys)
+{
+    keys_ = keys;
+    // the first of equal keys
+    std::vector<size_t> unique;
+    std::unordered_set<std::string> seen;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        std::string lower(keys[i].data(), keys[i].size());
+        std::transform(lower.begin(), lower.end(), lower.begin(), ascii_lower);
+        if (seen.insert(lower).second)
+            unique.push_back(i);
+    }
+    size_ = unique.size();
+
+    for (uint64_t seed = 0; !this->place(unique, seed); seed++)
+        ;
+}
+
+bool PerfectHash::place(const std::vector<size_t> &unique, uint64_t seed)
+{
+    seed_ = seed;
+    // a load of at most 0.8, 4 keys per bucket
+    size_t slots = 1;
+    while (slots < unique.size() + unique.size() / 4)
+        slots <<= 1;
+    mask_ = slots - 1;
+    slots_.assign(slots, -1);
+    displacements_.assign(std::max<size_t>(unique.size() / 4, 1), 0);
+
+    std::vector<std::vector<size_t>> buckets(displacements_.size());
+    std::vector<uint64_t> hashes(unique.size());
+    for (size_t i = 0; i < unique.size(); i++)
+    {
+        hashes[i] = hash(keys_[unique[i]], seed);
+        buckets[(hashes[i] >> 32) % buckets.size()].push_back(i);
+    }
+
+    // the largest buckets first, while most slots are free
+    std::vector<size_t> order(buckets.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b)
+    {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<size_t> placed;
+    for (size_t bucket : order)
+    {
+        const std::vector<size_t> &members = buckets[bucket];
+        if (members.empty())
+            break;
+
+        uint32_t displacement = 0;
+        for (; displacement < k_max_displacement; displacement++)
+        {
+            placed.clear();
+            for (size_t member : members)
+            {
+                size_t slot = this->slot_of(hashes[member], displacement);
+                if (slots_[slot] >= 0 || std::find(placed.begin(), placed.end(), slot) != placed.end())
+                    break;
+                placed.push_back(slot);
+            }
+            if (placed.size() == members.size())
+                break;
+        }
+        if (displacement == k_max_displacement)
+            return false;
+
+        displacements_[bucket] = displacement;
+        for (size_t i = 0; i < members.size(); i++)
+            slots_[placed[i]] = static_cast<int>(unique[members[i]]);
+    }
+    return true;
+}
+
+int PerfectHash::find(const StringPiece &key) const
+{
+    if (size_ == 0)
+        return -1;
+    uint64_t h = hash(key, seed_);
+    uint32_t displacement = displacements_[(h >> 32) % displacements_.size()];
+    int index = slots_[this->slot_of(h, displacement)];
+    if (index < 0)
+        return -1;
+
+    const StringPiece &candidate = keys_[index];
+    if (candidate.size() != key.size() ||
+        Simd::mismatch_nocase(candidate.data(), key.data(), key.size()) != key.size())
+        return -1;
+    return index;
+}
+
+}  // namespace wfrest
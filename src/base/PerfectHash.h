@@ -0,0 +1,51 @@
+#ifndef WFREST_PERFECTHASH_H_
+#define WFREST_PERFECTHASH_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "StringPiece.h"
+
+namespace wfrest
+{
+
+/*
+A perfect hash of a fixed set of keys, built once by hash and
+displace : the keys are spread over buckets, and each bucket gets the
+displacement which puts all of its keys in free slots. A lookup hashes
+the key once and compares it with the one key of its slot.
+Keys are ASCII case-insensitive.
+*/
+class PerfectHash
+{
+public:
+    // The keys are not copied and live as long as the hash. Of equal keys,
+    // the first one is kept.
+    void build(const std::vector<StringPiece> &keys);
+
+    // the index of key in the keys of build(), -1 if none
+    int find(const StringPiece &key) const;
+
+    // the keys kept
+    size_t size() const { return size_; }
+
+private:
+    static uint64_t hash(const StringPiece &key, uint64_t seed);
+
+    size_t slot_of(uint64_t h, uint32_t displacement) const;
+
+    // the keys of build() at the indices of unique
+    bool place(const std::vector<size_t> &unique, uint64_t seed);
+
+private:
+    uint64_t seed_ = 0;
+    size_t mask_ = 0;
+    size_t size_ = 0;
+    std::vector<uint32_t> displacements_;      // per bucket
+    std::vector<int> slots_;                   // the index of the key of each slot, -1 if free
+    std::vector<StringPiece> keys_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_PERFECTHASH_H_
@@ -0,0 +1,478 @@
+#include "Simd.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define WFREST_SIMD_X86 1
+#include <immintrin.h>
+#define WFREST_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define WFREST_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace wfrest
+{
+
+namespace
+{
+
+// ---------------------------------------------------------------- scalar
+
+const char k_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// the sextet of each char, -1 out of the alphabet
+const signed char k_base64_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+inline bool url_safe(unsigned char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+           c == '-' || c == '.' || c == '_' || c == '~' || c == '/';
+}
+
+inline unsigned char ascii_lower(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+const char *find_char_scalar(const char *begin, const char *end, char c)
+{
+    while (begin != end && *begin != c)
+        ++begin;
+    return begin;
+}
+
+const char *find_url_unsafe_scalar(const char *begin, const char *end)
+{
+    while (begin != end && url_safe(*begin))
+        ++begin;
+    return begin;
+}
+
+const char *find_url_escape_scalar(const char *begin, const char *end)
+{
+    while (begin != end && *begin != '%' && *begin != '+')
+        ++begin;
+    return begin;
+}
+
+size_t mismatch_nocase_scalar(const char *a, const char *b, size_t n)
+{
+    size_t i = 0;
+    while (i < n && ascii_lower(a[i]) == ascii_lower(b[i]))
+        i++;
+    return i;
+}
+
+size_t base64_encode_scalar(const unsigned char *in, size_t len, char *out)
+{
+    size_t i = 0;
+    for (; len - i >= 3; i += 3)
+    {
+        unsigned int group = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        *out++ = k_base64_chars[group >> 18];
+        *out++ = k_base64_chars[(group >> 12) & 0x3f];
+        *out++ = k_base64_chars[(group >> 6) & 0x3f];
+        *out++ = k_base64_chars[group & 0x3f];
+    }
+    return i;
+}
+
+size_t base64_decode_scalar(const char *in, size_t len, unsigned char *out)
+{
+    const signed char *values = k_base64_values;
+    size_t i = 0;
+    for (; len - i >= 4; i += 4)
+    {
+        int a = values[static_cast<unsigned char>(in[i])];
+        int b = values[static_cast<unsigned char>(in[i + 1])];
+        int c = values[static_cast<unsigned char>(in[i + 2])];
+        int d = values[static_cast<unsigned char>(in[i + 3])];
+        if ((a | b | c | d) < 0)
+            break;
+        unsigned int group = (a << 18) | (b << 12) | (c << 6) | d;
+        *out++ = static_cast<unsigned char>(group >> 16);
+        *out++ = static_cast<unsigned char>(group >> 8);
+        *out++ = static_cast<unsigned char>(group);
+    }
+    return i;
+}
+
+#ifdef WFREST_SIMD_X86
+
+// ---------------------------------------------------------------- sse4.2
+
+// the bytes of x in [lo, lo + span], unsigned
+WFREST_TARGET_SSE42 inline __m128i in_range_sse42(__m128i x, char lo, char span)
+{
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(span)), t);
+}
+
+WFREST_TARGET_SSE42 inline __m128i url_safe_sse42(__m128i x)
+{
+    __m128i letter = in_range_sse42(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 25);
+    __m128i digit = in_range_sse42(x, '0', 9);
+    // - . /
+    __m128i punct = in_range_sse42(x, '-', 2);
+    __m128i other = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('_')),
+                                 _mm_cmpeq_epi8(x, _mm_set1_epi8('~')));
+    return _mm_or_si128(_mm_or_si128(letter, digit), _mm_or_si128(punct, other));
+}
+
+WFREST_TARGET_SSE42 inline __m128i lower_sse42(__m128i x)
+{
+    return _mm_or_si128(x, _mm_and_si128(in_range_sse42(x, 'A', 25), _mm_set1_epi8(0x20)));
+}
+
+WFREST_TARGET_SSE42 const char *find_char_sse42(const char *begin, const char *end, char c)
+{
+    __m128i needle = _mm_set1_epi8(c);
+    for (; end - begin >= 16; begin += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, needle));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_char_scalar(begin, end, c);
+}
+
+WFREST_TARGET_SSE42 const char *find_url_unsafe_sse42(const char *begin, const char *end)
+{
+    for (; end - begin >= 16; begin += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        int mask = _mm_movemask_epi8(url_safe_sse42(x)) ^ 0xffff;
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_url_unsafe_scalar(begin, end);
+}
+
+WFREST_TARGET_SSE42 const char *find_url_escape_sse42(const char *begin, const char *end)
+{
+    __m128i percent = _mm_set1_epi8('%');
+    __m128i plus = _mm_set1_epi8('+');
+    for (; end - begin >= 16; begin += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, percent),
+                                                  _mm_cmpeq_epi8(x, plus)));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_url_escape_scalar(begin, end);
+}
+
+WFREST_TARGET_SSE42 size_t mismatch_nocase_sse42(const char *a, const char *b, size_t n)
+{
+    size_t i = 0;
+    for (; n - i >= 16; i += 16)
+    {
+        __m128i x = lower_sse42(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        __m128i y = lower_sse42(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + mismatch_nocase_scalar(a + i, b + i, n - i);
+}
+
+// 12 bytes in the low 3 bytes of each dword to 16 sextets, then to their chars.
+// http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+WFREST_TARGET_SSE42 size_t base64_encode_sse42(const unsigned char *in, size_t len, char *out)
+{
+    const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    // loads 16 bytes for 12
+    for (; len - i >= 16; i += 12, out += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        x = _mm_shuffle_epi8(x, shuffle);
+        __m128i hi = _mm_mulhi_epu16(_mm_and_si128(x, _mm_set1_epi32(0x0fc0fc00)),
+                                     _mm_set1_epi32(0x04000040));
+        __m128i lo = _mm_mullo_epi16(_mm_and_si128(x, _mm_set1_epi32(0x003f03f0)),
+                                     _mm_set1_epi32(0x01000010));
+        __m128i sextets = _mm_or_si128(hi, lo);
+
+        __m128i index = _mm_subs_epu8(sextets, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), sextets);
+        index = _mm_or_si128(index, _mm_and_si128(less, _mm_set1_epi8(13)));
+        __m128i chars = _mm_add_epi8(sextets, _mm_shuffle_epi8(shift_lut, index));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), chars);
+    }
+    return i + base64_encode_scalar(in + i, len - i, out);
+}
+
+// the sextets of 16 chars, valid is set for the chars of the alphabet
+WFREST_TARGET_SSE42 inline __m128i base64_values_sse42(__m128i x, __m128i *valid)
+{
+    __m128i upper = in_range_sse42(x, 'A', 25);
+    __m128i lower = in_range_sse42(x, 'a', 25);
+    __m128i digit = in_range_sse42(x, '0', 9);
+    __m128i plus = _mm_cmpeq_epi8(x, _mm_set1_epi8('+'));
+    __m128i slash = _mm_cmpeq_epi8(x, _mm_set1_epi8('/'));
+    *valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+
+    __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-65));
+    shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+    shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(19)));
+    shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(16)));
+    return _mm_add_epi8(x, shift);
+}
+
+// http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html, the packing
+WFREST_TARGET_SSE42 size_t base64_decode_sse42(const char *in, size_t len, unsigned char *out)
+{
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; len - i >= 16; i += 16, out += 12)
+    {
+        __m128i valid;
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        __m128i sextets = base64_values_sse42(x, &valid);
+        if (_mm_movemask_epi8(valid) != 0xffff)
+            break;
+        // 4 sextets to 24 bits in each dword
+        __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+        __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_shuffle_epi8(groups, pack));
+    }
+    return i + base64_decode_scalar(in + i, len - i, out);
+}
+
+// ---------------------------------------------------------------- avx2
+
+WFREST_TARGET_AVX2 inline __m256i in_range_avx2(__m256i x, char lo, char span)
+{
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(span)), t);
+}
+
+WFREST_TARGET_AVX2 inline __m256i url_safe_avx2(__m256i x)
+{
+    __m256i letter = in_range_avx2(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 25);
+    __m256i digit = in_range_avx2(x, '0', 9);
+    __m256i punct = in_range_avx2(x, '-', 2);
+    __m256i other = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')),
+                                    _mm256_cmpeq_epi8(x, _mm256_set1_epi8('~')));
+    return _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_or_si256(punct, other));
+}
+
+WFREST_TARGET_AVX2 inline __m256i lower_avx2(__m256i x)
+{
+    return _mm256_or_si256(x, _mm256_and_si256(in_range_avx2(x, 'A', 25), _mm256_set1_epi8(0x20)));
+}
+
+WFREST_TARGET_AVX2 const char *find_char_avx2(const char *begin, const char *end, char c)
+{
+    __m256i needle = _mm256_set1_epi8(c);
+    for (; end - begin >= 32; begin += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, needle));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_char_sse42(begin, end, c);
+}
+
+WFREST_TARGET_AVX2 const char *find_url_unsafe_avx2(const char *begin, const char *end)
+{
+    for (; end - begin >= 32; begin += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+        unsigned int mask = ~static_cast<unsigned int>(_mm256_movemask_epi8(url_safe_avx2(x)));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_url_unsafe_sse42(begin, end);
+}
+
+WFREST_TARGET_AVX2 const char *find_url_escape_avx2(const char *begin, const char *end)
+{
+    __m256i percent = _mm256_set1_epi8('%');
+    __m256i plus = _mm256_set1_epi8('+');
+    for (; end - begin >= 32; begin += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, percent),
+                                                                 _mm256_cmpeq_epi8(x, plus)));
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_url_escape_sse42(begin, end);
+}
+
+WFREST_TARGET_AVX2 size_t mismatch_nocase_avx2(const char *a, const char *b, size_t n)
+{
+    size_t i = 0;
+    for (; n - i >= 32; i += 32)
+    {
+        __m256i x = lower_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+        __m256i y = lower_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        unsigned int mask = ~static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + mismatch_nocase_sse42(a + i, b + i, n - i);
+}
+
+// the sse4.2 encoding in both lanes, 12 bytes each
+WFREST_TARGET_AVX2 size_t base64_encode_avx2(const unsigned char *in, size_t len, char *out)
+{
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    // loads 28 bytes for 24
+    for (; len - i >= 28; i += 24, out += 32)
+    {
+        __m128i lane0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        __m128i lane1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 12));
+        __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(lane0), lane1, 1);
+        x = _mm256_shuffle_epi8(x, shuffle);
+        __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(x, _mm256_set1_epi32(0x0fc0fc00)),
+                                        _mm256_set1_epi32(0x04000040));
+        __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(x, _mm256_set1_epi32(0x003f03f0)),
+                                        _mm256_set1_epi32(0x01000010));
+        __m256i sextets = _mm256_or_si256(hi, lo);
+
+        __m256i index = _mm256_subs_epu8(sextets, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), sextets);
+        index = _mm256_or_si256(index, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        __m256i chars = _mm256_add_epi8(sextets, _mm256_shuffle_epi8(shift_lut, index));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), chars);
+    }
+    return i + base64_encode_sse42(in + i, len - i, out);
+}
+
+WFREST_TARGET_AVX2 inline __m256i base64_values_avx2(__m256i x, __m256i *valid)
+{
+    __m256i upper = in_range_avx2(x, 'A', 25);
+    __m256i lower = in_range_avx2(x, 'a', 25);
+    __m256i digit = in_range_avx2(x, '0', 9);
+    __m256i plus = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('+'));
+    __m256i slash = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('/'));
+    *valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                             _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+
+    __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-65));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(19)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(16)));
+    return _mm256_add_epi8(x, shift);
+}
+
+WFREST_TARGET_AVX2 size_t base64_decode_avx2(const char *in, size_t len, unsigned char *out)
+{
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    // the 12 bytes of each lane together
+    const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0;
+    for (; len - i >= 32; i += 32, out += 24)
+    {
+        __m256i valid;
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        __m256i sextets = base64_values_avx2(x, &valid);
+        if (_mm256_movemask_epi8(valid) != -1)
+            break;
+        __m256i pairs = _mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140));
+        __m256i groups = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        groups = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(groups, pack), join);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), groups);
+    }
+    return i + base64_decode_sse42(in + i, len - i, out);
+}
+
+#endif // WFREST_SIMD_X86
+
+const Simd::Kernels k_kernels[] = {
+    {
+        find_char_scalar, find_url_unsafe_scalar, find_url_escape_scalar,
+        mismatch_nocase_scalar, base64_encode_scalar, base64_decode_scalar,
+    },
+#ifdef WFREST_SIMD_X86
+    {
+        find_char_sse42, find_url_unsafe_sse42, find_url_escape_sse42,
+        mismatch_nocase_sse42, base64_encode_sse42, base64_decode_sse42,
+    },
+    {
+        find_char_avx2, find_url_unsafe_avx2, find_url_escape_avx2,
+        mismatch_nocase_avx2, base64_encode_avx2, base64_decode_avx2,
+    },
+#endif
+};
+
+SimdLevel detect()
+{
+#ifdef WFREST_SIMD_X86
+    // may run before the constructors of libgcc
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return SimdLevel::SSE42;
+#endif
+    return SimdLevel::SCALAR;
+}
+
+}  // namespace
+
+const Simd::Kernels *Simd::kernels_ = &k_kernels[static_cast<int>(Simd::detected())];
+
+SimdLevel Simd::detected()
+{
+    static const SimdLevel level = detect();
+    return level;
+}
+
+SimdLevel Simd::level()
+{
+    return static_cast<SimdLevel>(kernels() - k_kernels);
+}
+
+SimdLevel Simd::set_level(SimdLevel level)
+{
+    if (static_cast<int>(level) > static_cast<int>(detected()))
+        level = detected();
+    kernels_ = &k_kernels[static_cast<int>(level)];
+    return level;
+}
+
+const char *Simd::level_name(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::SSE42: return "sse4.2";
+    default: return "scalar";
+    }
+}
+
+}  // namespace wfrest
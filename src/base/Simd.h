@@ -0,0 +1,91 @@
+#ifndef WFREST_SIMD_H_
+#define WFREST_SIMD_H_
+
+#include <cstddef>
+
+namespace wfrest
+{
+
+enum class SimdLevel : int
+{
+    SCALAR = 0,
+    SSE42 = 1,
+    AVX2 = 2,
+};
+
+/*
+The byte scanning kernels under StrUtil, CodeUtil and Base64.
+Each one has a scalar version and, on x86_64, SSE4.2 and AVX2 versions
+built with function target attributes, so the library needs no -m flags.
+The best level the cpu supports is picked on the first call.
+*/
+class Simd
+{
+public:
+    // the best level of the cpu
+    static SimdLevel detected();
+
+    static SimdLevel level();
+
+    // At most detected(), returns the level in use. For the tests and the
+    // benchmarks, not to be called while other threads use the kernels.
+    static SimdLevel set_level(SimdLevel level);
+
+    static const char *level_name(SimdLevel level);
+
+    // the first c in [begin, end), end if none
+    static const char *find_char(const char *begin, const char *end, char c)
+    { return kernels()->find_char(begin, end, c); }
+
+    // the first byte url_encode() escapes : none of 0-9 A-Z a-z - . _ ~ /
+    static const char *find_url_unsafe(const char *begin, const char *end)
+    { return kernels()->find_url_unsafe(begin, end); }
+
+    // the first '%' or '+'
+    static const char *find_url_escape(const char *begin, const char *end)
+    { return kernels()->find_url_escape(begin, end); }
+
+    // the index of the first ASCII case-insensitive difference, n if none
+    static size_t mismatch_nocase(const char *a, const char *b, size_t n)
+    { return kernels()->mismatch_nocase(a, b, n); }
+
+    // Encodes the whole groups of 3 bytes of in, returns the bytes encoded.
+    // out holds 4 chars per group.
+    static size_t base64_encode(const unsigned char *in, size_t len, char *out)
+    { return kernels()->base64_encode(in, len, out); }
+
+    // Decodes the leading groups of 4 chars of in, up to the first char out of
+    // the alphabet or '='. Returns the chars decoded, out holds 3 bytes per
+    // group and k_base64_decode_slack more.
+    static size_t base64_decode(const char *in, size_t len, unsigned char *out)
+    { return kernels()->base64_decode(in, len, out); }
+
+    // the vector stores of base64_decode() go past the decoded bytes
+    static const size_t k_base64_decode_slack = 8;
+
+public:
+    // the kernels of a level
+    struct Kernels
+    {
+        const char *(*find_char)(const char *, const char *, char);
+        const char *(*find_url_unsafe)(const char *, const char *);
+        const char *(*find_url_escape)(const char *, const char *);
+        size_t (*mismatch_nocase)(const char *, const char *, size_t);
+        size_t (*base64_encode)(const unsigned char *, size_t, char *);
+        size_t (*base64_decode)(const char *, size_t, unsigned char *);
+    };
+
+private:
+    static const Kernels *kernels()
+    {
+        if (__builtin_expect(kernels_ == nullptr, 0))
+            set_level(detected());
+        return kernels_;
+    }
+
+    static const Kernels *kernels_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_SIMD_H_
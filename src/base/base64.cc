@@ -1,4 +1,5 @@
 #include "base64.h"
+#include "Simd.h"
 using namespace wfrest;
 
 namespace 
@@ -21,27 +22,18 @@ const std::string Base64::base64_chars =
 std::string Base64::encode(const unsigned char *bytes_to_encode, unsigned int len)
 {
     std::string ret;
-    int i = 0;
+    ret.resize((static_cast<size_t>(len) + 2) / 3 * 4);
+    // the whole groups of 3 bytes
+    size_t done = Simd::base64_encode(bytes_to_encode, len, &ret[0]);
+    int i = len - done;
     int j = 0;
     unsigned char char_array_3[3];
     unsigned char char_array_4[4];
 
-    while (len--) {
-        char_array_3[i++] = *(bytes_to_encode++);
-        if (i == 3) {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-
-            for(i = 0; (i <4) ; i++)
-                ret += base64_chars[char_array_4[i]];
-            i = 0;
-        }
-    }
-
     if (i)
     {
+        for(j = 0; j < i; j++)
+            char_array_3[j] = bytes_to_encode[done + j];
         for(j = i; j < 3; j++)
             char_array_3[j] = '\0';
 
@@ -50,12 +42,12 @@ std::string Base64::encode(const unsigned char *bytes_to_encode, unsigned int le
         char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
         char_array_4[3] = char_array_3[2] & 0x3f;
 
+        char *out = &ret[done / 3 * 4];
         for (j = 0; (j < i + 1); j++)
-            ret += base64_chars[char_array_4[j]];
+            *out++ = base64_chars[char_array_4[j]];
 
         while((i++ < 3))
-            ret += '=';
-
+            *out++ = '=';
     }
 
     return ret;
@@ -63,27 +55,21 @@ std::string Base64::encode(const unsigned char *bytes_to_encode, unsigned int le
 
 std::string Base64::decode(const std::string &encoded_string)
 {
-    int in_len = encoded_string.size();
+    size_t in_len = encoded_string.size();
     int i = 0;
     int j = 0;
-    int in_ = 0;
     unsigned char char_array_4[4], char_array_3[3];
     std::string ret;
 
-    while (in_len-- && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
+    // the whole groups of 4 chars up to the first '=' or char out of the alphabet
+    ret.resize(in_len / 4 * 3 + Simd::k_base64_decode_slack);
+    size_t in_ = Simd::base64_decode(encoded_string.data(), in_len,
+                                     reinterpret_cast<unsigned char *>(&ret[0]));
+    ret.resize(in_ / 4 * 3);
+
+    // then a group cut short, by the end or by such a char
+    while (in_ < in_len && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
         char_array_4[i++] = encoded_string[in_]; in_++;
-        if (i ==4) {
-            for (i = 0; i <4; i++)
-                char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-            for (i = 0; (i < 3); i++)
-                ret += char_array_3[i];
-            i = 0;
-        }
     }
 
     if (i) {
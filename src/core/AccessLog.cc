@@ -0,0 +1,500 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+#include "AccessLog.h"
+#include "HttpServerTask.h"
+#include "JsonStruct.h"
+
+namespace wfrest
+{
+
+// Fixed size, copied into the ring without any allocation.
+// Long fields are truncated.
+struct AccessRecord
+{
+    long long time_us;      // realtime when the reply was sent
+    long long latency_us;   // -1 if unknown
+    unsigned long long bytes;
+    struct sockaddr_storage peer;
+    float spans[RequestTiming::SPAN_MAX];   // us, when timed
+    bool timed;
+    int status;
+    unsigned short uri_len;
+    unsigned char referer_len;
+    unsigned char agent_len;
+    char method[12];
+    char version[12];
+    char uri[256];
+    char referer[128];
+    char user_agent[128];
+};
+
+struct AccessLogRing
+{
+    std::vector<AccessRecord> slots;
+    size_t mask;
+    std::atomic<unsigned long long> head{0};     // next record to read, by the background thread
+    std::atomic<unsigned long long> tail{0};     // next slot to write, by the owner thread
+    std::atomic<unsigned long long> dropped{0};
+
+    explicit AccessLogRing(size_t size) : slots(size), mask(size - 1) {}
+};
+
+namespace
+{
+
+thread_local std::unordered_map<unsigned long long, AccessLogRing *> local_rings;
+
+std::atomic<unsigned long long> next_access_log_id{1};
+
+static const size_t k_write_batch = 64 * 1024;
+
+size_t round_up_pow2(size_t size)
+{
+    size_t res = 1;
+    while (res < size)
+        res <<= 1;
+    return res;
+}
+
+long long realtime_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+long long monotonic_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+template<size_t N>
+size_t copy_field(char (&dst)[N], const char *src, size_t len)
+{
+    if (!src)
+        return 0;
+    len = std::min(len, N);
+    memcpy(dst, src, len);
+    return len;
+}
+
+template<size_t N>
+void copy_cstr(char (&dst)[N], const char *src)
+{
+    size_t len = src ? strnlen(src, N - 1) : 0;
+    memcpy(dst, src ? src : "", len);
+    dst[len] = '\0';
+}
+
+void format_peer(const struct sockaddr_storage &peer, std::string &ip, unsigned short &port)
+{
+    char buf[INET6_ADDRSTRLEN] = "-";
+    port = 0;
+    if (peer.ss_family == AF_INET)
+    {
+        auto *sin = reinterpret_cast<const struct sockaddr_in *>(&peer);
+        inet_ntop(AF_INET, &sin->sin_addr, buf, sizeof buf);
+        port = ntohs(sin->sin_port);
+    }
+    else if (peer.ss_family == AF_INET6)
+    {
+        auto *sin6 = reinterpret_cast<const struct sockaddr_in6 *>(&peer);
+        inet_ntop(AF_INET6, &sin6->sin6_addr, buf, sizeof buf);
+        port = ntohs(sin6->sin6_port);
+    }
+    ip = buf;
+}
+
+// empty values are logged as "-"
+void append_quoted(std::string &buf, const char *str, size_t len)
+{
+    if (len == 0)
+    {
+        buf.append("\"-\"");
+        return;
+    }
+    buf.push_back('"');
+    for (size_t i = 0; i < len; i++)
+    {
+        if (str[i] == '"' || str[i] == '\\')
+            buf.push_back('\\');
+        buf.push_back(str[i]);
+    }
+    buf.push_back('"');
+}
+
+}  // namespace
+
+AccessLog::AccessLog(const AccessLogParams &params)
+    : id_(next_access_log_id++),
+    params_(params),
+    stop_(false),
+    fd_(-1),
+    file_size_(0),
+    file_open_time_(0),
+    cached_sec_(-1)
+{
+    params_.ring_size = round_up_pow2(std::max<size_t>(params_.ring_size, 2));
+    if (params_.flush_interval <= 0)
+        params_.flush_interval = 100;
+
+    this->open_file();
+    thread_ = std::thread(&AccessLog::run, this);
+}
+
+AccessLog::~AccessLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        stop_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+
+    if (fd_ > STDERR_FILENO)
+        close(fd_);
+}
+
+unsigned long long AccessLog::dropped() const
+{
+    unsigned long long cnt = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &ring : rings_)
+        cnt += ring->dropped.load(std::memory_order_relaxed);
+    return cnt;
+}
+
+AccessLogRing *AccessLog::local_ring()
+{
+    auto it = local_rings.find(id_);
+    if (it != local_rings.end())
+        return it->second;
+
+    auto *ring = new AccessLogRing(params_.ring_size);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.emplace_back(ring);
+    }
+    local_rings.emplace(id_, ring);
+    return ring;
+}
+
+void AccessLog::push(const AccessRecord &record)
+{
+    AccessLogRing *ring = this->local_ring();
+    unsigned long long tail = ring->tail.load(std::memory_order_relaxed);
+    unsigned long long head = ring->head.load(std::memory_order_acquire);
+    if (tail - head > ring->mask)
+    {
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+        return;
+    }
+
+    ring->slots[tail & ring->mask] = record;
+    ring->tail.store(tail + 1, std::memory_order_release);
+}
+
+void AccessLog::log(HttpServerTask *server_task, long long start_us)
+{
+    bool need_headers = params_.format == AccessLogFormat::COMBINED ||
+                        params_.format == AccessLogFormat::JSON;
+
+    server_task->add_callback([this, start_us, need_headers](HttpTask *task)
+    {
+        HttpReq *req = task->get_req();
+        HttpResp *resp = task->get_resp();
+        auto *server_task = static_cast<HttpServerTask *>(task);
+
+        AccessRecord record;
+        record.time_us = realtime_us();
+        record.latency_us = start_us > 0 ? monotonic_us() - start_us : -1;
+        record.bytes = resp->get_output_body_size();
+
+        socklen_t addr_len = sizeof record.peer;
+        record.peer.ss_family = AF_UNSPEC;
+        server_task->get_peer_addr(reinterpret_cast<struct sockaddr *>(&record.peer), &addr_len);
+
+        const RequestTiming *timing = server_task->timing();
+        record.timed = timing != nullptr;
+        if (timing)
+        {
+            for (int span = 0; span < RequestTiming::SPAN_MAX; span++)
+                record.spans[span] = timing->span_us(static_cast<RequestTiming::Span>(span));
+        }
+
+        const char *status_code = resp->get_status_code();
+        record.status = status_code ? atoi(status_code) : 0;
+        copy_cstr(record.method, req->get_method());
+        copy_cstr(record.version, req->get_http_version());
+
+        const char *uri = req->get_request_uri();
+        record.uri_len = copy_field(record.uri, uri, uri ? strlen(uri) : 0);
+        record.referer_len = 0;
+        record.agent_len = 0;
+        if (need_headers)
+        {
+            const std::string &referer = req->header("Referer");
+            const std::string &user_agent = req->header("User-Agent");
+            record.referer_len = copy_field(record.referer, referer.data(), referer.size());
+            record.agent_len = copy_field(record.user_agent, user_agent.data(), user_agent.size());
+        }
+        this->push(record);
+    });
+}
+
+void AccessLog::run()
+{
+    std::string buf;
+    buf.reserve(k_write_batch * 2);
+
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    while (true)
+    {
+        bool stop = cond_.wait_for(lock, std::chrono::milliseconds(params_.flush_interval),
+                                   [this] { return stop_; });
+        lock.unlock();
+
+        // keep going until the rings are empty
+        while (this->drain(buf) > 0)
+            ;
+        if (!buf.empty())
+        {
+            this->write_out(buf);
+            buf.clear();
+        }
+
+        lock.lock();
+        if (stop)
+            break;
+    }
+}
+
+size_t AccessLog::drain(std::string &buf)
+{
+    std::vector<AccessLogRing *> rings;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings.reserve(rings_.size());
+        for (const auto &ring : rings_)
+            rings.push_back(ring.get());
+    }
+
+    size_t cnt = 0;
+    for (AccessLogRing *ring : rings)
+    {
+        unsigned long long head = ring->head.load(std::memory_order_relaxed);
+        unsigned long long tail = ring->tail.load(std::memory_order_acquire);
+        for (; head != tail; head++)
+        {
+            this->format(ring->slots[head & ring->mask], buf);
+            cnt++;
+            if (buf.size() >= k_write_batch)
+            {
+                this->write_out(buf);
+                buf.clear();
+            }
+        }
+        ring->head.store(head, std::memory_order_release);
+    }
+    return cnt;
+}
+
+void AccessLog::format(const AccessRecord &record, std::string &buf)
+{
+    // the time only changes every second, so is formatted at most once a second
+    long long sec = record.time_us / 1000000;
+    if (sec != cached_sec_)
+    {
+        time_t now = static_cast<time_t>(sec);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        char tbuf[64];
+        size_t len = 0;
+        switch (params_.format)
+        {
+        case AccessLogFormat::WFREST:
+            len = strftime(tbuf, sizeof tbuf, "%Y-%m-%d %X", &tm);
+            break;
+        case AccessLogFormat::COMMON:
+        case AccessLogFormat::COMBINED:
+            len = strftime(tbuf, sizeof tbuf, "%d/%b/%Y:%H:%M:%S %z", &tm);
+            break;
+        case AccessLogFormat::JSON:
+            len = strftime(tbuf, sizeof tbuf, "%Y-%m-%dT%H:%M:%S%z", &tm);
+            break;
+        }
+        cached_time_.assign(tbuf, len);
+        cached_sec_ = sec;
+    }
+
+    std::string ip;
+    unsigned short port;
+    format_peer(record.peer, ip, port);
+    std::string status = std::to_string(record.status);
+
+    switch (params_.format)
+    {
+    case AccessLogFormat::WFREST:
+    {
+        // the path, without the query
+        const char *query = static_cast<const char *>(memchr(record.uri, '?', record.uri_len));
+        size_t path_len = query ? query - record.uri : record.uri_len;
+        buf.append("[WFREST] ").append(cached_time_);
+        buf.append(" | ").append(status);
+        buf.append(" | ").append(ip).append(" : ").append(std::to_string(port));
+        buf.append(" | ").append(record.method);
+        buf.append(" | \"").append(record.uri, path_len).append("\" | ");
+        if (record.timed)
+        {
+            char total[32];
+            int len = snprintf(total, sizeof total, "%.3fms \n",
+                               record.spans[RequestTiming::SPAN_TOTAL] / 1000);
+            buf.append(total, len);
+        }
+        else
+        {
+            buf.append("-- \n");
+        }
+        break;
+    }
+    case AccessLogFormat::COMMON:
+    case AccessLogFormat::COMBINED:
+        buf.append(ip).append(" - - [").append(cached_time_).append("] \"");
+        buf.append(record.method).push_back(' ');
+        buf.append(record.uri, record.uri_len).push_back(' ');
+        buf.append(record.version).append("\" ");
+        buf.append(status).push_back(' ');
+        buf.append(std::to_string(record.bytes));
+        if (params_.format == AccessLogFormat::COMBINED)
+        {
+            buf.push_back(' ');
+            append_quoted(buf, record.referer, record.referer_len);
+            buf.push_back(' ');
+            append_quoted(buf, record.user_agent, record.agent_len);
+        }
+        buf.push_back('\n');
+        break;
+    case AccessLogFormat::JSON:
+    {
+        JsonWriter writer(buf);
+        buf.append("{\"time\":");
+        writer.put_string(cached_time_.data(), cached_time_.size());
+        buf.append(",\"remote_addr\":");
+        writer.put_string(ip.data(), ip.size());
+        buf.append(",\"remote_port\":");
+        writer.put_uint(port);
+        buf.append(",\"method\":");
+        writer.put_string(record.method, strlen(record.method));
+        buf.append(",\"uri\":");
+        writer.put_string(record.uri, record.uri_len);
+        buf.append(",\"protocol\":");
+        writer.put_string(record.version, strlen(record.version));
+        buf.append(",\"status\":").append(status);
+        buf.append(",\"bytes\":");
+        writer.put_uint(record.bytes);
+        buf.append(",\"latency_us\":");
+        writer.put_int(record.latency_us);
+        buf.append(",\"referer\":");
+        writer.put_string(record.referer, record.referer_len);
+        buf.append(",\"user_agent\":");
+        writer.put_string(record.user_agent, record.agent_len);
+        if (record.timed)
+        {
+            buf.append(",\"timing_us\":{");
+            for (int span = 0; span < RequestTiming::SPAN_MAX; span++)
+            {
+                if (span > 0)
+                    buf.push_back(',');
+                buf.push_back('"');
+                buf.append(RequestTiming::span_name(static_cast<RequestTiming::Span>(span)));
+                buf.append("\":");
+                writer.put_double(record.spans[span]);
+            }
+            buf.push_back('}');
+        }
+        buf.append("}\n");
+        break;
+    }
+    }
+}
+
+void AccessLog::open_file()
+{
+    if (params_.path.empty())
+    {
+        fd_ = STDERR_FILENO;
+        return;
+    }
+
+    fd_ = open(params_.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        fprintf(stderr, "[WFREST] Error : cannot open access log %s, %s\n",
+                params_.path.c_str(), strerror(errno));
+        fd_ = STDERR_FILENO;
+        return;
+    }
+
+    struct stat st;
+    file_size_ = fstat(fd_, &st) == 0 ? st.st_size : 0;
+    file_open_time_ = realtime_us() / 1000000;
+}
+
+void AccessLog::rotate()
+{
+    close(fd_);
+
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char suffix[32];
+    strftime(suffix, sizeof suffix, ".%Y%m%d-%H%M%S", &tm);
+    rename(params_.path.c_str(), (params_.path + suffix).c_str());
+
+    this->open_file();
+}
+
+void AccessLog::write_out(const std::string &buf)
+{
+    if (fd_ > STDERR_FILENO)
+    {
+        bool rotate_by_size = params_.rotate_size > 0 &&
+                              file_size_ + buf.size() > params_.rotate_size &&
+                              file_size_ > 0;
+        bool rotate_by_time = params_.rotate_interval > 0 &&
+                              realtime_us() / 1000000 - file_open_time_ >= params_.rotate_interval;
+        if (rotate_by_size || rotate_by_time)
+            this->rotate();
+    }
+
+    const char *data = buf.data();
+    size_t left = buf.size();
+    while (left > 0)
+    {
+        ssize_t ret = write(fd_, data, left);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        data += ret;
+        left -= ret;
+    }
+    file_size_ += buf.size() - left;
+}
+
+}  // namespace wfrest
@@ -0,0 +1,100 @@
+#ifndef WFREST_ACCESSLOG_H_
+#define WFREST_ACCESSLOG_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+#include "Noncopyable.h"
+
+namespace wfrest
+{
+
+class HttpServerTask;
+struct AccessLogRing;
+struct AccessRecord;
+
+enum class AccessLogFormat
+{
+    WFREST,     // [WFREST] time | status | ip : port | verb | "path" | total time or --
+    COMMON,     // NCSA Common Log Format
+    COMBINED,   // Common + "referer" "user-agent"
+    JSON,       // one json object per line
+};
+
+struct AccessLogParams
+{
+    std::string path;                   // empty means stderr
+    AccessLogFormat format = AccessLogFormat::WFREST;
+    size_t ring_size = 1024;            // records buffered per thread, rounded up to a power of 2
+    int flush_interval = 100;           // ms
+    size_t rotate_size = 0;             // rotate the file once it reaches this size, 0 means never
+    int rotate_interval = 0;            // rotate the file every rotate_interval seconds, 0 means never
+};
+
+/*
+Handler threads copy a fixed size record of every request into their own
+single producer / single consumer ring, which never blocks : when the ring
+is full the record is dropped and counted.
+A background thread drains the rings every flush_interval ms, formats the
+records in batches and writes them with large writes.
+Rotated files are renamed to path.YYYYmmdd-HHMMSS.
+*/
+class AccessLog : public Noncopyable
+{
+public:
+    explicit AccessLog(const AccessLogParams &params);
+
+    ~AccessLog();
+
+    // Log the request once the reply has been sent, start_us is the
+    // monotonic time when processing began, 0 if unknown.
+    void log(HttpServerTask *server_task, long long start_us);
+
+    // records dropped because a ring was full
+    unsigned long long dropped() const;
+
+private:
+    AccessLogRing *local_ring();
+
+    void push(const AccessRecord &record);
+
+    void run();
+
+    size_t drain(std::string &buf);
+
+    void format(const AccessRecord &record, std::string &buf);
+
+    void write_out(const std::string &buf);
+
+    void open_file();
+
+    void rotate();
+
+private:
+    const unsigned long long id_;
+    AccessLogParams params_;
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<AccessLogRing>> rings_;
+
+    std::thread thread_;
+    std::mutex wait_mutex_;
+    std::condition_variable cond_;
+    bool stop_;
+
+    // only used by the background thread
+    int fd_;
+    size_t file_size_;
+    long long file_open_time_;
+    long long cached_sec_;
+    std::string cached_time_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_ACCESSLOG_H_
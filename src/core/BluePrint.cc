@@ -13,10 +13,13 @@ void BluePrint::ROUTE(const std::string &route, const Handler &handler, Verb ver
                 GlobalAspect *global_aspect = GlobalAspect::get_instance();
                 for(auto asp : global_aspect->aspect_list)
                 {
-                    asp->before(req, resp);
+                    if(!asp->before(req, resp)) return nullptr;
+                }
+                mark_timing(resp, RequestTiming::BEFORE_DONE);
+                {
+                    HandlerScope scope(req, resp);
+                    handler(req, resp);
                 }
-
-                handler(req, resp);
 
                 if(!global_aspect->aspect_list.empty())
                 {
@@ -45,13 +48,18 @@ void BluePrint::ROUTE(const std::string &route, int compute_queue_id, const Hand
                 GlobalAspect *global_aspect = GlobalAspect::get_instance();
                 for(auto asp : global_aspect->aspect_list)
                 {
-                    asp->before(req, resp);
+                    if(!asp->before(req, resp)) return nullptr;
                 }
+                mark_timing(resp, RequestTiming::BEFORE_DONE);
+                QueueTicket ticket = QueueStatsRegistry::get_instance()->compute_enqueue(compute_queue_id);
                 WFGoTask *go_task = WFTaskFactory::create_go_task(
                         "wfrest" + std::to_string(compute_queue_id),
-                        handler,
-                        req,
-                        resp);
+                        [handler, req, resp, ticket]
+                        {
+                            QueueScope queue_scope(ticket);
+                            HandlerScope scope(req, resp);
+                            handler(req, resp);
+                        });
                 if(!global_aspect->aspect_list.empty())
                 {
                     HttpServerTask *server_task = task_of(resp);
@@ -105,6 +113,16 @@ void BluePrint::POST(const std::string &route, int compute_queue_id, const Handl
     this->ROUTE(route, compute_queue_id, handler, Verb::POST);
 }
 
+void BluePrint::GRPC(const std::string &route, const Handler &handler)
+{
+    this->ROUTE(route, grpc_handler(handler), Verb::POST);
+}
+
+void BluePrint::GRPC(const std::string &route, int compute_queue_id, const Handler &handler)
+{
+    this->ROUTE(route, compute_queue_id, grpc_handler(handler), Verb::POST);
+}
+
 void BluePrint::DELETE(const std::string &route, const Handler &handler)
 {
     this->ROUTE(route, handler, Verb::DELETE);
@@ -155,9 +173,13 @@ void BluePrint::ROUTE(const std::string &route, const SeriesHandler &handler, Ve
                 GlobalAspect *global_aspect = GlobalAspect::get_instance();
                 for(auto asp : global_aspect->aspect_list)
                 {
-                    asp->before(req, resp);
+                    if(!asp->before(req, resp)) return nullptr;
+                }
+                mark_timing(resp, RequestTiming::BEFORE_DONE);
+                {
+                    HandlerScope scope(req, resp);
+                    handler(req, resp, series);
                 }
-                handler(req, resp, series);
                 if(!global_aspect->aspect_list.empty())
                 {
                     HttpServerTask *server_task = task_of(resp);
@@ -185,14 +207,18 @@ void BluePrint::ROUTE(const std::string &route, int compute_queue_id, const Seri
                 GlobalAspect *global_aspect = GlobalAspect::get_instance();
                 for(auto asp : global_aspect->aspect_list)
                 {
-                    asp->before(req, resp);
+                    if(!asp->before(req, resp)) return nullptr;
                 }
+                mark_timing(resp, RequestTiming::BEFORE_DONE);
+                QueueTicket ticket = QueueStatsRegistry::get_instance()->compute_enqueue(compute_queue_id);
                 WFGoTask *go_task = WFTaskFactory::create_go_task(
                         "wfrest" + std::to_string(compute_queue_id),
-                        handler,
-                        req,
-                        resp,
-                        series);
+                        [handler, req, resp, series, ticket]
+                        {
+                            QueueScope queue_scope(ticket);
+                            HandlerScope scope(req, resp);
+                            handler(req, resp, series);
+                        });
                 if(!global_aspect->aspect_list.empty())
                 {
                     HttpServerTask *server_task = task_of(resp);
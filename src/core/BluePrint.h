@@ -10,6 +10,8 @@
 // todo : hide
 #include "Router.h"
 #include "HttpServerTask.h" 
+#include "QueueStats.h"
+#include "Grpc.h"
 
 class SeriesWork;
 namespace wfrest
@@ -208,12 +210,30 @@ public:
     void HEAD(const std::string &route, int compute_queue_id,
              const SeriesHandler &handler, const AP &... ap);
 
+public:
+    // gRPC over HTTP/2, route is /package.Service/Method. The handler reads
+    // req->grpc_messages() and replies with resp->Grpc(), see Grpc.h
+    void GRPC(const std::string &route, const Handler &handler);
+
+    void GRPC(const std::string &route, int compute_queue_id, const Handler &handler);
+
+    template<typename... AP>
+    void GRPC(const std::string &route, const Handler &handler, const AP &... ap);
+
+    template<typename... AP>
+    void GRPC(const std::string &route, int compute_queue_id,
+              const Handler &handler, const AP &... ap);
+
 public:
     const Router &router() const
     { return router_; }
 
     void add_blueprint(const BluePrint &bp, const std::string &url_prefix);
 
+    // the routes of bp at their own paths, overriding the verbs they share
+    void merge(const BluePrint &bp)
+    { router_.merge(bp.router_); }
+
     void print_node_arch() { router_.print_node_arch(); }  // for test
 private:
     Router router_;    // ptr for hiding internel class
@@ -16,15 +16,24 @@ WFGoTask *aop_process(const Handler &handler,
     bool ret = aop_before(req, resp, *tp);
     if (!ret)
     {
+        delete tp;
         return nullptr;
     }
     GlobalAspect *global_aspect = GlobalAspect::get_instance();
     for(auto asp : global_aspect->aspect_list)
     {
         ret = asp->before(req, resp);
-        if(!ret) return nullptr;
+        if(!ret)
+        {
+            delete tp;
+            return nullptr;
+        }
+    }
+    mark_timing(resp, RequestTiming::BEFORE_DONE);
+    {
+        HandlerScope scope(req, resp);
+        handler(req, resp);
     }
-    handler(req, resp);
     HttpServerTask *server_task = task_of(resp);
     server_task->add_callback([req, resp, tp, global_aspect](HttpTask *) 
     {
@@ -49,15 +58,24 @@ WFGoTask *aop_process(const SeriesHandler &handler,
     bool ret = aop_before(req, resp, *tp);
     if (!ret)
     {
+        delete tp;
         return nullptr;
     }
     GlobalAspect *global_aspect = GlobalAspect::get_instance();
     for(auto asp : global_aspect->aspect_list)
     {
         ret = asp->before(req, resp);
-        if(!ret) return nullptr;
+        if(!ret)
+        {
+            delete tp;
+            return nullptr;
+        }
+    }
+    mark_timing(resp, RequestTiming::BEFORE_DONE);
+    {
+        HandlerScope scope(req, resp);
+        handler(req, resp, series);
     }
-    handler(req, resp, series);
 
     HttpServerTask *server_task = task_of(resp);
 
@@ -84,19 +102,29 @@ WFGoTask *aop_compute_process(const Handler &handler,
     bool ret = aop_before(req, resp, *tp);
     if (!ret)
     {
+        delete tp;
         return nullptr;
     }
     GlobalAspect *global_aspect = GlobalAspect::get_instance();
     for(auto asp : global_aspect->aspect_list)
     {
         ret = asp->before(req, resp);
-        if(!ret) return nullptr;
+        if(!ret)
+        {
+            delete tp;
+            return nullptr;
+        }
     }
+    mark_timing(resp, RequestTiming::BEFORE_DONE);
+    QueueTicket ticket = QueueStatsRegistry::get_instance()->compute_enqueue(compute_queue_id);
     WFGoTask *go_task = WFTaskFactory::create_go_task(
             "wfrest" + std::to_string(compute_queue_id),
-            handler,
-            req,
-            resp);
+            [handler, req, resp, ticket]
+            {
+                QueueScope queue_scope(ticket);
+                HandlerScope scope(req, resp);
+                handler(req, resp);
+            });
 
     HttpServerTask *server_task = task_of(resp);
 
@@ -125,20 +153,29 @@ WFGoTask *aop_compute_process(const SeriesHandler &handler,
     bool ret = aop_before(req, resp, *tp);
     if (!ret)
     {
+        delete tp;
         return nullptr;
     }
     GlobalAspect *global_aspect = GlobalAspect::get_instance();
     for(auto asp : global_aspect->aspect_list)
     {
         ret = asp->before(req, resp);
-        if(!ret) return nullptr;
+        if(!ret)
+        {
+            delete tp;
+            return nullptr;
+        }
     }
+    mark_timing(resp, RequestTiming::BEFORE_DONE);
+    QueueTicket ticket = QueueStatsRegistry::get_instance()->compute_enqueue(compute_queue_id);
     WFGoTask *go_task = WFTaskFactory::create_go_task(
             "wfrest" + std::to_string(compute_queue_id),
-            handler,
-            req,
-            resp,
-            series);
+            [handler, req, resp, series, ticket]
+            {
+                QueueScope queue_scope(ticket);
+                HandlerScope scope(req, resp);
+                handler(req, resp, series);
+            });
 
     HttpServerTask *server_task = task_of(resp);
 
@@ -439,6 +476,19 @@ void BluePrint::HEAD(const std::string &route, int compute_queue_id,
     this->ROUTE(route, compute_queue_id, handler, Verb::HEAD, ap...);
 }
 
+template<typename... AP>
+void BluePrint::GRPC(const std::string &route, const Handler &handler, const AP &... ap)
+{
+    this->ROUTE(route, grpc_handler(handler), Verb::POST, ap...);
+}
+
+template<typename... AP>
+void BluePrint::GRPC(const std::string &route, int compute_queue_id,
+                     const Handler &handler, const AP &... ap)
+{
+    this->ROUTE(route, compute_queue_id, grpc_handler(handler), Verb::POST, ap...);
+}
+
 } // namespace wfrest
 
 
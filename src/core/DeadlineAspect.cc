@@ -0,0 +1,20 @@
+#include "DeadlineAspect.h"
+#include "HttpMsg.h"
+#include "HttpServerTask.h"
+
+namespace wfrest
+{
+
+bool DeadlineAop::before(const HttpReq *req, HttpResp *resp)
+{
+    HttpServerTask *server_task = task_of(resp);
+    server_task->set_timeout(timeout_ms_);
+    if (server_task->deadline_exceeded())
+    {
+        server_task->expire();
+        return false;
+    }
+    return true;
+}
+
+}  // namespace wfrest
@@ -0,0 +1,30 @@
+#ifndef WFREST_DEADLINEASPECT_H_
+#define WFREST_DEADLINEASPECT_H_
+
+#include "Aspect.h"
+
+namespace wfrest
+{
+
+/*
+Budget of the requests of a route, in place of HttpServer::request_timeout():
+    svr.GET("/search", handler, DeadlineAop(200));
+The tasks the handler starts through HttpResp time out with what is left
+of it, and the request gets a 504 once it is gone.
+*/
+class DeadlineAop : public Aspect
+{
+public:
+    explicit DeadlineAop(int timeout_ms) : timeout_ms_(timeout_ms) {}
+
+    bool before(const HttpReq *req, HttpResp *resp) override;
+
+    bool after(const HttpReq *req, HttpResp *resp) override { return true; }
+
+private:
+    int timeout_ms_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_DEADLINEASPECT_H_
@@ -0,0 +1,67 @@
+#include "workflow/HttpUtil.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "DebugBluePrint.h"
+#include "Profiler.h"
+#include "QueueStats.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+int query_int(const HttpReq *req, const std::string &key, int def, int min, int max)
+{
+    if (!req->has_query(key))
+        return def;
+    int val = atoi(req->query(key).c_str());
+    return val < min ? min : (val > max ? max : val);
+}
+
+}  // namespace
+
+DebugBluePrint::DebugBluePrint()
+{
+    QueueStatsRegistry::get_instance()->enable();
+
+    this->GET("/profile", [](const HttpReq *req, HttpResp *resp)
+    {
+        int seconds = query_int(req, "seconds", 10, 1, 60);
+        int hz = query_int(req, "hz", 99, 1, 1000);
+        if (CpuProfiler::start(hz) < 0)
+        {
+            if (errno == EBUSY)
+            {
+                resp->set_status(HttpStatusConflict);
+                resp->String("a profile is already running\n");
+            }
+            else
+            {
+                resp->set_status(HttpStatusInternalServerError);
+                resp->String(std::string("can not start the profiler: ") + strerror(errno) + "\n");
+            }
+            return;
+        }
+        resp->Timer(seconds, 0, [resp]()
+        {
+            resp->headers["Content-Type"] = "text/plain";
+            resp->String(CpuProfiler::stop());
+        });
+    });
+
+    this->GET("/alloc", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->headers["Content-Type"] = "text/plain";
+        resp->String(AllocProfiler::report());
+        if (req->query("reset") == "true")
+            AllocProfiler::reset();
+    });
+
+    this->GET("/threads", [](const HttpReq *, HttpResp *resp)
+    {
+        resp->headers["Content-Type"] = "application/json";
+        resp->String(QueueStatsRegistry::get_instance()->dump());
+    });
+}
@@ -0,0 +1,32 @@
+#ifndef WFREST_DEBUGBLUEPRINT_H_
+#define WFREST_DEBUGBLUEPRINT_H_
+
+#include "BluePrint.h"
+
+namespace wfrest
+{
+
+/*
+Admin routes for profiling a running server, opt in with
+    DebugBluePrint admin_bp;
+    svr.register_blueprint(admin_bp, "/debug");
+
+GET /debug/profile?seconds=10&hz=99
+    cpu profile of the whole process, replied after seconds (at most 60)
+    as folded stacks : flamegraph.pl < profile.folded > profile.svg
+GET /debug/alloc[?reset=true]
+    allocations and bytes by route, needs the WFREST_ALLOC_PROFILE cmake option
+GET /debug/threads
+    thread pools and compute queues : queue depth, active tasks, busy time,
+    wait in the queue and the longest running task, counted from the
+    construction of a DebugBluePrint
+*/
+class DebugBluePrint : public BluePrint
+{
+public:
+    DebugBluePrint();
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_DEBUGBLUEPRINT_H_
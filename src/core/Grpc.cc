@@ -0,0 +1,213 @@
+#include "workflow/HttpUtil.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "Grpc.h"
+#include "HttpMsg.h"
+#include "HttpServerTask.h"
+#include "Compress.h"
+#include "ErrorCode.h"
+
+using namespace protocol;
+
+namespace wfrest
+{
+
+bool GrpcFrame::parse(const char *data, size_t size, std::vector<Message> *messages)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    size_t off = 0;
+    while (off < size)
+    {
+        if (size - off < k_prefix_size || p[off] > 1)
+            return false;
+        size_t length = (size_t(p[off + 1]) << 24) | (size_t(p[off + 2]) << 16) |
+                        (size_t(p[off + 3]) << 8) | p[off + 4];
+        off += k_prefix_size;
+        if (size - off < length)
+            return false;
+        messages->push_back({ StringPiece(data + off, length), p[off - k_prefix_size] == 1 });
+        off += length;
+    }
+    return true;
+}
+
+void GrpcFrame::append_prefix(bool compressed, uint32_t length, std::string *out)
+{
+    out->push_back(compressed ? 1 : 0);
+    out->push_back(static_cast<char>(length >> 24));
+    out->push_back(static_cast<char>(length >> 16));
+    out->push_back(static_cast<char>(length >> 8));
+    out->push_back(static_cast<char>(length));
+}
+
+long long GrpcFrame::parse_timeout(const std::string &value)
+{
+    // at most 8 digits and the unit
+    if (value.size() < 2 || value.size() > 9)
+        return -1;
+    long long n = 0;
+    for (size_t i = 0; i + 1 < value.size(); i++)
+    {
+        if (value[i] < '0' || value[i] > '9')
+            return -1;
+        n = n * 10 + (value[i] - '0');
+    }
+
+    switch (value.back())
+    {
+    case 'H': return n * 3600 * 1000;
+    case 'M': return n * 60 * 1000;
+    case 'S': return n * 1000;
+    case 'm': return n;
+    case 'u': return (n + 999) / 1000;
+    case 'n': return (n + 999999) / 1000000;
+    default: return -1;
+    }
+}
+
+std::string GrpcFrame::encode_status_message(const std::string &message)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(message.size());
+    for (unsigned char c : message)
+    {
+        if (c >= 0x20 && c <= 0x7e && c != '%')
+            out.push_back(c);
+        else
+        {
+            out.push_back('%');
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0xf]);
+        }
+    }
+    return out;
+}
+
+void GrpcReply::write(std::string &&message, bool compress)
+{
+    if (compress && accept_gzip_ && (!headers_sent_ || compressed_))
+    {
+        std::string gzipped;
+        if (Compressor::gzip(message.data(), message.size(), &gzipped) == StatusOK &&
+            gzipped.size() < message.size())
+        {
+            message.swap(gzipped);
+            compressed_ = true;
+        }
+        else
+            compress = false;
+    }
+    else
+        compress = false;
+
+    messages_.emplace_back(std::move(message));
+    const std::string &data = messages_.back();
+    pieces_.push_back({ prefixes_.size(), data.data(), data.size() });
+    GrpcFrame::append_prefix(compress, static_cast<uint32_t>(data.size()), &prefixes_);
+}
+
+void GrpcReply::write_nocopy(const void *data, size_t size)
+{
+    pieces_.push_back({ prefixes_.size(), static_cast<const char *>(data), size });
+    GrpcFrame::append_prefix(false, static_cast<uint32_t>(size), &prefixes_);
+}
+
+void GrpcReply::set_status(GrpcStatus status, const std::string &message)
+{
+    status_ = status;
+    status_message_ = message;
+}
+
+void GrpcReply::expire()
+{
+    this->clear_body();
+    // the grpc-encoding of the headers sent holds
+    if (!headers_sent_)
+        compressed_ = false;
+    this->set_status(GrpcStatus::DEADLINE_EXCEEDED, "Deadline Exceeded");
+}
+
+void GrpcReply::append_body(std::vector<struct iovec> *vectors) const
+{
+    for (const Piece &piece : pieces_)
+    {
+        vectors->push_back({ const_cast<char *>(&prefixes_[piece.prefix]), GrpcFrame::k_prefix_size });
+        if (piece.size > 0)
+            vectors->push_back({ const_cast<char *>(piece.data), piece.size });
+    }
+}
+
+void GrpcReply::clear_body()
+{
+    pieces_.clear();
+    prefixes_.clear();
+    messages_.clear();
+}
+
+Http2Headers GrpcReply::trailers() const
+{
+    Http2Headers trailers;
+    trailers.emplace_back("grpc-status", std::to_string(static_cast<int>(status_)));
+    if (!status_message_.empty())
+        trailers.emplace_back("grpc-message", GrpcFrame::encode_status_message(status_message_));
+    for (const auto &trailer : trailers_)
+        trailers.push_back(trailer);
+    return trailers;
+}
+
+Handler grpc_handler(const Handler &handler)
+{
+    return [handler](const HttpReq *req, HttpResp *resp)
+    {
+        // the status is in the trailers
+        if (!req->http2())
+        {
+            resp->set_status(HttpStatusHTTPVersionNotSupported);
+            resp->String("gRPC needs HTTP/2\n");
+            return;
+        }
+        // application/grpc, application/grpc+proto, ...
+        const std::string &content_type = req->header("Content-Type");
+        if (content_type.compare(0, 16, "application/grpc") != 0 ||
+            (content_type.size() > 16 && content_type[16] != '+' && content_type[16] != ';'))
+        {
+            resp->set_status(HttpStatusUnsupportedMediaType);
+            return;
+        }
+
+        const std::string &accept_encoding = req->header("grpc-accept-encoding");
+        resp->set_grpc(new GrpcReply(accept_encoding.find("gzip") != std::string::npos));
+        resp->headers["Content-Type"] = content_type;
+
+        const std::string &encoding = req->header("grpc-encoding");
+        if (!encoding.empty() && encoding != "identity" && encoding != "gzip")
+        {
+            resp->add_grpc_trailer("grpc-accept-encoding", "identity,gzip");
+            resp->set_grpc_status(GrpcStatus::UNIMPLEMENTED, "grpc-encoding " + encoding);
+            return;
+        }
+        req->grpc_messages();
+        if (!req->grpc_error().empty())
+        {
+            resp->set_grpc_status(GrpcStatus::INTERNAL, req->grpc_error());
+            return;
+        }
+
+        // the budget of the client, the backend tasks time out with what is left of it
+        const std::string &timeout = req->header("grpc-timeout");
+        if (!timeout.empty())
+        {
+            long long timeout_ms = GrpcFrame::parse_timeout(timeout);
+            if (timeout_ms >= 0)
+                task_of(resp)->set_client_timeout(timeout_ms > INT_MAX ? INT_MAX :
+                                                  std::max(static_cast<int>(timeout_ms), 1));
+        }
+        handler(req, resp);
+    };
+}
+
+}  // namespace wfrest
@@ -0,0 +1,143 @@
+#ifndef WFREST_GRPC_H_
+#define WFREST_GRPC_H_
+
+#include <sys/uio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+
+#include "Noncopyable.h"
+#include "StringPiece.h"
+#include "Http2.h"
+
+namespace wfrest
+{
+
+class HttpReq;
+class HttpResp;
+
+// https://github.com/grpc/grpc/blob/master/doc/statuscodes.md
+enum class GrpcStatus : int
+{
+    OK = 0,
+    CANCELLED = 1,
+    UNKNOWN = 2,
+    INVALID_ARGUMENT = 3,
+    DEADLINE_EXCEEDED = 4,
+    NOT_FOUND = 5,
+    ALREADY_EXISTS = 6,
+    PERMISSION_DENIED = 7,
+    RESOURCE_EXHAUSTED = 8,
+    FAILED_PRECONDITION = 9,
+    ABORTED = 10,
+    OUT_OF_RANGE = 11,
+    UNIMPLEMENTED = 12,
+    INTERNAL = 13,
+    UNAVAILABLE = 14,
+    DATA_LOSS = 15,
+    UNAUTHENTICATED = 16,
+};
+
+// The framing of https://github.com/grpc/grpc/blob/master/doc/PROTOCOL-HTTP2.md
+struct GrpcFrame
+{
+    // the compressed flag, then the length of the message in big endian
+    static const size_t k_prefix_size = 5;
+
+    struct Message
+    {
+        StringPiece data;
+        bool compressed;
+    };
+
+    // The messages of a body, views into it. false if the body does not end
+    // with a whole message.
+    static bool parse(const char *data, size_t size, std::vector<Message> *messages);
+
+    static void append_prefix(bool compressed, uint32_t length, std::string *out);
+
+    // grpc-timeout to ms, rounded up, -1 if malformed
+    static long long parse_timeout(const std::string &value);
+
+    // grpc-message, percent-encoded
+    static std::string encode_status_message(const std::string &message);
+};
+
+/*
+The reply of a call to a route of BluePrint::GRPC(). Each message written by
+the handler and the tasks of its series is queued on the connection as it is
+written, after the headers with the first one, and the trailers once the
+series is done. See Http2Connection for when the queue is written.
+*/
+class GrpcReply : public Noncopyable
+{
+public:
+    // accept_gzip : gzip is in the grpc-accept-encoding of the request
+    explicit GrpcReply(bool accept_gzip) :
+        accept_gzip_(accept_gzip), compressed_(false), headers_sent_(false),
+        status_(GrpcStatus::OK)
+    {}
+
+    // Compressed with gzip if compress, the client accepts it and it makes the
+    // message smaller. Once the headers are sent, only if they said gzip.
+    void write(std::string &&message, bool compress);
+
+    // not copied, data lives until it is sent
+    void write_nocopy(const void *data, size_t size);
+
+    void set_status(GrpcStatus status, const std::string &message);
+
+    void add_trailer(const std::string &name, const std::string &value)
+    { trailers_.emplace_back(name, value); }
+
+    // DEADLINE_EXCEEDED in place of the messages not sent yet
+    void expire();
+
+    // some message is gzip, the reply needs a grpc-encoding
+    bool compressed() const { return compressed_; }
+
+    bool headers_sent() const { return headers_sent_; }
+
+    void set_headers_sent() { headers_sent_ = true; }
+
+    GrpcStatus status() const { return status_; }
+
+    // the prefixes and the messages not sent yet, in order
+    void append_body(std::vector<struct iovec> *vectors) const;
+
+    // once the vectors of append_body() are sent
+    void clear_body();
+
+    Http2Headers trailers() const;
+
+private:
+    struct Piece
+    {
+        size_t prefix;      // offset in prefixes_
+        const char *data;
+        size_t size;
+    };
+
+    bool accept_gzip_;
+    bool compressed_;
+    bool headers_sent_;
+    GrpcStatus status_;
+    std::string status_message_;
+    Http2Headers trailers_;
+
+    std::string prefixes_;
+    std::vector<Piece> pieces_;
+    std::deque<std::string> messages_;      // what the pieces own, stable addresses
+};
+
+using Handler = std::function<void(const HttpReq *, HttpResp *)>;
+
+// The handler of a route of BluePrint::GRPC() : checks the transport, the content
+// type and the encoding of the request, and sets its deadline from grpc-timeout.
+Handler grpc_handler(const Handler &handler);
+
+}  // namespace wfrest
+
+#endif // WFREST_GRPC_H_
@@ -0,0 +1,1418 @@
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+#include "Http2.h"
+
+namespace wfrest
+{
+
+namespace
+{
+
+// RFC 9113 section 7
+const uint32_t k_no_error = 0x0;
+const uint32_t k_protocol_error = 0x1;
+const uint32_t k_flow_control_error = 0x3;
+const uint32_t k_stream_closed = 0x5;
+const uint32_t k_frame_size_error = 0x6;
+const uint32_t k_refused_stream = 0x7;
+const uint32_t k_cancel = 0x8;
+const uint32_t k_compression_error = 0x9;
+const uint32_t k_enhance_your_calm = 0xb;
+
+// RFC 9113 section 6.5.2
+const uint16_t k_settings_header_table_size = 0x1;
+const uint16_t k_settings_enable_push = 0x2;
+const uint16_t k_settings_max_concurrent_streams = 0x3;
+const uint16_t k_settings_initial_window_size = 0x4;
+const uint16_t k_settings_max_frame_size = 0x5;
+const uint16_t k_settings_max_header_list_size = 0x6;
+
+const uint32_t k_default_window = 65535;
+const uint32_t k_default_max_frame_size = 16384;
+const long long k_max_window = 0x7fffffff;
+
+// the output queue, in chunks ; the DATA of the replies is queued up to
+// k_high_water, the control frames up to k_max_queued
+const size_t k_chunk_size = 64 * 1024;
+const size_t k_high_water = 256 * 1024;
+const size_t k_max_queued = 1024 * 1024;
+
+struct StaticEntry
+{
+    const char *name;
+    const char *value;
+};
+
+// RFC 7541 appendix A, index 1 first
+const StaticEntry k_static_table[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+// RFC 7541 appendix B, by symbol, then the code of EOS
+const uint32_t k_huffman_codes[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+    0x3fffffff,
+};
+
+const uint8_t k_huffman_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+const size_t k_static_table_size = sizeof k_static_table / sizeof k_static_table[0];
+
+uint32_t read_u32(const char *p)
+{
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+    return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | u[3];
+}
+
+void append_u32(std::string *out, uint32_t value)
+{
+    out->push_back(static_cast<char>(value >> 24));
+    out->push_back(static_cast<char>(value >> 16));
+    out->push_back(static_cast<char>(value >> 8));
+    out->push_back(static_cast<char>(value));
+}
+
+// The code tree of the huffman decoder, built once from the code table.
+// A node is a leaf if its symbol is >= 0.
+struct HuffmanTree
+{
+    struct Node
+    {
+        int child[2];
+        int symbol;
+    };
+
+    std::vector<Node> nodes;
+
+    HuffmanTree()
+    {
+        nodes.push_back(Node{ { 0, 0 }, -1 });
+        for (int symbol = 0; symbol < 257; symbol++)
+        {
+            uint32_t code = k_huffman_codes[symbol];
+            int node = 0;
+            for (int bit = k_huffman_lengths[symbol] - 1; bit >= 0; bit--)
+            {
+                int b = (code >> bit) & 1;
+                if (nodes[node].child[b] == 0)
+                {
+                    nodes[node].child[b] = static_cast<int>(nodes.size());
+                    nodes.push_back(Node{ { 0, 0 }, -1 });
+                }
+                node = nodes[node].child[b];
+            }
+            nodes[node].symbol = symbol;
+        }
+    }
+};
+
+const HuffmanTree &huffman_tree()
+{
+    static const HuffmanTree tree;
+    return tree;
+}
+
+// first index of a name in the static table
+const std::unordered_map<std::string, size_t> &static_names()
+{
+    static const std::unordered_map<std::string, size_t> names = []
+    {
+        std::unordered_map<std::string, size_t> names;
+        for (size_t i = k_static_table_size; i > 0; i--)
+            names[k_static_table[i - 1].name] = i;
+        return names;
+    }();
+    return names;
+}
+
+bool read_integer(const char **p, const char *end, int prefix_bits, uint32_t *value)
+{
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(*p);
+    uint32_t max_prefix = (1u << prefix_bits) - 1;
+    uint32_t v = u[0] & max_prefix;
+    (*p)++;
+    if (v == max_prefix)
+    {
+        // up to 2^28, more than any length or index of a frame
+        for (int shift = 0;; shift += 7)
+        {
+            if (*p == end || shift > 21)
+                return false;
+            unsigned char b = static_cast<unsigned char>(**p);
+            (*p)++;
+            v += static_cast<uint32_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+    }
+    *value = v;
+    return true;
+}
+
+bool is_connection_header(const std::string &name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+enum FieldKind { NAME, VALUE, TOKEN };
+
+// RFC 9113 section 8.2.1, what the http parser would read differently.
+// TOKEN : the method and the path, in the request line.
+bool valid_field(const std::string &str, FieldKind kind)
+{
+    for (char c : str)
+    {
+        if (c == '\r' || c == '\n' || c == '\0')
+            return false;
+        if (kind == NAME && (c == ':' || (c >= 'A' && c <= 'Z')))
+            return false;
+        if (kind == TOKEN && (c == ' ' || c == '\t'))
+            return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+const size_t Http2Frame::k_header_size;
+const uint8_t Http2Frame::k_end_stream;
+const uint8_t Http2Frame::k_ack;
+const uint8_t Http2Frame::k_end_headers;
+const uint8_t Http2Frame::k_padded;
+const uint8_t Http2Frame::k_priority;
+const char Http2Frame::k_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t Http2Frame::k_preface_size;
+
+void Http2Frame::parse(const char *p)
+{
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+    length = (uint32_t(u[0]) << 16) | (uint32_t(u[1]) << 8) | u[2];
+    type = static_cast<Http2FrameType>(u[3]);
+    flags = u[4];
+    stream_id = read_u32(p + 5) & 0x7fffffff;
+}
+
+void Http2Frame::append_to(std::string *out) const
+{
+    char header[k_header_size];
+    header[0] = static_cast<char>(length >> 16);
+    header[1] = static_cast<char>(length >> 8);
+    header[2] = static_cast<char>(length);
+    header[3] = static_cast<char>(type);
+    header[4] = static_cast<char>(flags);
+    header[5] = static_cast<char>((stream_id >> 24) & 0x7f);
+    header[6] = static_cast<char>(stream_id >> 16);
+    header[7] = static_cast<char>(stream_id >> 8);
+    header[8] = static_cast<char>(stream_id);
+    out->append(header, k_header_size);
+}
+
+void Http2Frame::append_settings(std::string *out,
+                                 const std::vector<std::pair<uint16_t, uint32_t>> &settings)
+{
+    append(out, settings.size() * 6, Http2FrameType::SETTINGS, 0, 0);
+    for (const auto &setting : settings)
+    {
+        out->push_back(static_cast<char>(setting.first >> 8));
+        out->push_back(static_cast<char>(setting.first));
+        append_u32(out, setting.second);
+    }
+}
+
+void Http2Frame::append_window_update(std::string *out, uint32_t stream_id, uint32_t increment)
+{
+    append(out, 4, Http2FrameType::WINDOW_UPDATE, 0, stream_id);
+    append_u32(out, increment);
+}
+
+void Http2Frame::append_rst_stream(std::string *out, uint32_t stream_id, uint32_t error)
+{
+    append(out, 4, Http2FrameType::RST_STREAM, 0, stream_id);
+    append_u32(out, error);
+}
+
+void Http2Frame::append_goaway(std::string *out, uint32_t last_stream_id, uint32_t error)
+{
+    append(out, 8, Http2FrameType::GOAWAY, 0, 0);
+    append_u32(out, last_stream_id);
+    append_u32(out, error);
+}
+
+HpackDecoder::HpackDecoder(size_t max_table_size) :
+    limit_(max_table_size),
+    max_size_(max_table_size),
+    size_(0)
+{}
+
+bool HpackDecoder::huffman_decode(const char *data, size_t size, std::string *out)
+{
+    const HuffmanTree &tree = huffman_tree();
+    int node = 0;
+    int depth = 0;          // bits since the last symbol
+    bool ones = true;       // all of them 1, the prefix of EOS as padding
+    for (size_t i = 0; i < size; i++)
+    {
+        unsigned char byte = static_cast<unsigned char>(data[i]);
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            int b = (byte >> bit) & 1;
+            node = tree.nodes[node].child[b];
+            depth++;
+            ones = ones && b;
+            int symbol = tree.nodes[node].symbol;
+            if (symbol >= 0)
+            {
+                if (symbol == 256)
+                    return false;
+                out->push_back(static_cast<char>(symbol));
+                node = 0;
+                depth = 0;
+                ones = true;
+            }
+        }
+    }
+    // RFC 7541 section 5.2
+    return depth < 8 && ones;
+}
+
+bool HpackDecoder::read_string(const char **p, const char *end, std::string *str)
+{
+    if (*p == end)
+        return false;
+    bool huffman = static_cast<unsigned char>(**p) & 0x80;
+    uint32_t length;
+    if (!read_integer(p, end, 7, &length) || length > static_cast<size_t>(end - *p))
+        return false;
+
+    const char *data = *p;
+    *p += length;
+    if (!huffman)
+    {
+        str->assign(data, length);
+        return true;
+    }
+    str->clear();
+    return huffman_decode(data, length, str);
+}
+
+bool HpackDecoder::entry(size_t index, const std::string **name, const std::string **value) const
+{
+    if (index == 0 || index > k_static_table_size + table_.size())
+        return false;
+    if (index > k_static_table_size)
+    {
+        const auto &e = table_[index - k_static_table_size - 1];
+        *name = &e.first;
+        *value = &e.second;
+    }
+    else
+    {
+        *name = nullptr;
+        *value = nullptr;
+    }
+    return true;
+}
+
+void HpackDecoder::evict(size_t max_size)
+{
+    while (size_ > max_size && !table_.empty())
+    {
+        size_ -= table_.back().first.size() + table_.back().second.size() + 32;
+        table_.pop_back();
+    }
+}
+
+void HpackDecoder::insert(const std::string &name, const std::string &value)
+{
+    size_t size = name.size() + value.size() + 32;
+    // RFC 7541 section 4.4, an entry larger than the table empties it
+    this->evict(size > max_size_ ? 0 : max_size_ - size);
+    if (size <= max_size_)
+    {
+        table_.emplace_front(name, value);
+        size_ += size;
+    }
+}
+
+int HpackDecoder::decode(const char *data, size_t size, size_t max_list_size, Http2Headers *headers)
+{
+    const char *p = data;
+    const char *end = data + size;
+    size_t list_size = 0;
+    bool too_large = false;
+    std::string name;
+    std::string value;
+
+    while (p < end)
+    {
+        unsigned char first = static_cast<unsigned char>(*p);
+        uint32_t index;
+        if (first & 0x80)
+        {
+            // indexed header field
+            const std::string *dyn_name, *dyn_value;
+            if (!read_integer(&p, end, 7, &index) || !this->entry(index, &dyn_name, &dyn_value))
+                return -1;
+            if (dyn_name)
+            {
+                name = *dyn_name;
+                value = *dyn_value;
+            }
+            else
+            {
+                name = k_static_table[index - 1].name;
+                value = k_static_table[index - 1].value;
+            }
+        }
+        else if ((first & 0xe0) == 0x20)
+        {
+            // dynamic table size update
+            if (!read_integer(&p, end, 5, &index) || index > limit_)
+                return -1;
+            max_size_ = index;
+            this->evict(max_size_);
+            continue;
+        }
+        else
+        {
+            // literal, with incremental indexing (01), without indexing (0000)
+            // or never indexed (0001)
+            bool indexing = (first & 0xc0) == 0x40;
+            if (!read_integer(&p, end, indexing ? 6 : 4, &index))
+                return -1;
+            if (index == 0)
+            {
+                if (!this->read_string(&p, end, &name))
+                    return -1;
+            }
+            else
+            {
+                const std::string *dyn_name, *dyn_value;
+                if (!this->entry(index, &dyn_name, &dyn_value))
+                    return -1;
+                name = dyn_name ? *dyn_name : std::string(k_static_table[index - 1].name);
+            }
+            if (!this->read_string(&p, end, &value))
+                return -1;
+            if (indexing)
+                this->insert(name, value);
+        }
+
+        list_size += name.size() + value.size() + 32;
+        if (list_size > max_list_size)
+            too_large = true;
+        if (!too_large)
+            headers->emplace_back(std::move(name), std::move(value));
+    }
+    return too_large ? 1 : 0;
+}
+
+void HpackEncoder::encode_integer(uint32_t value, int prefix_bits, uint8_t first, std::string *out)
+{
+    uint32_t max_prefix = (1u << prefix_bits) - 1;
+    if (value < max_prefix)
+    {
+        out->push_back(static_cast<char>(first | value));
+        return;
+    }
+    out->push_back(static_cast<char>(first | max_prefix));
+    value -= max_prefix;
+    while (value >= 0x80)
+    {
+        out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+void HpackEncoder::encode_status(int status, std::string *out)
+{
+    // the indices 8 to 14 of the static table
+    switch (status)
+    {
+    case 200: out->push_back('\x88'); return;
+    case 204: out->push_back('\x89'); return;
+    case 206: out->push_back('\x8a'); return;
+    case 304: out->push_back('\x8b'); return;
+    case 400: out->push_back('\x8c'); return;
+    case 404: out->push_back('\x8d'); return;
+    case 500: out->push_back('\x8e'); return;
+    default: break;
+    }
+    unsigned int code = static_cast<unsigned int>(status) % 1000;
+    // literal without indexing, the name of index 8
+    out->push_back('\x08');
+    out->push_back('\x03');
+    out->push_back(static_cast<char>('0' + code / 100));
+    out->push_back(static_cast<char>('0' + code / 10 % 10));
+    out->push_back(static_cast<char>('0' + code % 10));
+}
+
+void HpackEncoder::encode(const std::string &name, const std::string &value, std::string *out)
+{
+    const auto &names = static_names();
+    auto it = names.find(name);
+    if (it != names.end())
+    {
+        // the entries with a value follow the first one of their name
+        for (size_t i = it->second; i <= k_static_table_size && name == k_static_table[i - 1].name; i++)
+        {
+            if (k_static_table[i - 1].value[0] != '\0' && value == k_static_table[i - 1].value)
+            {
+                encode_integer(static_cast<uint32_t>(i), 7, 0x80, out);
+                return;
+            }
+        }
+        encode_integer(static_cast<uint32_t>(it->second), 4, 0x00, out);
+    }
+    else
+    {
+        out->push_back('\x00');
+        encode_integer(static_cast<uint32_t>(name.size()), 7, 0x00, out);
+        out->append(name);
+    }
+    encode_integer(static_cast<uint32_t>(value.size()), 7, 0x00, out);
+    out->append(value);
+}
+
+Http2Stats Http2Service::stats() const
+{
+    Http2Stats stats;
+    stats.connections = connections_.load(std::memory_order_relaxed);
+    stats.streams = streams_.load(std::memory_order_relaxed);
+    stats.refused_streams = refused_.load(std::memory_order_relaxed);
+    stats.resets = resets_.load(std::memory_order_relaxed);
+    stats.protocol_errors = errors_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+Http2Connection::Http2Connection(Http2Service *service, size_t size_limit) :
+    service_(service),
+    params_(service->params()),
+    size_limit_(size_limit),
+    decoder_(service->params().header_table_size),
+    continuation_of_(0),
+    block_kind_(REQUEST_HEADERS),
+    block_end_stream_(false),
+    last_stream_id_(0),
+    stream_count_(0),
+    next_stream_(0),
+    peer_initial_window_(k_default_window),
+    peer_max_frame_size_(k_default_max_frame_size),
+    table_size_update_(false),
+    send_window_(k_default_window),
+    recv_window_(std::max(params_.initial_window_size, static_cast<int>(k_default_window))),
+    going_away_(false),
+    goaway_sent_(false),
+    out_off_(0),
+    front_locked_(false),
+    detached_(false),
+    write_error_(false)
+{
+    service_->connections_.fetch_add(1, std::memory_order_relaxed);
+
+    // the server preface, the streams are served without waiting for the ack
+    std::string *out = this->queue_tail();
+    Http2Frame::append_settings(out, {
+        { k_settings_header_table_size, static_cast<uint32_t>(params_.header_table_size) },
+        { k_settings_max_concurrent_streams, static_cast<uint32_t>(params_.max_concurrent_streams) },
+        { k_settings_initial_window_size, static_cast<uint32_t>(params_.initial_window_size) },
+        { k_settings_max_frame_size, static_cast<uint32_t>(params_.max_frame_size) },
+        { k_settings_max_header_list_size, static_cast<uint32_t>(params_.max_header_list_size) },
+    });
+    if (recv_window_ > static_cast<int>(k_default_window))
+        Http2Frame::append_window_update(out, 0, recv_window_ - k_default_window);
+}
+
+void Http2Connection::detach()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    detached_ = true;
+}
+
+int Http2Connection::feed(const char *data, size_t size, std::vector<Http2Request> *requests)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const char *p = data;
+    size_t n = size;
+    if (!in_.empty())
+    {
+        in_.append(data, size);
+        p = in_.data();
+        n = in_.size();
+    }
+
+    size_t off = 0;
+    int ret = 0;
+    while (n - off >= Http2Frame::k_header_size)
+    {
+        Http2Frame frame;
+        frame.parse(p + off);
+        if (frame.length > static_cast<uint32_t>(params_.max_frame_size))
+        {
+            ret = this->connection_error(k_frame_size_error);
+            break;
+        }
+        if (n - off < Http2Frame::k_header_size + frame.length)
+            break;
+
+        ret = this->on_frame(frame, p + off + Http2Frame::k_header_size, requests);
+        off += Http2Frame::k_header_size + frame.length;
+        if (ret < 0)
+            break;
+    }
+
+    if (ret >= 0)
+    {
+        if (p == data)
+            in_.assign(p + off, n - off);
+        else
+            in_.erase(0, off);
+
+        // the DATA is bounded, the rest piles up only when the client sends
+        // frames to answer without reading the answers
+        if (this->queued() > k_max_queued)
+            ret = this->connection_error(k_enhance_your_calm);
+    }
+    return ret;
+}
+
+int Http2Connection::on_frame(const Http2Frame &frame, const char *payload,
+                              std::vector<Http2Request> *requests)
+{
+    // RFC 9113 section 6.10, nothing between a HEADERS and its CONTINUATIONs
+    if (continuation_of_ != 0 &&
+        (frame.type != Http2FrameType::CONTINUATION || frame.stream_id != continuation_of_))
+        return this->connection_error(k_protocol_error);
+
+    switch (frame.type)
+    {
+    case Http2FrameType::DATA:
+        return this->on_data(frame, payload, requests);
+
+    case Http2FrameType::HEADERS:
+        return this->on_headers(frame, payload, requests);
+
+    case Http2FrameType::CONTINUATION:
+        if (continuation_of_ == 0)
+            return this->connection_error(k_protocol_error);
+        header_block_.append(payload, frame.length);
+        if (header_block_.size() > static_cast<size_t>(params_.max_header_list_size))
+            return this->connection_error(k_enhance_your_calm);
+        if (frame.flags & Http2Frame::k_end_headers)
+        {
+            uint32_t stream_id = continuation_of_;
+            continuation_of_ = 0;
+            return this->on_header_block(stream_id, requests);
+        }
+        return 0;
+
+    case Http2FrameType::PRIORITY:
+        if (frame.stream_id == 0)
+            return this->connection_error(k_protocol_error);
+        if (frame.length != 5)
+            return this->connection_error(k_frame_size_error);
+        return 0;
+
+    case Http2FrameType::RST_STREAM:
+    {
+        if (frame.stream_id == 0 || frame.stream_id > last_stream_id_)
+            return this->connection_error(k_protocol_error);
+        if (frame.length != 4)
+            return this->connection_error(k_frame_size_error);
+        // a reply on its way is dropped, the one of a handler later on too
+        auto it = streams_.find(frame.stream_id);
+        if (it != streams_.end())
+        {
+            service_->resets_.fetch_add(1, std::memory_order_relaxed);
+            streams_.erase(it);
+        }
+        return 0;
+    }
+
+    case Http2FrameType::SETTINGS:
+        return this->on_settings(frame, payload);
+
+    case Http2FrameType::PING:
+        if (frame.stream_id != 0)
+            return this->connection_error(k_protocol_error);
+        if (frame.length != 8)
+            return this->connection_error(k_frame_size_error);
+        if (!(frame.flags & Http2Frame::k_ack))
+        {
+            std::string *out = this->queue_tail();
+            Http2Frame::append(out, 8, Http2FrameType::PING, Http2Frame::k_ack, 0);
+            out->append(payload, 8);
+        }
+        return 0;
+
+    case Http2FrameType::GOAWAY:
+        // no new stream from the client, the open ones are replied
+        if (frame.stream_id != 0)
+            return this->connection_error(k_protocol_error);
+        going_away_ = true;
+        return 0;
+
+    case Http2FrameType::WINDOW_UPDATE:
+        return this->on_window_update(frame, payload);
+
+    case Http2FrameType::PUSH_PROMISE:
+        return this->connection_error(k_protocol_error);
+
+    default:
+        // RFC 9113 section 4.1, unknown types are ignored
+        return 0;
+    }
+}
+
+int Http2Connection::on_headers(const Http2Frame &frame, const char *payload,
+                                std::vector<Http2Request> *requests)
+{
+    uint32_t id = frame.stream_id;
+    if (id == 0 || (id & 1) == 0)
+        return this->connection_error(k_protocol_error);
+
+    size_t begin = 0;
+    size_t end = frame.length;
+    if (frame.flags & Http2Frame::k_padded)
+    {
+        if (end < 1)
+            return this->connection_error(k_frame_size_error);
+        size_t pad = static_cast<unsigned char>(payload[0]);
+        begin = 1;
+        if (pad > end - begin)
+            return this->connection_error(k_protocol_error);
+        end -= pad;
+    }
+    if (frame.flags & Http2Frame::k_priority)
+    {
+        if (end - begin < 5)
+            return this->connection_error(k_frame_size_error);
+        begin += 5;
+    }
+
+    auto it = streams_.find(id);
+    if (it != streams_.end() && it->second.state == Stream::RECEIVING)
+    {
+        // trailers of the request, they end it
+        if (!(frame.flags & Http2Frame::k_end_stream))
+            return this->connection_error(k_protocol_error);
+        block_kind_ = REQUEST_TRAILERS;
+    }
+    else if (id <= last_stream_id_)
+    {
+        return this->connection_error(k_stream_closed);
+    }
+    else
+    {
+        last_stream_id_ = id;
+        if (going_away_ || streams_.size() >= static_cast<size_t>(params_.max_concurrent_streams))
+        {
+            // over SETTINGS_MAX_CONCURRENT_STREAMS, decoded all the same
+            // to keep the dynamic table in sync
+            block_kind_ = REFUSED;
+        }
+        else
+        {
+            block_kind_ = REQUEST_HEADERS;
+            Stream &stream = streams_[id];
+            stream.state = Stream::RECEIVING;
+            stream.send_window = peer_initial_window_;
+            stream.recv_window = params_.initial_window_size;
+            stream.data_off = 0;
+            stream.end = false;
+            stream.has_trailers = false;
+        }
+    }
+
+    block_end_stream_ = frame.flags & Http2Frame::k_end_stream;
+    header_block_.assign(payload + begin, end - begin);
+    if (header_block_.size() > static_cast<size_t>(params_.max_header_list_size))
+        return this->connection_error(k_enhance_your_calm);
+    if (!(frame.flags & Http2Frame::k_end_headers))
+    {
+        continuation_of_ = id;
+        return 0;
+    }
+    return this->on_header_block(id, requests);
+}
+
+int Http2Connection::on_header_block(uint32_t stream_id, std::vector<Http2Request> *requests)
+{
+    Stream *stream = nullptr;
+    auto it = streams_.find(stream_id);
+    if (block_kind_ != REFUSED && it != streams_.end() && it->second.state == Stream::RECEIVING)
+        stream = &it->second;
+
+    Http2Headers trailers;
+    Http2Headers *headers = block_kind_ == REQUEST_HEADERS && stream ? &stream->headers : &trailers;
+    int ret = decoder_.decode(header_block_.data(), header_block_.size(),
+                              params_.max_header_list_size, headers);
+    header_block_.clear();
+    if (ret < 0)
+        return this->connection_error(k_compression_error);
+
+    if (block_kind_ == REFUSED)
+    {
+        service_->refused_.fetch_add(1, std::memory_order_relaxed);
+        Http2Frame::append_rst_stream(this->queue_tail(), stream_id, k_refused_stream);
+        return 0;
+    }
+    if (!stream)
+        return 0;
+    if (ret > 0)
+    {
+        this->reset_stream(stream_id, k_enhance_your_calm);
+        return 0;
+    }
+    if (block_end_stream_)
+        this->on_stream_complete(stream_id, *stream, requests);
+    return 0;
+}
+
+int Http2Connection::on_data(const Http2Frame &frame, const char *payload,
+                             std::vector<Http2Request> *requests)
+{
+    uint32_t id = frame.stream_id;
+    if (id == 0 || id > last_stream_id_)
+        return this->connection_error(k_protocol_error);
+
+    // the padding counts in the windows
+    recv_window_ -= frame.length;
+    if (recv_window_ < 0)
+        return this->connection_error(k_flow_control_error);
+    if (recv_window_ < params_.initial_window_size / 2)
+    {
+        Http2Frame::append_window_update(this->queue_tail(), 0,
+                                         params_.initial_window_size - recv_window_);
+        recv_window_ = params_.initial_window_size;
+    }
+
+    // a stream reset or refused, the client had sent it already
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second.state != Stream::RECEIVING)
+        return 0;
+    Stream &stream = it->second;
+
+    size_t begin = 0;
+    size_t end = frame.length;
+    if (frame.flags & Http2Frame::k_padded)
+    {
+        if (end < 1)
+            return this->connection_error(k_frame_size_error);
+        size_t pad = static_cast<unsigned char>(payload[0]);
+        begin = 1;
+        if (pad > end - begin)
+            return this->connection_error(k_protocol_error);
+        end -= pad;
+    }
+
+    stream.recv_window -= frame.length;
+    if (stream.recv_window < 0)
+    {
+        this->reset_stream(id, k_flow_control_error);
+        return 0;
+    }
+    if (stream.body.size() + (end - begin) > size_limit_)
+    {
+        this->reset_stream(id, k_enhance_your_calm);
+        return 0;
+    }
+    stream.body.append(payload + begin, end - begin);
+
+    if (frame.flags & Http2Frame::k_end_stream)
+        this->on_stream_complete(id, stream, requests);
+    else if (stream.recv_window < params_.initial_window_size / 2)
+    {
+        Http2Frame::append_window_update(this->queue_tail(), id,
+                                         params_.initial_window_size - stream.recv_window);
+        stream.recv_window = params_.initial_window_size;
+    }
+    return 0;
+}
+
+int Http2Connection::on_settings(const Http2Frame &frame, const char *payload)
+{
+    if (frame.stream_id != 0)
+        return this->connection_error(k_protocol_error);
+    if (frame.flags & Http2Frame::k_ack)
+    {
+        if (frame.length != 0)
+            return this->connection_error(k_frame_size_error);
+        return 0;
+    }
+    if (frame.length % 6 != 0)
+        return this->connection_error(k_frame_size_error);
+
+    for (size_t i = 0; i < frame.length; i += 6)
+    {
+        uint16_t id = (static_cast<unsigned char>(payload[i]) << 8) |
+                      static_cast<unsigned char>(payload[i + 1]);
+        uint32_t value = read_u32(payload + i + 2);
+        switch (id)
+        {
+        case k_settings_header_table_size:
+            // its decoder may expect the update of a smaller table
+            if (value < 4096)
+                table_size_update_ = true;
+            break;
+        case k_settings_enable_push:
+            if (value > 1)
+                return this->connection_error(k_protocol_error);
+            break;
+        case k_settings_initial_window_size:
+            if (value > k_max_window)
+                return this->connection_error(k_flow_control_error);
+            // RFC 9113 section 6.9.2, the open streams follow
+            for (auto &kv : streams_)
+                kv.second.send_window += static_cast<long long>(value) - peer_initial_window_;
+            peer_initial_window_ = value;
+            break;
+        case k_settings_max_frame_size:
+            if (value < k_default_max_frame_size || value > 0xffffff)
+                return this->connection_error(k_protocol_error);
+            peer_max_frame_size_ = value;
+            break;
+        default:
+            break;
+        }
+    }
+    Http2Frame::append(this->queue_tail(), 0, Http2FrameType::SETTINGS, Http2Frame::k_ack, 0);
+    return 0;
+}
+
+int Http2Connection::on_window_update(const Http2Frame &frame, const char *payload)
+{
+    if (frame.length != 4)
+        return this->connection_error(k_frame_size_error);
+    uint32_t increment = read_u32(payload) & 0x7fffffff;
+    if (frame.stream_id == 0)
+    {
+        if (increment == 0 || send_window_ + increment > k_max_window)
+            return this->connection_error(k_flow_control_error);
+        send_window_ += increment;
+        return 0;
+    }
+
+    auto it = streams_.find(frame.stream_id);
+    if (it != streams_.end())
+    {
+        Stream &stream = it->second;
+        if (increment == 0 || stream.send_window + increment > k_max_window)
+        {
+            this->reset_stream(frame.stream_id, k_flow_control_error);
+            return 0;
+        }
+        stream.send_window += increment;
+    }
+    else if (frame.stream_id > last_stream_id_)
+        return this->connection_error(k_protocol_error);
+    return 0;
+}
+
+void Http2Connection::on_stream_complete(uint32_t stream_id, Stream &stream,
+                                         std::vector<Http2Request> *requests)
+{
+    Http2Request request;
+    request.stream_id = stream_id;
+    if (!Http2Connection::to_message(stream.headers, stream.body, &request.message))
+    {
+        // RFC 9113 section 8.1.1, a malformed request
+        this->reset_stream(stream_id, k_protocol_error);
+        return;
+    }
+    Http2Headers().swap(stream.headers);
+    std::string().swap(stream.body);
+    stream.state = Stream::HANDLING;
+    requests->push_back(std::move(request));
+
+    service_->streams_.fetch_add(1, std::memory_order_relaxed);
+    if (params_.max_streams > 0 && ++stream_count_ >= static_cast<unsigned long long>(params_.max_streams))
+    {
+        going_away_ = true;
+        this->send_goaway(k_no_error);
+    }
+}
+
+void Http2Connection::reset_stream(uint32_t stream_id, uint32_t error)
+{
+    Http2Frame::append_rst_stream(this->queue_tail(), stream_id, error);
+    streams_.erase(stream_id);
+}
+
+int Http2Connection::connection_error(uint32_t error)
+{
+    service_->errors_.fetch_add(1, std::memory_order_relaxed);
+    this->send_goaway(error);
+    return -1;
+}
+
+void Http2Connection::send_goaway(uint32_t error)
+{
+    if (!goaway_sent_)
+    {
+        Http2Frame::append_goaway(this->queue_tail(), last_stream_id_, error);
+        goaway_sent_ = true;
+    }
+}
+
+Http2Connection::Stream *Http2Connection::replying_stream(uint32_t stream_id)
+{
+    if (detached_ || write_error_)
+    {
+        errno = EPIPE;
+        return nullptr;
+    }
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || it->second.state == Stream::RECEIVING)
+    {
+        errno = ECONNRESET;
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void Http2Connection::encode_headers(int status, const Http2Headers &headers, std::string *block)
+{
+    if (table_size_update_)
+    {
+        HpackEncoder::encode_table_size_zero(block);
+        table_size_update_ = false;
+    }
+    HpackEncoder::encode_status(status, block);
+    for (const auto &header : headers)
+        HpackEncoder::encode(header.first, header.second, block);
+}
+
+void Http2Connection::append_header_block(uint32_t stream_id, const std::string &block,
+                                          bool end_stream)
+{
+    // the frames of a block follow each other in the queue
+    size_t off = 0;
+    Http2FrameType type = Http2FrameType::HEADERS;
+    do
+    {
+        size_t length = std::min(block.size() - off, static_cast<size_t>(peer_max_frame_size_));
+        uint8_t flags = off + length == block.size() ? Http2Frame::k_end_headers : 0;
+        if (type == Http2FrameType::HEADERS && end_stream)
+            flags |= Http2Frame::k_end_stream;
+        std::string *out = this->queue_tail();
+        Http2Frame::append(out, length, type, flags, stream_id);
+        out->append(block, off, length);
+        off += length;
+        type = Http2FrameType::CONTINUATION;
+    } while (off < block.size());
+}
+
+int Http2Connection::reply(uint32_t stream_id, int status, const Http2Headers &headers,
+                           const struct iovec *body, int body_cnt, const Http2Headers *trailers)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stream *stream = this->replying_stream(stream_id);
+    if (!stream || stream->state != Stream::HANDLING)
+        return -1;
+
+    size_t body_size = 0;
+    for (int i = 0; i < body_cnt; i++)
+        body_size += body[i].iov_len;
+    bool has_trailers = trailers && !trailers->empty();
+
+    std::string block;
+    this->encode_headers(status, headers, &block);
+    if (body_size == 0 && !has_trailers)
+    {
+        this->append_header_block(stream_id, block, true);
+        streams_.erase(stream_id);
+        return 0;
+    }
+
+    this->append_header_block(stream_id, block, false);
+    stream->state = Stream::SENDING;
+    stream->data.reserve(body_size);
+    for (int i = 0; i < body_cnt; i++)
+        stream->data.append(static_cast<const char *>(body[i].iov_base), body[i].iov_len);
+    stream->end = true;
+    if (has_trailers)
+    {
+        for (const auto &header : *trailers)
+            HpackEncoder::encode(header.first, header.second, &stream->trailers);
+        stream->has_trailers = true;
+    }
+    return 0;
+}
+
+int Http2Connection::reply_headers(uint32_t stream_id, int status, const Http2Headers &headers)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stream *stream = this->replying_stream(stream_id);
+    if (!stream || stream->state != Stream::HANDLING)
+        return -1;
+
+    std::string block;
+    this->encode_headers(status, headers, &block);
+    this->append_header_block(stream_id, block, false);
+    stream->state = Stream::SENDING;
+    return 0;
+}
+
+int Http2Connection::reply_data(uint32_t stream_id, const struct iovec *data, int cnt)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stream *stream = this->replying_stream(stream_id);
+    if (!stream || stream->state != Stream::SENDING || stream->end)
+        return -1;
+
+    // what is sent already goes before it is appended to
+    if (stream->data_off > 0)
+    {
+        stream->data.erase(0, stream->data_off);
+        stream->data_off = 0;
+    }
+    for (int i = 0; i < cnt; i++)
+        stream->data.append(static_cast<const char *>(data[i].iov_base), data[i].iov_len);
+    return 0;
+}
+
+int Http2Connection::reply_end(uint32_t stream_id, const Http2Headers *trailers)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stream *stream = this->replying_stream(stream_id);
+    if (!stream || stream->state != Stream::SENDING || stream->end)
+        return -1;
+
+    stream->end = true;
+    if (trailers && !trailers->empty())
+    {
+        for (const auto &header : *trailers)
+            HpackEncoder::encode(header.first, header.second, &stream->trailers);
+        stream->has_trailers = true;
+    }
+    return 0;
+}
+
+void Http2Connection::reset(uint32_t stream_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (streams_.count(stream_id) == 0)
+        return;
+    this->reset_stream(stream_id, k_cancel);
+}
+
+void Http2Connection::go_away()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    going_away_ = true;
+    this->send_goaway(k_no_error);
+}
+
+bool Http2Connection::going_away() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return going_away_;
+}
+
+size_t Http2Connection::open_streams() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return streams_.size();
+}
+
+bool Http2Connection::finished() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return write_error_ || (goaway_sent_ && streams_.empty() && out_.empty());
+}
+
+std::string *Http2Connection::queue_tail()
+{
+    // after EAGAIN the same bytes are written again, TLS needs it
+    if (out_.empty() || out_.back().size() >= k_chunk_size || (out_.size() == 1 && front_locked_))
+        out_.emplace_back();
+    return &out_.back();
+}
+
+size_t Http2Connection::queued() const
+{
+    size_t size = 0;
+    for (const std::string &chunk : out_)
+        size += chunk.size();
+    return size - out_off_;
+}
+
+void Http2Connection::fill_data()
+{
+    // a frame of each stream in turn, while the windows allow and the queue is short
+    size_t waiting = 0;     // streams in a row with nothing to send
+    auto it = streams_.lower_bound(next_stream_);
+    while (!streams_.empty() && waiting < streams_.size() && this->queued() < k_high_water)
+    {
+        if (it == streams_.end())
+            it = streams_.begin();
+        uint32_t stream_id = it->first;
+        Stream &stream = it->second;
+        size_t left = stream.data.size() - stream.data_off;
+        long long window = std::min(send_window_, stream.send_window);
+        bool closed = false;
+
+        if (stream.state != Stream::SENDING || (left > 0 && window <= 0) || (left == 0 && !stream.end))
+        {
+            ++it;
+            waiting++;
+            continue;
+        }
+
+        if (left > 0)
+        {
+            size_t length = std::min({ left, static_cast<size_t>(window),
+                                       static_cast<size_t>(peer_max_frame_size_) });
+            closed = length == left && stream.end && !stream.has_trailers;
+            std::string *out = this->queue_tail();
+            Http2Frame::append(out, length, Http2FrameType::DATA,
+                               closed ? Http2Frame::k_end_stream : 0, stream_id);
+            out->append(stream.data, stream.data_off, length);
+            stream.data_off += length;
+            send_window_ -= length;
+            stream.send_window -= length;
+            if (length == left)
+            {
+                std::string().swap(stream.data);
+                stream.data_off = 0;
+            }
+        }
+        else
+        {
+            // the trailers, else an empty DATA for the END_STREAM
+            if (stream.has_trailers)
+                this->append_header_block(stream_id, stream.trailers, true);
+            else
+                Http2Frame::append(this->queue_tail(), 0, Http2FrameType::DATA,
+                                   Http2Frame::k_end_stream, stream_id);
+            closed = true;
+        }
+
+        next_stream_ = stream_id + 1;
+        waiting = 0;
+        if (closed)
+            it = streams_.erase(it);
+        else
+            ++it;
+    }
+}
+
+int Http2Connection::flush(Http2Transport *transport)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (write_error_)
+        return -1;
+
+    this->fill_data();
+    while (!out_.empty())
+    {
+        const std::string &chunk = out_.front();
+        if (out_off_ < chunk.size())
+        {
+            front_locked_ = true;
+            int n = transport->write(chunk.data() + out_off_, chunk.size() - out_off_);
+            if (n < 0)
+            {
+                // the client reads slower than the replies come
+                if (errno == EAGAIN)
+                    return 0;
+                // the connection is lost, its reader closes it
+                write_error_ = true;
+                out_.clear();
+                out_off_ = 0;
+                front_locked_ = false;
+                return -1;
+            }
+            out_off_ += n;
+            if (out_off_ < chunk.size())
+                continue;
+        }
+        out_.pop_front();
+        out_off_ = 0;
+        front_locked_ = false;
+        this->fill_data();
+    }
+    return 0;
+}
+
+bool Http2Connection::to_message(const Http2Headers &headers, const std::string &body,
+                                 std::string *message)
+{
+    const std::string *method = nullptr;
+    const std::string *path = nullptr;
+    const std::string *authority = nullptr;
+    std::string cookie;
+    bool has_host = false;
+    bool has_content_length = false;
+    std::string fields;
+
+    for (const auto &header : headers)
+    {
+        const std::string &name = header.first;
+        const std::string &value = header.second;
+        if (!valid_field(value, VALUE))
+            return false;
+        if (!name.empty() && name[0] == ':')
+        {
+            if (name == ":method")
+                method = &value;
+            else if (name == ":path")
+                path = &value;
+            else if (name == ":authority")
+                authority = &value;
+            continue;
+        }
+        if (!valid_field(name, NAME) || name.empty() || is_connection_header(name))
+            return false;
+        if (name == "cookie")
+        {
+            // RFC 9113 section 8.2.3
+            if (!cookie.empty())
+                cookie.append("; ");
+            cookie.append(value);
+            continue;
+        }
+        if (name == "content-length")
+        {
+            has_content_length = true;
+            continue;
+        }
+        if (name == "host")
+            has_host = true;
+        fields.append(name).append(": ").append(value).append("\r\n");
+    }
+
+    if (!method || !path || method->empty() || path->empty() ||
+        !valid_field(*method, TOKEN) || !valid_field(*path, TOKEN))
+        return false;
+
+    message->clear();
+    message->reserve(fields.size() + body.size() + 128);
+    message->append(*method).append(" ").append(*path).append(" HTTP/1.1\r\n");
+    if (authority && !has_host)
+        message->append("host: ").append(*authority).append("\r\n");
+    message->append(fields);
+    if (!cookie.empty())
+        message->append("cookie: ").append(cookie).append("\r\n");
+    if (!body.empty() || has_content_length)
+        message->append("content-length: ").append(std::to_string(body.size())).append("\r\n");
+    message->append("\r\n").append(body);
+    return true;
+}
+
+}  // namespace wfrest
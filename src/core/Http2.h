@@ -0,0 +1,360 @@
+#ifndef WFREST_HTTP2_H_
+#define WFREST_HTTP2_H_
+
+#include <sys/uio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <utility>
+#include <mutex>
+#include <atomic>
+
+#include "Noncopyable.h"
+
+namespace wfrest
+{
+
+struct Http2Params
+{
+    // SETTINGS_HEADER_TABLE_SIZE, the HPACK dynamic table of the request headers
+    int header_table_size = 4096;
+    // SETTINGS_INITIAL_WINDOW_SIZE, also the window of the connection :
+    // the request body a client sends before it waits for a WINDOW_UPDATE
+    int initial_window_size = 1 << 20;
+    // SETTINGS_MAX_FRAME_SIZE of the frames the clients send
+    int max_frame_size = 16384;
+    // SETTINGS_MAX_HEADER_LIST_SIZE, the decoded headers of a request
+    int max_header_list_size = 64 * 1024;
+    // SETTINGS_MAX_CONCURRENT_STREAMS, the requests of a connection served at once
+    int max_concurrent_streams = 100;
+    // requests of a connection before a GOAWAY, the client reconnects, 0 for no limit
+    int max_streams = 0;
+};
+
+struct Http2Stats
+{
+    unsigned long long connections;
+    unsigned long long streams;
+    unsigned long long refused_streams;    // over the concurrency limit, RST_STREAM REFUSED_STREAM
+    unsigned long long resets;             // RST_STREAM of the clients
+    unsigned long long protocol_errors;    // connections closed with a GOAWAY error
+};
+
+using Http2Headers = std::vector<std::pair<std::string, std::string>>;
+
+// RFC 9113 section 6
+enum class Http2FrameType : uint8_t
+{
+    DATA = 0x0,
+    HEADERS = 0x1,
+    PRIORITY = 0x2,
+    RST_STREAM = 0x3,
+    SETTINGS = 0x4,
+    PUSH_PROMISE = 0x5,
+    PING = 0x6,
+    GOAWAY = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION = 0x9,
+};
+
+struct Http2Frame
+{
+    static const size_t k_header_size = 9;
+
+    // the flags, ACK of SETTINGS and PING shares the bit of END_STREAM
+    static const uint8_t k_end_stream = 0x1;
+    static const uint8_t k_ack = 0x1;
+    static const uint8_t k_end_headers = 0x4;
+    static const uint8_t k_padded = 0x8;
+    static const uint8_t k_priority = 0x20;
+
+    // "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+    static const char k_preface[];
+    static const size_t k_preface_size = 24;
+
+    uint32_t length;
+    Http2FrameType type;
+    uint8_t flags;
+    uint32_t stream_id;
+
+    // k_header_size bytes
+    void parse(const char *p);
+
+    void append_to(std::string *out) const;
+
+    static void append(std::string *out, size_t length, Http2FrameType type,
+                       uint8_t flags, uint32_t stream_id)
+    {
+        Http2Frame frame{ static_cast<uint32_t>(length), type, flags, stream_id };
+        frame.append_to(out);
+    }
+
+    static void append_settings(std::string *out, const std::vector<std::pair<uint16_t, uint32_t>> &settings);
+
+    static void append_window_update(std::string *out, uint32_t stream_id, uint32_t increment);
+
+    static void append_rst_stream(std::string *out, uint32_t stream_id, uint32_t error);
+
+    static void append_goaway(std::string *out, uint32_t last_stream_id, uint32_t error);
+};
+
+// RFC 7541. The header blocks of one direction of a connection share the dynamic table.
+class HpackDecoder
+{
+public:
+    // max_table_size : the SETTINGS_HEADER_TABLE_SIZE sent to the peer
+    explicit HpackDecoder(size_t max_table_size = 4096);
+
+    // A whole header block, HEADERS and its CONTINUATIONs, appended to *headers.
+    // -1 on a compression error, the connection is lost ; 1 past max_list_size
+    // (RFC 9113 section 6.5.2) : the block is decoded for the dynamic table only.
+    int decode(const char *data, size_t size, size_t max_list_size, Http2Headers *headers);
+
+    static bool huffman_decode(const char *data, size_t size, std::string *out);
+
+private:
+    bool read_string(const char **p, const char *end, std::string *str);
+
+    bool entry(size_t index, const std::string **name, const std::string **value) const;
+
+    void insert(const std::string &name, const std::string &value);
+
+    void evict(size_t max_size);
+
+private:
+    const size_t limit_;
+    size_t max_size_;       // of the last dynamic table size update
+    size_t size_;           // RFC 7541 section 4.1
+    std::deque<std::pair<std::string, std::string>> table_;     // the newest first
+};
+
+// Never touches the dynamic table : a static table index, else a literal without
+// indexing, so the decoder of the peer has nothing to keep in sync.
+class HpackEncoder
+{
+public:
+    // one byte for the statuses of the static table
+    static void encode_status(int status, std::string *out);
+
+    // name in lower case
+    static void encode(const std::string &name, const std::string &value, std::string *out);
+
+    // the dynamic table of the peer emptied and capped to 0, first in a header block
+    static void encode_table_size_zero(std::string *out) { out->push_back('\x20'); }
+
+    static void encode_integer(uint32_t value, int prefix_bits, uint8_t first, std::string *out);
+};
+
+// Counters of the connections of a server, see HttpServer::http2()
+class Http2Service : public Noncopyable
+{
+public:
+    explicit Http2Service(const Http2Params &params) :
+        params_(params), connections_(0), streams_(0), refused_(0), resets_(0), errors_(0)
+    {}
+
+    const Http2Params &params() const { return params_; }
+
+    Http2Stats stats() const;
+
+private:
+    const Http2Params params_;
+    std::atomic<unsigned long long> connections_;
+    std::atomic<unsigned long long> streams_;
+    std::atomic<unsigned long long> refused_;
+    std::atomic<unsigned long long> resets_;
+    std::atomic<unsigned long long> errors_;
+
+    friend class Http2Connection;
+};
+
+// a complete request of a stream, in its HTTP/1.1 form
+struct Http2Request
+{
+    uint32_t stream_id;
+    std::string message;
+};
+
+// Where the reader of a connection writes its frames, with the connection locked
+class Http2Transport
+{
+public:
+    virtual ~Http2Transport() = default;
+
+    // Non-blocking : the bytes taken, -1 with errno EAGAIN if none can be now.
+    // The same bytes are retried at the same address after EAGAIN.
+    virtual int write(const char *data, size_t size) = 0;
+};
+
+/*
+The HTTP/2 side of a connection, from the client preface on. Each stream
+becomes an HTTP/1.1 request which goes through the http parser as usual,
+so it is served by the same route table, aspects and handlers, and up to
+max_concurrent_streams of them are served at once.
+
+The frames go through an output queue : the control frames and the reply
+headers as they come, the DATA of the replies round robin between the
+streams, within the windows of the client and only while the queue is
+short, so a client which does not read holds its replies in their streams
+rather than in the socket. The replies are queued from any thread, and
+only the reader of the connection writes the queue, with flush() after
+feed(), so nothing else touches the socket : the frames of a reply go out
+as the next frames of the client are read, and what the socket does not
+take waits for the ones after.
+*/
+class Http2Connection : public Noncopyable
+{
+public:
+    // size_limit : the request size limit of the server, headers and body
+    Http2Connection(Http2Service *service, size_t size_limit);
+
+    // the reader is gone, the replies fail from now on
+    void detach();
+
+    // Frames of the client after the preface, the requests they complete are
+    // appended to *requests. -1 on a connection error, the GOAWAY is queued
+    // and the connection is to be closed.
+    int feed(const char *data, size_t size, std::vector<Http2Request> *requests);
+
+    // Writes the queue to transport as it takes it, the settings of the server
+    // first. By the reader only, after feed(). -1 once the connection is lost.
+    int flush(Http2Transport *transport);
+
+    // The reply of a stream : HEADERS, the body as DATA, then the trailers if
+    // any. The body is copied and queued. -1 if the stream is gone, reset by
+    // the client.
+    int reply(uint32_t stream_id, int status, const Http2Headers &headers,
+              const struct iovec *body, int body_cnt, const Http2Headers *trailers);
+
+    // A reply sent as it is made : the headers, the data as often as needed,
+    // then the end with the trailers if any. -1 if the stream is gone.
+    int reply_headers(uint32_t stream_id, int status, const Http2Headers &headers);
+
+    int reply_data(uint32_t stream_id, const struct iovec *data, int cnt);
+
+    int reply_end(uint32_t stream_id, const Http2Headers *trailers);
+
+    // RST_STREAM of a stream which is not replied
+    void reset(uint32_t stream_id);
+
+    // No new stream from now on, the GOAWAY is sent with the last stream id.
+    // The client closes the connection once the open streams are replied.
+    void go_away();
+
+    bool going_away() const;
+
+    // streams open, from the request to the end of the reply
+    size_t open_streams() const;
+
+    // GOAWAY sent and nothing left to write
+    bool finished() const;
+
+    // Request headers to the HTTP/1.1 form, false without :method or :path.
+    // The cookie headers are joined, :authority becomes Host.
+    static bool to_message(const Http2Headers &headers, const std::string &body,
+                           std::string *message);
+
+private:
+    struct Stream
+    {
+        enum State { RECEIVING, HANDLING, SENDING };
+
+        State state;
+        Http2Headers headers;       // of the request
+        std::string body;
+        long long send_window;
+        int recv_window;
+
+        std::string data;           // of the reply, from data_off on not sent yet
+        size_t data_off;
+        bool end;                   // the reply is complete
+        bool has_trailers;
+        std::string trailers;       // the header block
+    };
+
+    // with the mutex locked, -1 on a connection error
+    int on_frame(const Http2Frame &frame, const char *payload,
+                 std::vector<Http2Request> *requests);
+
+    int on_headers(const Http2Frame &frame, const char *payload,
+                   std::vector<Http2Request> *requests);
+
+    int on_header_block(uint32_t stream_id, std::vector<Http2Request> *requests);
+
+    int on_data(const Http2Frame &frame, const char *payload,
+                std::vector<Http2Request> *requests);
+
+    int on_settings(const Http2Frame &frame, const char *payload);
+
+    int on_window_update(const Http2Frame &frame, const char *payload);
+
+    void on_stream_complete(uint32_t stream_id, Stream &stream,
+                            std::vector<Http2Request> *requests);
+
+    void reset_stream(uint32_t stream_id, uint32_t error);
+
+    int connection_error(uint32_t error);
+
+    void send_goaway(uint32_t error);
+
+    // the stream of a reply, nullptr if it is gone
+    Stream *replying_stream(uint32_t stream_id);
+
+    void encode_headers(int status, const Http2Headers &headers, std::string *block);
+
+    // HEADERS then CONTINUATIONs, each within the max frame size of the client
+    void append_header_block(uint32_t stream_id, const std::string &block,
+                             bool end_stream);
+
+    // where the next frames go
+    std::string *queue_tail();
+
+    // bytes in the queue not written yet
+    size_t queued() const;
+
+    // DATA and trailers of the sending streams while the queue is short
+    void fill_data();
+
+private:
+    Http2Service *service_;
+    const Http2Params &params_;
+    const size_t size_limit_;
+    mutable std::mutex mutex_;
+
+    std::string in_;                // a partial frame
+    HpackDecoder decoder_;
+    enum BlockKind { REQUEST_HEADERS, REQUEST_TRAILERS, REFUSED };
+
+    std::string header_block_;      // HEADERS until END_HEADERS
+    uint32_t continuation_of_;      // stream of the header block, 0 if none
+    BlockKind block_kind_;
+    bool block_end_stream_;
+
+    std::map<uint32_t, Stream> streams_;    // open ones
+    uint32_t last_stream_id_;
+    unsigned long long stream_count_;
+    uint32_t next_stream_;          // of the round robin of the replies
+
+    // of the client
+    uint32_t peer_initial_window_;
+    uint32_t peer_max_frame_size_;
+    bool table_size_update_;
+    long long send_window_;         // of the connection
+    int recv_window_;               // of the connection
+
+    bool going_away_;
+    bool goaway_sent_;
+
+    // the output queue
+    std::deque<std::string> out_;
+    size_t out_off_;                // written of the front chunk
+    bool front_locked_;             // a write of the front chunk was tried, it is not appended to
+    bool detached_;
+    bool write_error_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_HTTP2_H_
@@ -86,30 +86,7 @@ void multipart_parser_userdata::handle_header()
     if (header_field.empty() || header_value.empty()) return;
     if (strcasecmp(header_field.c_str(), "Content-Disposition") == 0)
     {
-        // Content-Disposition: attachment
-        // Content-Disposition: attachment; filename="filename.jpg"
-        // Content-Disposition: form-data; name="avatar"; filename="user.jpg"
-        StringPiece header_val_piece(header_value);
-        std::vector<StringPiece> dispo_list = StrUtil::split_piece<StringPiece>(header_val_piece, ';');
-
-        for (auto &dispo: dispo_list)
-        {
-            auto kv = StrUtil::split_piece<StringPiece>(StrUtil::trim(dispo), '=');
-            if (kv.size() == 2)
-            {
-                // name="file"
-                // kv[0] is key(name)
-                // kv[1] is value("file")
-                StringPiece value = StrUtil::trim_pairs(kv[1], R"(""'')");
-                if (kv[0].starts_with(StringPiece("name")))
-                {
-                    name = value.as_string();
-                } else if (kv[0].starts_with(StringPiece("filename")))
-                {
-                    filename = value.as_string();
-                }
-            }
-        }
+        MultiPartForm::parse_content_disposition(header_value, &name, &filename);
     }
     header_field.clear();
     header_value.clear();
@@ -129,6 +106,34 @@ void multipart_parser_userdata::handle_data()
     part_data.clear();
 }
 
+void MultiPartForm::parse_content_disposition(const StringPiece &header_value,
+                                              std::string *name, std::string *filename)
+{
+    // Content-Disposition: attachment
+    // Content-Disposition: attachment; filename="filename.jpg"
+    // Content-Disposition: form-data; name="avatar"; filename="user.jpg"
+    std::vector<StringPiece> dispo_list = StrUtil::split_piece<StringPiece>(header_value, ';');
+
+    for (auto &dispo: dispo_list)
+    {
+        auto kv = StrUtil::split_piece<StringPiece>(StrUtil::trim(dispo), '=');
+        if (kv.size() == 2)
+        {
+            // name="file"
+            // kv[0] is key(name)
+            // kv[1] is value("file")
+            StringPiece value = StrUtil::trim_pairs(kv[1], R"(""'')");
+            if (kv[0].starts_with(StringPiece("name")))
+            {
+                *name = value.as_string();
+            } else if (kv[0].starts_with(StringPiece("filename")))
+            {
+                *filename = value.as_string();
+            }
+        }
+    }
+}
+
 MultiPartForm::MultiPartForm()
 {
     settings_ = {
@@ -35,6 +35,10 @@ public:
     void set_boundary(const std::string &boundary)
     { boundary_ = boundary; }
 
+    // name and filename of a Content-Disposition header value
+    static void parse_content_disposition(const StringPiece &header_value,
+                                          std::string *name, std::string *filename);
+
 public:
     static const std::string k_default_boundary;
 
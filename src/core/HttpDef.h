@@ -2,6 +2,7 @@
 #define WFREST_HTTPDEF_H_
 
 #include <string>
+#include "StringPiece.h"
 
 namespace wfrest
 {
@@ -44,9 +45,25 @@ public:
 
     static std::string to_str_by_suffix(const std::string &suffix);
 
-    static enum http_content_type to_enum(const std::string &content_type_str);
+    // The media type before the parameters, ASCII case-insensitive.
+    // A structured syntax suffix is tried without it : image/svg+xml is IMAGE_SVG
+    static enum http_content_type to_enum(const StringPiece &content_type_str);
 
-    static enum http_content_type to_enum_by_suffix(const std::string &suffix);
+    static enum http_content_type to_enum_by_suffix(const StringPiece &suffix);
+
+public:
+    // to_str() without a copy, empty if none
+    static StringPiece view(enum http_content_type type);
+
+    // The media type of a file suffix, empty if none, without a copy.
+    // The suffixes are the ones of the media-types package, about 1500,
+    // ASCII case-insensitive, and the ones of load_mime_types().
+    static StringPiece view_by_suffix(const StringPiece &suffix);
+
+    // Adds the suffixes of a mime.types file, in the format of /etc/mime.types
+    // or of the types block of nginx, which take over the built-in ones.
+    // Rebuilds the lookup table : to be called before the server starts.
+    static int load_mime_types(const std::string &path);
 };
 
 } // wfrest
@@ -100,16 +100,11 @@ int HttpFile::send_file(const std::string &path, size_t file_start, size_t file_
         return StatusFileRangeInvalid;
     }
 
-    http_content_type content_type = CONTENT_TYPE_NONE;
-    std::string suffix = PathUtil::suffix(path);
-    if(!suffix.empty())
-    {
-        content_type = ContentType::to_enum_by_suffix(suffix);
-    }
-    if (content_type == CONTENT_TYPE_NONE || content_type == CONTENT_TYPE_UNDEFINED) {
-        content_type = APPLICATION_OCTET_STREAM;
+    StringPiece content_type = ContentType::view_by_suffix(PathUtil::suffix(path));
+    if (content_type.empty()) {
+        content_type = ContentType::view(APPLICATION_OCTET_STREAM);
     }
-    resp->headers["Content-Type"] = ContentType::to_str(content_type);
+    resp->headers["Content-Type"] = content_type.as_string();
 
     size_t size = end - start;
     void *buf = malloc(size);
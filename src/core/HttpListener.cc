@@ -0,0 +1,96 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "HttpListener.h"
+#include "HttpServer.h"
+#include "HttpServerTask.h"
+
+using namespace wfrest;
+
+HttpListener::HttpListener(HttpServer *server, const std::string &name,
+                           const struct WFServerParams &params, bool reuse_port) :
+        WFServer(&params, std::bind(&HttpServer::process, server, std::placeholders::_1)),
+        server_(server),
+        name_(name),
+        reuse_port_(reuse_port),
+        listen_fd_(-1),
+        accepted_(0),
+        requests_(0)
+{}
+
+HttpListener::~HttpListener()
+{
+    if (!unix_path_.empty())
+        unlink(unix_path_.c_str());
+}
+
+int HttpListener::listen(const struct sockaddr *addr, socklen_t addrlen,
+                         const char *cert_file, const char *key_file)
+{
+    std::string unix_path;
+    if (addr->sa_family == AF_UNIX)
+    {
+        unix_path = reinterpret_cast<const struct sockaddr_un *>(addr)->sun_path;
+        // left by a previous run, bind() would fail with EADDRINUSE.
+        // An inherited socket is still bound to it.
+        struct stat st;
+        if (!unix_path.empty() && !server_->inherits(name_) &&
+            lstat(unix_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(unix_path.c_str());
+    }
+
+    int ret;
+    if (cert_file && key_file)
+        ret = this->start(addr, addrlen, cert_file, key_file);
+    else
+        ret = this->start(addr, addrlen);
+    if (ret == 0)
+        unix_path_ = std::move(unix_path);
+    return ret;
+}
+
+ListenerStats HttpListener::stats() const
+{
+    return ListenerStats{name_, this->get_conn_count(),
+                         accepted_.load(std::memory_order_relaxed),
+                         requests_.load(std::memory_order_relaxed)};
+}
+
+int HttpListener::create_listen_fd()
+{
+    int fd = server_->inherit_listen_fd(name_, WFServer::create_listen_fd());
+    if (fd >= 0 && reuse_port_)
+    {
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof reuse);
+    }
+    listen_fd_ = fd;
+    return fd;
+}
+
+WFConnection *HttpListener::new_connection(int accept_fd)
+{
+    accepted_.fetch_add(1, std::memory_order_relaxed);
+    if (!server_->admit_connection(this->get_conn_count(), this->params.max_connections))
+    {
+        errno = EMFILE;
+        return nullptr;
+    }
+    return WFServer::new_connection(accept_fd);
+}
+
+CommSession *HttpListener::new_session(long long seq, CommConnection *conn)
+{
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    auto *task = new HttpServerTask(this, this->process);
+    server_->init_session(task, this->params, seq);
+    return task;
+}
+
+SSL_CTX *HttpListener::new_ssl_ctx()
+{
+    return server_->configure_ssl_ctx(WFServer::new_ssl_ctx());
+}
@@ -0,0 +1,83 @@
+#ifndef WFREST_HTTPLISTENER_H_
+#define WFREST_HTTPLISTENER_H_
+
+#include "workflow/WFHttpServer.h"
+
+#include <string>
+#include <atomic>
+
+#include "HttpMsg.h"
+#include "Noncopyable.h"
+
+namespace wfrest
+{
+
+class HttpServer;
+
+// Counters of one listening socket, see HttpServer::listener_stats()
+struct ListenerStats
+{
+    std::string name;
+    size_t connections;                 // open now
+    unsigned long long accepted;        // connections since start
+    unsigned long long requests;
+};
+
+// An endpoint added by HttpServer::listen() or listen_unix()
+struct ListenerParams
+{
+    // in listener_stats(), "tcp:host:port" or "unix:path" if empty
+    std::string name;
+    // timeouts, size limit and max connections of this endpoint only
+    struct WFServerParams server_params = SERVER_PARAMS_DEFAULT;
+    // https if both are set
+    std::string cert_file;
+    std::string key_file;
+};
+
+/*
+An extra listening socket of a HttpServer, with its own connections.
+Its requests go through the routes, aspects, metrics ... of the server.
+*/
+class HttpListener : public WFServer<HttpReq, HttpResp>, public Noncopyable
+{
+public:
+    HttpListener(HttpServer *server, const std::string &name,
+                 const struct WFServerParams &params, bool reuse_port);
+
+    ~HttpListener();
+
+    // start() which also replaces a stale unix socket file and removes it when destroyed
+    int listen(const struct sockaddr *addr, socklen_t addrlen,
+               const char *cert_file, const char *key_file);
+
+    ListenerStats stats() const;
+
+    // -1 before start()
+    int listen_fd() const { return listen_fd_; }
+
+    // the unix socket file is left to the next process of an upgrade
+    void keep_socket_file() { unix_path_.clear(); }
+
+protected:
+    int create_listen_fd() override;
+
+    WFConnection *new_connection(int accept_fd) override;
+
+    CommSession *new_session(long long seq, CommConnection *conn) override;
+
+    SSL_CTX *new_ssl_ctx() override;
+
+private:
+    HttpServer *server_;
+    std::string name_;
+    bool reuse_port_;
+    int listen_fd_;
+    std::string unix_path_;
+    std::atomic<unsigned long long> accepted_;
+    std::atomic<unsigned long long> requests_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_HTTPLISTENER_H_
@@ -0,0 +1,297 @@
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <map>
+#include <unordered_map>
+
+#include "HttpMetrics.h"
+#include "HttpServerTask.h"
+#include "VerbHandler.h"
+#include "Histogram.h"
+#include "CodeUtil.h"
+
+namespace wfrest
+{
+
+static const int k_max_status_code = 600;
+
+// Written by a single thread, summed with the other threads' on scrape.
+struct RouteMetrics
+{
+    std::string route;
+    Verb verb;
+    std::atomic<uint64_t> started{0};
+    std::atomic<uint64_t> finished{0};
+    std::atomic<uint64_t> request_bytes{0};
+    std::atomic<uint64_t> response_bytes{0};
+    std::atomic<uint64_t> status[k_max_status_code];
+    Histogram latency;
+
+    RouteMetrics()
+    {
+        for (auto &cnt : status)
+            cnt.store(0, std::memory_order_relaxed);
+    }
+};
+
+namespace
+{
+
+struct MetricsKey
+{
+    unsigned long long id;      // HttpMetrics instance, never reused
+    const char *route;          // the interned route pattern, see HttpReq::route_pattern()
+    int verb;
+
+    bool operator==(const MetricsKey &other) const
+    {
+        return id == other.id && route == other.route && verb == other.verb;
+    }
+};
+
+struct MetricsKeyHash
+{
+    size_t operator()(const MetricsKey &key) const
+    {
+        return std::hash<const void *>()(key.route) ^ (key.id << 3) ^ key.verb;
+    }
+};
+
+thread_local std::unordered_map<MetricsKey, RouteMetrics *, MetricsKeyHash> local_metrics_map;
+
+std::atomic<unsigned long long> next_metrics_id{1};
+
+inline void add(std::atomic<uint64_t> &counter, uint64_t n)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline uint64_t get(const std::atomic<uint64_t> &counter)
+{
+    return counter.load(std::memory_order_relaxed);
+}
+
+// histogram buckets exported, in microseconds
+const struct
+{
+    uint64_t us;
+    const char *le;
+} k_latency_buckets[] = {
+    { 100, "0.0001" }, { 250, "0.00025" }, { 500, "0.0005" },
+    { 1000, "0.001" }, { 2500, "0.0025" }, { 5000, "0.005" },
+    { 10000, "0.01" }, { 25000, "0.025" }, { 50000, "0.05" },
+    { 100000, "0.1" }, { 250000, "0.25" }, { 500000, "0.5" },
+    { 1000000, "1" }, { 2500000, "2.5" }, { 5000000, "5" }, { 10000000, "10" },
+};
+
+struct RouteSummary
+{
+    uint64_t started = 0;
+    uint64_t finished = 0;
+    uint64_t request_bytes = 0;
+    uint64_t response_bytes = 0;
+    std::map<int, uint64_t> status;
+    std::vector<uint64_t> buckets;
+    uint64_t latency_sum = 0;
+
+    RouteSummary() : buckets(Histogram::k_bucket_count, 0) {}
+};
+
+std::string escape_label(const std::string &value)
+{
+    std::string res;
+    res.reserve(value.size());
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            res.push_back('\\');
+            res.push_back(c);
+        }
+        else if (c == '\n')
+        {
+            res.append("\\n");
+        }
+        else
+        {
+            res.push_back(c);
+        }
+    }
+    return res;
+}
+
+}  // namespace
+
+HttpMetrics::HttpMetrics() : id_(next_metrics_id++)
+{}
+
+HttpMetrics::~HttpMetrics() = default;
+
+long long HttpMetrics::now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+RouteMetrics *HttpMetrics::local_metrics(const StringPiece &route, const char *method)
+{
+    Verb verb = str_to_verb(method);
+    MetricsKey key{id_, route.data(), static_cast<int>(verb)};
+    auto it = local_metrics_map.find(key);
+    if (it != local_metrics_map.end())
+        return it->second;
+
+    // first request of this route in this thread
+    auto *metrics = new RouteMetrics;
+    if (route.empty())
+        metrics->route = "unmatched";
+    else if (CodeUtil::is_url_encode(route.as_string()))
+        metrics->route = CodeUtil::url_decode(route.as_string());
+    else
+        metrics->route = route.as_string();
+    metrics->verb = verb;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        metrics_list_.emplace_back(metrics);
+    }
+    local_metrics_map.emplace(key, metrics);
+    return metrics;
+}
+
+void HttpMetrics::track(HttpServerTask *server_task, long long start_us)
+{
+    HttpReq *req = server_task->get_req();
+    StringPiece route = req->route_pattern();
+    add(this->local_metrics(route, req->get_method())->started, 1);
+
+    // The callback may run in another thread, which has its own counters.
+    server_task->add_callback([this, route, start_us](HttpTask *task)
+    {
+        HttpReq *req = task->get_req();
+        HttpResp *resp = task->get_resp();
+        RouteMetrics *metrics = this->local_metrics(route, req->get_method());
+
+        const void *body;
+        size_t body_len = 0;
+        if (!req->get_parsed_body(&body, &body_len))
+            body_len = 0;
+        add(metrics->request_bytes, body_len);
+        add(metrics->response_bytes, resp->get_output_body_size());
+
+        const char *status_code = resp->get_status_code();
+        int code = status_code ? atoi(status_code) : 0;
+        if (code < 0 || code >= k_max_status_code)
+            code = 0;
+        add(metrics->status[code], 1);
+
+        long long latency = now_us() - start_us;
+        metrics->latency.record(latency > 0 ? latency : 0);
+        add(metrics->finished, 1);
+    });
+}
+
+std::string HttpMetrics::expose() const
+{
+    std::map<std::pair<std::string, Verb>, RouteSummary> summaries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &metrics : metrics_list_)
+        {
+            RouteSummary &summary = summaries[std::make_pair(metrics->route, metrics->verb)];
+            summary.started += get(metrics->started);
+            summary.finished += get(metrics->finished);
+            summary.request_bytes += get(metrics->request_bytes);
+            summary.response_bytes += get(metrics->response_bytes);
+            for (int code = 0; code < k_max_status_code; code++)
+            {
+                uint64_t cnt = get(metrics->status[code]);
+                if (cnt > 0)
+                    summary.status[code] += cnt;
+            }
+            metrics->latency.merge_to(summary.buckets);
+            summary.latency_sum += metrics->latency.sum();
+        }
+    }
+
+    std::string out;
+    out.reserve(1024 + summaries.size() * 2048);
+
+    out.append("# HELP wfrest_http_requests_total Finished requests by route, verb and status code.\n"
+               "# TYPE wfrest_http_requests_total counter\n");
+    for (const auto &kv : summaries)
+    {
+        std::string labels = "route=\"" + escape_label(kv.first.first) +
+                             "\",verb=\"" + verb_to_str(kv.first.second) + "\"";
+        for (const auto &status : kv.second.status)
+        {
+            out.append("wfrest_http_requests_total{" + labels + ",code=\"" +
+                       std::to_string(status.first) + "\"} " +
+                       std::to_string(status.second) + "\n");
+        }
+    }
+
+    out.append("# HELP wfrest_http_requests_in_flight Requests being processed.\n"
+               "# TYPE wfrest_http_requests_in_flight gauge\n");
+    for (const auto &kv : summaries)
+    {
+        // started and finished are read at slightly different times
+        uint64_t in_flight = kv.second.started > kv.second.finished ?
+                             kv.second.started - kv.second.finished : 0;
+        out.append("wfrest_http_requests_in_flight{route=\"" + escape_label(kv.first.first) +
+                   "\",verb=\"" + verb_to_str(kv.first.second) + "\"} " +
+                   std::to_string(in_flight) + "\n");
+    }
+
+    out.append("# HELP wfrest_http_request_body_bytes_total Request body bytes.\n"
+               "# TYPE wfrest_http_request_body_bytes_total counter\n");
+    for (const auto &kv : summaries)
+    {
+        out.append("wfrest_http_request_body_bytes_total{route=\"" + escape_label(kv.first.first) +
+                   "\",verb=\"" + verb_to_str(kv.first.second) + "\"} " +
+                   std::to_string(kv.second.request_bytes) + "\n");
+    }
+
+    out.append("# HELP wfrest_http_response_body_bytes_total Response body bytes.\n"
+               "# TYPE wfrest_http_response_body_bytes_total counter\n");
+    for (const auto &kv : summaries)
+    {
+        out.append("wfrest_http_response_body_bytes_total{route=\"" + escape_label(kv.first.first) +
+                   "\",verb=\"" + verb_to_str(kv.first.second) + "\"} " +
+                   std::to_string(kv.second.response_bytes) + "\n");
+    }
+
+    out.append("# HELP wfrest_http_request_duration_seconds Request latency, from routing to the reply sent.\n"
+               "# TYPE wfrest_http_request_duration_seconds histogram\n");
+    for (const auto &kv : summaries)
+    {
+        std::string labels = "route=\"" + escape_label(kv.first.first) +
+                             "\",verb=\"" + verb_to_str(kv.first.second) + "\"";
+        const std::vector<uint64_t> &buckets = kv.second.buckets;
+        uint64_t cumulative = 0;
+        int idx = 0;
+        for (const auto &bucket : k_latency_buckets)
+        {
+            // a fine bucket is counted once all its values are below le
+            while (idx < Histogram::k_bucket_count && Histogram::upper_bound(idx) <= bucket.us)
+                cumulative += buckets[idx++];
+            out.append("wfrest_http_request_duration_seconds_bucket{" + labels +
+                       ",le=\"" + bucket.le + "\"} " + std::to_string(cumulative) + "\n");
+        }
+        uint64_t count = 0;
+        for (uint64_t cnt : buckets)
+            count += cnt;
+
+        char sum[32];
+        snprintf(sum, sizeof sum, "%.6f", kv.second.latency_sum / 1e6);
+        out.append("wfrest_http_request_duration_seconds_bucket{" + labels +
+                   ",le=\"+Inf\"} " + std::to_string(count) + "\n");
+        out.append("wfrest_http_request_duration_seconds_sum{" + labels + "} " + sum + "\n");
+        out.append("wfrest_http_request_duration_seconds_count{" + labels + "} " +
+                   std::to_string(count) + "\n");
+    }
+    return out;
+}
+
+}  // namespace wfrest
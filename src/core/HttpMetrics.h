@@ -0,0 +1,52 @@
+#ifndef WFREST_HTTPMETRICS_H_
+#define WFREST_HTTPMETRICS_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "StringPiece.h"
+#include "Noncopyable.h"
+
+namespace wfrest
+{
+
+class HttpServerTask;
+struct RouteMetrics;
+
+/*
+Per-route request metrics, keyed by the interned route pattern and the verb :
+finished requests by status code, in-flight requests, body bytes and a latency histogram.
+
+Every thread records into its own counters, found through a thread local map,
+so recording takes no lock. The counters of all threads are summed on scrape.
+*/
+class HttpMetrics : public Noncopyable
+{
+public:
+    HttpMetrics();
+
+    ~HttpMetrics();
+
+    // Called once the request has been routed, start_us is when processing began.
+    void track(HttpServerTask *server_task, long long start_us);
+
+    // Prometheus text exposition format
+    std::string expose() const;
+
+    // monotonic clock, in microseconds
+    static long long now_us();
+
+private:
+    RouteMetrics *local_metrics(const StringPiece &route, const char *verb);
+
+private:
+    const unsigned long long id_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<RouteMetrics>> metrics_list_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_HTTPMETRICS_H_
@@ -5,7 +5,13 @@
 #include "workflow/WFTaskFactory.h"
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/ssl.h>
 #include <algorithm>
+#include <deque>
 
 #include "HttpMsg.h"
 #include "UriUtil.h"
@@ -13,9 +19,11 @@
 #include "json.hpp"
 #include "MysqlUtil.h"
 #include "ErrorCode.h"
-#include "FileUtil.h"
 #include "HttpServerTask.h"
+#include "Session.h"
 #include "CodeUtil.h"
+#include "Http2.h"
+#include "Grpc.h"
 
 using namespace wfrest;
 using namespace protocol;
@@ -30,6 +38,92 @@ struct ReqData
     std::map<std::string, std::string> form_kv;
     Form form;
     Json json;
+    bool json_parsed = false;
+    std::string json_errmsg;
+    std::vector<StringPiece> grpc_messages;
+    std::deque<std::string> grpc_inflated;     // the compressed messages
+    bool grpc_parsed = false;
+    std::string grpc_errmsg;
+};
+
+// Parse and build the DOM in one pass, keep the error message instead of throwing.
+// Only the public SAX interface of json.hpp is used.
+class JsonDomParser : public Json::json_sax_t
+{
+public:
+    JsonDomParser(Json &json, std::string &errmsg)
+        : root_(json), object_element_(nullptr), errmsg_(errmsg)
+    {}
+
+    bool null() override { this->add(nullptr); return true; }
+
+    bool boolean(bool val) override { this->add(val); return true; }
+
+    bool number_integer(number_integer_t val) override { this->add(val); return true; }
+
+    bool number_unsigned(number_unsigned_t val) override { this->add(val); return true; }
+
+    bool number_float(number_float_t val, const string_t &) override
+    {
+        this->add(val);
+        return true;
+    }
+
+    bool string(string_t &val) override { this->add(std::move(val)); return true; }
+
+    bool binary(binary_t &val) override { this->add(std::move(val)); return true; }
+
+    bool start_object(std::size_t) override
+    {
+        stack_.push_back(this->add(Json::object()));
+        return true;
+    }
+
+    bool key(string_t &val) override
+    {
+        object_element_ = &(*stack_.back())[val];
+        return true;
+    }
+
+    bool end_object() override { stack_.pop_back(); return true; }
+
+    bool start_array(std::size_t) override
+    {
+        stack_.push_back(this->add(Json::array()));
+        return true;
+    }
+
+    bool end_array() override { stack_.pop_back(); return true; }
+
+    bool parse_error(std::size_t, const std::string &, const Json::exception &ex) override
+    {
+        errmsg_ = ex.what();
+        return false;
+    }
+
+private:
+    // into the array on top of the stack, or at the last key of the object
+    Json *add(Json &&val)
+    {
+        if (stack_.empty())
+        {
+            root_ = std::move(val);
+            return &root_;
+        }
+        if (stack_.back()->is_array())
+        {
+            stack_.back()->push_back(std::move(val));
+            return &stack_.back()->back();
+        }
+        *object_element_ = std::move(val);
+        return object_element_;
+    }
+
+private:
+    Json &root_;
+    std::vector<Json *> stack_;
+    Json *object_element_;
+    std::string &errmsg_;
 };
 
 struct ProxyCtx
@@ -39,6 +133,82 @@ struct ProxyCtx
     bool is_keep_alive;
 };
 
+// The head of every file is read ahead as soon as the reply is built,
+// the rest as the socket drains it.
+const size_t k_multipart_readahead = 1024 * 1024;
+
+struct MultiPartCtx
+{
+    std::unique_ptr<MultiPartEncoder> encoder;
+    std::deque<std::string> heads;          // appended to the body, stable addresses
+    std::vector<struct iovec> maps;         // of the files, unmapped with the task
+    std::string tail;
+
+    ~MultiPartCtx()
+    {
+        for (const struct iovec &map : maps)
+            munmap(map.iov_base, map.iov_len);
+    }
+};
+
+// -1 if path is not a regular file which can be read, *addr is nullptr if it is empty
+int map_file(const std::string &path, void **addr, size_t *size)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    int ret = -1;
+    *addr = nullptr;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        *size = st.st_size;
+        if (*size == 0)
+            ret = 0;
+        else
+        {
+            void *map = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                madvise(map, *size, MADV_SEQUENTIAL);
+                madvise(map, std::min(*size, k_multipart_readahead), MADV_WILLNEED);
+                *addr = map;
+                ret = 0;
+            }
+        }
+    }
+    close(fd);
+    return ret;
+}
+
+// The backend tasks of a request with a budget time out with what is left of it
+template<class TASK>
+void inherit_deadline(HttpServerTask *server_task, TASK *task)
+{
+    int remaining_ms = server_task->remaining_ms();
+    if (remaining_ms > 0)
+    {
+        task->set_send_timeout(remaining_ms);
+        task->set_receive_timeout(remaining_ms);
+    }
+}
+
+// Each retry would get the whole budget again, a request with one has none
+int retry_within_deadline(HttpServerTask *server_task, int retry_max)
+{
+    return server_task->deadline() == 0 ? retry_max : 0;
+}
+
+// Sleeps past the deadline are cut short
+unsigned int clamp_to_deadline(HttpServerTask *server_task, unsigned int microseconds)
+{
+    int remaining_ms = server_task->remaining_ms();
+    if (remaining_ms >= 0 && microseconds > remaining_ms * 1000U)
+        return remaining_ms * 1000U;
+    return microseconds;
+}
+
 void proxy_http_callback(WFHttpTask *http_task)
 {   
     int state = http_task->get_state();
@@ -80,8 +250,9 @@ void proxy_http_callback(WFHttpTask *http_task)
         if (http_resp->get_parsed_body(&body, &len))
             http_resp->append_output_body_nocopy(body, len);
 
-        HttpResp resp(std::move(*http_resp));
-        *server_resp = std::move(resp);
+        // the stream of an HTTP/2 request stays
+        server_resp->drop_reply();
+        *static_cast<HttpResponse *>(server_resp) = std::move(*http_resp);
 
         if (!proxy_ctx->is_keep_alive)
             server_resp->set_header_pair("Connection", "close");
@@ -293,12 +464,37 @@ void mysql_callback(WFMySQLTask *mysql_task)
 } // namespace wfrest
 
 
+// The frames of an HTTP/2 connection go out through the request which reads
+// it, inside append() on the poller thread, the only place feedback() may write.
+class HttpReq::Http2Writer : public Http2Transport
+{
+public:
+    explicit Http2Writer(HttpReq *reader) : reader_(reader) {}
+
+    int write(const char *data, size_t size) override
+    {
+        int ret = reader_->feedback(data, size);
+        // tls wants the same bytes again later
+        if (ret < 0 && (errno == EAGAIN || errno == -SSL_ERROR_WANT_WRITE ||
+                        errno == -SSL_ERROR_WANT_READ))
+            errno = EAGAIN;
+        return ret;
+    }
+
+private:
+    HttpReq *reader_;
+};
+
 HttpReq::HttpReq() : req_data_(new ReqData)
 {}
 
 HttpReq::~HttpReq()
 {
     delete req_data_;
+    delete multipart_stream_;
+    // the streams still handled can not reply any more
+    if (http2_reader_)
+        http2_->detach();
 }
 
 std::string &HttpReq::body() const
@@ -337,6 +533,9 @@ std::map<std::string, std::string> &HttpReq::form_kv() const
 
 Form &HttpReq::form() const
 {
+    if (multipart_stream_)
+        return multipart_stream_->form();
+
     if (content_type_ == MULTIPART_FORM_DATA && req_data_->form.empty())
     {
         StringPiece body_piece(this->body());
@@ -348,17 +547,73 @@ Form &HttpReq::form() const
 
 Json &HttpReq::json() const
 {
-    if (content_type_ == APPLICATION_JSON && req_data_->json.empty())
+    if (content_type_ == APPLICATION_JSON && !req_data_->json_parsed)
     {
+        req_data_->json_parsed = true;
         const std::string &body_content = this->body();
-        if (!Json::accept(body_content))
+        JsonDomParser parser(req_data_->json, req_data_->json_errmsg);
+        if (!Json::sax_parse(body_content, &parser))
+            req_data_->json = Json();
+    }
+    return req_data_->json;
+}
+
+const std::string &HttpReq::json_error() const
+{
+    this->json();
+    return req_data_->json_errmsg;
+}
+
+const std::vector<StringPiece> &HttpReq::grpc_messages() const
+{
+    if (req_data_->grpc_parsed)
+        return req_data_->grpc_messages;
+    req_data_->grpc_parsed = true;
+
+    const void *body;
+    size_t len;
+    this->get_parsed_body(&body, &len);
+    std::vector<GrpcFrame::Message> messages;
+    if (!GrpcFrame::parse(static_cast<const char *>(body), len, &messages))
+    {
+        req_data_->grpc_errmsg = "truncated message";
+        return req_data_->grpc_messages;
+    }
+
+    bool gzip = this->header("grpc-encoding") == "gzip";
+    std::vector<StringPiece> &pieces = req_data_->grpc_messages;
+    for (const GrpcFrame::Message &message : messages)
+    {
+        if (!message.compressed)
+        {
+            pieces.push_back(message.data);
+            continue;
+        }
+
+        std::string inflated;
+        if (!gzip || Compressor::ungzip(message.data.data(), message.data.size(), &inflated) != StatusOK)
         {
-            return req_data_->json;
-            // todo : how to let user know the error ?
+            req_data_->grpc_errmsg = gzip ? "bad gzip message" : "compressed message without grpc-encoding";
+            pieces.clear();
+            return pieces;
         }
-        req_data_->json = Json::parse(body_content);
+        req_data_->grpc_inflated.emplace_back(std::move(inflated));
+        pieces.push_back(req_data_->grpc_inflated.back());
     }
-    return req_data_->json;
+    return pieces;
+}
+
+const std::string &HttpReq::grpc_error() const
+{
+    this->grpc_messages();
+    return req_data_->grpc_errmsg;
+}
+
+JsonView HttpReq::json_view() const
+{
+    if (content_type_ != APPLICATION_JSON)
+        return JsonView();
+    return JsonView(StringPiece(this->body()));
 }
 
 const std::string &HttpReq::param(const std::string &key) const
@@ -401,6 +656,22 @@ bool HttpReq::has_query(const std::string &key) const
     }
 }
 
+namespace
+{
+
+StringPiece boundary_of(const std::string &content_type_str)
+{
+    const char *boundary = strstr(content_type_str.c_str(), "boundary=");
+    if (boundary == nullptr)
+        return StringPiece();
+
+    boundary += strlen("boundary=");
+    StringPiece boundary_piece(boundary);
+    return StrUtil::trim_pairs(boundary_piece, R"(""'')");
+}
+
+}  // namespace
+
 void HttpReq::fill_content_type()
 {
     const std::string &content_type_str = header("Content-Type");
@@ -409,19 +680,215 @@ void HttpReq::fill_content_type()
     if (content_type_ == MULTIPART_FORM_DATA)
     {
         // if type is multipart form, we reserve the boudary first
-        const char *boundary = strstr(content_type_str.c_str(), "boundary=");
-        if (boundary == nullptr)
+        StringPiece boundary_str = boundary_of(content_type_str);
+        if (boundary_str.empty())
         {
             return;
         }
-        boundary += strlen("boundary=");
-        StringPiece boundary_piece(boundary);
-
-        StringPiece boundary_str = StrUtil::trim_pairs(boundary_piece, R"(""'')");
         multi_part_.set_boundary(boundary_str.as_string());
     }
 }
 
+const MultiPartFiles &HttpReq::files() const
+{
+    static const MultiPartFiles no_files;
+    if (!multipart_stream_)
+        return no_files;
+    return multipart_stream_->files();
+}
+
+int HttpReq::append(const void *buf, size_t *size)
+{
+    if (http2_ || http2_service_)
+        return this->append_http2(buf, size);
+
+    int ret = this->append_message(buf, size);
+    if (ret == 1)
+        this->set_handler_ticket();
+    return ret;
+}
+
+void HttpReq::set_handler_ticket()
+{
+    // complete, queued for a handler thread
+    received_us_ = QueueStatsRegistry::now_us();
+    QueueStats *stats = QueueStatsRegistry::get_instance()->handler_stats();
+    if (stats)
+        handler_ticket_ = stats->enqueue();
+    else if (queue_clock_)
+        handler_ticket_.enqueue_us = received_us_;
+}
+
+int HttpReq::append_message(const void *buf, size_t *size)
+{
+    if (!multipart_params_ || (header_received_ && !multipart_stream_))
+        return HttpRequest::append(buf, size);
+
+    const char *data = static_cast<const char *>(buf);
+    size_t header_len = 0;
+    if (!header_received_)
+    {
+        // The header goes to the http parser as usual,
+        // it may be split between several reads.
+        static const char header_end[] = "\r\n\r\n";
+        size_t i = 0;
+        while (i < *size && header_end_matched_ < 4)
+        {
+            if (data[i] == header_end[header_end_matched_])
+                header_end_matched_++;
+            else
+                header_end_matched_ = data[i] == '\r' ? 1 : 0;
+            i++;
+        }
+        if (header_end_matched_ < 4)
+            return HttpRequest::append(buf, size);
+
+        header_received_ = true;
+        header_len = i;
+        int ret = HttpRequest::append(buf, &header_len);
+        if (ret != 0)
+        {
+            *size = header_len;
+            return ret;
+        }
+
+        this->create_multipart_stream();
+        if (!multipart_stream_)
+        {
+            size_t rest = *size - header_len;
+            if (rest > 0)
+                ret = HttpRequest::append(data + header_len, &rest);
+            *size = header_len + rest;
+            return ret;
+        }
+        // what the http parser would refuse, the body alone
+        if (body_remaining_ > this->get_size_limit())
+        {
+            errno = EMSGSIZE;
+            return -1;
+        }
+    }
+
+    // The body bypasses the http parser and is never buffered as a whole.
+    size_t body_len = std::min(*size - header_len, body_remaining_);
+    if (multipart_stream_->append(data + header_len, body_len) < 0)
+        return -1;
+    body_remaining_ -= body_len;
+    if (body_remaining_ > 0)
+        return 0;
+
+    multipart_stream_->finish();
+    *size = header_len + body_len;
+    return 1;
+}
+
+int HttpReq::append_http2(const void *buf, size_t *size)
+{
+    const char *data = static_cast<const char *>(buf);
+    size_t offset = 0;
+    if (!http2_)
+    {
+        // The first bytes of the connection : the client preface of HTTP/2
+        // with prior knowledge, else HTTP/1.1.
+        while (offset < *size && preface_matched_ < Http2Frame::k_preface_size)
+        {
+            if (data[offset] != Http2Frame::k_preface[preface_matched_])
+            {
+                // the part of the preface in the previous reads was HTTP/1.1 too
+                http2_service_ = nullptr;
+                size_t previous = preface_matched_ - offset;
+                if (previous > 0)
+                {
+                    int ret = this->append_message(Http2Frame::k_preface, &previous);
+                    if (ret != 0)
+                    {
+                        *size = 0;
+                        if (ret == 1)
+                            this->set_handler_ticket();
+                        return ret;
+                    }
+                }
+                int ret = this->append_message(buf, size);
+                if (ret == 1)
+                    this->set_handler_ticket();
+                return ret;
+            }
+            offset++;
+            preface_matched_++;
+        }
+        if (preface_matched_ < Http2Frame::k_preface_size)
+            return 0;
+
+        http2_ = std::make_shared<Http2Connection>(http2_service_, this->get_size_limit());
+        http2_reader_ = true;
+    }
+
+    // This request never completes, it reads the frames as long as the connection
+    // lives, and each complete stream is dispatched as a request of its own.
+    std::vector<Http2Request> requests;
+    int ret = http2_->feed(data + offset, *size - offset, &requests);
+    for (Http2Request &request : requests)
+        http2_dispatch_(http2_, &request);
+
+    // the frames queued since the last read, the replies of the streams included
+    Http2Writer writer(this);
+    int flushed = http2_->flush(&writer);
+    if (ret < 0)
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+    // the GOAWAY is sent and the streams are replied, the connection closes
+    if (flushed < 0 || http2_->finished())
+    {
+        errno = ECONNRESET;
+        return -1;
+    }
+    // the read timeouts count from the last frames
+    this->renew();
+    return 0;
+}
+
+int HttpReq::append_stream(const std::string &message)
+{
+    // all the bytes are the stream's, the request is a whole HTTP/1.1 message
+    size_t length = message.size();
+    int ret = this->append_message(message.data(), &length);
+    if (ret != 1)
+    {
+        if (ret == 0)
+            errno = EBADMSG;
+        return -1;
+    }
+    this->set_handler_ticket();
+    return 0;
+}
+
+void HttpReq::create_multipart_stream()
+{
+    // chunked bodies are buffered as usual
+    if (this->is_chunked())
+        return;
+
+    std::string content_type;
+    std::string content_length;
+    protocol::HttpHeaderCursor cursor(this);
+    if (!cursor.find("Content-Type", content_type) ||
+        ContentType::to_enum(content_type) != MULTIPART_FORM_DATA)
+        return;
+
+    cursor.rewind();
+    if (!cursor.find("Content-Length", content_length))
+        return;
+
+    StringPiece boundary = boundary_of(content_type);
+    if (boundary.empty())
+        return;
+
+    body_remaining_ = strtoull(content_length.c_str(), nullptr, 10);
+    multipart_stream_ = new MultiPartStream(multipart_params_, boundary.as_string());
+}
+
 const std::string &HttpReq::header(const std::string &key) const
 {
     const auto it = headers_.find(key);
@@ -484,15 +951,26 @@ HttpReq::HttpReq(HttpReq&& other)
     content_type_(other.content_type_),
     route_match_path_(std::move(other.route_match_path_)),
     route_full_path_(std::move(other.route_full_path_)),
+    route_pattern_(other.route_pattern_),
     route_params_(std::move(other.route_params_)),
     query_params_(std::move(other.query_params_)),
     cookies_(std::move(other.cookies_)),
     multi_part_(std::move(other.multi_part_)),
     headers_(std::move(other.headers_)),
-    parsed_uri_(std::move(other.parsed_uri_))
+    parsed_uri_(std::move(other.parsed_uri_)),
+    multipart_params_(other.multipart_params_),
+    header_received_(other.header_received_),
+    header_end_matched_(other.header_end_matched_),
+    body_remaining_(other.body_remaining_),
+    handler_ticket_(other.handler_ticket_),
+    queue_clock_(other.queue_clock_),
+    received_us_(other.received_us_)
 {
     req_data_ = other.req_data_;
     other.req_data_ = nullptr;
+
+    multipart_stream_ = other.multipart_stream_;
+    other.multipart_stream_ = nullptr;
 }
 
 HttpReq &HttpReq::operator=(HttpReq&& other)
@@ -505,6 +983,7 @@ HttpReq &HttpReq::operator=(HttpReq&& other)
 
     route_match_path_ = std::move(other.route_match_path_);
     route_full_path_ = std::move(other.route_full_path_);
+    route_pattern_ = other.route_pattern_;
     route_params_ = std::move(other.route_params_);
     query_params_ = std::move(other.query_params_);
     cookies_ = std::move(other.cookies_);
@@ -512,6 +991,17 @@ HttpReq &HttpReq::operator=(HttpReq&& other)
     headers_ = std::move(other.headers_);
     parsed_uri_ = std::move(other.parsed_uri_);
 
+    delete multipart_stream_;
+    multipart_stream_ = other.multipart_stream_;
+    other.multipart_stream_ = nullptr;
+    multipart_params_ = other.multipart_params_;
+    header_received_ = other.header_received_;
+    header_end_matched_ = other.header_end_matched_;
+    body_remaining_ = other.body_remaining_;
+    handler_ticket_ = other.handler_ticket_;
+    queue_clock_ = other.queue_clock_;
+    received_us_ = other.received_us_;
+
     return *this;
 }
 
@@ -557,91 +1047,63 @@ void HttpResp::String(MultiPartEncoder *encoder)
 {   
     const std::string &boudary = encoder->boundary();
     this->headers["Content-Type"] = "multipart/form-data; boundary=" + boudary;
-    
-    HttpServerTask *server_task = task_of(this);
-    SeriesWork *series = series_of(server_task);
 
-    const MultiPartEncoder::FileList &file_list = encoder->files();
-    size_t file_cnt = file_list.size();
-    assert(file_cnt >= 0);
-    for(const auto &file : file_list) 
+    // The files are mapped, not read : the socket writes take their pages as
+    // the reply is sent, with sequential read ahead. No buffer holds the
+    // files, whatever their size, and the parts are blocks of the output body.
+    // A file must not be truncated while it is sent, replace it with rename().
+    auto *ctx = new MultiPartCtx;
+    ctx->encoder.reset(encoder);
+    task_of(this)->add_callback([ctx](HttpTask *) { delete ctx; });
+
+    for(const auto &param : encoder->params()) {
+        std::string head;
+        head.append("\r\n--");
+        head.append(boudary);
+        head.append("\r\nContent-Disposition: form-data; name=\"");
+        head.append(param.first);
+        head.append("\"\r\n\r\n");
+        head.append(param.second);
+        ctx->heads.emplace_back(std::move(head));
+        this->append_output_body_nocopy(ctx->heads.back().c_str(), ctx->heads.back().size());
+    } 
+
+    for (const auto &file : encoder->files())
     {
-        file_cnt--;
-        if(!PathUtil::is_file(file.second))
-        {
-            fprintf(stderr, "[Error] Not a File : %s\n", file.second.c_str());
-            continue;
-        }
-        size_t file_size;
-        int ret = FileUtil::size(file.second, OUT &file_size);
-        if (ret != StatusOK)
+        void *addr;
+        size_t size;
+        if (map_file(file.second, &addr, &size) < 0)
         {
             fprintf(stderr, "[Error] Invalid File : %s\n", file.second.c_str());
             continue;
         }
-        void *buf = malloc(file_size);
-        WFFileIOTask *pread_task = WFTaskFactory::create_pread_task(file.second,
-                buf, file_size, 0,
-                [&file, &boudary](WFFileIOTask *pread_task) {
-                    FileIOArgs *args = pread_task->get_args();
-                    long ret = pread_task->get_retval();
-                    
-                    SeriesWork *series = series_of(pread_task);
-                    std::string *content = static_cast<std::string *>(series->get_context());
-                    if (pread_task->get_state() != WFT_STATE_SUCCESS || ret < 0)
-                    {
-                        fprintf(stderr, "Read %s Error\n", file.second.c_str());
-                    } else
-                    {
-                        std::string file_suffix = PathUtil::suffix(file.second);
-                        std::string file_type = ContentType::to_str_by_suffix(file_suffix);
-                        content->append("\r\n--");
-                        content->append(boudary);
-                        content->append("\r\nContent-Disposition: form-data; name=\"");
-                        content->append(file.first);
-                        content->append("\"; filename=\"");
-                        content->append(PathUtil::base(file.second));
-                        content->append("\"\r\nContent-Type: ");
-                        content->append(file_type);
-                        content->append("\r\n\r\n");
-                        content->append(static_cast<char *>(args->buf), ret);
-                    } 
-                    // last one, send the content
-                    if(pread_task->user_data) {
-                        content->append("\r\n--");
-                        content->append(boudary);
-                        content->append("--\r\n");
-                        HttpResp *resp = static_cast<HttpResp *>(pread_task->user_data);
-                        resp->append_output_body_nocopy(content->c_str(), content->size());
-                    }
-                });
-        if(file_cnt == 0)
+
+        std::string file_suffix = PathUtil::suffix(file.second);
+        std::string file_type = ContentType::to_str_by_suffix(file_suffix);
+        std::string head;
+        head.append("\r\n--");
+        head.append(boudary);
+        head.append("\r\nContent-Disposition: form-data; name=\"");
+        head.append(file.first);
+        head.append("\"; filename=\"");
+        head.append(PathUtil::base(file.second));
+        head.append("\"\r\nContent-Type: ");
+        head.append(file_type);
+        head.append("\r\n\r\n");
+        ctx->heads.emplace_back(std::move(head));
+        this->append_output_body_nocopy(ctx->heads.back().c_str(), ctx->heads.back().size());
+
+        if (addr)
         {
-            pread_task->user_data = this;
+            ctx->maps.push_back({ addr, size });
+            this->append_output_body_nocopy(addr, size);
         }
-        server_task->add_callback([buf](const HttpTask *server_task)
-                                {
-                                    free(buf);
-                                });
-        series->push_back(pread_task);
     }
-    
-    std::string *content = new std::string;
-    series->set_context(content);
-    series->set_callback([encoder](const SeriesWork *series) {
-        delete encoder;
-        delete static_cast<std::string *>(series->get_context());
-    });
 
-    const MultiPartEncoder::ParamList &param_list = encoder->params();
-    for(const auto &param : param_list) {
-        content->append("\r\n--");
-        content->append(boudary);
-        content->append("\r\nContent-Disposition: form-data; name=\"");
-        content->append(param.first);
-        content->append("\"\r\n\r\n");
-        content->append(param.second);
-    } 
+    ctx->tail.append("\r\n--");
+    ctx->tail.append(boudary);
+    ctx->tail.append("--\r\n");
+    this->append_output_body_nocopy(ctx->tail.c_str(), ctx->tail.size());
 }
 
 int HttpResp::compress(const std::string * const data, std::string *compress_data)
@@ -694,14 +1156,30 @@ void HttpResp::Error(int error_code, const std::string &errmsg)
 
 void HttpResp::Timer(unsigned int microseconds, const TimerFunc &func)
 {
-    WFTimerTask *timer_task = WFTaskFactory::create_timer_task(microseconds, 
+    if (this->past_deadline())
+        return;
+    HttpServerTask *server_task = task_of(this);
+    microseconds = clamp_to_deadline(server_task, microseconds);
+    // cancelled by the deadline timer of the request
+    WFTimerTask *timer_task = WFTaskFactory::create_timer_task(server_task->timer_name(),
+                                                               microseconds / 1000000,
+                                                               microseconds % 1000000 * 1000L,
                                                                [func](WFTimerTask *) { func(); });
     this->add_task(timer_task);
 }
 
 void HttpResp::Timer(time_t seconds, long nanoseconds, const TimerFunc &func)
 {
-    WFTimerTask *timer_task = WFTaskFactory::create_timer_task(seconds, nanoseconds, 
+    if (this->past_deadline())
+        return;
+    int remaining_ms = task_of(this)->remaining_ms();
+    if (remaining_ms >= 0 && seconds * 1000 + nanoseconds / 1000000 > remaining_ms)
+    {
+        seconds = remaining_ms / 1000;
+        nanoseconds = remaining_ms % 1000 * 1000000L;
+    }
+    WFTimerTask *timer_task = WFTaskFactory::create_timer_task(task_of(this)->timer_name(),
+                                                               seconds, nanoseconds,
                                                                [func](WFTimerTask *) { func(); });
     this->add_task(timer_task);
 }
@@ -773,11 +1251,7 @@ void HttpResp::Json(const ::Json &json)
 
 void HttpResp::Json(const std::string &str)
 {
-    if (!Json::accept(str))
-    {
-        this->Error(StatusJsonInvalid);
-        return;
-    }
+    // sent as is, the handler vouches for the text
     this->headers["Content-Type"] = "application/json";
     this->String(str);
 }
@@ -802,6 +1276,8 @@ int HttpResp::get_error() const
 
 void HttpResp::Http(const std::string &url, int redirect_max, size_t size_limit)
 {
+    if (this->past_deadline())
+        return;
     HttpServerTask *server_task = task_of(this);
     HttpReq *server_req = server_task->get_req();
     std::string http_url = url;
@@ -853,19 +1329,30 @@ void HttpResp::Http(const std::string &url, int redirect_max, size_t size_limit)
     HttpRequest *server_req_cast = static_cast<HttpRequest *>(server_req);
 	*http_task->get_req() = std::move(*server_req_cast);  
     http_task->get_resp()->set_size_limit(size_limit);
-	**server_task << http_task;
+    inherit_deadline(server_task, http_task);
+    this->add_task(http_task);
+}
+
+void HttpResp::Parallel(const std::vector<ParallelCall> &calls, const ParallelFunc &func)
+{
+    HttpParallel::fanout(calls, func, this);
 }
 
 void HttpResp::MySQL(const std::string &url, const std::string &sql)
 {
+    if (this->past_deadline())
+        return;
     WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, mysql_callback);
     mysql_task->get_req()->set_query(sql);
     mysql_task->user_data = this;
+    inherit_deadline(task_of(this), mysql_task);
     this->add_task(mysql_task);
 }
 
 void HttpResp::MySQL(const std::string &url, const std::string &sql, const MySQLJsonFunc &func)
 {
+    if (this->past_deadline())
+        return;
     WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, 
     [func](WFMySQLTask *mysql_task)
     {
@@ -874,11 +1361,14 @@ void HttpResp::MySQL(const std::string &url, const std::string &sql, const MySQL
     });
 
     mysql_task->get_req()->set_query(sql);
+    inherit_deadline(task_of(this), mysql_task);
     this->add_task(mysql_task);
 }
 
 void HttpResp::MySQL(const std::string &url, const std::string &sql, const MySQLFunc &func)
 {
+    if (this->past_deadline())
+        return;
     WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0, 
     [func](WFMySQLTask *mysql_task)
     {
@@ -896,46 +1386,276 @@ void HttpResp::MySQL(const std::string &url, const std::string &sql, const MySQL
     });
     mysql_task->get_req()->set_query(sql);
     mysql_task->user_data = this;
+    inherit_deadline(task_of(this), mysql_task);
     this->add_task(mysql_task);
 }
 
 void HttpResp::Redis(const std::string &url, const std::string &command,
         const std::vector<std::string>& params)
 {
-    WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, 2, [this](WFRedisTask *redis_task) 
+    if (this->past_deadline())
+        return;
+    int retry_max = retry_within_deadline(task_of(this), 2);
+    WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, retry_max, [this](WFRedisTask *redis_task) 
     {
         ::Json js = redis_json_res(redis_task);
         this->Json(js);
     });
 	redis_task->get_req()->set_request(command, params);
+    inherit_deadline(task_of(this), redis_task);
     this->add_task(redis_task);
 }
 
 void HttpResp::Redis(const std::string &url, const std::string &command,
         const std::vector<std::string>& params, const RedisFunc &func)
 {
-    WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, 2, [func](WFRedisTask *redis_task) 
+    if (this->past_deadline())
+        return;
+    int retry_max = retry_within_deadline(task_of(this), 2);
+    WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, retry_max, [func](WFRedisTask *redis_task) 
     {
         ::Json js = redis_json_res(redis_task);
         func(&js);
     });
 	redis_task->get_req()->set_request(command, params);
+    inherit_deadline(task_of(this), redis_task);
     this->add_task(redis_task);
 }
 
+void HttpResp::Session(const SessionFunc &func)
+{
+    HttpServerTask *server_task = task_of(this);
+    SessionStore *store = server_task->sessions();
+    if (!store)
+    {
+        func(nullptr);
+        return;
+    }
+
+    std::string id;
+    if (store->verify(server_task->get_req()->cookie(store->cookie_name()), &id))
+    {
+        if (store->touch(id))
+        {
+            wfrest::Session session(store, this, id, false);
+            func(&session);
+            return;
+        }
+
+        if (this->past_deadline())
+            return;
+        SubTask *load_task = store->create_load_task(id, [this, store, id, func](bool found)
+        {
+            wfrest::Session session(store, this, found ? id : store->new_id(), !found);
+            func(&session);
+        });
+        if (load_task)
+        {
+            this->add_task(load_task);
+            return;
+        }
+    }
+
+    wfrest::Session session(store, this, store->new_id(), true);
+    func(&session);
+}
+
+void HttpResp::Grpc(const std::string &message, bool compress)
+{
+    this->Grpc(std::string(message), compress);
+}
+
+void HttpResp::Grpc(std::string &&message, bool compress)
+{
+    // past the deadline the reply is DEADLINE_EXCEEDED whatever comes next
+    if (!grpc_ || this->past_deadline())
+        return;
+    grpc_->write(std::move(message), compress);
+    this->send_grpc();
+}
+
+void HttpResp::GrpcNocopy(const void *data, size_t size)
+{
+    if (!grpc_ || this->past_deadline())
+        return;
+    grpc_->write_nocopy(data, size);
+    this->send_grpc();
+}
+
+void HttpResp::set_grpc_status(GrpcStatus status, const std::string &message)
+{
+    if (grpc_)
+        grpc_->set_status(status, message);
+}
+
+void HttpResp::add_grpc_trailer(const std::string &name, const std::string &value)
+{
+    if (grpc_)
+        grpc_->add_trailer(name, value);
+}
+
+void HttpResp::set_grpc(GrpcReply *grpc)
+{
+    grpc_.reset(grpc);
+}
+
 void HttpResp::add_task(SubTask *task)
 {
     HttpServerTask *server_task = task_of(this);
     **server_task << task;
+    if (server_task->deadline() == 0)
+        return;
+
+    if (server_task->deadline_exceeded())
+        server_task->expire();
+    else
+        server_task->check_deadline();
+}
+
+bool HttpResp::past_deadline()
+{
+    HttpServerTask *server_task = task_of(this);
+    if (!server_task->deadline_exceeded())
+        return false;
+
+    server_task->expire();
+    return true;
+}
+
+namespace
+{
+
+// RFC 9113 section 8.2.2, name in lower case
+bool is_http2_field(const std::string &name, bool grpc)
+{
+    if (name == "connection" || name == "keep-alive" || name == "transfer-encoding" ||
+        name == "proxy-connection" || name == "upgrade")
+        return false;
+    // the gRPC body is made of the messages
+    return !grpc || (name != "content-length" && name != "content-encoding");
+}
+
+// lower case and no connection-specific field
+Http2Headers http2_fields(const HttpResponse *resp, bool grpc)
+{
+    Http2Headers fields;
+    std::string name;
+    std::string value;
+    HttpHeaderCursor cursor(resp);
+    while (cursor.next(name, value))
+    {
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (is_http2_field(name, grpc))
+            fields.emplace_back(std::move(name), std::move(value));
+    }
+    return fields;
+}
+
+}  // namespace
+
+int HttpResp::reply_http2()
+{
+    if (grpc_)
+        return this->reply_grpc();
+
+    // The HTTP/1.1 form, its body follows the header section,
+    // which a HEADERS frame replaces.
+    static const int k_max_vectors = 2048;
+    std::vector<struct iovec> message(k_max_vectors);
+    int cnt = this->HttpResponse::encode(message.data(), k_max_vectors);
+    if (cnt < 0)
+        return -1;
+
+    static const char header_end[] = "\r\n\r\n";
+    int matched = 0;
+    int i = 0;
+    size_t off = 0;
+    while (i < cnt && matched < 4)
+    {
+        const char *p = static_cast<const char *>(message[i].iov_base);
+        if (off < message[i].iov_len)
+        {
+            char c = p[off++];
+            matched = c == header_end[matched] ? matched + 1 : (c == '\r' ? 1 : 0);
+        }
+        if (off == message[i].iov_len)
+        {
+            i++;
+            off = 0;
+        }
+    }
+
+    std::vector<struct iovec> body;
+    for (; i < cnt; i++)
+    {
+        body.push_back({ static_cast<char *>(message[i].iov_base) + off, message[i].iov_len - off });
+        off = 0;
+    }
+
+    const char *status = this->get_status_code();
+    return http2_->reply(http2_stream_id_, status ? atoi(status) : HttpStatusOK,
+                         http2_fields(this, false), body.data(), static_cast<int>(body.size()),
+                         nullptr);
+}
+
+// The messages written so far queued on the stream, after the headers with
+// the first ones : the ones of resp->headers, the reply is not encoded yet.
+void HttpResp::send_grpc()
+{
+    if (!http2_)
+        return;
+    if (!grpc_->headers_sent())
+    {
+        Http2Headers fields;
+        for (const auto &header : headers)
+        {
+            std::string name = header.first;
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if (is_http2_field(name, true))
+                fields.emplace_back(std::move(name), header.second);
+        }
+        if (grpc_->compressed())
+            fields.emplace_back("grpc-encoding", "gzip");
+        http2_->reply_headers(http2_stream_id_, HttpStatusOK, fields);
+        grpc_->set_headers_sent();
+    }
+
+    // a stream reset by the client fails its reply once the series is done
+    std::vector<struct iovec> body;
+    grpc_->append_body(&body);
+    http2_->reply_data(http2_stream_id_, body.data(), static_cast<int>(body.size()));
+    grpc_->clear_body();
+}
+
+// Always 200, the status of the GrpcReply in the trailers. Without a message
+// sent yet, the headers, the body and the trailers go together.
+int HttpResp::reply_grpc()
+{
+    Http2Headers trailers = grpc_->trailers();
+    if (grpc_->headers_sent())
+        return http2_->reply_end(http2_stream_id_, &trailers);
+
+    Http2Headers fields = http2_fields(this, true);
+    if (grpc_->compressed())
+        fields.emplace_back("grpc-encoding", "gzip");
+
+    std::vector<struct iovec> body;
+    grpc_->append_body(&body);
+    return http2_->reply(http2_stream_id_, HttpStatusOK, fields,
+                         body.data(), static_cast<int>(body.size()), &trailers);
 }
 
 HttpResp::HttpResp(HttpResp&& other)
     : HttpResponse(std::move(other)),
     headers(std::move(other.headers)),
-    cookies_(std::move(other.cookies_))
+    cookies_(std::move(other.cookies_)),
+    http2_(std::move(other.http2_)),
+    http2_stream_id_(other.http2_stream_id_),
+    grpc_(std::move(other.grpc_))
 {
     user_data = other.user_data;
     other.user_data = nullptr;
+    other.http2_stream_id_ = 0;
 }
 
 HttpResp &HttpResp::operator=(HttpResp&& other)
@@ -945,6 +1665,23 @@ HttpResp &HttpResp::operator=(HttpResp&& other)
     user_data = other.user_data;
     other.user_data = nullptr;
     cookies_ = std::move(other.cookies_);
+    http2_ = std::move(other.http2_);
+    http2_stream_id_ = other.http2_stream_id_;
+    other.http2_stream_id_ = 0;
+    grpc_ = std::move(other.grpc_);
     return *this;
 }
 
+void HttpResp::drop_reply()
+{
+    void *data = user_data;
+    std::shared_ptr<Http2Connection> http2 = std::move(http2_);
+    uint32_t stream_id = http2_stream_id_;
+    std::unique_ptr<GrpcReply> grpc = std::move(grpc_);
+    *this = HttpResp();
+    user_data = data;
+    http2_ = std::move(http2);
+    http2_stream_id_ = stream_id;
+    grpc_ = std::move(grpc);
+}
+
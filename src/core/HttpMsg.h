@@ -13,10 +13,16 @@
 #include "HttpContent.h"
 #include "Compress.h"
 #include "json_fwd.hpp"
+#include "JsonView.h"
+#include "JsonStruct.h"
 #include "StrUtil.h"
 #include "HttpCookie.h"
 #include "Noncopyable.h"
+#include "QueueStats.h"
 #include "HttpFile.h"
+#include "HttpParallel.h"
+#include "MultiPartStream.h"
+#include "Grpc.h"
 
 namespace protocol
 {
@@ -31,6 +37,10 @@ using Json = nlohmann::json;
 
 struct ReqData;
 class MySQL;
+class Session;
+class Http2Service;
+class Http2Connection;
+struct Http2Request;
 
 class HttpReq : public protocol::HttpRequest, public Noncopyable
 {
@@ -44,6 +54,26 @@ public:
 
     Json &json() const;
 
+    // Why json() is empty, empty if the body is valid json.
+    const std::string &json_error() const;
+
+    // Lazy view of the json body, reads a few fields without building the DOM.
+    JsonView json_view() const;
+
+    // Parse the body into a struct bound with WFREST_JSON_STRUCT, no DOM is built.
+    // Return false if the body does not match the struct.
+    template<typename T>
+    bool json_as(T *obj) const
+    { return json_read(this->json_view(), *obj); }
+
+    template<typename T>
+    T json_as() const
+    {
+        T obj;
+        this->json_as(&obj);
+        return obj;
+    }
+
     http_content_type content_type() const
     { return content_type_; }
 
@@ -75,17 +105,79 @@ public:
     const std::string &full_path() const
     { return route_full_path_; }
 
+    // Same as full_path(), but interned for the lifetime of the process : a
+    // pattern has one address, the same after a reload of the routes, which
+    // can be used as a key.
+    const StringPiece &route_pattern() const
+    { return route_pattern_; }
+
     std::string current_path() const
     { return parsed_uri_.path; }
 
     const std::map<std::string, std::string> &cookies() const;
 
     const std::string &cookie(const std::string &key) const;
+
+    // file parts of a multipart body streamed to disk, see HttpServer::stream_multipart()
+    const MultiPartFiles &files() const;
+
+    // The messages of a gRPC request, views into the body unless they were
+    // compressed. Empty if the body is not made of whole messages.
+    const std::vector<StringPiece> &grpc_messages() const;
+
+    // Why grpc_messages() is empty, empty if the body is valid.
+    const std::string &grpc_error() const;
 public:
     void fill_content_type();
 
     void fill_header_map();
 
+    void set_multipart_params(const MultiPartStreamParams *params)
+    { multipart_params_ = params; }
+
+    MultiPartStream *multipart_stream() const
+    { return multipart_stream_; }
+
+    // wait of the complete request for a handler thread, taken once
+    QueueTicket take_handler_ticket()
+    {
+        QueueTicket ticket = handler_ticket_;
+        handler_ticket_ = { nullptr, 0 };
+        return ticket;
+    }
+
+    // timestamp the ticket even without the queue stats, for the overload control
+    void set_queue_clock(bool queue_clock)
+    { queue_clock_ = queue_clock; }
+
+    // when the request was complete, on the monotonic clock in microseconds
+    long long received_us() const
+    { return received_us_; }
+
+    // A stream of an HTTP/2 connection, served as a request of its own
+    using Http2Dispatch = std::function<void (const std::shared_ptr<Http2Connection> &http2,
+                                              Http2Request *request)>;
+
+    // The first request of a connection with HttpServer::http2() : the client
+    // preface turns the connection to HTTP/2, this request then reads all of its
+    // frames, dispatches its streams and writes what the connection queued.
+    void set_http2_service(Http2Service *service, const Http2Dispatch &dispatch)
+    {
+        http2_service_ = service;
+        http2_dispatch_ = dispatch;
+    }
+
+    // the request of a stream, in its HTTP/1.1 form. -1 if the parser refuses it
+    int append_stream(const std::string &message);
+
+    // the connection of the request of a stream
+    void set_http2(const std::shared_ptr<Http2Connection> &http2)
+    { http2_ = http2; }
+
+    // nullptr over HTTP/1.1
+    const std::shared_ptr<Http2Connection> &http2() const
+    { return http2_; }
+
     // /{name}/{id} params in route
     void set_route_params(std::map<std::string, std::string> &&params)
     { route_params_ = std::move(params); }
@@ -101,6 +193,9 @@ public:
     void set_full_path(std::string &&route_full_path)
     { route_full_path_ = std::move(route_full_path); }
 
+    void set_route_pattern(const StringPiece &route_pattern)
+    { route_pattern_ = route_pattern; }
+
     void set_query_params(std::map<std::string, std::string> &&query_params)
     { query_params_ = std::move(query_params); }
 
@@ -120,6 +215,24 @@ public:
 
     HttpReq &operator=(HttpReq&& other);
 
+protected:
+    int append(const void *buf, size_t *size) override;
+
+private:
+    int append_message(const void *buf, size_t *size);
+
+    // frames to the Http2Connection, its requests to the dispatch
+    int append_http2(const void *buf, size_t *size);
+
+    // wait of the complete request for a handler thread
+    void set_handler_ticket();
+
+    void create_multipart_stream();
+
+    // the frames of the connection are written by the request which reads them,
+    // on the poller thread
+    class Http2Writer;
+
 private:
     using HeaderMap = std::map<std::string, std::vector<std::string>, MapStringCaseLess>;
     
@@ -128,6 +241,7 @@ private:
 
     std::string route_match_path_;
     std::string route_full_path_;
+    StringPiece route_pattern_;
 
     std::map<std::string, std::string> route_params_;
     std::map<std::string, std::string> query_params_;
@@ -137,6 +251,23 @@ private:
     HeaderMap headers_;
 
     ParsedURI parsed_uri_;
+
+    // streaming multipart body
+    const MultiPartStreamParams *multipart_params_ = nullptr;
+    MultiPartStream *multipart_stream_ = nullptr;
+    bool header_received_ = false;
+    int header_end_matched_ = 0;    // bytes of "\r\n\r\n" matched so far
+    size_t body_remaining_ = 0;
+
+    QueueTicket handler_ticket_ = { nullptr, 0 };
+    bool queue_clock_ = false;
+    long long received_us_ = 0;
+
+    Http2Service *http2_service_ = nullptr;
+    Http2Dispatch http2_dispatch_;
+    size_t preface_matched_ = 0;
+    std::shared_ptr<Http2Connection> http2_;
+    bool http2_reader_ = false;     // the connection is read by this request
 };
 
 template<>
@@ -177,6 +308,10 @@ public:
 
     using TimerFunc = std::function<void()>;
 
+    using ParallelFunc = HttpParallel::ParallelFunc;
+
+    using SessionFunc = std::function<void(wfrest::Session *session)>;
+
 public:
     // send string
     void String(const std::string &str);
@@ -212,8 +347,17 @@ public:
     // json
     void Json(const Json &json);
 
+    // the text is sent as is, without being checked
     void Json(const std::string &str);
 
+    // struct bound with WFREST_JSON_STRUCT, serialized straight into the body
+    template<typename T, typename std::enable_if<is_json_struct<T>::value, int>::type = 0>
+    void Json(const T &obj)
+    {
+        this->headers["Content-Type"] = "application/json";
+        this->String(json_dump(obj));
+    }
+
     void set_status(int status_code);
     
     // Compress
@@ -241,6 +385,9 @@ public:
     
     void Http(const std::string &url)
     { this->Http(url, 0, 200 * 1024 * 1024); }
+
+    // fan-out, func is called when every call has an answer or reached its deadline
+    void Parallel(const std::vector<ParallelCall> &calls, const ParallelFunc &func);
     
     // MySQL
     void MySQL(const std::string &url, const std::string &sql);
@@ -256,6 +403,25 @@ public:
     void Redis(const std::string &url, const std::string &command,
             const std::vector<std::string>& params, const RedisFunc &func);
 
+    // The session of the request, loaded from the backend first if it is not in
+    // memory. nullptr without HttpServer::session(). See Session.h
+    void Session(const SessionFunc &func);
+
+    // gRPC, in the handlers of BluePrint::GRPC(). One message of the reply, queued
+    // on the connection at once, gzip compressed if compress and the client
+    // accepts it. See Grpc.h
+    void Grpc(const std::string &message, bool compress = false);
+
+    void Grpc(std::string &&message, bool compress = false);
+
+    // without the copy into a std::string, data lives until the call returns
+    void GrpcNocopy(const void *data, size_t size);
+
+    // grpc-status and grpc-message of the trailers, OK by default
+    void set_grpc_status(GrpcStatus status, const std::string &message = "");
+
+    void add_grpc_trailer(const std::string &name, const std::string &value);
+
     template<class FUNC, class... ARGS>
     void Compute(int compute_queue_id, FUNC&& func, ARGS&&... args)
     {
@@ -277,9 +443,38 @@ public:
 
     void add_task(SubTask *task);
 
+    // the reply of a stream of an HTTP/2 connection, see Http2StreamTask
+    void set_http2(const std::shared_ptr<Http2Connection> &http2, uint32_t stream_id)
+    {
+        http2_ = http2;
+        http2_stream_id_ = stream_id;
+    }
+
+    // The reply as the frames of its stream, queued on the connection.
+    // -1 if the stream is gone.
+    int reply_http2();
+
+    // the reply of a gRPC route, set by grpc_handler(), owned from now on
+    void set_grpc(GrpcReply *grpc);
+
+    // nullptr out of the gRPC routes
+    GrpcReply *grpc() const
+    { return grpc_.get(); }
+
+    // The reply so far is dropped, the user_data, the stream it goes to and
+    // the gRPC reply stay.
+    void drop_reply();
+
 private:
+    void send_grpc();
+
+    int reply_grpc();
+
     int compress(const std::string * const data, std::string *compress_data);
 
+    // replies 504 if the budget of the request is gone, see HttpServer::request_timeout()
+    bool past_deadline();
+
     void String(MultiPartEncoder *encoder);
 
 public:
@@ -301,6 +496,9 @@ public:
 
 private:
     std::vector<HttpCookie> cookies_;
+    std::shared_ptr<Http2Connection> http2_;
+    uint32_t http2_stream_id_ = 0;
+    std::unique_ptr<GrpcReply> grpc_;
 };
 
 using HttpTask = WFNetworkTask<HttpReq, HttpResp>;
@@ -0,0 +1,329 @@
+#include "workflow/WFTaskFactory.h"
+#include "workflow/Workflow.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <strings.h>
+#include <time.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "HttpParallel.h"
+#include "HttpMsg.h"
+#include "HttpServerTask.h"
+#include "Histogram.h"
+
+using namespace protocol;
+
+namespace wfrest
+{
+
+namespace
+{
+
+/*
+Every call of a fan-out may have up to three contenders : the primary task,
+the hedged task and the deadline timer. They run outside of the server series
+and race for the call's slot, the first one settles it and counts the counter task
+which holds the server series. The timers of the call are cancelled then, so no
+hedge is sent after an answer; a request which lost runs to its own timeout, as
+workflow can not cancel a network task once it is started.
+*/
+struct ParallelCtx
+{
+    std::vector<ParallelCall> calls;
+    std::vector<ParallelResult> results;
+    std::unique_ptr<std::atomic<bool>[]> settled;
+    WFCounterTask *counter;
+
+    explicit ParallelCtx(const std::vector<ParallelCall> &call_list)
+        : calls(call_list),
+        results(call_list.size()),
+        settled(new std::atomic<bool>[call_list.size()]),
+        counter(nullptr)
+    {
+        for (size_t i = 0; i < call_list.size(); i++)
+            settled[i] = false;
+    }
+};
+
+using ParallelCtxPtr = std::shared_ptr<ParallelCtx>;
+
+// of the hedge and deadline timers of a call
+std::string timer_name(const ParallelCtx *ctx, size_t idx)
+{
+    return "wfrest_parallel_" + std::to_string(reinterpret_cast<uintptr_t>(ctx)) +
+           "_" + std::to_string(idx);
+}
+
+bool settle(ParallelCtx *ctx, size_t idx)
+{
+    bool expected = false;
+    if (!ctx->settled[idx].compare_exchange_strong(expected, true))
+        return false;
+
+    WFTaskFactory::cancel_by_name(timer_name(ctx, idx));
+    return true;
+}
+
+const int k_default_timeout = 10 * 1000;
+// answers of a target before its p95 is used as hedge delay
+const uint64_t k_hedge_min_samples = 20;
+// the p95 is the one of the last two windows of answers
+const uint64_t k_latency_window = 1024;
+
+long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+enum class CallType
+{
+    HTTP,
+    MYSQL,
+    REDIS,
+};
+
+CallType call_type(const std::string &url)
+{
+    if (strncasecmp(url.c_str(), "mysql://", 8) == 0 ||
+        strncasecmp(url.c_str(), "mysqls://", 9) == 0)
+        return CallType::MYSQL;
+    if (strncasecmp(url.c_str(), "redis://", 8) == 0 ||
+        strncasecmp(url.c_str(), "rediss://", 9) == 0)
+        return CallType::REDIS;
+    return CallType::HTTP;
+}
+
+// scheme and authority : "http://user-service", "redis://cache:6379"
+std::string target_of(const std::string &url)
+{
+    size_t pos = url.find("://");
+    pos = pos == std::string::npos ? 0 : pos + 3;
+    return url.substr(0, url.find('/', pos));
+}
+
+struct TargetLatency
+{
+    std::vector<uint64_t> window;
+    std::vector<uint64_t> previous;     // empty until a window is full
+    uint64_t samples = 0;
+
+    TargetLatency() : window(Histogram::k_bucket_count, 0) {}
+};
+
+std::mutex latency_mutex;
+// leaked, a call may still answer while the process exits
+auto *target_latencies = new std::unordered_map<std::string, TargetLatency>;
+
+void record_latency(const std::string &target, long long latency_us)
+{
+    std::lock_guard<std::mutex> lock(latency_mutex);
+    TargetLatency &latency = (*target_latencies)[target];
+    latency.window[Histogram::bucket_of(latency_us > 0 ? latency_us : 0)]++;
+    if (++latency.samples == k_latency_window)
+    {
+        latency.previous.swap(latency.window);
+        latency.window.assign(Histogram::k_bucket_count, 0);
+        latency.samples = 0;
+    }
+}
+
+// -1 while the target has too few answers
+int p95_ms(const std::string &target)
+{
+    std::vector<uint64_t> counts;
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        auto it = target_latencies->find(target);
+        if (it == target_latencies->end())
+            return -1;
+
+        const TargetLatency &latency = it->second;
+        if (latency.previous.empty() && latency.samples < k_hedge_min_samples)
+            return -1;
+        counts = latency.window;
+        for (size_t i = 0; i < latency.previous.size(); i++)
+            counts[i] += latency.previous[i];
+    }
+    return static_cast<int>((Histogram::quantile(counts, 0.95) + 999) / 1000);
+}
+
+// Callback of a primary or hedged task : its latency is recorded, won or lost,
+// so that the slow answers beaten by a hedge still count in the p95.
+template<class TASK, class RESP>
+std::function<void (TASK *)> call_callback(const ParallelCtxPtr &ctx, size_t idx,
+                                           const std::string &url, bool hedged,
+                                           RESP ParallelResult::*resp)
+{
+    std::string target = target_of(url);
+    long long start_us = now_us();
+    return [ctx, idx, hedged, resp, target, start_us](TASK *task)
+    {
+        if (task->get_state() == WFT_STATE_SUCCESS)
+            record_latency(target, now_us() - start_us);
+
+        if (!settle(ctx.get(), idx))
+            return;
+
+        ParallelResult &result = ctx->results[idx];
+        result.state = task->get_state();
+        result.error = task->get_error();
+        result.hedged = hedged;
+        result.*resp = std::move(*task->get_resp());
+        ctx->counter->count();
+    };
+}
+
+template<class TASK>
+TASK *set_timeout(TASK *task, int timeout)
+{
+    if (timeout > 0)
+    {
+        task->set_send_timeout(timeout);
+        task->set_receive_timeout(timeout);
+    }
+    return task;
+}
+
+void start_call_task(const ParallelCtxPtr &ctx, size_t idx,
+                     const std::string &url, bool hedged)
+{
+    // ctx is held by the callbacks, so the call outlives the task
+    const ParallelCall &call = ctx->calls[idx];
+    switch (call_type(url))
+    {
+    case CallType::MYSQL:
+    {
+        WFMySQLTask *mysql_task = WFTaskFactory::create_mysql_task(url, 0,
+            call_callback<WFMySQLTask>(ctx, idx, url, hedged, &ParallelResult::mysql_resp));
+        mysql_task->get_req()->set_query(call.query);
+        set_timeout(mysql_task, call.timeout)->start();
+        return;
+    }
+    case CallType::REDIS:
+    {
+        WFRedisTask *redis_task = WFTaskFactory::create_redis_task(url, 0,
+            call_callback<WFRedisTask>(ctx, idx, url, hedged, &ParallelResult::redis_resp));
+        redis_task->get_req()->set_request(call.command, call.params);
+        set_timeout(redis_task, call.timeout)->start();
+        return;
+    }
+    default:
+        break;
+    }
+
+    std::string http_url = url;
+    if (strncasecmp(url.c_str(), "http://", 7) != 0 &&
+        strncasecmp(url.c_str(), "https://", 8) != 0)
+    {
+        http_url = "http://" + http_url;
+    }
+
+    WFHttpTask *http_task = WFTaskFactory::create_http_task(http_url, 0, 0,
+        call_callback<WFHttpTask>(ctx, idx, http_url, hedged, &ParallelResult::resp));
+    HttpRequest *req = http_task->get_req();
+    req->set_method(call.method);
+    if (!call.body.empty())
+        req->append_output_body_nocopy(call.body.c_str(), call.body.size());
+    set_timeout(http_task, call.timeout)->start();
+}
+
+void start_call(const ParallelCtxPtr &ctx, size_t idx)
+{
+    const ParallelCall &call = ctx->calls[idx];
+
+    int hedge_delay = call.hedge_delay;
+    if (!call.hedge_url.empty() && hedge_delay < 0)
+    {
+        const std::string &url = call.url;
+        bool has_scheme = url.find("://") != std::string::npos;
+        hedge_delay = p95_ms(target_of(has_scheme ? url : "http://" + url));
+    }
+
+    // the timers go first, so that an early answer finds them to cancel
+    if (!call.hedge_url.empty() && hedge_delay >= 0)
+    {
+        WFTimerTask *hedge_timer = WFTaskFactory::create_timer_task(timer_name(ctx.get(), idx),
+                                                                    hedge_delay / 1000,
+                                                                    hedge_delay % 1000 * 1000000L,
+        [ctx, idx](WFTimerTask *hedge_timer)
+        {
+            // cancelled once the call is settled
+            if (hedge_timer->get_state() != WFT_STATE_SUCCESS || ctx->settled[idx])
+                return;
+            start_call_task(ctx, idx, ctx->calls[idx].hedge_url, true);
+        });
+        hedge_timer->start();
+    }
+
+    WFTimerTask *deadline_timer = WFTaskFactory::create_timer_task(timer_name(ctx.get(), idx),
+                                                                   call.timeout / 1000,
+                                                                   call.timeout % 1000 * 1000000L,
+    [ctx, idx](WFTimerTask *deadline_timer)
+    {
+        if (deadline_timer->get_state() != WFT_STATE_SUCCESS || !settle(ctx.get(), idx))
+            return;
+
+        ParallelResult &result = ctx->results[idx];
+        result.state = WFT_STATE_SYS_ERROR;
+        result.error = ETIMEDOUT;
+        result.timeout = true;
+        ctx->counter->count();
+    });
+    deadline_timer->start();
+
+    start_call_task(ctx, idx, call.url, false);
+}
+
+}  // namespace
+
+void HttpParallel::fanout(const std::vector<ParallelCall> &calls,
+                          const ParallelFunc &func, HttpResp *resp)
+{
+    HttpServerTask *server_task = task_of(resp);
+    if (server_task->deadline_exceeded())
+    {
+        server_task->expire();
+        return;
+    }
+
+    auto ctx = std::make_shared<ParallelCtx>(calls);
+    // the calls answer within the budget of the request, as timeouts
+    int remaining_ms = server_task->remaining_ms();
+    for (ParallelCall &call : ctx->calls)
+    {
+        // never wait for ever on a backend which hangs
+        if (call.timeout <= 0)
+            call.timeout = k_default_timeout;
+        if (remaining_ms > 0 && call.timeout > remaining_ms)
+            call.timeout = remaining_ms;
+    }
+
+    // Counting before the counter task starts is fine,
+    // it only finishes after it has been dispatched by the series.
+    WFCounterTask *counter = WFTaskFactory::create_counter_task(calls.size(),
+    [ctx, func, resp](WFCounterTask *)
+    {
+        if (func)
+            func(ctx->results, resp);
+    });
+    ctx->counter = counter;
+
+    // The merge function may reference the result bodies with
+    // append_output_body_nocopy(), keep them until the reply is sent.
+    server_task->add_callback([ctx](HttpTask *) {});
+    **server_task << counter;
+    if (remaining_ms > 0)
+        server_task->check_deadline();
+
+    for (size_t i = 0; i < calls.size(); i++)
+        start_call(ctx, i);
+}
+
+}  // namespace wfrest
@@ -0,0 +1,81 @@
+#ifndef WFREST_HTTPPARALLEL_H_
+#define WFREST_HTTPPARALLEL_H_
+
+#include "workflow/HttpMessage.h"
+#include "workflow/MySQLMessage.h"
+#include "workflow/RedisMessage.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace wfrest
+{
+
+class HttpResp;
+
+// One backend call of a fan-out, the scheme of url picks the protocol :
+// http:// or https:// (the default), mysql:// or mysqls://, redis:// or rediss://.
+struct ParallelCall
+{
+    std::string url;
+
+    // http
+    std::string method = "GET";
+    std::string body;
+
+    // mysql
+    std::string query;
+
+    // redis
+    std::string command;
+    std::vector<std::string> params;
+
+    // per-call deadline in milliseconds, -1 means 10 seconds.
+    // Cut to what is left of the deadline of the request.
+    int timeout = -1;
+
+    // Hedged request : if the primary has not answered after hedge_delay ms,
+    // send the same request to hedge_url as well. The first answer wins.
+    // -1 means the p95 latency of the target of url, measured by the calls
+    // of the process, and no hedging until it has enough answers.
+    std::string hedge_url;
+    int hedge_delay = -1;
+
+    ParallelCall() = default;
+
+    ParallelCall(const std::string &url) : url(url) {}
+
+    ParallelCall(const std::string &url, int timeout)
+        : url(url), timeout(timeout)
+    {}
+};
+
+struct ParallelResult
+{
+    int state = -1;     // WFT_STATE_XXX of the winning task
+    int error = 0;
+    bool timeout = false;   // deadline reached before any answer
+    bool hedged = false;    // the answer comes from hedge_url
+
+    // Moved from the winning task, the one of the protocol of the call.
+    // The body is not copied : it stays valid until the server response
+    // has been sent, so it can be passed to append_output_body_nocopy().
+    protocol::HttpResponse resp;
+    protocol::MySQLResponse mysql_resp;
+    protocol::RedisResponse redis_resp;
+};
+
+class HttpParallel
+{
+public:
+    using ParallelFunc = std::function<void(std::vector<ParallelResult> &results, HttpResp *resp)>;
+
+public:
+    static void fanout(const std::vector<ParallelCall> &calls,
+                       const ParallelFunc &func, HttpResp *resp);
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_HTTPPARALLEL_H_
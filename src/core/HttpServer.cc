@@ -1,5 +1,13 @@
 #include "workflow/HttpMessage.h"
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <string.h>
+#include <stdlib.h>
+#include <linux/filter.h>
+#include <unistd.h>
+#include <errno.h>
 #include <utility>
 
 #include "HttpServer.h"
@@ -20,9 +28,44 @@ void HttpServer::process(HttpTask *task)
 
     auto *req = server_task->get_req();
     auto *resp = server_task->get_resp();
+    QueueTicket handler_ticket = req->take_handler_ticket();
+    QueueScope handler_scope(handler_ticket);
+
+    // the streamed file parts may still be written to disk
+    MultiPartStream *multipart_stream = req->multipart_stream();
+    if (multipart_stream)
+    {
+        WFCounterTask *flush_task = multipart_stream->create_flush_task(
+        [this, task](WFCounterTask *)
+        {
+            this->process(task);
+        });
+        if (flush_task)
+        {
+            **server_task << flush_task;
+            return;
+        }
+    }
+
+    // an upload back from the wait for its files has no ticket, it is never shed
+    if (overload_ && handler_ticket.enqueue_us != 0 && !this->admit(server_task, handler_ticket.enqueue_us))
+        return;
     
+    long long start_us = metrics_ || access_log_ ? HttpMetrics::now_us() : 0;
+    server_task->mark_timing(RequestTiming::RECV_END);
+
     req->fill_header_map();
     req->fill_content_type();
+    server_task->mark_timing(RequestTiming::HEADER_PARSED);
+
+    if (request_timeout_ > 0)
+        server_task->set_timeout(request_timeout_);
+    if (!timeout_header_.empty())
+    {
+        const std::string &client_timeout = req->header(timeout_header_);
+        if (!client_timeout.empty())
+            server_task->set_client_timeout(atoi(client_timeout.c_str()));
+    }
 
     const std::string &host = req->header("Host");
     
@@ -39,6 +82,7 @@ void HttpServer::process(HttpTask *task)
         resp->set_status(HttpStatusBadRequest);
         return;
     }
+    server_task->mark_timing(RequestTiming::URI_PARSED);
 
     std::string route;
 
@@ -55,11 +99,22 @@ void HttpServer::process(HttpTask *task)
 
     req->set_parsed_uri(std::move(uri));
     std::string verb = req->get_method();
-    int ret = blue_print_.router().call(str_to_verb(verb), CodeUtil::url_encode(route), server_task);
+    RoutesVersion *routes = live_routes_.acquire();
+    server_task->set_routes(routes);
+    int ret = routes->router().call(str_to_verb(verb), CodeUtil::url_encode(route), server_task);
     if(ret != StatusOK)
     {
         resp->Error(ret, verb + " " + route);
     }
+    server_task->mark_timing(RequestTiming::PROCESS_END);
+    if (metrics_)
+    {
+        metrics_->track(server_task, start_us);
+    }
+    if (access_log_)
+    {
+        access_log_->log(server_task, start_us);
+    }
     if(track_func_)
     {
         server_task->add_callback(track_func_);
@@ -68,17 +123,424 @@ void HttpServer::process(HttpTask *task)
 
 CommSession *HttpServer::new_session(long long seq, CommConnection *conn)
 {
-    HttpTask *task = new HttpServerTask(this, this->WFServer<HttpReq, HttpResp>::process);
-    task->set_keep_alive(this->params.keep_alive_timeout);
-    task->set_receive_timeout(this->params.receive_timeout);
-    task->get_req()->set_size_limit(this->params.request_size_limit);
-
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    auto *task = new HttpServerTask(this, this->WFServer<HttpReq, HttpResp>::process);
+    this->init_session(task, this->params, seq);
     return task;
 }
 
+void HttpServer::init_session(HttpServerTask *task, const struct WFServerParams &params,
+                              long long seq)
+{
+    task->set_keep_alive(params.keep_alive_timeout);
+    task->set_receive_timeout(params.receive_timeout);
+    task->get_req()->set_size_limit(params.request_size_limit);
+    task->get_req()->set_multipart_params(multipart_params_.get());
+    if (overload_)
+        task->get_req()->set_queue_clock(true);
+    task->set_draining(&draining_);
+    task->set_sessions(sessions_.get());
+    if (http2_ && seq == 0)
+    {
+        const struct WFServerParams *stream_params = &params;
+        task->get_req()->set_http2_service(http2_.get(),
+            [this, task, stream_params](const std::shared_ptr<Http2Connection> &http2,
+                                        Http2Request *request)
+        {
+            Http2StreamTask *stream = task->new_stream(http2, request->stream_id);
+            this->init_session(stream, *stream_params, -1);
+            stream->start(request->message);
+        });
+    }
+    if (timing_params_ && timing_sample_++ % timing_params_->sample_every == 0)
+    {
+        task->enable_timing(timing_params_->server_timing_header);
+        task->mark_timing(RequestTiming::RECV_BEGIN);
+    }
+}
+
+int HttpServer::create_listen_fd()
+{
+    int fd = this->inherit_listen_fd(reuse_port_ ? "shard0" : "main", WFServer::create_listen_fd());
+    if (fd >= 0 && reuse_port_)
+    {
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof reuse);
+    }
+    listen_fd_ = fd;
+    return fd;
+}
+
+WFConnection *HttpServer::new_connection(int accept_fd)
+{
+    accepted_.fetch_add(1, std::memory_order_relaxed);
+    if (!this->admit_connection(this->get_conn_count(), this->params.max_connections))
+    {
+        errno = EMFILE;
+        return nullptr;
+    }
+    return WFServer::new_connection(accept_fd);
+}
+
+bool HttpServer::admit(HttpServerTask *server_task, long long enqueue_us)
+{
+    HttpReq *req = server_task->get_req();
+    RoutePriority priority = RoutePriority::NORMAL;
+    // the path without the query, before the full uri parsing
+    const char *uri = req->get_request_uri();
+    if (uri)
+    {
+        const char *query = strchr(uri, '?');
+        priority = overload_->priority(query ? std::string(uri, query) : std::string(uri));
+    }
+
+    long long now = QueueStatsRegistry::now_us();
+    if (!overload_->admit(now - enqueue_us, priority, now))
+    {
+        overload_->reply_overloaded(server_task->get_resp());
+        return false;
+    }
+
+    OverloadController *overload = overload_.get();
+    server_task->add_callback([overload](HttpTask *)
+    {
+        overload->release();
+    });
+    return true;
+}
+
+bool HttpServer::admit_connection(size_t conn_count, size_t max_connections)
+{
+    return !overload_ || overload_->accept_connection(conn_count, max_connections);
+}
+
+HttpServer &HttpServer::overload_control(const OverloadParams &params)
+{
+    overload_.reset(new OverloadController(params));
+    return *this;
+}
+
+OverloadStats HttpServer::overload_stats() const
+{
+    if (overload_)
+        return overload_->stats();
+    return OverloadStats();
+}
+
+SessionStats HttpServer::session_stats() const
+{
+    if (sessions_)
+        return sessions_->stats();
+    return SessionStats();
+}
+
+Http2Stats HttpServer::http2_stats() const
+{
+    if (http2_)
+        return http2_->stats();
+    return Http2Stats();
+}
+
+SSL_CTX *HttpServer::new_ssl_ctx()
+{
+    return this->configure_ssl_ctx(WFServer::new_ssl_ctx());
+}
+
+SSL_CTX *HttpServer::configure_ssl_ctx(SSL_CTX *ssl_ctx)
+{
+    if (ssl_ctx && tls_ && tls_->configure(ssl_ctx) < 0)
+    {
+        SSL_CTX_free(ssl_ctx);
+        errno = EINVAL;
+        return nullptr;
+    }
+    return ssl_ctx;
+}
+
+HttpServer &HttpServer::tls(const TlsParams &params)
+{
+    tls_.reset(new TlsContext(params));
+    return *this;
+}
+
+TlsStats HttpServer::tls_stats() const
+{
+    if (tls_)
+        return tls_->stats();
+    TlsStats stats;
+    memset(&stats, 0, sizeof stats);
+    return stats;
+}
+
+// A[cpu] -> return cpu_map[cpu] or cpu % shards, the index of the socket
+// in the reuseport group, in the order they started listening.
+static int attach_cpu_steering(int fd, int shards, const std::vector<int> &cpu_map)
+{
+    // BPF_MAXINSNS is 4096
+    if (cpu_map.size() > 2000)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    std::vector<struct sock_filter> code;
+    code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<__u32>(SKF_AD_OFF + SKF_AD_CPU)));
+    for (size_t cpu = 0; cpu < cpu_map.size(); cpu++)
+    {
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<__u32>(cpu), 0, 1));
+        code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<__u32>(cpu_map[cpu] % shards)));
+    }
+    code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<__u32>(shards)));
+    code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+
+    struct sock_fprog prog;
+    prog.len = static_cast<unsigned short>(code.size());
+    prog.filter = code.data();
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof prog);
+}
+
+int HttpServer::start_sharded(const char *host, unsigned short port, const ShardParams &params)
+{
+    int shards = params.shards;
+    if (shards <= 0)
+        shards = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    if (shards <= 0)
+        shards = 1;
+    for (int shard : params.cpu_map)
+    {
+        if (shard < 0)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    reuse_port_ = true;
+    if (this->start(AF_INET, host, port) < 0)
+        return -1;
+
+    // the port picked by the kernel if port is 0
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof addr;
+    if (this->get_listen_addr(reinterpret_cast<struct sockaddr *>(&addr), &addrlen) < 0)
+    {
+        this->stop();
+        return -1;
+    }
+
+    for (int i = 1; i < shards; i++)
+    {
+        listeners_.emplace_back(new HttpListener(this, "shard" + std::to_string(i),
+                                                 this->params, true));
+        if (listeners_.back()->start(reinterpret_cast<struct sockaddr *>(&addr), addrlen) < 0)
+        {
+            listeners_.pop_back();
+            this->stop();
+            return -1;
+        }
+    }
+
+    if (params.steer_by_cpu && attach_cpu_steering(listen_fd_, shards, params.cpu_map) < 0)
+    {
+        this->stop();
+        return -1;
+    }
+    return 0;
+}
+
+int HttpServer::add_listener(const std::string &name, const struct sockaddr *addr, socklen_t addrlen,
+                             const ListenerParams &params)
+{
+    const char *cert_file = nullptr;
+    const char *key_file = nullptr;
+    if (!params.cert_file.empty() && !params.key_file.empty())
+    {
+        cert_file = params.cert_file.c_str();
+        key_file = params.key_file.c_str();
+    }
+
+    listeners_.emplace_back(new HttpListener(this, params.name.empty() ? name : params.name,
+                                             params.server_params, false));
+    if (listeners_.back()->listen(addr, addrlen, cert_file, key_file) < 0)
+    {
+        listeners_.pop_back();
+        return -1;
+    }
+    return 0;
+}
+
+int HttpServer::listen(const char *host, unsigned short port, const ListenerParams &params)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+    struct addrinfo *res;
+    std::string service = std::to_string(port);
+    int ret = getaddrinfo(host, service.c_str(), &hints, &res);
+    if (ret != 0)
+    {
+        errno = ret == EAI_SYSTEM ? errno : EINVAL;
+        return -1;
+    }
+
+    std::string name = std::string("tcp:") + (host ? host : "*") + ":" + service;
+    ret = this->add_listener(name, res->ai_addr, res->ai_addrlen, params);
+    freeaddrinfo(res);
+    return ret;
+}
+
+int HttpServer::listen_unix(const std::string &path, const ListenerParams &params)
+{
+    struct sockaddr_un addr;
+    if (path.empty() || path.size() >= sizeof addr.sun_path)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return this->add_listener("unix:" + path, reinterpret_cast<struct sockaddr *>(&addr),
+                              sizeof addr, params);
+}
+
+std::vector<ListenerStats> HttpServer::listener_stats() const
+{
+    std::vector<ListenerStats> stats;
+    stats.push_back(ListenerStats{reuse_port_ ? "shard0" : "main",
+                                  this->get_conn_count(),
+                                  accepted_.load(std::memory_order_relaxed),
+                                  requests_.load(std::memory_order_relaxed)});
+    for (const auto &listener : listeners_)
+        stats.push_back(listener->stats());
+    return stats;
+}
+
+void HttpServer::shutdown()
+{
+    for (auto &listener : listeners_)
+        listener->shutdown();
+
+    // the server itself may not be started when it only serves listen() endpoints
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof addr;
+    serving_ = this->get_listen_addr(reinterpret_cast<struct sockaddr *>(&addr), &addrlen) == 0;
+    if (serving_)
+        WFServer::shutdown();
+}
+
+void HttpServer::wait_finish()
+{
+    for (auto &listener : listeners_)
+        listener->wait_finish();
+    if (serving_)
+        WFServer::wait_finish();
+    // the changes not written back yet
+    if (sessions_)
+        sessions_->flush(true);
+    serving_ = false;
+    listeners_.clear();
+    reuse_port_ = false;
+    listen_fd_ = -1;
+}
+
+int HttpServer::inherit_listen_fd(const std::string &name, int fd)
+{
+    int inherited = upgrade_ && fd >= 0 ? upgrade_->take(name) : -1;
+    if (inherited < 0)
+        return fd;
+
+    // the fd workflow knows becomes the bound socket, so its bind() is skipped
+    dup2(inherited, fd);
+    close(inherited);
+    return fd;
+}
+
+int HttpServer::inherit_sockets(const std::string &upgrade_path, int timeout_ms)
+{
+    if (!upgrade_)
+        upgrade_.reset(new Upgrade);
+    return upgrade_->inherit(upgrade_path, timeout_ms);
+}
+
+int HttpServer::serve_upgrades(const std::string &upgrade_path)
+{
+    if (!upgrade_)
+        upgrade_.reset(new Upgrade);
+    upgrade_->ready();
+    return upgrade_->serve(upgrade_path, [this]() { return this->upgrade_sockets(); });
+}
+
+std::vector<UpgradeSocket> HttpServer::upgrade_sockets() const
+{
+    std::vector<UpgradeSocket> sockets;
+    if (listen_fd_ >= 0)
+        sockets.push_back(UpgradeSocket{reuse_port_ ? "shard0" : "main", listen_fd_});
+    for (const auto &listener : listeners_)
+    {
+        if (listener->listen_fd() >= 0)
+            sockets.push_back(UpgradeSocket{listener->stats().name, listener->listen_fd()});
+    }
+    return sockets;
+}
+
+size_t HttpServer::connection_count() const
+{
+    size_t count = this->get_conn_count();
+    for (const auto &listener : listeners_)
+        count += listener->get_conn_count();
+    return count;
+}
+
+bool HttpServer::wait_upgraded(int drain_timeout_ms)
+{
+    if (!upgrade_ || !upgrade_->wait_handoff())
+        return false;
+
+    // the next process accepts from the same sockets, their backlog included
+    long long begin = HttpMetrics::now_us();
+    draining_.store(true, std::memory_order_relaxed);
+    for (auto &listener : listeners_)
+        listener->keep_socket_file();
+    this->shutdown();
+    upgrade_->stop();
+
+    long long deadline = begin + drain_timeout_ms * 1000LL;
+    while (this->connection_count() > 0 && HttpMetrics::now_us() < deadline)
+        usleep(10 * 1000);
+    if (this->connection_count() > 0)
+        return false;
+
+    this->wait_finish();
+    upgrade_->set_drain_us(HttpMetrics::now_us() - begin);
+    return true;
+}
+
+UpgradeStats HttpServer::upgrade_stats() const
+{
+    if (upgrade_)
+        return upgrade_->stats();
+    return UpgradeStats{0, -1, -1, 0, -1};
+}
+
 void HttpServer::list_routes()
 {
-    blue_print_.router().print_routes();
+    RoutesVersion *routes = live_routes_.acquire();
+    routes->router().print_routes();
+    routes->unref();
+}
+
+unsigned long long HttpServer::reload(const BluePrint &bp, bool startup_routes)
+{
+    std::unique_ptr<BluePrint> blue_print(new BluePrint);
+    if (startup_routes)
+        blue_print->merge(blue_print_);
+    blue_print->merge(bp);
+    return live_routes_.publish(std::move(blue_print));
 }
 
 void HttpServer::register_blueprint(const BluePrint &bp, const std::string& url_prefix)
@@ -125,32 +587,55 @@ int HttpServer::serve_static(const char* path, OUT BluePrint &bp)
 
 HttpServer &HttpServer::track()
 {
-    track_func_ = [](HttpTask *server_task) {
-        HttpResp *resp = server_task->get_resp();
-        HttpReq *req = server_task->get_req();
-        HttpServerTask *task = static_cast<HttpServerTask *>(server_task);
-        Timestamp current_time = Timestamp::now();
-        std::string fmt_time = current_time.to_format_str();
-        // time | http status code | peer ip address | verb | route path
-        fprintf(stderr, "[WFREST] %s | %s | %s : %d | %s | \"%s\" | -- \n", 
-                    fmt_time.c_str(),
-                    resp->get_status_code(),
-                    task->peer_addr().c_str(),
-                    task->peer_port(), 
-                    req->get_method(),
-                    req->current_path().c_str());
-    };
+    // the last track() or track(func) wins
+    track_func_ = nullptr;
+    access_log_.reset(new AccessLog(AccessLogParams()));
+    track_log_ = true;
     return *this;
 }
 
-HttpServer &HttpServer::track(const TrackFunc &track_func)
+HttpServer &HttpServer::access_log(const AccessLogParams &params)
+{
+    access_log_.reset(new AccessLog(params));
+    track_log_ = false;
+    return *this;
+}
+
+HttpServer &HttpServer::timing(const RequestTimingParams &params)
+{
+    timing_params_.reset(new RequestTimingParams(params));
+    if (timing_params_->sample_every == 0)
+        timing_params_->sample_every = 1;
+    // calibrate the clock now instead of in the first request
+    CycleClock::ns_per_tick();
+    return *this;
+}
+
+HttpServer &HttpServer::metrics(const std::string &route)
 {
-    track_func_ = track_func;
+    metrics_.reset(new HttpMetrics);
+    HttpMetrics *metrics = metrics_.get();
+    blue_print_.GET(route, [metrics](const HttpReq *req, HttpResp *resp)
+    {
+        resp->headers["Content-Type"] = "text/plain; version=0.0.4";
+        resp->String(metrics->expose());
+    });
     return *this;
 }
 
+HttpServer &HttpServer::track(const TrackFunc &track_func)
+{
+    return this->track(TrackFunc(track_func));
+}
+
 HttpServer &HttpServer::track(TrackFunc &&track_func)
 {
+    // replaces the log of track(), not the one of access_log()
+    if (track_log_)
+    {
+        access_log_.reset();
+        track_log_ = false;
+    }
     track_func_ = std::move(track_func);
     return *this;
 }
@@ -6,13 +6,38 @@
 
 #include <unordered_map>
 #include <string>
+#include <atomic>
+#include <vector>
+#include <memory>
 
 #include "HttpMsg.h"
 #include "BluePrint.h"
+#include "HttpMetrics.h"
+#include "AccessLog.h"
+#include "RequestTiming.h"
+#include "HttpListener.h"
+#include "TlsContext.h"
+#include "OverloadController.h"
+#include "Upgrade.h"
+#include "LiveRoutes.h"
+#include "Session.h"
+#include "Http2.h"
 
 namespace wfrest
 {
 
+struct ShardParams
+{
+    // listening sockets, 0 for one per online cpu
+    int shards;
+    // Pick the socket of a connection by the cpu which receives its packets,
+    // with a reuseport bpf program, instead of the hash of the address.
+    bool steer_by_cpu;
+    // with steer_by_cpu, the socket of the connections received on cpu i is
+    // cpu_map[i], cpu % shards for the cpus past the map
+    std::vector<int> cpu_map;
+};
+
 class HttpServer : public WFServer<HttpReq, HttpResp>, public Noncopyable
 {
 public:
@@ -397,12 +422,53 @@ public:
         blue_print_.HEAD(route, compute_queue_id, handler, ap...);
     }
 
+public:
+    // gRPC over HTTP/2, needs http2(), see BluePrint::GRPC()
+    void GRPC(const std::string &route, const Handler &handler)
+    {
+        blue_print_.GRPC(route, handler);
+    }
+
+    void GRPC(const std::string &route, int compute_queue_id, const Handler &handler)
+    {
+        blue_print_.GRPC(route, compute_queue_id, handler);
+    }
+
+    template<typename... AP>
+    void GRPC(const std::string &route, const Handler &handler, const AP &... ap)
+    {
+        blue_print_.GRPC(route, handler, ap...);
+    }
+
+    template<typename... AP>
+    void GRPC(const std::string &route, int compute_queue_id,
+              const Handler &handler, const AP &... ap)
+    {
+        blue_print_.GRPC(route, compute_queue_id, handler, ap...);
+    }
+
 public:
     void Static(const char *relative_path, const char *root);
 
     void list_routes();
 
     void register_blueprint(const BluePrint &bp, const std::string &url_prefix);
+
+    // Replace the routes while serving : the routes registered before start() and
+    // the ones of bp, which take over their paths, replace the ones of the last reload().
+    // The table is built on the calling thread and swapped without locking the
+    // requests, which keep the table they started with. Returns the new version.
+    unsigned long long reload(const BluePrint &bp)
+    {
+        return this->reload(bp, true);
+    }
+
+    // without startup_routes, the table is the routes of bp only : the routes
+    // registered before start() are disabled until a reload() keeps them again
+    unsigned long long reload(const BluePrint &bp, bool startup_routes);
+
+    // 1 until the first reload()
+    unsigned long long routes_version() const { return live_routes_.version(); }
     
     template <typename... AP>
     void Use(AP &&...ap)
@@ -413,9 +479,84 @@ public:
 
 public:
     HttpServer() :
-            WFServer(std::bind(&HttpServer::process, this, std::placeholders::_1))
+            WFServer(std::bind(&HttpServer::process, this, std::placeholders::_1)),
+            live_routes_(&blue_print_),
+            track_log_(false),
+            timing_sample_(0),
+            request_timeout_(0),
+            reuse_port_(false),
+            listen_fd_(-1),
+            serving_(false),
+            draining_(false),
+            accepted_(0),
+            requests_(0)
     {}
 
+    // Listen on shards SO_REUSEPORT sockets of the same port, which share the routes.
+    // The kernel spreads the connections over the sockets instead of waking
+    // every poller on one accept queue. host nullptr listens on all addresses.
+    int start_sharded(const char *host, unsigned short port, const ShardParams &params);
+
+    int start_sharded(unsigned short port, int shards)
+    {
+        ShardParams params = { shards, false, {} };
+        return this->start_sharded(nullptr, port, params);
+    }
+
+    // Serve the routes on one more endpoint, with its own params.
+    // Works with or without start(), stop() closes every endpoint.
+    // host nullptr listens on all addresses.
+    int listen(const char *host, unsigned short port, const ListenerParams &params);
+
+    // with the params of the server
+    int listen(const char *host, unsigned short port)
+    {
+        ListenerParams params;
+        params.server_params = this->params;
+        return this->listen(host, port, params);
+    }
+
+    // AF_UNIX endpoint for local clients, no tcp on the way
+    int listen_unix(const std::string &path, const ListenerParams &params);
+
+    int listen_unix(const std::string &path)
+    {
+        ListenerParams params;
+        params.server_params = this->params;
+        return this->listen_unix(path, params);
+    }
+
+    // the server itself first
+    std::vector<ListenerStats> listener_stats() const;
+
+    // Zero downtime upgrade, see Upgrade.h. In the new binary, before start() and
+    // listen() : they take the listening sockets of the process serving upgrade_path,
+    // by endpoint name, instead of binding new ones. 0 if there is no such process.
+    int inherit_sockets(const std::string &upgrade_path, int timeout_ms = 5000);
+
+    // Once every endpoint is started : the previous process, if any, starts to drain,
+    // and the next binary can take the sockets from upgrade_path.
+    int serve_upgrades(const std::string &upgrade_path);
+
+    // Blocks until the next binary serves the sockets, then stops accepting and
+    // answers with "Connection: close" until the connections are closed or
+    // drain_timeout_ms. The server is stopped when it returns, false if connections
+    // are left (or serve_upgrades() was not called) : exit the process.
+    bool wait_upgraded(int drain_timeout_ms = 30000);
+
+    UpgradeStats upgrade_stats() const;
+
+    // stop the extra listeners too
+    void stop()
+    {
+        this->shutdown();
+        this->wait_finish();
+    }
+
+    void shutdown();
+
+    void wait_finish();
+
     HttpServer &max_connections(size_t max_connections)
     {
         this->params.max_connections = max_connections;
@@ -452,8 +593,121 @@ public:
         return *this;
     }
 
+    // Budget of every request in ms from its arrival. The tasks started through
+    // HttpResp time out with what is left of it, and the request gets a 504
+    // once it is gone. DeadlineAop sets it per route.
+    HttpServer &request_timeout(int timeout_ms)
+    {
+        request_timeout_ = timeout_ms;
+        return *this;
+    }
+
+    // Budget the clients send in a header, in ms. It can only shorten the one
+    // of the server or the route.
+    HttpServer &request_timeout_header(const std::string &name = "X-Request-Timeout")
+    {
+        timeout_header_ = name;
+        return *this;
+    }
+
+    // Shed the requests which waited too long for a handler thread, and cap
+    // the requests in flight, with a 503. See OverloadController.h
+    HttpServer &overload_control(const OverloadParams &params);
+
+    HttpServer &overload_control()
+    {
+        return this->overload_control(OverloadParams());
+    }
+
+    // zeros without overload_control()
+    OverloadStats overload_stats() const;
+
+    // Server side sessions behind a signed cookie, see HttpResp::Session() and Session.h
+    HttpServer &session(const SessionParams &params)
+    {
+        sessions_ = std::make_shared<SessionStore>(params);
+        return *this;
+    }
+
+    HttpServer &session()
+    {
+        return this->session(SessionParams());
+    }
+
+    // zeros without session()
+    SessionStats session_stats() const;
+
+    // HTTP/2 on the connections which start with the client preface, with
+    // prior knowledge : the replies go out as the client sends frames, so
+    // "h2" is not offered to ALPN. The other ones stay HTTP/1.1. See Http2.h
+    HttpServer &http2(const Http2Params &params)
+    {
+        http2_.reset(new Http2Service(params));
+        return *this;
+    }
+
+    HttpServer &http2()
+    {
+        return this->http2(Http2Params());
+    }
+
+    // zeros without http2()
+    Http2Stats http2_stats() const;
+
+    // Parse multipart/form-data bodies while they are received and write the
+    // file parts to temp files, instead of buffering the whole body.
+    HttpServer &stream_multipart(const MultiPartStreamParams &params)
+    {
+        multipart_params_.reset(new MultiPartStreamParams(params));
+        return *this;
+    }
+
+    HttpServer &stream_multipart()
+    {
+        return this->stream_multipart(MultiPartStreamParams());
+    }
+
+    // Collect per-route request metrics and expose them in
+    // Prometheus text format on GET route.
+    HttpServer &metrics(const std::string &route = "/metrics");
+
+    // Timestamp the phases of one request out of params.sample_every, see RequestTiming.h.
+    // The timings are in HttpServerTask::timing(), the access log and the Server-Timing header.
+    HttpServer &timing(const RequestTimingParams &params);
+
+    HttpServer &timing()
+    {
+        return this->timing(RequestTimingParams());
+    }
+
+    // Log every request through a background writer, see AccessLog.h
+    HttpServer &access_log(const AccessLogParams &params);
+
+    // records dropped because the access log could not keep up
+    unsigned long long access_log_dropped() const
+    {
+        return access_log_ ? access_log_->dropped() : 0;
+    }
+
+    // Session cache, ticket keys, ALPN and ciphers of the https endpoints,
+    // see TlsContext.h. Call before start() and listen().
+    HttpServer &tls(const TlsParams &params);
+
+    // zeros without tls()
+    TlsStats tls_stats() const;
+
+    // new ticket key now, e.g. on a suspected leak, or read
+    // TlsParams::ticket_key_file again after it was rewritten
+    void rotate_ticket_keys()
+    {
+        if (tls_)
+            tls_->rotate_ticket_keys();
+    }
+
     using TrackFunc = std::function<void(HttpTask *server_task)>;
     
+    // access log in the [WFREST] format to stderr,
+    // the last track() or track(func) replaces the other one
     HttpServer &track();
 
     HttpServer &track(const TrackFunc &track_func);
@@ -465,9 +719,44 @@ public:
 protected:
     CommSession *new_session(long long seq, CommConnection *conn) override;
 
+    int create_listen_fd() override;
+
+    WFConnection *new_connection(int accept_fd) override;
+
+    SSL_CTX *new_ssl_ctx() override;
+
 private:
     void process(HttpTask *task);
 
+    // apply tls() to the SSL_CTX of an endpoint
+    SSL_CTX *configure_ssl_ctx(SSL_CTX *ssl_ctx);
+
+    int add_listener(const std::string &name, const struct sockaddr *addr, socklen_t addrlen,
+                     const ListenerParams &params);
+
+    // the server part of a new task, shared with the listeners.
+    // seq : of the request on its connection, -1 for a stream of HTTP/2
+    void init_session(HttpServerTask *task, const struct WFServerParams &params, long long seq);
+
+    // false to shed the request, replied with a 503
+    bool admit(HttpServerTask *server_task, long long enqueue_us);
+
+    // false to refuse a new connection of an endpoint while overloaded
+    bool admit_connection(size_t conn_count, size_t max_connections);
+
+    // replaces the new socket fd of an endpoint with the inherited one, if any
+    int inherit_listen_fd(const std::string &name, int fd);
+
+    bool inherits(const std::string &name) const
+    { return upgrade_ && upgrade_->has(name); }
+
+    // the listening sockets handed over by serve_upgrades()
+    std::vector<UpgradeSocket> upgrade_sockets() const;
+
+    size_t connection_count() const;
+
+    friend class HttpListener;
+
     int serve_static(const char *path, OUT BluePrint &bp);
     
     struct GlobalAspectFunc 
@@ -483,7 +772,28 @@ private:
     
 private:
     BluePrint blue_print_;
+    LiveRoutes live_routes_;
     TrackFunc track_func_;
+    std::unique_ptr<MultiPartStreamParams> multipart_params_;
+    std::unique_ptr<HttpMetrics> metrics_;
+    std::unique_ptr<AccessLog> access_log_;
+    bool track_log_;    // access_log_ is the one of track()
+    std::unique_ptr<RequestTimingParams> timing_params_;
+    std::unique_ptr<TlsContext> tls_;
+    std::unique_ptr<OverloadController> overload_;
+    std::unique_ptr<Upgrade> upgrade_;
+    std::shared_ptr<SessionStore> sessions_;    // its write back timer holds a weak_ptr
+    std::unique_ptr<Http2Service> http2_;
+    std::atomic<unsigned int> timing_sample_;
+    int request_timeout_;
+    std::string timeout_header_;
+    bool reuse_port_;
+    int listen_fd_;
+    bool serving_;      // the server itself was listening at shutdown()
+    std::atomic<bool> draining_;    // handed over by an upgrade, keep-alive is off
+    std::atomic<unsigned long long> accepted_;
+    std::atomic<unsigned long long> requests_;
+    std::vector<std::unique_ptr<HttpListener>> listeners_;
 };
 
 }  // namespace wfrest
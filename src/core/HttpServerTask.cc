@@ -1,9 +1,17 @@
 #include "workflow/HttpUtil.h"
 #include "workflow/HttpMessage.h"
+#include "workflow/WFTaskFactory.h"
 
 #include <arpa/inet.h>
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
 
 #include "HttpServerTask.h"
+#include "LiveRoutes.h"
+#include "Http2.h"
+#include "Grpc.h"
 #include "StrUtil.h"
 
 using namespace protocol;
@@ -15,6 +23,18 @@ using namespace protocol;
 namespace wfrest
 {
 
+namespace
+{
+
+long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+}  // namespace
+
 HttpServerTask::HttpServerTask(CommService *service,
                                ProcFunc& process) :
         WFServerTask(service, WFGlobal::get_scheduler(), process),
@@ -22,6 +42,7 @@ HttpServerTask::HttpServerTask(CommService *service,
         req_has_keep_alive_header_(false)
 {
     WFServerTask::set_callback([this](HttpTask *task) {
+        this->mark_timing(RequestTiming::SENT);
         for(auto &cb : cb_list_)
         {
             cb(task);
@@ -29,6 +50,21 @@ HttpServerTask::HttpServerTask(CommService *service,
     });
 }
 
+// Shared with the deadline timer, which may fire while the task is being done
+struct HttpServerTask::DeadlineWatch
+{
+    std::mutex mutex;
+    HttpServerTask *task;
+};
+
+HttpServerTask::~HttpServerTask()
+{
+    this->disarm_deadline();
+    // after the callbacks, which may still read the route pattern
+    if (routes_)
+        routes_->unref();
+}
+
 void HttpServerTask::handle(int state, int error)
 {
     if (state == WFT_STATE_TOREPLY)
@@ -56,8 +92,16 @@ void HttpServerTask::handle(int state, int error)
 CommMessageOut *HttpServerTask::message_out()
 {
     HttpResp *resp = this->get_resp();
+    this->disarm_deadline();
+    if (deadline_fired_.load())
+        this->expire();
+    this->mark_timing(RequestTiming::REPLY_BEGIN);
 
     std::map<std::string, std::string, MapStringCaseLess> &headers = resp->headers;
+    if (timing_ && server_timing_header_)
+    {
+        headers["Server-Timing"] = timing_->server_timing();
+    }
     // content type
     if(headers.find("Content-Type") == headers.end())
     {
@@ -115,9 +159,26 @@ CommMessageOut *HttpServerTask::message_out()
         resp->add_header(&header);
     }
 
+    const std::shared_ptr<Http2Connection> &http2 = this->req.http2();
+    if (http2)
+    {
+        // the client reconnects to the next process of an upgrade
+        if (draining_ && draining_->load(std::memory_order_relaxed))
+            http2->go_away();
+        this->mark_timing(RequestTiming::REPLY_END);
+        return this->WFServerTask::message_out();
+    }
+
     bool is_alive;
 
-    if (resp->has_connection_header())
+    if (draining_ && draining_->load(std::memory_order_relaxed))
+    {
+        // the client reconnects to the next process of an upgrade
+        if (resp->has_connection_header())
+            resp->set_header_pair("Connection", "close");
+        is_alive = false;
+    }
+    else if (resp->has_connection_header())
         is_alive = resp->is_keep_alive();
     else
         is_alive = req_is_alive_;
@@ -186,9 +247,129 @@ CommMessageOut *HttpServerTask::message_out()
 
         resp->add_header(&header);
     }
+    this->mark_timing(RequestTiming::REPLY_END);
     return this->WFServerTask::message_out();
 }
 
+void HttpServerTask::set_timeout(int timeout_ms)
+{
+    // from the end of the read of the request, its wait for a thread included
+    if (arrival_us_ == 0)
+        arrival_us_ = this->req.received_us() ? this->req.received_us() : now_us();
+    timeout_ms_ = timeout_ms;
+    this->arm_deadline();
+}
+
+void HttpServerTask::set_client_timeout(int timeout_ms)
+{
+    if (arrival_us_ == 0)
+        arrival_us_ = this->req.received_us() ? this->req.received_us() : now_us();
+    client_timeout_ms_ = timeout_ms;
+    this->arm_deadline();
+}
+
+long long HttpServerTask::deadline() const
+{
+    int timeout_ms = timeout_ms_;
+    if (client_timeout_ms_ > 0 && (timeout_ms <= 0 || client_timeout_ms_ < timeout_ms))
+        timeout_ms = client_timeout_ms_;
+    return timeout_ms > 0 ? arrival_us_ + timeout_ms * 1000LL : 0;
+}
+
+int HttpServerTask::remaining_ms() const
+{
+    long long deadline_us = this->deadline();
+    if (deadline_us == 0)
+        return -1;
+    long long left_us = deadline_us - now_us();
+    return left_us >= 1000 ? static_cast<int>(left_us / 1000) : 0;
+}
+
+void HttpServerTask::expire()
+{
+    // drop the reply so far, the headers of a proxied response included
+    HttpResp *resp = this->get_resp();
+    resp->drop_reply();
+    // the status of a gRPC reply goes in its trailers
+    if (resp->grpc())
+        resp->grpc()->expire();
+    resp->set_status(HttpStatusGatewayTimeout);
+    resp->String("Gateway Timeout\n");
+    (**this).cancel();
+}
+
+void HttpServerTask::check_deadline()
+{
+    // a counter without target is done as soon as it starts
+    WFCounterTask *check = WFTaskFactory::create_counter_task(0, [this](WFCounterTask *)
+    {
+        if (this->deadline_exceeded())
+            this->expire();
+    });
+    **this << check;
+}
+
+std::string HttpServerTask::timer_name() const
+{
+    return "wfrest_sleep_" + std::to_string(reinterpret_cast<uintptr_t>(this));
+}
+
+void HttpServerTask::arm_deadline()
+{
+    this->disarm_deadline();
+    int remaining_ms = this->remaining_ms();
+    if (remaining_ms < 0)
+        return;
+
+    std::shared_ptr<DeadlineWatch> watch = std::make_shared<DeadlineWatch>();
+    watch->task = this;
+    deadline_watch_ = watch;
+    std::string name = "wfrest_deadline_" + std::to_string(reinterpret_cast<uintptr_t>(this));
+    WFTimerTask *timer = WFTaskFactory::create_timer_task(name, remaining_ms / 1000,
+                                                          remaining_ms % 1000 * 1000000L,
+                                                          [watch](WFTimerTask *timer)
+    {
+        // cancelled once the reply is on its way
+        if (timer->get_state() != WFT_STATE_SUCCESS)
+            return;
+        std::lock_guard<std::mutex> lock(watch->mutex);
+        if (watch->task)
+            watch->task->on_deadline();
+    });
+    timer->start();
+}
+
+void HttpServerTask::disarm_deadline()
+{
+    if (!deadline_watch_)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(deadline_watch_->mutex);
+        deadline_watch_->task = nullptr;
+    }
+    deadline_watch_.reset();
+    WFTaskFactory::cancel_by_name("wfrest_deadline_" + std::to_string(reinterpret_cast<uintptr_t>(this)));
+}
+
+void HttpServerTask::on_deadline()
+{
+    // the resp belongs to the thread of the series, it is replaced at the end
+    deadline_fired_.store(true);
+    (**this).cancel();
+    WFTaskFactory::cancel_by_name(this->timer_name());
+}
+
+Http2StreamTask *HttpServerTask::new_stream(const std::shared_ptr<Http2Connection> &http2,
+                                            uint32_t stream_id)
+{
+    auto *task = new Http2StreamTask(this->service, this->processor.process, http2, stream_id);
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof addr;
+    if (this->get_peer_addr(reinterpret_cast<struct sockaddr *>(&addr), &addr_len) == 0)
+        task->set_peer_addr(reinterpret_cast<struct sockaddr *>(&addr), addr_len);
+    return task;
+}
+
 std::string HttpServerTask::peer_addr() const
 {
     struct sockaddr_storage addr;
@@ -230,4 +411,83 @@ unsigned short HttpServerTask::peer_port() const
     return port;
 }
 
+Http2StreamTask::Http2StreamTask(CommService *service, ProcFunc &process,
+                                 const std::shared_ptr<Http2Connection> &http2,
+                                 uint32_t stream_id) :
+        HttpServerTask(service, process),
+        http2_(http2),
+        stream_id_(stream_id),
+        peer_addrlen_(0)
+{
+    memset(&peer_addr_, 0, sizeof peer_addr_);
+    this->req.set_http2(http2);
+    this->resp.set_http2(http2, stream_id);
+}
+
+void Http2StreamTask::start(const std::string &message)
+{
+    if (this->req.append_stream(message) < 0)
+    {
+        http2_->reset(stream_id_);
+        delete this;
+        return;
+    }
+
+    // The request is handed over as the communicator hands a session its
+    // request, workflow makes the series, which holds the service, and runs
+    // the process. In a compute thread, the poller thread goes on with the frames.
+    WFGoTask *go_task = WFTaskFactory::create_go_task("wfrest_http2", [this]()
+    {
+        this->handle(WFT_STATE_TOREPLY, 0);
+    });
+    go_task->start();
+}
+
+void Http2StreamTask::set_peer_addr(const struct sockaddr *addr, socklen_t addrlen)
+{
+    if (addrlen > sizeof peer_addr_)
+        addrlen = sizeof peer_addr_;
+    memcpy(&peer_addr_, addr, addrlen);
+    peer_addrlen_ = addrlen;
+}
+
+int Http2StreamTask::get_peer_addr(struct sockaddr *addr, socklen_t *addrlen) const
+{
+    if (peer_addrlen_ == 0 || *addrlen < peer_addrlen_)
+    {
+        errno = peer_addrlen_ == 0 ? ENOTCONN : ENOBUFS;
+        return -1;
+    }
+    memcpy(addr, &peer_addr_, peer_addrlen_);
+    *addrlen = peer_addrlen_;
+    return 0;
+}
+
+WFConnection *Http2StreamTask::get_connection() const
+{
+    errno = EPERM;
+    return nullptr;
+}
+
+void Http2StreamTask::dispatch()
+{
+    // in place of the reply of workflow, the frames are queued on the connection,
+    // its reader writes them
+    if (this->state == WFT_STATE_TOREPLY)
+    {
+        this->message_out();
+        if (this->resp.reply_http2() >= 0)
+            this->state = WFT_STATE_SUCCESS;
+        else
+        {
+            this->state = WFT_STATE_SYS_ERROR;
+            this->error = errno;
+        }
+    }
+    else
+        http2_->reset(stream_id_);
+
+    this->subtask_done();
+}
+
 } // namespace wfrest
\ No newline at end of file
@@ -1,12 +1,21 @@
 #ifndef WFREST_HTTPSERVERTASK_H_
 #define WFREST_HTTPSERVERTASK_H_
 
+#include <memory>
+#include <atomic>
+
 #include "HttpMsg.h"
 #include "Noncopyable.h"
+#include "RequestTiming.h"
+#include "Profiler.h"
 
 namespace wfrest
 {
 
+class RoutesVersion;
+class SessionStore;
+class Http2StreamTask;
+
 class HttpServerTask : public WFServerTask<HttpReq, HttpResp> , public Noncopyable
 {
 public:
@@ -26,20 +35,88 @@ public:
 
     static size_t get_resp_offset()
     {
-        HttpServerTask task(nullptr);
-        return task.resp_offset();
+        static const size_t offset = HttpServerTask(nullptr).resp_offset();
+        return offset;
     }
 
     std::string peer_addr() const;
 
     unsigned short peer_port() const;
-    
+
+    // Phase timestamps of this request, nullptr if it is not sampled.
+    // See HttpServer::timing()
+    RequestTiming *timing() const { return timing_.get(); }
+
+    void enable_timing(bool server_timing_header)
+    {
+        timing_.reset(new RequestTiming);
+        server_timing_header_ = server_timing_header;
+    }
+
+    void mark_timing(RequestTiming::Phase phase)
+    {
+        if (timing_)
+            timing_->mark(phase);
+    }
+
+    // Budget of the request in ms from its arrival, set by HttpServer::request_timeout()
+    // and DeadlineAop. The client budget (X-Request-Timeout) can only shorten it.
+    // <= 0 removes it.
+    void set_timeout(int timeout_ms);
+
+    void set_client_timeout(int timeout_ms);
+
+    // on the monotonic clock in microseconds, 0 without any budget
+    long long deadline() const;
+
+    // what is left of the budget in ms, -1 without any budget
+    int remaining_ms() const;
+
+    bool deadline_exceeded() const { return remaining_ms() == 0; }
+
+    // 504 in place of the reply so far, and the tasks left in the series are cancelled
+    void expire();
+
+    // expire() once the tasks in the series so far are done, if the budget is gone by then
+    void check_deadline();
+
+    // of the timers of HttpResp::Timer(), cancelled once the budget is gone
+    std::string timer_name() const;
+
+    // while *draining, the replies close the connection, see HttpServer::wait_upgraded()
+    void set_draining(const std::atomic<bool> *draining) { draining_ = draining; }
+
+    // the route table of the request, unref()'d with the task, see HttpServer::reload()
+    void set_routes(RoutesVersion *routes) { routes_ = routes; }
+
+    // nullptr without HttpServer::session()
+    SessionStore *sessions() const { return sessions_; }
+
+    void set_sessions(SessionStore *sessions) { sessions_ = sessions; }
+
+    // a task for a stream of the HTTP/2 connection this one reads, same service and process
+    Http2StreamTask *new_stream(const std::shared_ptr<Http2Connection> &http2, uint32_t stream_id);
+
 protected:
+    ~HttpServerTask();
+
     void handle(int state, int error) override;
 
     CommMessageOut *message_out() override;
 
 private:
+    struct DeadlineWatch;
+
+    // A timer fires once the budget is gone while the series runs : it cancels
+    // the series and the timers of the request, the reply is replaced by
+    // message_out(). Set again as the budget changes.
+    void arm_deadline();
+
+    void disarm_deadline();
+
+    // in the thread of the timer, the task is not done yet
+    void on_deadline();
+
     // for hidning set_callback
     void set_callback()
     {}
@@ -59,6 +136,49 @@ private:
     bool req_has_keep_alive_header_;
     std::string req_keep_alive_;
     std::vector<ServerCallBack> cb_list_;
+    std::unique_ptr<RequestTiming> timing_;
+    bool server_timing_header_ = false;
+    long long arrival_us_ = 0;
+    int timeout_ms_ = 0;
+    int client_timeout_ms_ = 0;
+    std::shared_ptr<DeadlineWatch> deadline_watch_;
+    std::atomic<bool> deadline_fired_{false};
+    const std::atomic<bool> *draining_ = nullptr;
+    RoutesVersion *routes_ = nullptr;
+    SessionStore *sessions_ = nullptr;
+};
+
+/*
+A stream of an HTTP/2 connection, as a request of its own : the same
+series, aspects, handlers and callbacks as the requests of HTTP/1.1.
+It is not a session of workflow, the request comes from the reader of
+the connection and the reply goes to it, see Http2Connection.
+*/
+class Http2StreamTask : public HttpServerTask
+{
+public:
+    Http2StreamTask(CommService *service, ProcFunc &process,
+                    const std::shared_ptr<Http2Connection> &http2, uint32_t stream_id);
+
+    // Processes the request of the stream, in its HTTP/1.1 form, out of the poller
+    // thread which read it. The stream is reset if the parser refuses it.
+    void start(const std::string &message);
+
+    void set_peer_addr(const struct sockaddr *addr, socklen_t addrlen);
+
+    int get_peer_addr(struct sockaddr *addr, socklen_t *addrlen) const override;
+
+    // none, the connection is the reader's
+    WFConnection *get_connection() const override;
+
+protected:
+    void dispatch() override;
+
+private:
+    std::shared_ptr<Http2Connection> http2_;
+    uint32_t stream_id_;
+    struct sockaddr_storage peer_addr_;
+    socklen_t peer_addrlen_;
 };
 
 inline HttpServerTask *task_of(const SubTask *task)
@@ -73,6 +193,31 @@ inline HttpServerTask *task_of(const HttpResp *resp)
     return (HttpServerTask *) ((char *) (resp) - http_resp_offset);
 }
 
+inline void mark_timing(const HttpResp *resp, RequestTiming::Phase phase)
+{
+    task_of(resp)->mark_timing(phase);
+}
+
+// Around a route handler : marks its timing phase and charges its allocations to the route.
+class HandlerScope : public Noncopyable
+{
+public:
+    HandlerScope(const HttpReq *req, HttpResp *resp)
+        : resp_(resp), alloc_scope_(req->route_pattern())
+    {
+        mark_timing(resp_, RequestTiming::HANDLER_BEGIN);
+    }
+
+    ~HandlerScope()
+    {
+        mark_timing(resp_, RequestTiming::HANDLER_END);
+    }
+
+private:
+    HttpResp *resp_;
+    AllocScope alloc_scope_;
+};
+
 } // namespace wfrest
 
 
@@ -0,0 +1,361 @@
+#include <time.h>
+#include <math.h>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+
+#include "LimitAspect.h"
+#include "HttpMsg.h"
+#include "HttpServerTask.h"
+
+namespace wfrest
+{
+
+namespace
+{
+
+// a shard is locked for a few arithmetic operations per request
+const int k_shards = 64;
+
+long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+std::string limit_key(LimitKey key, const std::string &header, const HttpReq *req, HttpResp *resp)
+{
+    switch (key)
+    {
+    case LimitKey::PEER_IP:
+        return task_of(resp)->peer_addr();
+    case LimitKey::HEADER:
+        return req->header(header);
+    case LimitKey::ROUTE:
+        return req->route_pattern().as_string();
+    }
+    return std::string();
+}
+
+void reject(HttpResp *resp, long long retry_after)
+{
+    resp->set_status(HttpStatusTooManyRequests);
+    resp->headers["Retry-After"] = std::to_string(std::max(1LL, retry_after));
+    resp->String("Too Many Requests\n");
+}
+
+// Entries by key, split in shards which sweep their idle entries
+// every sweep_us, while they are locked for a request.
+template<typename Entry>
+class KeyedTable
+{
+public:
+    explicit KeyedTable(long long sweep_us) : sweep_us_(sweep_us) {}
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        long long next_sweep = 0;
+    };
+
+    Shard &shard_of(const std::string &key)
+    {
+        return shards_[std::hash<std::string>()(key) % k_shards];
+    }
+
+    template<typename Idle>
+    void sweep(Shard &shard, long long now, Idle idle)
+    {
+        if (now < shard.next_sweep)
+            return;
+        shard.next_sweep = now + sweep_us_;
+        for (auto it = shard.entries.begin(); it != shard.entries.end(); )
+        {
+            if (idle(it->second))
+                it = shard.entries.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    size_t size()
+    {
+        size_t n = 0;
+        for (auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            n += shard.entries.size();
+        }
+        return n;
+    }
+
+private:
+    long long sweep_us_;
+    Shard shards_[k_shards];
+};
+
+}  // namespace
+
+namespace detail
+{
+
+/*
+GCRA, the token bucket as one timestamp : tat is when the bucket is
+full again, each request pushes it by interval. A request passes while
+tat is at most burst - 1 intervals ahead of now.
+*/
+class RateLimitTable
+{
+public:
+    explicit RateLimitTable(const RateLimitParams &params) :
+        params_(params),
+        interval_us_(static_cast<long long>(1000000 / std::max(params.rate, 1e-6))),
+        tolerance_us_(static_cast<long long>(interval_us_ * std::max(params.burst - 1, 0.0))),
+        idle_us_(std::max(params.idle_seconds, 1) * 1000000LL),
+        table_(idle_us_ / 2)
+    {}
+
+    // 0 if the request passes, otherwise microseconds to the next token
+    long long acquire(const std::string &key, long long now)
+    {
+        auto &shard = table_.shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        long long idle_us = idle_us_;
+        table_.sweep(shard, now, [now, idle_us](long long tat) { return tat + idle_us < now; });
+
+        long long &tat = shard.entries.emplace(key, now).first->second;
+        long long start = std::max(tat, now);
+        if (start - now > tolerance_us_)
+            return start - tolerance_us_ - now;
+        tat = start + interval_us_;
+        return 0;
+    }
+
+    size_t size() { return table_.size(); }
+
+    const RateLimitParams params_;
+
+private:
+    long long interval_us_;
+    long long tolerance_us_;
+    long long idle_us_;
+    KeyedTable<long long> table_;
+};
+
+class ConcurrencyTable
+{
+public:
+    explicit ConcurrencyTable(const ConcurrencyLimitParams &params) :
+        params_(params), table_(k_idle_us / 2)
+    {}
+
+    bool acquire(const std::string &key, long long now)
+    {
+        auto &shard = table_.shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        table_.sweep(shard, now, [now](const Entry &entry)
+        {
+            return entry.inflight == 0 && entry.last_used + k_idle_us < now;
+        });
+
+        Entry &entry = shard.entries[key];
+        entry.last_used = now;
+        if (entry.inflight >= params_.max_concurrency)
+            return false;
+        entry.inflight++;
+        return true;
+    }
+
+    void release(const std::string &key)
+    {
+        auto &shard = table_.shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && it->second.inflight > 0)
+            it->second.inflight--;
+    }
+
+    int inflight(const std::string &key)
+    {
+        auto &shard = table_.shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        return it != shard.entries.end() ? it->second.inflight : 0;
+    }
+
+    const ConcurrencyLimitParams params_;
+
+private:
+    struct Entry
+    {
+        int inflight = 0;
+        long long last_used = 0;
+    };
+
+    static const long long k_idle_us = 60 * 1000000LL;
+
+    KeyedTable<Entry> table_;
+};
+
+/*
+Gradient of the latency : every window replies,
+    gradient = clamp(tolerance * long_rtt / short_rtt, 0.5, 1)
+    limit = limit * gradient + sqrt(limit)
+smoothed, where short_rtt is the average of the window and long_rtt a
+slow moving average. The sqrt(limit) headroom probes for more capacity.
+*/
+class AdaptiveLimiter
+{
+public:
+    explicit AdaptiveLimiter(const AdaptiveConcurrencyParams &params) :
+        params_(params),
+        limit_(params.initial_limit),
+        inflight_(0),
+        window_sum_(0),
+        window_count_(0),
+        long_rtt_(0),
+        smooth_limit_(params.initial_limit)
+    {}
+
+    bool acquire()
+    {
+        int n = inflight_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (n > limit_.load(std::memory_order_relaxed))
+        {
+            inflight_.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    void release(long long rtt_us)
+    {
+        inflight_.fetch_sub(1, std::memory_order_relaxed);
+        window_sum_.fetch_add(rtt_us, std::memory_order_relaxed);
+        long long count = window_count_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (count < params_.window)
+            return;
+
+        // one thread updates the limit, the replies meanwhile go to the next window
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;
+        count = window_count_.exchange(0, std::memory_order_relaxed);
+        long long sum = window_sum_.exchange(0, std::memory_order_relaxed);
+        if (count <= 0)
+            return;
+
+        double short_rtt = std::max(1.0, static_cast<double>(sum) / count);
+        long_rtt_ = long_rtt_ == 0 ? short_rtt : long_rtt_ * 0.95 + short_rtt * 0.05;
+        // recover faster when the latency is back to well under the average
+        if (long_rtt_ > 2 * short_rtt)
+            long_rtt_ *= 0.9;
+
+        double gradient = std::max(0.5, std::min(1.0, params_.tolerance * long_rtt_ / short_rtt));
+        double new_limit = smooth_limit_ * gradient + sqrt(smooth_limit_);
+        smooth_limit_ = smooth_limit_ * 0.8 + new_limit * 0.2;
+        smooth_limit_ = std::max<double>(params_.min_limit, std::min<double>(params_.max_limit, smooth_limit_));
+        limit_.store(static_cast<int>(smooth_limit_), std::memory_order_relaxed);
+    }
+
+    int limit() const { return limit_.load(std::memory_order_relaxed); }
+
+    int inflight() const { return inflight_.load(std::memory_order_relaxed); }
+
+    const AdaptiveConcurrencyParams params_;
+
+private:
+    std::atomic<int> limit_;
+    std::atomic<int> inflight_;
+    std::atomic<long long> window_sum_;
+    std::atomic<long long> window_count_;
+    std::mutex mutex_;
+    double long_rtt_;
+    double smooth_limit_;
+};
+
+}  // namespace detail
+
+RateLimitAop::RateLimitAop(const RateLimitParams &params)
+    : table_(std::make_shared<detail::RateLimitTable>(params))
+{}
+
+bool RateLimitAop::before(const HttpReq *req, HttpResp *resp)
+{
+    const RateLimitParams &params = table_->params_;
+    long long wait_us = table_->acquire(limit_key(params.key, params.header, req, resp), now_us());
+    if (wait_us == 0)
+        return true;
+
+    reject(resp, (wait_us + 999999) / 1000000);
+    return false;
+}
+
+size_t RateLimitAop::size() const
+{
+    return table_->size();
+}
+
+ConcurrencyLimitAop::ConcurrencyLimitAop(const ConcurrencyLimitParams &params)
+    : table_(std::make_shared<detail::ConcurrencyTable>(params))
+{}
+
+bool ConcurrencyLimitAop::before(const HttpReq *req, HttpResp *resp)
+{
+    const ConcurrencyLimitParams &params = table_->params_;
+    std::string key = limit_key(params.key, params.header, req, resp);
+    if (!table_->acquire(key, now_us()))
+    {
+        reject(resp, params.retry_after);
+        return false;
+    }
+
+    // after() is skipped when a later aspect rejects the request, the callback is not
+    std::shared_ptr<detail::ConcurrencyTable> table = table_;
+    task_of(resp)->add_callback([table, key](HttpTask *)
+    {
+        table->release(key);
+    });
+    return true;
+}
+
+int ConcurrencyLimitAop::inflight(const std::string &key) const
+{
+    return table_->inflight(key);
+}
+
+AdaptiveConcurrencyAop::AdaptiveConcurrencyAop(const AdaptiveConcurrencyParams &params)
+    : limiter_(std::make_shared<detail::AdaptiveLimiter>(params))
+{}
+
+bool AdaptiveConcurrencyAop::before(const HttpReq *req, HttpResp *resp)
+{
+    if (!limiter_->acquire())
+    {
+        reject(resp, limiter_->params_.retry_after);
+        return false;
+    }
+
+    std::shared_ptr<detail::AdaptiveLimiter> limiter = limiter_;
+    long long start = now_us();
+    task_of(resp)->add_callback([limiter, start](HttpTask *)
+    {
+        limiter->release(now_us() - start);
+    });
+    return true;
+}
+
+int AdaptiveConcurrencyAop::limit() const
+{
+    return limiter_->limit();
+}
+
+int AdaptiveConcurrencyAop::inflight() const
+{
+    return limiter_->inflight();
+}
+
+}  // namespace wfrest
@@ -0,0 +1,128 @@
+#ifndef WFREST_LIMITASPECT_H_
+#define WFREST_LIMITASPECT_H_
+
+#include <string>
+#include <memory>
+
+#include "Aspect.h"
+
+namespace wfrest
+{
+
+// What the requests are counted by
+enum class LimitKey
+{
+    PEER_IP,        // address of the client, without the port
+    HEADER,         // value of a header, e.g. an api key
+    ROUTE,          // route pattern, "/user/{id}"
+};
+
+struct RateLimitParams
+{
+    // tokens added per second and bucket size, a request takes one token
+    double rate = 100;
+    double burst = 200;
+    LimitKey key = LimitKey::PEER_IP;
+    // for LimitKey::HEADER, requests without it share the "" bucket
+    std::string header;
+    // buckets unused for idle_seconds (and full) are evicted
+    int idle_seconds = 60;
+};
+
+struct ConcurrencyLimitParams
+{
+    // requests of a key between before() and the end of the reply
+    int max_concurrency = 100;
+    LimitKey key = LimitKey::ROUTE;
+    std::string header;
+    // Retry-After of the rejected requests
+    int retry_after = 1;
+};
+
+struct AdaptiveConcurrencyParams
+{
+    int initial_limit = 20;
+    int min_limit = 4;
+    int max_limit = 1000;
+    // latency over the long term average tolerated before the limit shrinks
+    double tolerance = 1.5;
+    // replies per update of the limit
+    int window = 100;
+    int retry_after = 1;
+};
+
+namespace detail
+{
+class RateLimitTable;
+class ConcurrencyTable;
+class AdaptiveLimiter;
+}  // namespace detail
+
+/*
+Token bucket per key. A request without a token gets a 429 with the
+Retry-After of the next token, before the handler runs:
+    svr.Use(RateLimitAop(params));
+    svr.GET("/login", handler, RateLimitAop(login_params));
+Copies share the buckets.
+*/
+class RateLimitAop : public Aspect
+{
+public:
+    explicit RateLimitAop(const RateLimitParams &params);
+
+    bool before(const HttpReq *req, HttpResp *resp) override;
+
+    bool after(const HttpReq *req, HttpResp *resp) override { return true; }
+
+    // buckets in the table, for tests and stats
+    size_t size() const;
+
+private:
+    std::shared_ptr<detail::RateLimitTable> table_;
+};
+
+/*
+At most max_concurrency requests per key at a time, the others get a 429.
+A request counts until its reply is sent, the tasks it started included.
+*/
+class ConcurrencyLimitAop : public Aspect
+{
+public:
+    explicit ConcurrencyLimitAop(const ConcurrencyLimitParams &params);
+
+    bool before(const HttpReq *req, HttpResp *resp) override;
+
+    bool after(const HttpReq *req, HttpResp *resp) override { return true; }
+
+    // requests of key running now
+    int inflight(const std::string &key) const;
+
+private:
+    std::shared_ptr<detail::ConcurrencyTable> table_;
+};
+
+/*
+Concurrency limit found from the latency of the replies (gradient):
+the limit grows while the latency stays near its long term average,
+and shrinks when requests start to queue behind the backends.
+*/
+class AdaptiveConcurrencyAop : public Aspect
+{
+public:
+    explicit AdaptiveConcurrencyAop(const AdaptiveConcurrencyParams &params);
+
+    bool before(const HttpReq *req, HttpResp *resp) override;
+
+    bool after(const HttpReq *req, HttpResp *resp) override { return true; }
+
+    int limit() const;
+
+    int inflight() const;
+
+private:
+    std::shared_ptr<detail::AdaptiveLimiter> limiter_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_LIMITASPECT_H_
@@ -0,0 +1,75 @@
+#include <sched.h>
+
+#include "LiveRoutes.h"
+#include "BluePrint.h"
+
+namespace wfrest
+{
+
+RoutesVersion::RoutesVersion(unsigned long long version, BluePrint *blue_print, bool owned) :
+    version_(version),
+    blue_print_(blue_print),
+    owned_(owned),
+    refs_(1)
+{}
+
+RoutesVersion::~RoutesVersion()
+{
+    if (owned_)
+        delete blue_print_;
+}
+
+const Router &RoutesVersion::router() const
+{
+    return blue_print_->router();
+}
+
+LiveRoutes::LiveRoutes(BluePrint *initial) :
+    current_(new RoutesVersion(1, initial, false)),
+    version_(1),
+    parity_(0)
+{
+    readers_[0] = 0;
+    readers_[1] = 0;
+}
+
+LiveRoutes::~LiveRoutes()
+{
+    current_.load()->unref();
+}
+
+RoutesVersion *LiveRoutes::acquire()
+{
+    std::atomic<int> &readers = readers_[parity_.load() & 1];
+    readers.fetch_add(1);
+    RoutesVersion *version = current_.load();
+    version->ref();
+    readers.fetch_sub(1);
+    return version;
+}
+
+void LiveRoutes::wait_readers()
+{
+    // a reader which read the parity before the flip may count itself on either
+    // counter : each one is drained once, after the exchange of the version
+    for (int i = 0; i < 2; i++)
+    {
+        unsigned int old_parity = parity_.fetch_add(1) & 1;
+        while (readers_[old_parity].load() != 0)
+            sched_yield();
+    }
+}
+
+unsigned long long LiveRoutes::publish(std::unique_ptr<BluePrint> blue_print)
+{
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    unsigned long long version = version_.load(std::memory_order_relaxed) + 1;
+    RoutesVersion *old = current_.exchange(new RoutesVersion(version, blue_print.release(), true));
+    version_.store(version, std::memory_order_relaxed);
+    this->wait_readers();
+    // the requests still holding it delete it
+    old->unref();
+    return version;
+}
+
+}  // namespace wfrest
@@ -0,0 +1,82 @@
+#ifndef WFREST_LIVEROUTES_H_
+#define WFREST_LIVEROUTES_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "Noncopyable.h"
+
+namespace wfrest
+{
+
+class BluePrint;
+class Router;
+
+// One immutable route table, alive while it is current or a request holds it
+class RoutesVersion : public Noncopyable
+{
+public:
+    RoutesVersion(unsigned long long version, BluePrint *blue_print, bool owned);
+
+    ~RoutesVersion();
+
+    unsigned long long version() const { return version_; }
+
+    const Router &router() const;
+
+    void ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+    // the last one deletes the version, and the handlers of the routes with it
+    void unref()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+private:
+    const unsigned long long version_;
+    BluePrint *blue_print_;
+    const bool owned_;
+    std::atomic<int> refs_;     // 1 for being current
+};
+
+/*
+The routes of a server, replaced while it serves with publish().
+acquire() takes no lock : the readers count themselves on one of two
+counters while they load and ref the current version, and publish() flips
+the counter of the new readers twice and waits for the old readers of both,
+so the version it replaced is never loaded again once it unrefs it.
+The version is deleted by the last request holding it.
+*/
+class LiveRoutes : public Noncopyable
+{
+public:
+    // version 1, the routes registered before start(), not owned
+    explicit LiveRoutes(BluePrint *initial);
+
+    ~LiveRoutes();
+
+    // the current version referenced, unref() it once done
+    RoutesVersion *acquire();
+
+    // the new version number, blue_print is immutable from now on
+    unsigned long long publish(std::unique_ptr<BluePrint> blue_print);
+
+    unsigned long long version() const
+    { return version_.load(std::memory_order_relaxed); }
+
+private:
+    void wait_readers();
+
+private:
+    std::atomic<RoutesVersion *> current_;
+    std::atomic<unsigned long long> version_;
+    std::atomic<unsigned int> parity_;
+    std::atomic<int> readers_[2];
+    std::mutex publish_mutex_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_LIVEROUTES_H_
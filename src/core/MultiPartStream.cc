@@ -0,0 +1,400 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <strings.h>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+
+#include "MultiPartStream.h"
+#include "StringPiece.h"
+
+using namespace wfrest;
+
+// Shared with the pwrite tasks, which may finish after the request is gone.
+struct MultiPartStream::WriteState
+{
+    struct TempFile
+    {
+        int fd = -1;
+        int pending = 0;
+        bool ended = false;
+    };
+
+    std::mutex mutex;
+    int pending = 0;
+    int running = 0;
+    std::deque<WFFileIOTask *> waiting;     // past max_pending_writes
+    WFCounterTask *waiter = nullptr;
+    MultiPartFiles files;
+    std::vector<TempFile> temps;            // by file
+
+    // with the mutex held
+    void close_if_written(size_t idx)
+    {
+        TempFile &temp = temps[idx];
+        if (temp.ended && temp.pending == 0 && temp.fd >= 0)
+        {
+            close(temp.fd);
+            temp.fd = -1;
+        }
+    }
+
+    ~WriteState()
+    {
+        for (const TempFile &temp : temps)
+        {
+            if (temp.fd >= 0)
+                close(temp.fd);
+        }
+    }
+};
+
+MultiPartStream::MultiPartStream(const MultiPartStreamParams *params, const std::string &boundary)
+    : params_(params),
+    boundary_("--" + boundary),
+    is_file_(false),
+    fd_(-1),
+    file_idx_(0),
+    offset_(0),
+    buffer_(nullptr),
+    parts_(0),
+    error_(0),
+    state_(std::make_shared<WriteState>())
+{
+    settings_ = {
+            .on_header_field = header_field_cb,
+            .on_header_value = header_value_cb,
+            .on_part_data = part_data_cb,
+            .on_part_data_begin = nullptr,
+            .on_headers_complete = headers_complete_cb,
+            .on_part_data_end = part_data_end_cb,
+            .on_body_end = nullptr
+    };
+    parser_ = multipart_parser_init(boundary_.c_str(), &settings_);
+    multipart_parser_set_data(parser_, this);
+}
+
+MultiPartStream::~MultiPartStream()
+{
+    multipart_parser_free(parser_);
+    delete buffer_;
+
+    for (const auto &file : state_->files)
+    {
+        if (!file.path.empty())
+            unlink(file.path.c_str());
+    }
+}
+
+int MultiPartStream::append(const char *buf, size_t len)
+{
+    if (error_ == 0 && multipart_parser_execute(parser_, buf, len) != len && error_ == 0)
+        error_ = EBADMSG;
+
+    if (error_ == 0)
+        return 0;
+
+    errno = error_;
+    return -1;
+}
+
+void MultiPartStream::finish()
+{
+    // the body ends without the closing boundary
+    if (is_file_ && error_ == 0)
+        end_part();
+}
+
+WFCounterTask *MultiPartStream::create_flush_task(const counter_callback_t &cb)
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->pending == 0)
+        return nullptr;
+
+    state_->waiter = WFTaskFactory::create_counter_task(1, cb);
+    return state_->waiter;
+}
+
+const MultiPartFiles &MultiPartStream::files() const
+{
+    return state_->files;
+}
+
+int MultiPartStream::header_field_cb(multipart_parser *parser, const char *buf, size_t len)
+{
+    auto *stream = static_cast<MultiPartStream *>(multipart_parser_get_data(parser));
+    stream->handle_header();
+    stream->header_field_.append(buf, len);
+    return 0;
+}
+
+int MultiPartStream::header_value_cb(multipart_parser *parser, const char *buf, size_t len)
+{
+    auto *stream = static_cast<MultiPartStream *>(multipart_parser_get_data(parser));
+    stream->header_value_.append(buf, len);
+    return 0;
+}
+
+int MultiPartStream::part_data_cb(multipart_parser *parser, const char *buf, size_t len)
+{
+    auto *stream = static_cast<MultiPartStream *>(multipart_parser_get_data(parser));
+    return stream->part_data(buf, len);
+}
+
+int MultiPartStream::headers_complete_cb(multipart_parser *parser)
+{
+    auto *stream = static_cast<MultiPartStream *>(multipart_parser_get_data(parser));
+    stream->handle_header();
+    return stream->begin_part();
+}
+
+int MultiPartStream::part_data_end_cb(multipart_parser *parser)
+{
+    auto *stream = static_cast<MultiPartStream *>(multipart_parser_get_data(parser));
+    return stream->end_part();
+}
+
+void MultiPartStream::handle_header()
+{
+    if (header_field_.empty() || header_value_.empty())
+        return;
+
+    if (strcasecmp(header_field_.c_str(), "Content-Disposition") == 0)
+        MultiPartForm::parse_content_disposition(header_value_, &name_, &filename_);
+
+    header_field_.clear();
+    header_value_.clear();
+}
+
+int MultiPartStream::begin_part()
+{
+    if (++parts_ > params_->max_parts)
+    {
+        error_ = EMSGSIZE;
+        return -1;
+    }
+
+    is_file_ = !filename_.empty();
+    if (!is_file_)
+        return 0;
+
+    if (state_->files.size() >= params_->max_files)
+    {
+        error_ = EMSGSIZE;
+        return -1;
+    }
+
+    MultiPartFile file;
+    file.name = name_;
+    file.filename = filename_;
+    fd_ = -1;
+    offset_ = 0;
+
+    if (!params_->part_func)
+    {
+        std::string path = params_->temp_dir + "/wfrest_upload_XXXXXX";
+        fd_ = mkstemp(&path[0]);
+        if (fd_ >= 0)
+            file.path = std::move(path);
+        else
+            file.error = errno;
+    }
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    file_idx_ = state_->files.size();
+    state_->files.emplace_back(std::move(file));
+    state_->temps.emplace_back();
+    state_->temps.back().fd = fd_;
+    return 0;
+}
+
+int MultiPartStream::part_data(const char *buf, size_t len)
+{
+    if (!is_file_)
+    {
+        if (field_.size() + len > params_->field_size_limit)
+        {
+            error_ = EMSGSIZE;
+            return -1;
+        }
+        field_.append(buf, len);
+        return 0;
+    }
+
+    // Only this thread changes size and truncated before the flush,
+    // the pwrite callbacks only touch error.
+    MultiPartFile &file = state_->files[file_idx_];
+    if (params_->part_size_limit > 0 && file.size + len > params_->part_size_limit)
+    {
+        len = params_->part_size_limit - file.size;
+        file.truncated = true;
+    }
+    if (len == 0)
+        return 0;
+
+    file.size += len;
+    if (params_->part_func)
+    {
+        params_->part_func(file, buf, len);
+        return 0;
+    }
+
+    if (fd_ < 0)
+        return 0;
+
+    if (!buffer_)
+    {
+        buffer_ = new std::string;
+        buffer_->reserve(params_->write_buffer_size);
+    }
+    buffer_->append(buf, len);
+    if (buffer_->size() >= params_->write_buffer_size)
+        return flush_buffer();
+    return 0;
+}
+
+int MultiPartStream::end_part()
+{
+    int ret = 0;
+    if (is_file_)
+    {
+        if (params_->part_func)
+            params_->part_func(state_->files[file_idx_], nullptr, 0);
+        else
+            ret = flush_buffer();
+
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->temps[file_idx_].ended = true;
+        state_->close_if_written(file_idx_);
+    }
+    else if (!name_.empty())
+    {
+        form_[name_] = std::make_pair(std::string(), std::move(field_));
+    }
+
+    is_file_ = false;
+    fd_ = -1;
+    name_.clear();
+    filename_.clear();
+    field_.clear();
+    return ret;
+}
+
+int MultiPartStream::flush_buffer()
+{
+    if (!buffer_ || buffer_->empty() || fd_ < 0)
+        return 0;
+
+    bool backlogged;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        backlogged = state_->waiting.size() >= params_->max_pending_writes;
+    }
+
+    // The disk is behind : write this buffer here, so the body is not read
+    // any further until it is written and TCP slows the client down.
+    if (backlogged)
+    {
+        this->write_buffer();
+        return 0;
+    }
+
+    std::string *data = buffer_;
+    buffer_ = nullptr;
+
+    std::shared_ptr<WriteState> state = state_;
+    size_t idx = file_idx_;
+    WFFileIOTask *pwrite_task = WFTaskFactory::create_pwrite_task(fd_,
+                                                                  data->data(),
+                                                                  data->size(),
+                                                                  offset_,
+    [state, idx, data](WFFileIOTask *pwrite_task)
+    {
+        WFCounterTask *waiter = nullptr;
+        WFFileIOTask *next = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            MultiPartFile &file = state->files[idx];
+            if (file.error == 0)
+            {
+                if (pwrite_task->get_state() != WFT_STATE_SUCCESS)
+                    file.error = pwrite_task->get_error();
+                else if (static_cast<size_t>(pwrite_task->get_retval()) != data->size())
+                    file.error = EIO;
+            }
+            state->temps[idx].pending--;
+            state->close_if_written(idx);
+
+            if (!state->waiting.empty())
+            {
+                next = state->waiting.front();
+                state->waiting.pop_front();
+            }
+            else
+                state->running--;
+
+            if (--state->pending == 0)
+            {
+                waiter = state->waiter;
+                state->waiter = nullptr;
+            }
+        }
+
+        delete data;
+        if (next)
+            next->start();
+        if (waiter)
+            waiter->count();
+    });
+    offset_ += data->size();
+
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->pending++;
+        state_->temps[idx].pending++;
+        if (state_->running >= static_cast<int>(params_->max_pending_writes))
+        {
+            state_->waiting.push_back(pwrite_task);
+            return 0;
+        }
+        state_->running++;
+    }
+    pwrite_task->start();
+    return 0;
+}
+
+void MultiPartStream::write_buffer()
+{
+    const char *p = buffer_->data();
+    size_t left = buffer_->size();
+    int error = 0;
+    while (left > 0)
+    {
+        ssize_t n = pwrite(fd_, p, left, offset_);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            error = errno;
+            break;
+        }
+        if (n == 0)
+        {
+            error = EIO;
+            break;
+        }
+        p += n;
+        left -= n;
+        offset_ += n;
+    }
+    buffer_->clear();
+
+    if (error != 0)
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        MultiPartFile &file = state_->files[file_idx_];
+        if (file.error == 0)
+            file.error = error;
+    }
+}
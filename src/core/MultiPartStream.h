@@ -0,0 +1,131 @@
+#ifndef WFREST_MULTIPARTSTREAM_H_
+#define WFREST_MULTIPARTSTREAM_H_
+
+#include "workflow/WFTaskFactory.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "HttpContent.h"
+#include "MultiPartParser.h"
+#include "Noncopyable.h"
+
+namespace wfrest
+{
+
+struct MultiPartFile
+{
+    std::string name;           // form field name
+    std::string filename;       // file name sent by the client
+    std::string path;           // temp file, empty if the part was passed to part_func
+    size_t size = 0;            // bytes kept, at most part_size_limit
+    bool truncated = false;     // the part was larger than part_size_limit
+    int error = 0;              // errno of the first failed write
+};
+
+using MultiPartFiles = std::vector<MultiPartFile>;
+
+// Called in the network thread as the bytes of a file part arrive,
+// then once more with len == 0 when the part ends.
+using PartDataFunc = std::function<void(const MultiPartFile &part, const char *data, size_t len)>;
+
+struct MultiPartStreamParams
+{
+    std::string temp_dir = "/tmp";
+    size_t part_size_limit = 0;             // per file part, 0 means no limit
+    size_t field_size_limit = 64 * 1024;    // per field which is not a file, larger ones are refused
+    size_t write_buffer_size = 256 * 1024;  // data is coalesced up to this size before each pwrite
+    size_t max_parts = 256;                 // files and fields of a body
+    size_t max_files = 16;                  // file parts of a body
+    size_t max_pending_writes = 8;          // pwrites in flight, as many buffers may wait for them
+    PartDataFunc part_func;                 // if set, file parts are passed to it instead of temp files
+};
+
+/*
+Parse a multipart/form-data body while it is being received.
+File parts are written to temp files by async pwrite tasks, in chunks of
+write_buffer_size, so the body is never held in memory as a whole. Past
+max_pending_writes waiting buffers, the next ones are written in place : the
+body is not read until the disk catches up. The temp file of a part is
+closed once the part is written.
+Other fields are kept in memory, up to field_size_limit.
+The temp files are removed with the request, rename() them to keep them.
+*/
+class MultiPartStream : public Noncopyable
+{
+public:
+    MultiPartStream(const MultiPartStreamParams *params, const std::string &boundary);
+
+    ~MultiPartStream();
+
+    // -1 once the body is refused, errno is EBADMSG if it is malformed, EMSGSIZE
+    // over max_parts, max_files or field_size_limit.
+    int append(const char *buf, size_t len);
+
+    // end of body, flush the data still buffered
+    void finish();
+
+    // Return a counter task counted once all the pending writes have finished,
+    // nullptr if there is nothing to wait for.
+    WFCounterTask *create_flush_task(const counter_callback_t &cb);
+
+    Form &form() { return form_; }
+
+    const MultiPartFiles &files() const;
+
+private:
+    struct WriteState;
+
+    static int header_field_cb(multipart_parser *parser, const char *buf, size_t len);
+
+    static int header_value_cb(multipart_parser *parser, const char *buf, size_t len);
+
+    static int part_data_cb(multipart_parser *parser, const char *buf, size_t len);
+
+    static int headers_complete_cb(multipart_parser *parser);
+
+    static int part_data_end_cb(multipart_parser *parser);
+
+    void handle_header();
+
+    int begin_part();
+
+    int part_data(const char *buf, size_t len);
+
+    int end_part();
+
+    int flush_buffer();
+
+    // pwrite buffer_ in this thread
+    void write_buffer();
+
+private:
+    const MultiPartStreamParams *params_;
+    std::string boundary_;
+    multipart_parser_settings settings_;
+    multipart_parser *parser_;
+
+    std::string header_field_;
+    std::string header_value_;
+    std::string name_;
+    std::string filename_;
+
+    // current part
+    bool is_file_;
+    int fd_;
+    size_t file_idx_;
+    off_t offset_;
+    std::string *buffer_;
+    std::string field_;
+
+    size_t parts_;
+    int error_;
+    Form form_;
+    std::shared_ptr<WriteState> state_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_MULTIPARTSTREAM_H_
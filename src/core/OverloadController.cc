@@ -0,0 +1,141 @@
+#include <limits.h>
+#include <algorithm>
+
+#include "OverloadController.h"
+#include "HttpMsg.h"
+
+namespace wfrest
+{
+
+namespace
+{
+
+const char k_overloaded_body[] = "Service Unavailable\n";
+
+}  // namespace
+
+OverloadController::OverloadController(const OverloadParams &params) :
+    target_us_(std::max(params.target_delay_ms, 1) * 1000LL),
+    interval_us_(std::max(params.interval_ms, params.target_delay_ms) * 1000LL),
+    max_inflight_(params.max_inflight),
+    connection_high_water_(params.connection_high_water),
+    retry_after_(std::to_string(std::max(params.retry_after, 1))),
+    overloaded_(false),
+    interval_end_(0),
+    interval_min_(LLONG_MAX),
+    inflight_(0),
+    admitted_(0),
+    shed_(0),
+    refused_(0)
+{
+    for (const auto &kv : params.priorities)
+    {
+        const std::string &path = kv.first;
+        if (!path.empty() && path.back() == '*')
+            prefixes_.emplace_back(path.substr(0, path.size() - 1), kv.second);
+        else
+            exact_.emplace(path, kv.second);
+    }
+    // the longest prefix first
+    std::sort(prefixes_.begin(), prefixes_.end(),
+              [](const std::pair<std::string, RoutePriority> &a,
+                 const std::pair<std::string, RoutePriority> &b)
+    {
+        return a.first.size() > b.first.size();
+    });
+}
+
+RoutePriority OverloadController::priority(const std::string &path) const
+{
+    if (!exact_.empty())
+    {
+        auto it = exact_.find(path);
+        if (it != exact_.end())
+            return it->second;
+    }
+    for (const auto &prefix : prefixes_)
+    {
+        if (path.compare(0, prefix.first.size(), prefix.first) == 0)
+            return prefix.second;
+    }
+    return RoutePriority::NORMAL;
+}
+
+void OverloadController::observe(long long queue_delay_us, long long now_us)
+{
+    long long min = interval_min_.load(std::memory_order_relaxed);
+    while (queue_delay_us < min &&
+           !interval_min_.compare_exchange_weak(min, queue_delay_us, std::memory_order_relaxed))
+    {}
+
+    long long end = interval_end_.load(std::memory_order_relaxed);
+    if (now_us < end)
+        return;
+    // one thread closes the interval
+    if (!interval_end_.compare_exchange_strong(end, now_us + interval_us_, std::memory_order_relaxed))
+        return;
+    min = interval_min_.exchange(LLONG_MAX, std::memory_order_relaxed);
+    // the first interval only starts the clock
+    if (end != 0)
+        overloaded_.store(min != LLONG_MAX && min > target_us_, std::memory_order_relaxed);
+}
+
+bool OverloadController::admit(long long queue_delay_us, RoutePriority priority, long long now_us)
+{
+    this->observe(queue_delay_us, now_us);
+
+    if (priority != RoutePriority::CRITICAL)
+    {
+        bool overloaded = overloaded_.load(std::memory_order_relaxed);
+        long long limit_us = overloaded ? target_us_ : interval_us_;
+        if (queue_delay_us > limit_us || (overloaded && priority == RoutePriority::SHEDDABLE))
+        {
+            shed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    int inflight = inflight_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (max_inflight_ > 0 && priority != RoutePriority::CRITICAL)
+    {
+        int cap = priority == RoutePriority::SHEDDABLE ? max_inflight_ * 3 / 4 : max_inflight_;
+        if (inflight > cap)
+        {
+            inflight_.fetch_sub(1, std::memory_order_relaxed);
+            shed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    admitted_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool OverloadController::accept_connection(size_t conn_count, size_t max_connections)
+{
+    if (!overloaded_.load(std::memory_order_relaxed) ||
+        conn_count < max_connections * connection_high_water_)
+        return true;
+
+    refused_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void OverloadController::reply_overloaded(HttpResp *resp) const
+{
+    resp->set_status(HttpStatusServiceUnavailable);
+    resp->headers["Retry-After"] = retry_after_;
+    resp->append_output_body_nocopy(k_overloaded_body, sizeof k_overloaded_body - 1);
+}
+
+OverloadStats OverloadController::stats() const
+{
+    OverloadStats stats;
+    stats.overloaded = overloaded_.load(std::memory_order_relaxed);
+    stats.inflight = inflight_.load(std::memory_order_relaxed);
+    stats.admitted = admitted_.load(std::memory_order_relaxed);
+    stats.shed = shed_.load(std::memory_order_relaxed);
+    stats.refused_connections = refused_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+}  // namespace wfrest
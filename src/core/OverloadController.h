@@ -0,0 +1,101 @@
+#ifndef WFREST_OVERLOADCONTROLLER_H_
+#define WFREST_OVERLOADCONTROLLER_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+
+#include "Noncopyable.h"
+
+namespace wfrest
+{
+
+class HttpResp;
+
+enum class RoutePriority
+{
+    CRITICAL,       // never shed, e.g. health checks
+    NORMAL,
+    SHEDDABLE,      // shed first, as soon as the server is overloaded
+};
+
+struct OverloadParams
+{
+    // CoDel : the server is overloaded once the wait of the requests for a
+    // handler thread stayed over target_delay_ms for a whole interval_ms.
+    // Then the requests which waited more than target_delay_ms are shed,
+    // otherwise only the ones which waited more than interval_ms.
+    int target_delay_ms = 5;
+    int interval_ms = 100;
+    // requests between process() and the end of their reply, 0 for no cap.
+    // The sheddable routes get 3/4 of it.
+    int max_inflight = 0;
+    // while overloaded, new connections are refused past this share of max_connections
+    double connection_high_water = 0.9;
+    // Retry-After of the 503
+    int retry_after = 1;
+    // by request path, a trailing '*' matches a prefix : "/internal/*"
+    std::unordered_map<std::string, RoutePriority> priorities;
+};
+
+struct OverloadStats
+{
+    bool overloaded;
+    int inflight;
+    unsigned long long admitted;
+    unsigned long long shed;
+    unsigned long long refused_connections;
+};
+
+/*
+Load shedding in front of the handlers, see HttpServer::overload_control().
+Requests which would time out anyway are answered with a cheap 503 as soon
+as a handler thread takes them, so the handlers keep serving the ones that
+can still make it and the goodput stays flat under overload.
+*/
+class OverloadController : public Noncopyable
+{
+public:
+    explicit OverloadController(const OverloadParams &params);
+
+    RoutePriority priority(const std::string &path) const;
+
+    // counts the request in flight if it passes, release() it after the reply
+    bool admit(long long queue_delay_us, RoutePriority priority, long long now_us);
+
+    void release()
+    { inflight_.fetch_sub(1, std::memory_order_relaxed); }
+
+    bool accept_connection(size_t conn_count, size_t max_connections);
+
+    // 503 with Retry-After, the body is not copied
+    void reply_overloaded(HttpResp *resp) const;
+
+    OverloadStats stats() const;
+
+private:
+    // CoDel state, updated by the handler threads
+    void observe(long long queue_delay_us, long long now_us);
+
+private:
+    const long long target_us_;
+    const long long interval_us_;
+    const int max_inflight_;
+    const double connection_high_water_;
+    const std::string retry_after_;
+    std::unordered_map<std::string, RoutePriority> exact_;
+    std::vector<std::pair<std::string, RoutePriority>> prefixes_;
+
+    std::atomic<bool> overloaded_;
+    std::atomic<long long> interval_end_;
+    std::atomic<long long> interval_min_;      // lowest wait since the interval started
+    std::atomic<int> inflight_;
+    std::atomic<unsigned long long> admitted_;
+    std::atomic<unsigned long long> shed_;
+    std::atomic<unsigned long long> refused_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_OVERLOADCONTROLLER_H_
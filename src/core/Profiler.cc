@@ -0,0 +1,356 @@
+#include <signal.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+
+#include "Profiler.h"
+#include "CodeUtil.h"
+
+namespace wfrest
+{
+
+namespace
+{
+
+// ---------------------------------------------------------------- cpu
+
+static const int k_max_depth = 48;
+static const size_t k_max_samples = 32768;
+
+struct Sample
+{
+    std::atomic<int> depth;     // 0 until the stack is written
+    void *pcs[k_max_depth];
+};
+
+Sample *samples = nullptr;
+std::atomic<size_t> sample_count{0};
+std::atomic<size_t> dropped_samples{0};
+std::atomic<bool> profiling{false};
+struct sigaction old_action;
+
+void sigprof_handler(int, siginfo_t *, void *)
+{
+    int saved_errno = errno;
+    size_t idx = sample_count.fetch_add(1, std::memory_order_relaxed);
+    if (idx < k_max_samples)
+    {
+        Sample &sample = samples[idx];
+        int depth = backtrace(sample.pcs, k_max_depth);
+        sample.depth.store(depth > 0 ? depth : -1, std::memory_order_release);
+    }
+    else
+    {
+        dropped_samples.fetch_add(1, std::memory_order_relaxed);
+    }
+    errno = saved_errno;
+}
+
+std::string symbolize(void *pc, std::unordered_map<void *, std::string> &cache)
+{
+    auto it = cache.find(pc);
+    if (it != cache.end())
+        return it->second;
+
+    std::string name;
+    Dl_info info;
+    // pc is a return address, look up the call instruction before it
+    void *addr = static_cast<char *>(pc) - 1;
+    int found = dladdr(addr, &info);
+    if (found && info.dli_sname)
+    {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        name = status == 0 && demangled ? demangled : info.dli_sname;
+        free(demangled);
+    }
+    else if (found && info.dli_fname)
+    {
+        // static functions have no dynamic symbol, module+offset is left to addr2line
+        char buf[256];
+        const char *module = strrchr(info.dli_fname, '/');
+        snprintf(buf, sizeof buf, "%s+0x%zx", module ? module + 1 : info.dli_fname,
+                 static_cast<size_t>(static_cast<char *>(addr) - static_cast<char *>(info.dli_fbase)));
+        name = buf;
+    }
+    else
+    {
+        char buf[32];
+        snprintf(buf, sizeof buf, "%p", addr);
+        name = buf;
+    }
+    // ';' separates the frames and ' ' the count in the folded format
+    std::replace(name.begin(), name.end(), ';', ':');
+    std::replace(name.begin(), name.end(), ' ', '_');
+    cache.emplace(pc, name);
+    return name;
+}
+
+// ---------------------------------------------------------------- alloc
+
+// Written by a single thread, summed on report.
+struct RouteAlloc
+{
+    std::string route;
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+std::mutex alloc_mutex;
+std::vector<std::unique_ptr<RouteAlloc>> alloc_list;
+
+thread_local RouteAlloc *current_alloc = nullptr;
+// by the interned route pattern, see HttpReq::route_pattern()
+thread_local std::unordered_map<const char *, RouteAlloc *> *local_allocs = nullptr;
+
+inline void add(std::atomic<uint64_t> &counter, uint64_t n)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+int CpuProfiler::start(int hz)
+{
+    bool expected = false;
+    if (!profiling.compare_exchange_strong(expected, true))
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (!samples)
+        samples = new Sample[k_max_samples];
+    for (size_t i = 0; i < k_max_samples; i++)
+        samples[i].depth.store(0, std::memory_order_relaxed);
+    sample_count.store(0, std::memory_order_relaxed);
+    dropped_samples.store(0, std::memory_order_relaxed);
+
+    // the first backtrace() loads libgcc, which is not safe in a signal handler
+    void *warm_up[2];
+    backtrace(warm_up, 2);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_sigaction = sigprof_handler;
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &old_action);
+
+    hz = std::max(1, std::min(hz, 1000));
+    struct itimerval timer;
+    // tv_usec must stay below a second, hz=1 is a whole one
+    long interval_us = 1000000L / hz;
+    timer.it_interval.tv_sec = interval_us / 1000000;
+    timer.it_interval.tv_usec = interval_us % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) < 0)
+    {
+        int err = errno;
+        sigaction(SIGPROF, &old_action, nullptr);
+        profiling.store(false);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+std::string CpuProfiler::stop()
+{
+    if (!profiling.load())
+        return std::string();
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof timer);
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &old_action, nullptr);
+
+    // a handler may still be writing its sample, which is then skipped
+    size_t count = std::min(sample_count.load(), k_max_samples);
+    std::map<std::string, uint64_t> folded;
+    std::unordered_map<void *, std::string> cache;
+    for (size_t i = 0; i < count; i++)
+    {
+        int depth = samples[i].depth.load(std::memory_order_acquire);
+        // the handler and the signal trampoline
+        if (depth <= 2)
+            continue;
+        std::string stack;
+        for (int j = depth - 1; j >= 2; j--)
+        {
+            if (!stack.empty())
+                stack.push_back(';');
+            stack.append(symbolize(samples[i].pcs[j], cache));
+        }
+        folded[stack]++;
+    }
+
+    std::string res;
+    for (const auto &kv : folded)
+        res.append(kv.first).append(" ").append(std::to_string(kv.second)).append("\n");
+    size_t dropped = dropped_samples.load();
+    if (dropped > 0)
+        res.append("[dropped] ").append(std::to_string(dropped)).append("\n");
+
+    profiling.store(false);
+    return res;
+}
+
+bool CpuProfiler::running()
+{
+    return profiling.load();
+}
+
+#ifdef WFREST_ALLOC_PROFILE
+const bool AllocProfiler::enabled_ = true;
+#else
+const bool AllocProfiler::enabled_ = false;
+#endif
+
+void *AllocProfiler::enter(const StringPiece &route)
+{
+    RouteAlloc *prev = current_alloc;
+    // the bookkeeping below allocates too
+    current_alloc = nullptr;
+
+    if (!local_allocs)
+        local_allocs = new std::unordered_map<const char *, RouteAlloc *>;
+    auto it = local_allocs->find(route.data());
+    if (it == local_allocs->end())
+    {
+        auto *alloc = new RouteAlloc;
+        if (route.empty())
+            alloc->route = "unmatched";
+        else if (CodeUtil::is_url_encode(route.as_string()))
+            alloc->route = CodeUtil::url_decode(route.as_string());
+        else
+            alloc->route = route.as_string();
+        {
+            std::lock_guard<std::mutex> lock(alloc_mutex);
+            alloc_list.emplace_back(alloc);
+        }
+        it = local_allocs->emplace(route.data(), alloc).first;
+    }
+    current_alloc = it->second;
+    return prev;
+}
+
+void AllocProfiler::leave(void *prev)
+{
+    current_alloc = static_cast<RouteAlloc *>(prev);
+}
+
+std::string AllocProfiler::report()
+{
+    if (!enabled_)
+        return "allocation profiling is not compiled in, build with -DWFREST_ALLOC_PROFILE=ON\n";
+
+    std::map<std::string, std::pair<uint64_t, uint64_t>> routes;
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        for (const auto &alloc : alloc_list)
+        {
+            auto &stat = routes[alloc->route];
+            stat.first += alloc->count.load(std::memory_order_relaxed);
+            stat.second += alloc->bytes.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<std::pair<std::string, std::pair<uint64_t, uint64_t>>> sorted(routes.begin(), routes.end());
+    std::sort(sorted.begin(), sorted.end(), [](const decltype(sorted)::value_type &a,
+                                               const decltype(sorted)::value_type &b)
+    {
+        return a.second.second > b.second.second;
+    });
+
+    std::string res = "route\tallocations\tbytes\n";
+    for (const auto &kv : sorted)
+    {
+        res.append(kv.first).append("\t")
+           .append(std::to_string(kv.second.first)).append("\t")
+           .append(std::to_string(kv.second.second)).append("\n");
+    }
+    return res;
+}
+
+void AllocProfiler::reset()
+{
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    for (const auto &alloc : alloc_list)
+    {
+        alloc->count.store(0, std::memory_order_relaxed);
+        alloc->bytes.store(0, std::memory_order_relaxed);
+    }
+}
+
+}  // namespace wfrest
+
+#ifdef WFREST_ALLOC_PROFILE
+
+// Replaces the global operator new of the program, delete is left to free().
+namespace
+{
+
+void *counted_alloc(size_t size, bool nothrow)
+{
+    wfrest::RouteAlloc *alloc = wfrest::current_alloc;
+    if (alloc)
+    {
+        wfrest::add(alloc->count, 1);
+        wfrest::add(alloc->bytes, size);
+    }
+
+    if (size == 0)
+        size = 1;
+    while (true)
+    {
+        void *ptr = malloc(size);
+        if (ptr)
+            return ptr;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+        {
+            if (nothrow)
+                return nullptr;
+            abort();
+        }
+        handler();
+    }
+}
+
+}  // namespace
+
+void *operator new(size_t size)
+{
+    return counted_alloc(size, false);
+}
+
+void *operator new[](size_t size)
+{
+    return counted_alloc(size, false);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size, true);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size, true);
+}
+
+#endif
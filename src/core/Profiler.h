@@ -0,0 +1,81 @@
+#ifndef WFREST_PROFILER_H_
+#define WFREST_PROFILER_H_
+
+#include <string>
+
+#include "StringPiece.h"
+
+namespace wfrest
+{
+
+/*
+SIGPROF sampling cpu profiler of the whole process.
+Every 1/hz second of cpu time the running thread records its stack,
+stop() returns the stacks folded for flamegraph.pl :
+    main;foo;bar 12
+Only one profile may run at a time.
+*/
+class CpuProfiler
+{
+public:
+    // -1 with errno EBUSY if a profile is running, or the errno of setitimer
+    static int start(int hz);
+
+    static std::string stop();
+
+    static bool running();
+};
+
+/*
+Allocations per route, counted by a replacement of the global operator new,
+which is only compiled in with the WFREST_ALLOC_PROFILE cmake option.
+An allocation is charged to the route whose handler runs in the thread,
+see AllocScope.
+*/
+class AllocProfiler
+{
+public:
+    // true if built with WFREST_ALLOC_PROFILE
+    static bool enabled() { return enabled_; }
+
+    // route allocations bytes, sorted by bytes
+    static std::string report();
+
+    static void reset();
+
+    static void *enter(const StringPiece &route);
+
+    static void leave(void *prev);
+
+private:
+    static const bool enabled_;
+};
+
+// Charge the allocations of this thread to route until the end of the scope.
+class AllocScope
+{
+public:
+    explicit AllocScope(const StringPiece &route)
+        : prev_(nullptr), active_(AllocProfiler::enabled())
+    {
+        if (active_)
+            prev_ = AllocProfiler::enter(route);
+    }
+
+    ~AllocScope()
+    {
+        if (active_)
+            AllocProfiler::leave(prev_);
+    }
+
+    AllocScope(const AllocScope &) = delete;
+    AllocScope &operator=(const AllocScope &) = delete;
+
+private:
+    void *prev_;
+    bool active_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_PROFILER_H_
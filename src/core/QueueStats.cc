@@ -0,0 +1,160 @@
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#include "workflow/WFGlobal.h"
+
+#include "QueueStats.h"
+#include "json.hpp"
+
+namespace wfrest
+{
+
+namespace
+{
+
+inline void add(std::atomic<long long> &counter, long long n)
+{
+    counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+QueueTicket QueueStats::enqueue()
+{
+    add(queued_, 1);
+    return QueueTicket{this, QueueStatsRegistry::now_us()};
+}
+
+int QueueStats::begin(long long enqueue_us, long long now_us)
+{
+    add(queued_, -1);
+    add(active_, 1);
+    wait_us_.record_shared(now_us > enqueue_us ? now_us - enqueue_us : 0);
+
+    // the running tasks are few, the first free slot is near
+    for (int i = 0; i < k_running_slots; i++)
+    {
+        long long expected = 0;
+        if (running_[i].load(std::memory_order_relaxed) == 0 &&
+            running_[i].compare_exchange_strong(expected, now_us, std::memory_order_relaxed))
+            return i;
+    }
+    return -1;
+}
+
+void QueueStats::end(int slot, long long begin_us, long long now_us)
+{
+    if (slot >= 0)
+        running_[slot].store(0, std::memory_order_relaxed);
+    add(active_, -1);
+    done_.fetch_add(1, std::memory_order_relaxed);
+    busy_us_.fetch_add(now_us > begin_us ? now_us - begin_us : 0, std::memory_order_relaxed);
+}
+
+void QueueStats::dump(int threads, long long now_us, nlohmann::json &json) const
+{
+    long long longest_begin = 0;
+    for (const auto &slot : running_)
+    {
+        long long begin_us = slot.load(std::memory_order_relaxed);
+        if (begin_us > 0 && (longest_begin == 0 || begin_us < longest_begin))
+            longest_begin = begin_us;
+    }
+
+    std::vector<uint64_t> counts(Histogram::k_bucket_count, 0);
+    wait_us_.merge_to(counts);
+
+    json["name"] = name_;
+    if (threads > 0)
+        json["threads"] = threads;
+    // the counters are read one by one, a task in between may show as negative
+    json["queue_depth"] = std::max(0LL, queued_.load(std::memory_order_relaxed));
+    json["active"] = std::max(0LL, active_.load(std::memory_order_relaxed));
+    json["completed"] = done_.load(std::memory_order_relaxed);
+    json["busy_us"] = busy_us_.load(std::memory_order_relaxed);
+    json["longest_running_us"] = longest_begin > 0 ? now_us - longest_begin : 0;
+    json["wait_us"] = {
+        { "count", wait_us_.count() },
+        { "mean", wait_us_.count() > 0 ? wait_us_.sum() / wait_us_.count() : 0 },
+        { "p50", Histogram::quantile(counts, 0.5) },
+        { "p99", Histogram::quantile(counts, 0.99) },
+        { "p999", Histogram::quantile(counts, 0.999) },
+        { "max", Histogram::quantile(counts, 1.0) },
+    };
+}
+
+QueueScope::QueueScope(const QueueTicket &ticket)
+    : stats_(ticket.stats), begin_us_(0), slot_(-1)
+{
+    if (stats_)
+    {
+        begin_us_ = QueueStatsRegistry::now_us();
+        slot_ = stats_->begin(ticket.enqueue_us, begin_us_);
+    }
+}
+
+QueueScope::~QueueScope()
+{
+    if (stats_)
+        stats_->end(slot_, begin_us_, QueueStatsRegistry::now_us());
+}
+
+QueueStats *QueueStatsRegistry::compute_stats(int compute_queue_id)
+{
+    if (!this->enabled())
+        return nullptr;
+
+    if (compute_queue_id >= 0 && compute_queue_id < k_fast_queue_ids)
+    {
+        QueueStats *stats = compute_fast_[compute_queue_id].load(std::memory_order_acquire);
+        if (stats)
+            return stats;
+    }
+    return this->create_compute_stats(compute_queue_id);
+}
+
+QueueStats *QueueStatsRegistry::create_compute_stats(int compute_queue_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &stats = compute_[compute_queue_id];
+    if (!stats)
+    {
+        // the queue name of the compute handlers, see BluePrint
+        stats.reset(new QueueStats("wfrest" + std::to_string(compute_queue_id)));
+        if (compute_queue_id >= 0 && compute_queue_id < k_fast_queue_ids)
+            compute_fast_[compute_queue_id].store(stats.get(), std::memory_order_release);
+    }
+    return stats.get();
+}
+
+std::string QueueStatsRegistry::dump() const
+{
+    const struct WFGlobalSettings *settings = WFGlobal::get_global_settings();
+    long long now = now_us();
+
+    nlohmann::json json;
+    json["enabled"] = this->enabled();
+    json["pools"]["poller"]["threads"] = settings->poller_threads;
+    handler_.dump(settings->handler_threads, now, json["pools"]["handler"]);
+    json["pools"]["compute"]["threads"] = settings->compute_threads;
+
+    json["compute_queues"] = nlohmann::json::array();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &kv : compute_)
+    {
+        nlohmann::json queue;
+        kv.second->dump(0, now, queue);
+        json["compute_queues"].push_back(queue);
+    }
+    return json.dump();
+}
+
+long long QueueStatsRegistry::now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+}  // namespace wfrest
@@ -0,0 +1,134 @@
+#ifndef WFREST_QUEUESTATS_H_
+#define WFREST_QUEUESTATS_H_
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <memory>
+
+#include "Noncopyable.h"
+#include "Histogram.h"
+#include "json_fwd.hpp"
+
+namespace wfrest
+{
+
+class QueueStats;
+
+// Handed from where a task is queued to where it runs.
+struct QueueTicket
+{
+    QueueStats *stats;          // nullptr when the stats are disabled
+    long long enqueue_us;
+};
+
+/*
+Counters of the tasks run by a pool of threads : queued, running, done,
+busy time, the wait in the queue and the longest running task.
+Any thread may update them, with relaxed atomics.
+*/
+class QueueStats : public Noncopyable
+{
+public:
+    explicit QueueStats(const std::string &name) : name_(name)
+    {
+        for (auto &slot : running_)
+            slot.store(0, std::memory_order_relaxed);
+    }
+
+    QueueTicket enqueue();
+
+    // returns the slot which tracks the running task, -1 if none is free
+    int begin(long long enqueue_us, long long now_us);
+
+    void end(int slot, long long begin_us, long long now_us);
+
+    const std::string &name() const { return name_; }
+
+    void dump(int threads, long long now_us, nlohmann::json &json) const;
+
+private:
+    enum { k_running_slots = 64 };
+
+    std::string name_;
+    std::atomic<long long> queued_{0};
+    std::atomic<long long> active_{0};
+    std::atomic<uint64_t> done_{0};
+    std::atomic<uint64_t> busy_us_{0};
+    std::atomic<long long> running_[k_running_slots];     // begin time of the running tasks
+    Histogram wait_us_;
+};
+
+// Runs a task dequeued with ticket, for the scope.
+class QueueScope : public Noncopyable
+{
+public:
+    explicit QueueScope(const QueueTicket &ticket);
+
+    ~QueueScope();
+
+private:
+    QueueStats *stats_;
+    long long begin_us_;
+    int slot_;
+};
+
+/*
+Stats of the handler threads (HttpServer::process()) and of the compute
+queues of the compute handlers ("wfrest" + compute_queue_id).
+Disabled until enable() is called, see DebugBluePrint.
+*/
+class QueueStatsRegistry : public Noncopyable
+{
+public:
+    static QueueStatsRegistry *get_instance()
+    {
+        static QueueStatsRegistry kInstance;
+        return &kInstance;
+    }
+
+    void enable() { enabled_.store(true, std::memory_order_relaxed); }
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // nullptr when disabled
+    QueueStats *handler_stats()
+    { return this->enabled() ? &handler_ : nullptr; }
+
+    QueueStats *compute_stats(int compute_queue_id);
+
+    // ticket of a compute task about to be queued
+    QueueTicket compute_enqueue(int compute_queue_id)
+    {
+        QueueStats *stats = this->compute_stats(compute_queue_id);
+        return stats ? stats->enqueue() : QueueTicket{nullptr, 0};
+    }
+
+    // json of the thread pools and the queues
+    std::string dump() const;
+
+    static long long now_us();
+
+private:
+    QueueStatsRegistry() : handler_("handler")
+    {
+        for (auto &stats : compute_fast_)
+            stats.store(nullptr, std::memory_order_relaxed);
+    }
+
+    QueueStats *create_compute_stats(int compute_queue_id);
+
+private:
+    enum { k_fast_queue_ids = 256 };
+
+    std::atomic<bool> enabled_{false};
+    QueueStats handler_;
+    std::atomic<QueueStats *> compute_fast_[k_fast_queue_ids];    // by id, without lock
+    mutable std::mutex mutex_;
+    std::map<int, std::unique_ptr<QueueStats>> compute_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_QUEUESTATS_H_
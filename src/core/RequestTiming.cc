@@ -0,0 +1,75 @@
+#include <stdio.h>
+
+#include "RequestTiming.h"
+
+namespace wfrest
+{
+
+namespace
+{
+
+const struct
+{
+    const char *name;
+    RequestTiming::Phase from;
+    RequestTiming::Phase to;
+} k_spans[RequestTiming::SPAN_MAX] = {
+    { "recv", RequestTiming::RECV_BEGIN, RequestTiming::RECV_END },
+    { "header", RequestTiming::RECV_END, RequestTiming::HEADER_PARSED },
+    { "uri", RequestTiming::HEADER_PARSED, RequestTiming::URI_PARSED },
+    { "route", RequestTiming::URI_PARSED, RequestTiming::ROUTED },
+    { "before", RequestTiming::ROUTED, RequestTiming::BEFORE_DONE },
+    { "queue", RequestTiming::BEFORE_DONE, RequestTiming::HANDLER_BEGIN },
+    { "handler", RequestTiming::HANDLER_BEGIN, RequestTiming::HANDLER_END },
+    { "series", RequestTiming::PROCESS_END, RequestTiming::REPLY_BEGIN },
+    { "serialize", RequestTiming::REPLY_BEGIN, RequestTiming::REPLY_END },
+    { "write", RequestTiming::REPLY_END, RequestTiming::SENT },
+    { "total", RequestTiming::RECV_BEGIN, RequestTiming::SENT },
+};
+
+}  // namespace
+
+const char *RequestTiming::span_name(Span span)
+{
+    return k_spans[span].name;
+}
+
+double RequestTiming::span_us(Span span) const
+{
+    uint64_t from = stamps_[k_spans[span].from];
+    uint64_t to = stamps_[k_spans[span].to];
+
+    // a compute handler runs after process() returned
+    if (span == SPAN_SERIES && stamps_[HANDLER_END] > from)
+        from = stamps_[HANDLER_END];
+
+    if (from == 0 || to == 0)
+        return -1;
+    return to > from ? CycleClock::to_us(to - from) : 0;
+}
+
+std::string RequestTiming::server_timing() const
+{
+    std::string res;
+    char buf[64];
+    for (int span = SPAN_RECV; span <= SPAN_SERIES; span++)
+    {
+        double us = this->span_us(static_cast<Span>(span));
+        if (us < 0)
+            continue;
+        int len = snprintf(buf, sizeof buf, "%s%s;dur=%.3f", res.empty() ? "" : ", ",
+                           k_spans[span].name, us / 1000);
+        res.append(buf, len);
+    }
+
+    // up to now, the reply is being serialized
+    if (this->has(RECV_BEGIN) && this->has(REPLY_BEGIN))
+    {
+        double us = CycleClock::to_us(stamps_[REPLY_BEGIN] - stamps_[RECV_BEGIN]);
+        int len = snprintf(buf, sizeof buf, "%sapp;dur=%.3f", res.empty() ? "" : ", ", us / 1000);
+        res.append(buf, len);
+    }
+    return res;
+}
+
+}  // namespace wfrest
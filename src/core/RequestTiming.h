@@ -0,0 +1,85 @@
+#ifndef WFREST_REQUESTTIMING_H_
+#define WFREST_REQUESTTIMING_H_
+
+#include <string>
+#include <cstdint>
+
+#include "CycleClock.h"
+
+namespace wfrest
+{
+
+struct RequestTimingParams
+{
+    unsigned int sample_every = 1;      // time one request out of sample_every
+    bool server_timing_header = true;   // add a Server-Timing header to the timed responses
+};
+
+/*
+Timestamps of the phases of a request, taken with CycleClock.
+Only the sampled requests have one, see HttpServerTask::timing().
+The phases are marked in order, by whichever thread runs the request at that point.
+*/
+class RequestTiming
+{
+public:
+    enum Phase
+    {
+        RECV_BEGIN,         // first bytes of the request received
+        RECV_END,           // request parsed, process() called
+        HEADER_PARSED,      // fill_header_map() / fill_content_type()
+        URI_PARSED,
+        ROUTED,             // Router::call() matched the route
+        BEFORE_DONE,        // aspects' before()
+        HANDLER_BEGIN,      // for compute handlers, after waiting in the compute queue
+        HANDLER_END,
+        PROCESS_END,        // process() returned, the tasks of the series run from here
+        REPLY_BEGIN,        // series done, message_out() called
+        REPLY_END,          // response serialized
+        SENT,               // reply written to the socket
+        PHASE_MAX,
+    };
+
+    enum Span
+    {
+        SPAN_RECV,          // RECV_BEGIN ~ RECV_END
+        SPAN_HEADER,        // RECV_END ~ HEADER_PARSED
+        SPAN_URI,           // HEADER_PARSED ~ URI_PARSED
+        SPAN_ROUTE,         // URI_PARSED ~ ROUTED
+        SPAN_BEFORE,        // ROUTED ~ BEFORE_DONE
+        SPAN_QUEUE,         // BEFORE_DONE ~ HANDLER_BEGIN
+        SPAN_HANDLER,       // HANDLER_BEGIN ~ HANDLER_END
+        SPAN_SERIES,        // the later of PROCESS_END and HANDLER_END ~ REPLY_BEGIN
+        SPAN_SERIALIZE,     // REPLY_BEGIN ~ REPLY_END
+        SPAN_WRITE,         // REPLY_END ~ SENT
+        SPAN_TOTAL,         // RECV_BEGIN ~ SENT
+        SPAN_MAX,
+    };
+
+    RequestTiming()
+    {
+        for (auto &stamp : stamps_)
+            stamp = 0;
+    }
+
+    void mark(Phase phase) { stamps_[phase] = CycleClock::now(); }
+
+    bool has(Phase phase) const { return stamps_[phase] != 0; }
+
+    uint64_t stamp(Phase phase) const { return stamps_[phase]; }
+
+    // microseconds, -1 if the span was not reached
+    double span_us(Span span) const;
+
+    static const char *span_name(Span span);
+
+    // Server-Timing header value, with the spans before the reply, in milliseconds
+    std::string server_timing() const;
+
+private:
+    uint64_t stamps_[PHASE_MAX];
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_REQUESTTIMING_H_
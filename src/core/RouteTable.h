@@ -49,6 +49,10 @@ public:
     template<typename Func>
     void all_routes(const Func &func, std::string prefix) const;
 
+    // every node with handlers, inner ones included
+    template<typename Func>
+    void each_handler(const Func &func) const;
+
     void print_node_arch();  // for test
     
 private:
@@ -73,6 +77,15 @@ void RouteTableNode::all_routes(const Func &func, std::string prefix) const
     }
 }
 
+template<typename Func>
+void RouteTableNode::each_handler(const Func &func) const
+{
+    if (!verb_handler_.verb_handler_map.empty())
+        func(verb_handler_);
+    for (auto &pair: children_)
+        pair.second->each_handler(func);
+}
+
 class RouteTable : public Noncopyable
 { 
 public:
@@ -88,6 +101,10 @@ public:
     void all_routes(const Func &func) const
     { root_.all_routes(func, ""); }
 
+    template<typename Func>
+    void each_handler(const Func &func) const
+    { root_.each_handler(func); }
+
     RouteTableNode::iterator end() const
     { return root_.end(); }
 
@@ -1,5 +1,8 @@
 #include "workflow/HttpUtil.h"
 
+#include <mutex>
+#include <unordered_set>
+
 #include "Router.h"
 #include "HttpServerTask.h"
 #include "HttpMsg.h"
@@ -8,6 +11,21 @@
 
 using namespace wfrest;
 
+namespace
+{
+
+// The patterns of all the routes ever added, never freed : a pattern keeps one
+// address across the reloads of the routes, and the metrics key on it.
+StringPiece intern_route(const std::string &route)
+{
+    static std::mutex mutex;
+    static auto *patterns = new std::unordered_set<std::string>;
+    std::lock_guard<std::mutex> lock(mutex);
+    return StringPiece(*patterns->insert(route).first);
+}
+
+}  // namespace
+
 void Router::handle(const std::string &route, int compute_queue_id, const WrapHandler &handler, Verb verb)
 {
     std::pair<RouteVerbIter, bool> rv_pair = add_route(verb, route);
@@ -19,10 +37,27 @@ void Router::handle(const std::string &route, int compute_queue_id, const WrapHa
     }
 
     vh.verb_handler_map.insert({verb, handler});
-    vh.path = rv_pair.first->route;
+    vh.path = intern_route(rv_pair.first->route);
     vh.compute_queue_id = compute_queue_id;
 }
 
+void Router::merge(const Router &other)
+{
+    other.routes_map_.each_handler([this](const VerbHandler &other_vh)
+    {
+        std::vector<Verb> verbs;
+        for (auto &vh_item : other_vh.verb_handler_map)
+            verbs.push_back(vh_item.first);
+        std::pair<RouteVerbIter, bool> rv_pair = add_route(verbs, other_vh.path.as_string());
+
+        VerbHandler &vh = routes_map_.find_or_create(rv_pair.first->route.c_str());
+        for (auto &vh_item : other_vh.verb_handler_map)
+            vh.verb_handler_map[vh_item.first] = vh_item.second;
+        vh.path = intern_route(rv_pair.first->route);
+        vh.compute_queue_id = other_vh.compute_queue_id;
+    });
+}
+
 int Router::call(Verb verb, const std::string &route, HttpServerTask *server_task) const
 {
     HttpReq *req = server_task->get_req();
@@ -42,6 +77,7 @@ int Router::call(Verb verb, const std::string &route, HttpServerTask *server_tas
     int error_code = StatusOK;
     if (it != routes_map_.end())   // has route
     {
+        server_task->mark_timing(RequestTiming::ROUTED);
         // match verb
         // it == <StringPiece : path, VerbHandler>
         std::map<Verb, WrapHandler> &verb_handler_map = it->second.verb_handler_map;
@@ -49,6 +85,7 @@ int Router::call(Verb verb, const std::string &route, HttpServerTask *server_tas
         if(verb_handler_map.find(Verb::ANY) != verb_handler_map.end() or has_verb)
         {
             req->set_full_path(it->second.path.as_string());
+            req->set_route_pattern(it->second.path);
             req->set_route_params(std::move(route_params));
             req->set_route_match_path(std::move(route_match_path));
             WFGoTask * go_task;
@@ -17,6 +17,9 @@ public:
 
     int call(Verb verb, const std::string &route, HttpServerTask *server_task) const;
 
+    // the routes of other at their own paths, its handlers replace the ones of the same verbs
+    void merge(const Router &other);
+
     void print_routes() const;   // for logging
 
     std::vector<std::pair<std::string, std::string>> all_routes() const;   // for test 
@@ -0,0 +1,465 @@
+#include "workflow/WFTaskFactory.h"
+#include "workflow/WFFacilities.h"
+#include "workflow/RedisMessage.h"
+
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/crypto.h>
+
+#include <time.h>
+#include <vector>
+#include <algorithm>
+
+#include "Session.h"
+#include "HttpMsg.h"
+#include "json.hpp"
+
+namespace wfrest
+{
+
+namespace
+{
+
+const size_t k_id_bytes = 16;
+// HMAC-SHA256 truncated to 128 bits
+const size_t k_signature_bytes = 16;
+
+long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+std::string to_hex(const unsigned char *data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(len * 2, '\0');
+    for (size_t i = 0; i < len; i++)
+    {
+        hex[i * 2] = digits[data[i] >> 4];
+        hex[i * 2 + 1] = digits[data[i] & 0xf];
+    }
+    return hex;
+}
+
+}  // namespace
+
+SubTask *RedisSessionBackend::create_load_task(const std::string &id, LoadCallback callback)
+{
+    WFRedisTask *task = WFTaskFactory::create_redis_task(url_, 2, [callback](WFRedisTask *task)
+    {
+        protocol::RedisValue value;
+        if (task->get_state() == WFT_STATE_SUCCESS && task->get_resp()->get_result(value) &&
+            value.is_string())
+            callback(true, value.string_value());
+        else
+            callback(false, std::string());
+    });
+    task->get_req()->set_request("GET", { key_prefix_ + id });
+    return task;
+}
+
+SubTask *RedisSessionBackend::create_store_task(const std::string &id, const std::string &data,
+                                                int ttl_seconds)
+{
+    WFRedisTask *task = WFTaskFactory::create_redis_task(url_, 2, nullptr);
+    task->get_req()->set_request("SET", { key_prefix_ + id, data, "EX", std::to_string(ttl_seconds) });
+    return task;
+}
+
+SubTask *RedisSessionBackend::create_remove_task(const std::string &id)
+{
+    WFRedisTask *task = WFTaskFactory::create_redis_task(url_, 2, nullptr);
+    task->get_req()->set_request("DEL", { key_prefix_ + id });
+    return task;
+}
+
+bool Session::has(const std::string &key) const
+{
+    std::string value;
+    return store_->get(id_, key, &value);
+}
+
+std::string Session::get(const std::string &key) const
+{
+    std::string value;
+    store_->get(id_, key, &value);
+    return value;
+}
+
+SessionValues Session::values() const
+{
+    return store_->values(id_);
+}
+
+void Session::set(const std::string &key, const std::string &value)
+{
+    store_->set(id_, key, value);
+    if (is_new_ && !cookie_sent_)
+    {
+        resp_->add_cookie(store_->cookie(id_));
+        cookie_sent_ = true;
+    }
+}
+
+void Session::erase(const std::string &key)
+{
+    store_->erase(id_, key);
+}
+
+void Session::destroy()
+{
+    store_->destroy(id_);
+    HttpCookie cookie = store_->cookie(id_);
+    cookie.set_value("deleted").set_expires(Timestamp(1000000));
+    resp_->add_cookie(std::move(cookie));
+}
+
+SessionStore::SessionStore(const SessionParams &params) :
+    params_(params),
+    ttl_us_(std::max(params.ttl_seconds, 1) * 1000000LL),
+    shard_capacity_(std::max<size_t>(params.max_sessions / std::max(params.shards, 1), 1)),
+    secret_(params.secret),
+    shards_(std::max(params.shards, 1)),
+    flush_scheduled_(false),
+    hits_(0),
+    loads_(0),
+    created_(0),
+    updates_(0),
+    writes_(0),
+    evicted_(0)
+{
+    if (secret_.empty())
+    {
+        unsigned char key[32];
+        RAND_bytes(key, sizeof key);
+        secret_.assign(reinterpret_cast<const char *>(key), sizeof key);
+    }
+}
+
+std::string SessionStore::sign(const std::string &id) const
+{
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_len = 0;
+    HMAC(EVP_sha256(), secret_.data(), static_cast<int>(secret_.size()),
+         reinterpret_cast<const unsigned char *>(id.data()), id.size(), mac, &mac_len);
+    return id + "." + to_hex(mac, std::min<size_t>(mac_len, k_signature_bytes));
+}
+
+bool SessionStore::verify(const std::string &cookie_value, std::string *id) const
+{
+    if (cookie_value.size() != (k_id_bytes + k_signature_bytes) * 2 + 1 ||
+        cookie_value[k_id_bytes * 2] != '.')
+        return false;
+
+    std::string candidate = cookie_value.substr(0, k_id_bytes * 2);
+    std::string expected = this->sign(candidate);
+    if (CRYPTO_memcmp(expected.data(), cookie_value.data(), expected.size()) != 0)
+        return false;
+    *id = std::move(candidate);
+    return true;
+}
+
+std::string SessionStore::new_id() const
+{
+    unsigned char id[k_id_bytes];
+    RAND_bytes(id, sizeof id);
+    return to_hex(id, sizeof id);
+}
+
+HttpCookie SessionStore::cookie(const std::string &id) const
+{
+    HttpCookie cookie(params_.cookie_name, this->sign(id));
+    cookie.set_path(params_.cookie_path)
+          .set_domain(params_.cookie_domain)
+          .set_secure(params_.cookie_secure)
+          .set_http_only(true)
+          .set_same_site(params_.same_site);
+    return cookie;
+}
+
+SessionStore::Entry *SessionStore::find(Shard &shard, const std::string &id, long long now)
+{
+    auto it = shard.index.find(id);
+    if (it == shard.index.end())
+        return nullptr;
+
+    auto entry = it->second;
+    if (entry->expires_us < now)
+    {
+        shard.index.erase(it);
+        shard.lru.erase(entry);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+    entry->expires_us = now + ttl_us_;
+    // the ttl of the backend copy only moves when it is written
+    if (params_.backend && !entry->dirty && now - entry->stored_us > ttl_us_ / 2)
+        this->mark_dirty(*entry, now);
+    return &*entry;
+}
+
+SessionStore::Entry *SessionStore::insert(Shard &shard, const std::string &id,
+                                          SessionValues &&values, long long now)
+{
+    while (shard.lru.size() >= shard_capacity_)
+    {
+        Entry &last = shard.lru.back();
+        if (last.dirty && last.expires_us >= now)
+        {
+            std::lock_guard<std::mutex> lock(flush_mutex_);
+            pending_[last.id] = serialize(last.values);
+        }
+        evicted_.fetch_add(1, std::memory_order_relaxed);
+        shard.index.erase(last.id);
+        shard.lru.pop_back();
+    }
+
+    shard.lru.push_front(Entry{id, std::move(values), now + ttl_us_, now, false});
+    shard.index[id] = shard.lru.begin();
+    return &shard.lru.front();
+}
+
+void SessionStore::mark_dirty(Entry &entry, long long now)
+{
+    if (!params_.backend || entry.dirty)
+        return;
+
+    entry.dirty = true;
+    std::lock_guard<std::mutex> lock(flush_mutex_);
+    pending_.emplace(entry.id, std::string());
+    if (flush_scheduled_)
+        return;
+
+    flush_scheduled_ = true;
+    std::weak_ptr<SessionStore> store = shared_from_this();
+    WFTimerTask *timer = WFTaskFactory::create_timer_task(params_.write_back_ms * 1000,
+    [store](WFTimerTask *)
+    {
+        std::shared_ptr<SessionStore> locked = store.lock();
+        if (locked)
+            locked->flush(false);
+    });
+    timer->start();
+}
+
+bool SessionStore::touch(const std::string &id)
+{
+    long long now = now_us();
+    Shard &shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (this->find(shard, id, now))
+    {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // evicted before it was written back
+    std::string data;
+    {
+        std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+        auto it = pending_.find(id);
+        if (it == pending_.end() || it->second.empty())
+            return false;
+        data = std::move(it->second);
+        pending_.erase(it);
+    }
+
+    SessionValues values;
+    deserialize(data, &values);
+    Entry *entry = this->insert(shard, id, std::move(values), now);
+    entry->stored_us = 0;
+    this->mark_dirty(*entry, now);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool SessionStore::insert_loaded(const std::string &id, const std::string &data)
+{
+    SessionValues values;
+    if (!deserialize(data, &values))
+        return false;
+
+    long long now = now_us();
+    Shard &shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // a concurrent request of the same session loaded it first
+    if (!this->find(shard, id, now))
+        this->insert(shard, id, std::move(values), now);
+    return true;
+}
+
+SubTask *SessionStore::create_load_task(const std::string &id, std::function<void(bool)> callback)
+{
+    if (!params_.backend)
+        return nullptr;
+
+    loads_.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<SessionStore> store = shared_from_this();
+    return params_.backend->create_load_task(id,
+    [store, id, callback](bool found, const std::string &data)
+    {
+        callback(found && store->insert_loaded(id, data));
+    });
+}
+
+bool SessionStore::get(const std::string &id, const std::string &key, std::string *value)
+{
+    Shard &shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry *entry = this->find(shard, id, now_us());
+    if (!entry)
+        return false;
+
+    auto it = entry->values.find(key);
+    if (it == entry->values.end())
+        return false;
+    *value = it->second;
+    return true;
+}
+
+SessionValues SessionStore::values(const std::string &id)
+{
+    Shard &shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry *entry = this->find(shard, id, now_us());
+    return entry ? entry->values : SessionValues();
+}
+
+void SessionStore::set(const std::string &id, const std::string &key, const std::string &value)
+{
+    long long now = now_us();
+    Shard &shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry *entry = this->find(shard, id, now);
+    if (!entry)
+    {
+        created_.fetch_add(1, std::memory_order_relaxed);
+        entry = this->insert(shard, id, SessionValues(), now);
+    }
+    entry->values[key] = value;
+    updates_.fetch_add(1, std::memory_order_relaxed);
+    this->mark_dirty(*entry, now);
+}
+
+void SessionStore::erase(const std::string &id, const std::string &key)
+{
+    long long now = now_us();
+    Shard &shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry *entry = this->find(shard, id, now);
+    if (entry && entry->values.erase(key) != 0)
+    {
+        updates_.fetch_add(1, std::memory_order_relaxed);
+        this->mark_dirty(*entry, now);
+    }
+}
+
+void SessionStore::destroy(const std::string &id)
+{
+    {
+        Shard &shard = this->shard_of(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(id);
+        if (it != shard.index.end())
+        {
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+        std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+        pending_.erase(id);
+    }
+
+    if (params_.backend)
+        Workflow::start_series_work(params_.backend->create_remove_task(id), nullptr);
+}
+
+void SessionStore::flush(bool wait)
+{
+    std::unordered_map<std::string, std::string> pending;
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex_);
+        pending.swap(pending_);
+        flush_scheduled_ = false;
+    }
+
+    long long now = now_us();
+    std::vector<SubTask *> tasks;
+    for (auto &kv : pending)
+    {
+        const std::string &id = kv.first;
+        std::string &data = kv.second;
+        if (data.empty())
+        {
+            Shard &shard = this->shard_of(id);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(id);
+            // destroyed or evicted since
+            if (it == shard.index.end() || !it->second->dirty)
+                continue;
+            Entry &entry = *it->second;
+            entry.dirty = false;
+            entry.stored_us = now;
+            data = serialize(entry.values);
+        }
+        tasks.push_back(params_.backend->create_store_task(id, data, params_.ttl_seconds));
+    }
+    writes_.fetch_add(tasks.size(), std::memory_order_relaxed);
+    if (tasks.empty())
+        return;
+
+    WFFacilities::WaitGroup wait_group(static_cast<int>(tasks.size()));
+    for (SubTask *task : tasks)
+    {
+        if (wait)
+            Workflow::start_series_work(task, [&wait_group](const SeriesWork *) { wait_group.done(); });
+        else
+            Workflow::start_series_work(task, nullptr);
+    }
+    if (wait)
+        wait_group.wait();
+}
+
+SessionStats SessionStore::stats() const
+{
+    SessionStats stats;
+    stats.sessions = 0;
+    for (const auto &shard : shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.sessions += shard.lru.size();
+    }
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.loads = loads_.load(std::memory_order_relaxed);
+    stats.created = created_.load(std::memory_order_relaxed);
+    stats.updates = updates_.load(std::memory_order_relaxed);
+    stats.writes = writes_.load(std::memory_order_relaxed);
+    stats.evicted = evicted_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::string SessionStore::serialize(const SessionValues &values)
+{
+    Json js = Json::object();
+    for (const auto &kv : values)
+        js[kv.first] = kv.second;
+    // built without exceptions, invalid utf-8 must not abort
+    return js.dump(-1, ' ', false, Json::error_handler_t::replace);
+}
+
+bool SessionStore::deserialize(const std::string &data, SessionValues *values)
+{
+    Json js = Json::parse(data, nullptr, false);
+    if (!js.is_object())
+        return false;
+    for (auto it = js.begin(); it != js.end(); ++it)
+    {
+        if (it.value().is_string())
+            (*values)[it.key()] = it.value().get<std::string>();
+    }
+    return true;
+}
+
+}  // namespace wfrest
@@ -0,0 +1,234 @@
+#ifndef WFREST_SESSION_H_
+#define WFREST_SESSION_H_
+
+#include <string>
+#include <map>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "Noncopyable.h"
+#include "HttpCookie.h"
+
+class SubTask;
+
+namespace wfrest
+{
+
+class HttpResp;
+
+using SessionValues = std::map<std::string, std::string>;
+
+// Where the sessions outlive the process and are shared by the servers
+class SessionBackend
+{
+public:
+    using LoadCallback = std::function<void(bool found, const std::string &data)>;
+
+    virtual ~SessionBackend() = default;
+
+    // found false when the session is missing or the backend failed
+    virtual SubTask *create_load_task(const std::string &id, LoadCallback callback) = 0;
+
+    virtual SubTask *create_store_task(const std::string &id, const std::string &data,
+                                       int ttl_seconds) = 0;
+
+    virtual SubTask *create_remove_task(const std::string &id) = 0;
+};
+
+// GET / SET EX / DEL of key_prefix + id
+class RedisSessionBackend : public SessionBackend
+{
+public:
+    RedisSessionBackend(const std::string &url, const std::string &key_prefix = "session:")
+        : url_(url), key_prefix_(key_prefix)
+    {}
+
+    SubTask *create_load_task(const std::string &id, LoadCallback callback) override;
+
+    SubTask *create_store_task(const std::string &id, const std::string &data,
+                               int ttl_seconds) override;
+
+    SubTask *create_remove_task(const std::string &id) override;
+
+private:
+    std::string url_;
+    std::string key_prefix_;
+};
+
+struct SessionParams
+{
+    // HMAC key of the session ids in the cookies, random if empty : set it
+    // when several processes share the backend or the sessions survive restarts
+    std::string secret;
+    std::string cookie_name = "wfrest_session";
+    std::string cookie_path = "/";
+    std::string cookie_domain;
+    bool cookie_secure = false;
+    SameSite same_site = SameSite::LAX;
+    // since the last use
+    int ttl_seconds = 1800;
+    // in memory, the least recently used ones are evicted past it
+    size_t max_sessions = 100000;
+    int shards = 16;
+    // the changes of a session within write_back_ms are written once
+    int write_back_ms = 1000;
+    // nullptr : the sessions only live in memory
+    std::shared_ptr<SessionBackend> backend;
+};
+
+struct SessionStats
+{
+    size_t sessions;
+    unsigned long long hits;        // found in memory
+    unsigned long long loads;       // from the backend, found or not
+    unsigned long long created;
+    unsigned long long updates;     // set(), erase()
+    unsigned long long writes;      // to the backend
+    unsigned long long evicted;
+};
+
+class SessionStore;
+
+// The session of a request, see HttpResp::Session(). A small handle,
+// copy it to use it after the callback, while the request is alive.
+class Session
+{
+public:
+    const std::string &id() const { return id_; }
+
+    // no cookie came with the request, or its session expired
+    bool is_new() const { return is_new_; }
+
+    bool has(const std::string &key) const;
+
+    // empty if not set
+    std::string get(const std::string &key) const;
+
+    SessionValues values() const;
+
+    // the first one of a new session sends its cookie
+    void set(const std::string &key, const std::string &value);
+
+    void erase(const std::string &key);
+
+    // removed here and from the backend, the cookie is expired
+    void destroy();
+
+    Session(SessionStore *store, HttpResp *resp, const std::string &id, bool is_new)
+        : store_(store), resp_(resp), id_(id), is_new_(is_new)
+    {}
+
+private:
+    SessionStore *store_;
+    HttpResp *resp_;
+    std::string id_;
+    bool is_new_;
+    bool cookie_sent_ = false;
+};
+
+/*
+Sessions by id, in shards of LRU lists with a TTL since the last use.
+With a backend, the changed sessions are written back every write_back_ms
+whatever the number of changes, and the ones missing in memory are loaded
+from it. The requests which never call HttpResp::Session() pay nothing,
+not even the check of their cookie.
+*/
+class SessionStore : public std::enable_shared_from_this<SessionStore>, public Noncopyable
+{
+public:
+    explicit SessionStore(const SessionParams &params);
+
+    const std::string &cookie_name() const { return params_.cookie_name; }
+
+    // the id of a cookie value if its signature matches
+    bool verify(const std::string &cookie_value, std::string *id) const;
+
+    std::string sign(const std::string &id) const;
+
+    std::string new_id() const;
+
+    HttpCookie cookie(const std::string &id) const;
+
+    // uses the session if it is in memory
+    bool touch(const std::string &id);
+
+    // nullptr without backend, callback(found) once it is in memory or missing
+    SubTask *create_load_task(const std::string &id, std::function<void(bool)> callback);
+
+    bool get(const std::string &id, const std::string &key, std::string *value);
+
+    SessionValues values(const std::string &id);
+
+    void set(const std::string &id, const std::string &key, const std::string &value);
+
+    void erase(const std::string &id, const std::string &key);
+
+    void destroy(const std::string &id);
+
+    // write the changed sessions to the backend now, and wait for them
+    void flush(bool wait);
+
+    SessionStats stats() const;
+
+    static std::string serialize(const SessionValues &values);
+
+    static bool deserialize(const std::string &data, SessionValues *values);
+
+private:
+    struct Entry
+    {
+        std::string id;
+        SessionValues values;
+        long long expires_us;
+        long long stored_us;    // written to or read from the backend
+        bool dirty;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;   // the most recent first
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    };
+
+    Shard &shard_of(const std::string &id)
+    { return shards_[std::hash<std::string>()(id) % shards_.size()]; }
+
+    // with the shard locked
+    Entry *find(Shard &shard, const std::string &id, long long now);
+
+    Entry *insert(Shard &shard, const std::string &id, SessionValues &&values, long long now);
+
+    void mark_dirty(Entry &entry, long long now);
+
+    // false if data is not a session
+    bool insert_loaded(const std::string &id, const std::string &data);
+
+private:
+    const SessionParams params_;
+    const long long ttl_us_;
+    const size_t shard_capacity_;
+    std::string secret_;
+    std::vector<Shard> shards_;
+
+    std::mutex flush_mutex_;
+    // to write back : empty to read it from memory, else evicted while dirty
+    std::unordered_map<std::string, std::string> pending_;
+    bool flush_scheduled_;
+
+    std::atomic<unsigned long long> hits_;
+    std::atomic<unsigned long long> loads_;
+    std::atomic<unsigned long long> created_;
+    std::atomic<unsigned long long> updates_;
+    std::atomic<unsigned long long> writes_;
+    std::atomic<unsigned long long> evicted_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_SESSION_H_
@@ -0,0 +1,434 @@
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "TlsContext.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+int ssl_ctx_index = -1;
+int ssl_index = -1;
+std::once_flag index_once;
+
+void init_indexes()
+{
+    ssl_ctx_index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    ssl_index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+}
+
+long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// ex_data of a connection : 0, the start of its handshake, then k_handshake_counted
+const intptr_t k_handshake_counted = 1;
+
+void info_callback(const SSL *ssl, int where, int ret)
+{
+    TlsContext *tls = TlsContext::of(ssl);
+    if (!tls)
+        return;
+
+    SSL *mut_ssl = const_cast<SSL *>(ssl);
+    intptr_t start = reinterpret_cast<intptr_t>(SSL_get_ex_data(ssl, ssl_index));
+    // TLS 1.3 tickets after the handshake start and finish handshakes too
+    if (where & SSL_CB_HANDSHAKE_START)
+    {
+        if (start == 0)
+            SSL_set_ex_data(mut_ssl, ssl_index, reinterpret_cast<void *>(static_cast<intptr_t>(now_us())));
+    }
+    else if (where & SSL_CB_HANDSHAKE_DONE)
+    {
+        if (start > k_handshake_counted)
+        {
+            tls->handshake_done(now_us() - start, SSL_session_reused(mut_ssl) == 1);
+            SSL_set_ex_data(mut_ssl, ssl_index, reinterpret_cast<void *>(k_handshake_counted));
+        }
+    }
+    else if ((where & SSL_CB_ALERT) && (where & SSL_CB_WRITE) && (ret >> 8) == SSL3_AL_FATAL)
+    {
+        if (start > k_handshake_counted)
+        {
+            tls->handshake_failed();
+            SSL_set_ex_data(mut_ssl, ssl_index, reinterpret_cast<void *>(k_handshake_counted));
+        }
+    }
+}
+
+int new_session_callback(SSL *ssl, SSL_SESSION *session)
+{
+    TlsContext *tls = TlsContext::of(ssl);
+    if (tls)
+        tls->add_session(session);
+    // the session is serialized, openssl keeps its reference
+    return 0;
+}
+
+SSL_SESSION *get_session_callback(SSL *ssl, const unsigned char *id, int len, int *copy)
+{
+    *copy = 0;
+    TlsContext *tls = TlsContext::of(ssl);
+    return tls ? tls->get_session(id, len) : nullptr;
+}
+
+void remove_session_callback(SSL_CTX *ssl_ctx, SSL_SESSION *session)
+{
+    auto *tls = static_cast<TlsContext *>(SSL_CTX_get_ex_data(ssl_ctx, ssl_ctx_index));
+    if (tls)
+        tls->remove_session(session);
+}
+
+int alpn_callback(SSL *ssl, const unsigned char **out, unsigned char *outlen,
+                  const unsigned char *in, unsigned int inlen, void *arg)
+{
+    const std::string &wire = static_cast<TlsContext *>(arg)->alpn_wire();
+    unsigned char *selected;
+    if (SSL_select_next_proto(&selected, outlen,
+                              reinterpret_cast<const unsigned char *>(wire.data()),
+                              static_cast<unsigned int>(wire.size()),
+                              in, inlen) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int set_hmac_key(EVP_MAC_CTX *hctx, unsigned char *hmac_key)
+{
+    char digest[] = "sha256";
+    OSSL_PARAM params[3];
+    params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, hmac_key, 32);
+    params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0);
+    params[2] = OSSL_PARAM_construct_end();
+    return EVP_MAC_CTX_set_params(hctx, params);
+}
+
+int ticket_key_callback(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                        EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc)
+#else
+int set_hmac_key(HMAC_CTX *hctx, unsigned char *hmac_key)
+{
+    return HMAC_Init_ex(hctx, hmac_key, 32, EVP_sha256(), nullptr);
+}
+
+int ticket_key_callback(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                        EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc)
+#endif
+{
+    TlsContext *tls = TlsContext::of(ssl);
+    TlsContext::TicketKey key;
+    if (!tls)
+        return -1;
+
+    if (enc)
+    {
+        if (!tls->current_ticket_key(&key) || RAND_bytes(iv, EVP_MAX_IV_LENGTH) <= 0)
+            return -1;
+        memcpy(key_name, key.name, sizeof key.name);
+        if (EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) != 1 ||
+            set_hmac_key(hctx, key.hmac_key) != 1)
+            return -1;
+        return 1;
+    }
+
+    // an unknown key : full handshake, then a new ticket
+    int found = tls->find_ticket_key(key_name, &key);
+    if (found == 0)
+        return 0;
+    if (set_hmac_key(hctx, key.hmac_key) != 1 ||
+        EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) != 1)
+        return -1;
+    // 2 renews the ticket with the current key
+    return found;
+}
+
+}  // namespace
+
+TlsContext::TlsContext(const TlsParams &params)
+    : params_(params), full_(0), resumed_(0), failed_(0)
+{
+    std::call_once(index_once, init_indexes);
+    if (params_.ticket_keys_kept < 1)
+        params_.ticket_keys_kept = 1;
+
+    for (const std::string &proto : params_.alpn)
+    {
+        // The replies of HTTP/2 are written as the client sends, which suits
+        // h2c clients that ping, not the browsers ALPN would bring.
+        if (proto.empty() || proto.size() > 255 || proto == "h2")
+            continue;
+        alpn_wire_.push_back(static_cast<char>(proto.size()));
+        alpn_wire_.append(proto);
+    }
+}
+
+TlsContext *TlsContext::of(const SSL *ssl)
+{
+    SSL_CTX *ssl_ctx = SSL_get_SSL_CTX(ssl);
+    return ssl_ctx ? static_cast<TlsContext *>(SSL_CTX_get_ex_data(ssl_ctx, ssl_ctx_index)) : nullptr;
+}
+
+int TlsContext::configure(SSL_CTX *ssl_ctx)
+{
+    SSL_CTX_set_ex_data(ssl_ctx, ssl_ctx_index, this);
+    SSL_CTX_set_info_callback(ssl_ctx, info_callback);
+
+    if (params_.min_version > 0 && SSL_CTX_set_min_proto_version(ssl_ctx, params_.min_version) != 1)
+        return -1;
+    if (!params_.ciphers.empty() && SSL_CTX_set_cipher_list(ssl_ctx, params_.ciphers.c_str()) != 1)
+        return -1;
+    if (!params_.ciphersuites.empty() && SSL_CTX_set_ciphersuites(ssl_ctx, params_.ciphersuites.c_str()) != 1)
+        return -1;
+    if (params_.prefer_server_ciphers)
+        SSL_CTX_set_options(ssl_ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+    if (!alpn_wire_.empty())
+        SSL_CTX_set_alpn_select_cb(ssl_ctx, alpn_callback, this);
+
+    // the sessions live here, shared by the SSL_CTX of every endpoint
+    static const unsigned char sid_ctx[] = "wfrest";
+    SSL_CTX_set_session_id_context(ssl_ctx, sid_ctx, sizeof sid_ctx - 1);
+    SSL_CTX_set_timeout(ssl_ctx, params_.session_timeout);
+    if (params_.session_cache_size > 0)
+    {
+        SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+        SSL_CTX_sess_set_new_cb(ssl_ctx, new_session_callback);
+        SSL_CTX_sess_set_get_cb(ssl_ctx, get_session_callback);
+        SSL_CTX_sess_set_remove_cb(ssl_ctx, remove_session_callback);
+    }
+    else
+    {
+        SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_OFF);
+    }
+
+    if (params_.session_tickets)
+    {
+        if (!params_.ticket_key_file.empty())
+        {
+            std::lock_guard<std::mutex> lock(key_mutex_);
+            if (ticket_keys_.empty() && this->load_ticket_keys() < 0)
+                return -1;
+        }
+        SSL_CTX_clear_options(ssl_ctx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(ssl_ctx, ticket_key_callback);
+#else
+        SSL_CTX_set_tlsext_ticket_key_cb(ssl_ctx, ticket_key_callback);
+#endif
+    }
+    else
+    {
+        SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_TICKET);
+    }
+    return 0;
+}
+
+bool TlsContext::new_ticket_key(long long now)
+{
+    TicketKey key;
+    if (RAND_bytes(key.name, sizeof key.name) <= 0 ||
+        RAND_bytes(key.aes_key, sizeof key.aes_key) <= 0 ||
+        RAND_bytes(key.hmac_key, sizeof key.hmac_key) <= 0)
+        return false;
+
+    key.created = now;
+    ticket_keys_.insert(ticket_keys_.begin(), key);
+    if (ticket_keys_.size() > static_cast<size_t>(params_.ticket_keys_kept))
+        ticket_keys_.resize(params_.ticket_keys_kept);
+    return true;
+}
+
+int TlsContext::load_ticket_keys()
+{
+    FILE *fp = fopen(params_.ticket_key_file.c_str(), "rb");
+    if (!fp)
+        return -1;
+
+    const size_t key_size = sizeof (TicketKey::name) + sizeof (TicketKey::hmac_key) +
+                            sizeof (TicketKey::aes_key);
+    std::vector<TicketKey> keys;
+    unsigned char buf[key_size];
+    size_t n;
+    long long now = now_us();
+    while ((n = fread(buf, 1, key_size, fp)) == key_size)
+    {
+        TicketKey key;
+        memcpy(key.name, buf, sizeof key.name);
+        memcpy(key.hmac_key, buf + sizeof key.name, sizeof key.hmac_key);
+        memcpy(key.aes_key, buf + sizeof key.name + sizeof key.hmac_key, sizeof key.aes_key);
+        key.created = now;
+        keys.push_back(key);
+    }
+    bool failed = ferror(fp) != 0;
+    fclose(fp);
+    OPENSSL_cleanse(buf, sizeof buf);
+
+    if (failed)
+        return -1;
+    // a truncated key, or none
+    if (n != 0 || keys.empty())
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ticket_keys_.swap(keys);
+    OPENSSL_cleanse(keys.data(), keys.size() * sizeof (TicketKey));
+    return 0;
+}
+
+bool TlsContext::current_ticket_key(TicketKey *key)
+{
+    long long now = now_us();
+    std::lock_guard<std::mutex> lock(key_mutex_);
+    // the keys of ticket_key_file are rotated by whoever writes it
+    if (params_.ticket_key_file.empty() &&
+        (ticket_keys_.empty() ||
+         now - ticket_keys_.front().created >= params_.ticket_key_rotation * 1000000LL))
+    {
+        this->new_ticket_key(now);
+    }
+    if (ticket_keys_.empty())
+        return false;
+
+    *key = ticket_keys_.front();
+    return true;
+}
+
+int TlsContext::find_ticket_key(const unsigned char *name, TicketKey *key) const
+{
+    std::lock_guard<std::mutex> lock(key_mutex_);
+    for (size_t i = 0; i < ticket_keys_.size(); i++)
+    {
+        if (memcmp(ticket_keys_[i].name, name, sizeof key->name) == 0)
+        {
+            *key = ticket_keys_[i];
+            return i == 0 ? 1 : 2;
+        }
+    }
+    return 0;
+}
+
+void TlsContext::rotate_ticket_keys()
+{
+    std::lock_guard<std::mutex> lock(key_mutex_);
+    if (params_.ticket_key_file.empty())
+        this->new_ticket_key(now_us());
+    else
+        this->load_ticket_keys();
+}
+
+void TlsContext::add_session(SSL_SESSION *session)
+{
+    unsigned int id_len;
+    const unsigned char *id = SSL_SESSION_get_id(session, &id_len);
+    int der_len = i2d_SSL_SESSION(session, nullptr);
+    if (id_len == 0 || der_len <= 0)
+        return;
+
+    CachedSession cached;
+    cached.id.assign(reinterpret_cast<const char *>(id), id_len);
+    cached.der.resize(der_len);
+    unsigned char *p = reinterpret_cast<unsigned char *>(&cached.der[0]);
+    i2d_SSL_SESSION(session, &p);
+    cached.expire = now_us() + SSL_SESSION_get_timeout(session) * 1000000LL;
+
+    std::lock_guard<std::mutex> lock(session_mutex_);
+    auto it = session_index_.find(cached.id);
+    if (it != session_index_.end())
+    {
+        sessions_.erase(it->second);
+        session_index_.erase(it);
+    }
+    sessions_.push_front(std::move(cached));
+    session_index_[sessions_.front().id] = sessions_.begin();
+    while (sessions_.size() > params_.session_cache_size)
+    {
+        session_index_.erase(sessions_.back().id);
+        sessions_.pop_back();
+    }
+}
+
+SSL_SESSION *TlsContext::get_session(const unsigned char *id, int len)
+{
+    std::string der;
+    {
+        std::lock_guard<std::mutex> lock(session_mutex_);
+        auto it = session_index_.find(std::string(reinterpret_cast<const char *>(id), len));
+        if (it == session_index_.end())
+            return nullptr;
+        if (it->second->expire < now_us())
+        {
+            sessions_.erase(it->second);
+            session_index_.erase(it);
+            return nullptr;
+        }
+        // a hit is the most recent use, the eviction from the back is LRU
+        sessions_.splice(sessions_.begin(), sessions_, it->second);
+        der = sessions_.front().der;
+    }
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(der.data());
+    return d2i_SSL_SESSION(nullptr, &p, static_cast<long>(der.size()));
+}
+
+void TlsContext::remove_session(SSL_SESSION *session)
+{
+    unsigned int id_len;
+    const unsigned char *id = SSL_SESSION_get_id(session, &id_len);
+
+    std::lock_guard<std::mutex> lock(session_mutex_);
+    auto it = session_index_.find(std::string(reinterpret_cast<const char *>(id), id_len));
+    if (it != session_index_.end())
+    {
+        sessions_.erase(it->second);
+        session_index_.erase(it);
+    }
+}
+
+void TlsContext::handshake_done(long long latency_us, bool resumed)
+{
+    (resumed ? resumed_ : full_).fetch_add(1, std::memory_order_relaxed);
+    handshake_us_.record_shared(latency_us > 0 ? latency_us : 0);
+}
+
+void TlsContext::handshake_failed()
+{
+    failed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+TlsStats TlsContext::stats() const
+{
+    std::vector<uint64_t> counts(Histogram::k_bucket_count, 0);
+    handshake_us_.merge_to(counts);
+
+    TlsStats stats;
+    stats.full_handshakes = full_.load(std::memory_order_relaxed);
+    stats.resumed_handshakes = resumed_.load(std::memory_order_relaxed);
+    stats.failed_handshakes = failed_.load(std::memory_order_relaxed);
+    stats.handshake_p50_us = Histogram::quantile(counts, 0.5);
+    stats.handshake_p99_us = Histogram::quantile(counts, 0.99);
+    stats.handshake_max_us = Histogram::quantile(counts, 1.0);
+    {
+        std::lock_guard<std::mutex> lock(session_mutex_);
+        stats.cached_sessions = sessions_.size();
+    }
+    return stats;
+}
@@ -0,0 +1,139 @@
+#ifndef WFREST_TLSCONTEXT_H_
+#define WFREST_TLSCONTEXT_H_
+
+#include <openssl/ssl.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+#include "Noncopyable.h"
+#include "Histogram.h"
+
+namespace wfrest
+{
+
+struct TlsParams
+{
+    // sessions kept for resumption by session id, 0 to disable the cache
+    size_t session_cache_size = 20480;
+    // seconds a session (or a ticket) can be resumed
+    int session_timeout = 300;
+    // stateless resumption with tickets, encrypted with keys made and rotated here
+    bool session_tickets = true;
+    // seconds between two ticket keys
+    int ticket_key_rotation = 3600;
+    // keys a ticket is still accepted with, the current one included
+    int ticket_keys_kept = 3;
+    // Keys shared with other processes, an upgraded binary included : a file
+    // of 80 byte keys (name, hmac key, aes key, as nginx ssl_session_ticket_key),
+    // the first one encrypts. They are not rotated here, rotate_ticket_keys()
+    // reads the file again.
+    std::string ticket_key_file;
+    // protocols offered to ALPN, by preference, "h2" is not offered
+    std::vector<std::string> alpn = { "http/1.1" };
+    // openssl cipher list of TLS 1.2 and below, openssl default if empty
+    std::string ciphers;
+    // TLS 1.3 cipher suites, openssl default if empty
+    std::string ciphersuites;
+    int min_version = TLS1_2_VERSION;
+    bool prefer_server_ciphers = true;
+};
+
+struct TlsStats
+{
+    unsigned long long full_handshakes;
+    unsigned long long resumed_handshakes;
+    unsigned long long failed_handshakes;
+    // handshake latency, from the ClientHello to the Finished
+    unsigned long long handshake_p50_us;
+    unsigned long long handshake_p99_us;
+    unsigned long long handshake_max_us;
+    size_t cached_sessions;
+};
+
+/*
+Server side TLS settings shared by the SSL_CTX of every https endpoint
+of a server : session cache, ticket keys, ALPN, ciphers and handshake
+counters. See HttpServer::tls().
+*/
+class TlsContext : public Noncopyable
+{
+public:
+    explicit TlsContext(const TlsParams &params);
+
+    // apply to a new SSL_CTX, -1 if the ciphers or versions are not supported
+    int configure(SSL_CTX *ssl_ctx);
+
+    TlsStats stats() const;
+
+    // start a new ticket key now, tickets of the kept keys remain valid,
+    // or read ticket_key_file again, the keys are kept if it is unreadable
+    void rotate_ticket_keys();
+
+    // for the openssl callbacks
+    static TlsContext *of(const SSL *ssl);
+
+public:
+    struct TicketKey
+    {
+        unsigned char name[16];
+        unsigned char aes_key[32];
+        unsigned char hmac_key[32];
+        long long created;
+    };
+
+    // current key, rotated if due
+    bool current_ticket_key(TicketKey *key);
+
+    // 0 if unknown, 1 for the current key, 2 for an older one
+    int find_ticket_key(const unsigned char *name, TicketKey *key) const;
+
+    void add_session(SSL_SESSION *session);
+
+    SSL_SESSION *get_session(const unsigned char *id, int len);
+
+    void remove_session(SSL_SESSION *session);
+
+    void handshake_done(long long latency_us, bool resumed);
+
+    void handshake_failed();
+
+    const std::string &alpn_wire() const { return alpn_wire_; }
+
+private:
+    struct CachedSession
+    {
+        std::string id;
+        std::string der;
+        long long expire;
+    };
+
+    bool new_ticket_key(long long now);
+
+    // ticket_key_file into ticket_keys_, -1 with errno if unreadable or malformed
+    int load_ticket_keys();
+
+private:
+    TlsParams params_;
+    std::string alpn_wire_;         // the ALPN list, in the format of the extension
+
+    mutable std::mutex key_mutex_;
+    std::vector<TicketKey> ticket_keys_;    // newest first
+
+    mutable std::mutex session_mutex_;
+    std::list<CachedSession> sessions_;     // most recent first
+    std::unordered_map<std::string, std::list<CachedSession>::iterator> session_index_;
+
+    std::atomic<unsigned long long> full_;
+    std::atomic<unsigned long long> resumed_;
+    std::atomic<unsigned long long> failed_;
+    Histogram handshake_us_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_TLSCONTEXT_H_
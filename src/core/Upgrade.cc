@@ -0,0 +1,401 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "Upgrade.h"
+
+namespace wfrest
+{
+
+namespace
+{
+
+// SCM_MAX_FD is 253
+const size_t k_max_sockets = 64;
+const char k_ready = 'R';
+
+long long now_us(clockid_t clock = CLOCK_MONOTONIC)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// since the exec of the process, from its start time in /proc (in clock ticks)
+long long process_uptime_us()
+{
+    FILE *fp = fopen("/proc/self/stat", "r");
+    if (!fp)
+        return -1;
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof buf - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+
+    // the command in parentheses may contain spaces, starttime is the 20th field after it
+    const char *p = strrchr(buf, ')');
+    for (int field = 0; p && field < 20; field++)
+        p = strchr(p + 1, ' ');
+    if (!p)
+        return -1;
+
+    long long ticks = strtoll(p + 1, nullptr, 10);
+    long hz = sysconf(_SC_CLK_TCK);
+    if (hz <= 0)
+        return -1;
+    return now_us(CLOCK_BOOTTIME) - ticks * 1000000LL / hz;
+}
+
+int unix_addr(const std::string &path, struct sockaddr_un *addr)
+{
+    if (path.empty() || path.size() >= sizeof addr->sun_path)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path.c_str(), path.size());
+    return 0;
+}
+
+}  // namespace
+
+Upgrade::Upgrade() :
+    previous_fd_(-1),
+    stats_{0, -1, -1, 0, -1},
+    upgrade_fd_(-1),
+    handed_over_(false),
+    stopped_(false)
+{}
+
+Upgrade::~Upgrade()
+{
+    this->stop();
+    for (auto &kv : inherited_)
+        close(kv.second);
+    if (previous_fd_ >= 0)
+        close(previous_fd_);
+}
+
+int Upgrade::inherit(const std::string &upgrade_path, int timeout_ms)
+{
+    struct sockaddr_un addr;
+    if (unix_addr(upgrade_path, &addr) < 0)
+        return -1;
+
+    long long begin = now_us();
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+
+    if (connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+    {
+        int error = errno;
+        close(sock);
+        // nobody serves it : the first start, or a stale socket file
+        if (error == ENOENT || error == ECONNREFUSED)
+            return 0;
+        errno = error;
+        return -1;
+    }
+
+    std::vector<UpgradeSocket> sockets;
+    if (recv_sockets(sock, timeout_ms, &sockets) < 0)
+    {
+        int error = errno;
+        close(sock);
+        errno = error;
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &socket : sockets)
+    {
+        auto ret = inherited_.emplace(socket.name, socket.fd);
+        if (!ret.second)
+            close(socket.fd);
+    }
+    previous_fd_ = sock;
+    stats_.inherited = sockets.size();
+    stats_.handoff_us = now_us() - begin;
+    return 0;
+}
+
+int Upgrade::take(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = inherited_.find(name);
+    if (it == inherited_.end())
+        return -1;
+    int fd = it->second;
+    inherited_.erase(it);
+    return fd;
+}
+
+bool Upgrade::has(const std::string &name) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return inherited_.count(name) != 0;
+}
+
+void Upgrade::ready()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // endpoints the new configuration dropped
+    for (auto &kv : inherited_)
+        close(kv.second);
+    inherited_.clear();
+    stats_.startup_us = process_uptime_us();
+
+    if (previous_fd_ >= 0)
+    {
+        send(previous_fd_, &k_ready, 1, MSG_NOSIGNAL);
+        close(previous_fd_);
+        previous_fd_ = -1;
+    }
+}
+
+int Upgrade::serve(const std::string &upgrade_path, SocketsFunc sockets_func)
+{
+    struct sockaddr_un addr;
+    if (unix_addr(upgrade_path, &addr) < 0)
+        return -1;
+
+    if (upgrade_fd_ >= 0)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    // left by the previous process, which does not remove it once it handed over
+    struct stat st;
+    if (lstat(upgrade_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(upgrade_path.c_str());
+
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0 ||
+        listen(fd, 1) < 0)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    upgrade_path_ = upgrade_path;
+    upgrade_fd_ = fd;
+    sockets_func_ = std::move(sockets_func);
+    handed_over_ = false;
+    stopped_ = false;
+    thread_ = std::thread(&Upgrade::handoff_routine, this);
+    return 0;
+}
+
+void Upgrade::handoff_routine()
+{
+    for (;;)
+    {
+        int conn = accept4(upgrade_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;      // shut down by stop()
+        }
+
+        std::vector<UpgradeSocket> sockets = sockets_func_();
+        char ready = 0;
+        if (send_sockets(conn, sockets) == 0)
+        {
+            // the new process takes its time to start, until it is ready or gone
+            struct pollfd pfd = { conn, POLLIN, 0 };
+            for (;;)
+            {
+                int ret = poll(&pfd, 1, 100);
+                if (ret > 0)
+                {
+                    if (recv(conn, &ready, 1, 0) != 1)
+                        ready = 0;
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                if ((ret < 0 && errno != EINTR) || stopped_)
+                    break;
+            }
+        }
+        close(conn);
+
+        if (ready == k_ready)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            handed_over_ = true;
+            stats_.handed_over = sockets.size();
+            cond_.notify_all();
+            break;
+        }
+        // the new process failed to start, the sockets are still served here
+    }
+}
+
+bool Upgrade::wait_handoff()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return handed_over_ || stopped_ || upgrade_fd_ < 0; });
+    return handed_over_;
+}
+
+void Upgrade::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (upgrade_fd_ < 0)
+            return;
+        stopped_ = true;
+    }
+
+    // wakes accept()
+    ::shutdown(upgrade_fd_, SHUT_RDWR);
+    thread_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    close(upgrade_fd_);
+    upgrade_fd_ = -1;
+    // once handed over, the path is the one of the next process
+    if (!handed_over_)
+        unlink(upgrade_path_.c_str());
+    cond_.notify_all();
+}
+
+void Upgrade::set_drain_us(long long drain_us)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.drain_us = drain_us;
+}
+
+UpgradeStats Upgrade::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+int Upgrade::send_sockets(int sock, const std::vector<UpgradeSocket> &sockets)
+{
+    if (sockets.size() > k_max_sockets)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    std::string names = std::to_string(sockets.size()) + "\n";
+    for (const auto &socket : sockets)
+        names.append(socket.name).push_back('\n');
+
+    struct iovec iov;
+    iov.iov_base = const_cast<char *>(names.data());
+    iov.iov_len = names.size();
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * k_max_sockets));
+    if (!sockets.empty())
+    {
+        msg.msg_control = control.data();
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * sockets.size());
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * sockets.size());
+        int *fds = reinterpret_cast<int *>(CMSG_DATA(cmsg));
+        for (size_t i = 0; i < sockets.size(); i++)
+            fds[i] = sockets[i].fd;
+    }
+
+    ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    return n == static_cast<ssize_t>(names.size()) ? 0 : -1;
+}
+
+int Upgrade::recv_sockets(int sock, int timeout_ms, std::vector<UpgradeSocket> *sockets)
+{
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret <= 0)
+    {
+        if (ret == 0)
+            errno = ETIMEDOUT;
+        return -1;
+    }
+
+    char buf[8192];
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = sizeof buf;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * k_max_sockets));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0)
+    {
+        if (n == 0)
+            errno = ECONNRESET;
+        return -1;
+    }
+
+    std::vector<int> fds;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *data = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        fds.insert(fds.end(), data, data + count);
+    }
+
+    std::vector<std::string> names;
+    const char *p = buf;
+    const char *end = buf + n;
+    while (p < end)
+    {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+            break;
+        names.emplace_back(p, eol);
+        p = eol + 1;
+    }
+
+    // the count line, then one name per fd
+    bool ok = !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) && !names.empty() &&
+              names[0] == std::to_string(fds.size()) && names.size() == fds.size() + 1;
+    if (!ok)
+    {
+        for (int fd : fds)
+            close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+
+    for (size_t i = 0; i < fds.size(); i++)
+        sockets->push_back(UpgradeSocket{names[i + 1], fds[i]});
+    return 0;
+}
+
+}  // namespace wfrest
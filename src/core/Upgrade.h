@@ -0,0 +1,107 @@
+#ifndef WFREST_UPGRADE_H_
+#define WFREST_UPGRADE_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Noncopyable.h"
+
+namespace wfrest
+{
+
+// A listening socket handed from a process to the next one, by endpoint name
+struct UpgradeSocket
+{
+    std::string name;       // "main", "shard<n>" or the name of a listen() endpoint
+    int fd;
+};
+
+struct UpgradeStats
+{
+    // new process
+    size_t inherited;           // sockets received from the previous process
+    long long handoff_us;       // from the connection to the previous process to the sockets
+    long long startup_us;       // from the exec of the process to ready(), -1 if unknown
+    // running process
+    size_t handed_over;         // sockets sent to the next process, 0 until it is ready
+    long long drain_us;         // from ready to the last connection closed, -1 if not drained
+};
+
+/*
+Zero downtime binary upgrade. The running process serves upgrade_path,
+a unix socket. The new binary connects to it and gets the listening
+sockets with SCM_RIGHTS, so the connections in their accept queues are
+not lost. Once it serves them it is ready : the old process stops
+accepting and drains its connections. If the new process dies before,
+the old one keeps serving and waits for another one.
+See HttpServer::inherit_sockets() and serve_upgrades().
+*/
+class Upgrade : public Noncopyable
+{
+public:
+    using SocketsFunc = std::function<std::vector<UpgradeSocket>()>;
+
+    Upgrade();
+
+    ~Upgrade();
+
+    // New process : take the sockets of the process serving upgrade_path.
+    // 0 without such a process (first start), -1 on error.
+    int inherit(const std::string &upgrade_path, int timeout_ms);
+
+    // the inherited socket of an endpoint, -1 if none, the caller owns it
+    int take(const std::string &name);
+
+    bool has(const std::string &name) const;
+
+    // close the sockets nobody took and let the previous process drain
+    void ready();
+
+    // Running process : hand the sockets of sockets_func to the next binary
+    // which connects to upgrade_path, from a background thread.
+    int serve(const std::string &upgrade_path, SocketsFunc sockets_func);
+
+    // blocks until the next process is ready, false if stop() was called first
+    bool wait_handoff();
+
+    // stop serving upgrade_path, unlinked unless the sockets were handed over
+    void stop();
+
+    void set_drain_us(long long drain_us);
+
+    UpgradeStats stats() const;
+
+    // one message : the names separated by '\n', the fds in SCM_RIGHTS
+    static int send_sockets(int sock, const std::vector<UpgradeSocket> &sockets);
+
+    static int recv_sockets(int sock, int timeout_ms, std::vector<UpgradeSocket> *sockets);
+
+private:
+    void handoff_routine();
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+
+    // new process
+    std::unordered_map<std::string, int> inherited_;
+    int previous_fd_;           // connection to the previous process until ready()
+    UpgradeStats stats_;
+
+    // running process
+    std::string upgrade_path_;
+    int upgrade_fd_;
+    SocketsFunc sockets_func_;
+    std::thread thread_;
+    bool handed_over_;
+    bool stopped_;
+};
+
+}  // namespace wfrest
+
+#endif // WFREST_UPGRADE_H_
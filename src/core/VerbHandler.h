@@ -58,7 +58,7 @@ using WrapHandler = std::function<WFGoTask *(HttpReq * , HttpResp *, SeriesWork
 struct VerbHandler
 {
     std::map<Verb, WrapHandler> verb_handler_map;
-    StringPiece path;
+    StringPiece path;           // interned, see HttpReq::route_pattern()
     int compute_queue_id;
 };
 
@@ -1,9 +1,37 @@
 #include "CodeUtil.h"
 #include "StringPiece.h"
+#include "Simd.h"
+
+#include <stdlib.h>
 
 namespace wfrest
 {
 
+namespace
+{
+
+// the value of a hex digit, -1 if none
+const signed char k_hex_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+}  // namespace
+
 std::string CodeUtil::url_encode(const std::string &value)
 {
     static auto hex_chars = "0123456789ABCDEF";
@@ -11,19 +39,20 @@ std::string CodeUtil::url_encode(const std::string &value)
     std::string result;
     result.reserve(value.size()); // Minimum size of result
 
-    for (auto &chr : value) 
+    const char *p = value.data();
+    const char *end = p + value.size();
+    while (p != end)
     {
-        if (!((chr >= '0' && chr <= '9') || (chr >= 'A' && chr <= 'Z') ||
-            (chr >= 'a' && chr <= 'z') || chr == '-' || chr == '.' ||
-            chr == '_' || chr == '~' || chr == '/'))
-        {
-            result += std::string("%") +
-                    hex_chars[static_cast<unsigned char>(chr) >> 4] +
-                    hex_chars[static_cast<unsigned char>(chr) & 15];
-        } else
-        {
-            result += chr;
-        }   
+        // the run of bytes kept as they are, then one escaped
+        const char *unsafe = Simd::find_url_unsafe(p, end);
+        result.append(p, unsafe - p);
+        if (unsafe == end)
+            break;
+
+        unsigned char chr = *unsafe;
+        char escaped[3] = { '%', hex_chars[chr >> 4], hex_chars[chr & 15] };
+        result.append(escaped, 3);
+        p = unsafe + 1;
     }
 
     return result;
@@ -32,24 +61,43 @@ std::string CodeUtil::url_encode(const std::string &value)
 std::string CodeUtil::url_decode(const std::string &value)
 {
     std::string result;
-    result.reserve(value.size() / 3 + (value.size() % 3)); // Minimum size of result
+    result.reserve(value.size()); // Maximum size of result
 
-    for (std::size_t i = 0; i < value.size(); ++i) 
+    const char *begin = value.data();
+    const char *p = begin;
+    const char *end = begin + value.size();
+    while (p != end)
     {
-        auto &chr = value[i];
-        if (chr == '%' && i + 2 < value.size()) 
-        {
-            auto hex = value.substr(i + 1, 2);
-            auto decoded_chr =
-                static_cast<char>(std::strtol(hex.c_str(), nullptr, 16));
-            result += decoded_chr;
-            i += 2;
-        } else if (chr == '+')
+        const char *escape = Simd::find_url_escape(p, end);
+        result.append(p, escape - p);
+        if (escape == end)
+            break;
+
+        if (*escape == '+')
         {
             result += ' ';
-        } else
+            p = escape + 1;
+        }
+        else if (end - escape >= 3)
+        {
+            int hi = k_hex_values[static_cast<unsigned char>(escape[1])];
+            int lo = k_hex_values[static_cast<unsigned char>(escape[2])];
+            if (hi >= 0 && lo >= 0)
+            {
+                result += static_cast<char>((hi << 4) | lo);
+            }
+            else
+            {
+                // not two hex digits, decoded as strtol() always did
+                char hex[3] = { escape[1], escape[2], '\0' };
+                result += static_cast<char>(strtol(hex, nullptr, 16));
+            }
+            p = escape + 3;
+        }
+        else
         {
-            result += chr;
+            result += '%';
+            p = escape + 1;
         }
     }
     return result;
@@ -1,4 +1,5 @@
 #include "StrUtil.h"
+#include <algorithm>
 
 using namespace wfrest;
 
@@ -46,4 +47,17 @@ StringPiece StrUtil::rtrim(const StringPiece &str)
 StringPiece StrUtil::trim(const StringPiece &str)
 {
     return ltrim(rtrim(str));
-}
\ No newline at end of file
+}
+
+int StrUtil::compare_nocase(const char *lhs, size_t lhs_len, const char *rhs, size_t rhs_len)
+{
+    size_t len = std::min(lhs_len, rhs_len);
+    size_t i = Simd::mismatch_nocase(lhs, rhs, len);
+    if (i < len)
+    {
+        unsigned char l = lhs[i];
+        unsigned char r = rhs[i];
+        return (l >= 'A' && l <= 'Z' ? l | 0x20 : l) - (r >= 'A' && r <= 'Z' ? r | 0x20 : r);
+    }
+    return lhs_len < rhs_len ? -1 : (lhs_len > rhs_len ? 1 : 0);
+}
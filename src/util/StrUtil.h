@@ -4,6 +4,7 @@
 #include "workflow/StringUtil.h"
 #include <string>
 #include "StringPiece.h"
+#include "Simd.h"
 
 namespace wfrest
 {
@@ -23,7 +24,16 @@ public:
 
     template<class OutputStringType>
     static std::vector<OutputStringType> split_piece(const StringPiece &str, char sep);
-    
+
+    // ASCII case-insensitive, as strcasecmp() without stopping at a '\0'
+    static int compare_nocase(const char *lhs, size_t lhs_len, const char *rhs, size_t rhs_len);
+
+    static bool equals_nocase(const StringPiece &lhs, const StringPiece &rhs)
+    {
+        return lhs.size() == rhs.size() &&
+               Simd::mismatch_nocase(lhs.data(), rhs.data(), lhs.size()) == lhs.size();
+    }
+
 
 private:
     static const std::string k_pairs_;
@@ -37,17 +47,13 @@ std::vector<OutputStringType> StrUtil::split_piece(const StringPiece &str, char
     if (str.empty())
         return res;
 
-    const char *p = str.begin();
-    const char *cursor = p;
+    const char *cursor = str.begin();
+    const char *p;
 
-    while (p != str.end())
+    while ((p = Simd::find_char(cursor, str.end(), sep)) != str.end())
     {
-        if (*p == sep)
-        {
-            res.emplace_back(OutputStringType(cursor, p - cursor));
-            cursor = p + 1;
-        }
-        ++p;
+        res.emplace_back(OutputStringType(cursor, p - cursor));
+        cursor = p + 1;
     }
     res.emplace_back(OutputStringType(cursor, str.end() - cursor));
     return res;
@@ -57,7 +63,7 @@ std::vector<OutputStringType> StrUtil::split_piece(const StringPiece &str, char
 class MapStringCaseLess {
 public:
     bool operator()(const std::string& lhs, const std::string& rhs) const {
-        return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
+        return StrUtil::compare_nocase(lhs.data(), lhs.size(), rhs.data(), rhs.size()) < 0;
     }
 };
 
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "wfrest/Grpc.h"
+#include "wfrest/Compress.h"
+#include "wfrest/ErrorCode.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+std::string framed(const std::string &message, bool compressed = false)
+{
+    std::string out;
+    GrpcFrame::append_prefix(compressed, message.size(), &out);
+    return out + message;
+}
+
+std::string flatten(const std::vector<struct iovec> &vectors)
+{
+    std::string data;
+    for (const struct iovec &vec : vectors)
+        data.append(static_cast<const char *>(vec.iov_base), vec.iov_len);
+    return data;
+}
+
+}  // namespace
+
+TEST(GrpcFrame, parse)
+{
+    std::string body = framed("hello") + framed("") + framed(std::string(70000, 'x'), true);
+    std::vector<GrpcFrame::Message> messages;
+    EXPECT_TRUE(GrpcFrame::parse(body.data(), body.size(), &messages));
+    ASSERT_EQ(messages.size(), 3u);
+    EXPECT_EQ(messages[0].data.as_string(), "hello");
+    EXPECT_FALSE(messages[0].compressed);
+    // views into the body
+    EXPECT_EQ(messages[0].data.data(), body.data() + GrpcFrame::k_prefix_size);
+    EXPECT_TRUE(messages[1].data.empty());
+    EXPECT_EQ(messages[2].data.size(), 70000u);
+    EXPECT_TRUE(messages[2].compressed);
+
+    messages.clear();
+    EXPECT_TRUE(GrpcFrame::parse("", 0, &messages));
+    EXPECT_TRUE(messages.empty());
+
+    // a message cut short, a prefix cut short, an unknown flag
+    EXPECT_FALSE(GrpcFrame::parse(body.data(), 8, &messages));
+    EXPECT_FALSE(GrpcFrame::parse(body.data(), 3, &messages));
+    std::string bad_flag = framed("a");
+    bad_flag[0] = 2;
+    EXPECT_FALSE(GrpcFrame::parse(bad_flag.data(), bad_flag.size(), &messages));
+}
+
+TEST(GrpcFrame, prefix)
+{
+    std::string out;
+    GrpcFrame::append_prefix(true, 0x01020304, &out);
+    EXPECT_EQ(out, std::string("\x01\x01\x02\x03\x04", 5));
+}
+
+TEST(GrpcFrame, timeout)
+{
+    EXPECT_EQ(GrpcFrame::parse_timeout("2H"), 7200000);
+    EXPECT_EQ(GrpcFrame::parse_timeout("3M"), 180000);
+    EXPECT_EQ(GrpcFrame::parse_timeout("5S"), 5000);
+    EXPECT_EQ(GrpcFrame::parse_timeout("250m"), 250);
+    // rounded up to the ms
+    EXPECT_EQ(GrpcFrame::parse_timeout("1500u"), 2);
+    EXPECT_EQ(GrpcFrame::parse_timeout("1n"), 1);
+    EXPECT_EQ(GrpcFrame::parse_timeout("0m"), 0);
+    EXPECT_EQ(GrpcFrame::parse_timeout("99999999S"), 99999999000LL);
+
+    EXPECT_EQ(GrpcFrame::parse_timeout(""), -1);
+    EXPECT_EQ(GrpcFrame::parse_timeout("S"), -1);
+    EXPECT_EQ(GrpcFrame::parse_timeout("10"), -1);
+    EXPECT_EQ(GrpcFrame::parse_timeout("10s"), -1);
+    EXPECT_EQ(GrpcFrame::parse_timeout("-1S"), -1);
+    EXPECT_EQ(GrpcFrame::parse_timeout("123456789S"), -1);
+}
+
+TEST(GrpcFrame, status_message)
+{
+    EXPECT_EQ(GrpcFrame::encode_status_message("no such user"), "no such user");
+    EXPECT_EQ(GrpcFrame::encode_status_message("100% \r\n\xc3\xa9"), "100%25 %0D%0A%C3%A9");
+}
+
+TEST(GrpcReply, messages)
+{
+    GrpcReply reply(false);
+    std::string first(100, 'f');
+    const char *first_data = first.data();
+    reply.write(std::move(first), true);
+    static const char second[] = "second";
+    reply.write_nocopy(second, 6);
+
+    std::vector<struct iovec> vectors;
+    reply.append_body(&vectors);
+    ASSERT_EQ(vectors.size(), 4u);
+    EXPECT_EQ(flatten(vectors), framed(std::string(100, 'f')) + framed("second"));
+    // neither copied, the client does not accept gzip
+    EXPECT_EQ(vectors[1].iov_base, first_data);
+    EXPECT_EQ(vectors[3].iov_base, second);
+    EXPECT_FALSE(reply.compressed());
+
+    Http2Headers trailers = reply.trailers();
+    Http2Headers expected = { { "grpc-status", "0" } };
+    EXPECT_EQ(trailers, expected);
+
+    reply.set_status(GrpcStatus::NOT_FOUND, "no such user");
+    reply.add_trailer("x-request-id", "1");
+    expected = { { "grpc-status", "5" }, { "grpc-message", "no such user" }, { "x-request-id", "1" } };
+    EXPECT_EQ(reply.trailers(), expected);
+
+    reply.expire();
+    vectors.clear();
+    reply.append_body(&vectors);
+    EXPECT_TRUE(vectors.empty());
+    EXPECT_EQ(reply.status(), GrpcStatus::DEADLINE_EXCEEDED);
+}
+
+TEST(GrpcReply, compression)
+{
+    GrpcReply reply(true);
+    std::string message(10000, 'a');
+    reply.write(std::string(message), true);
+    // not smaller compressed, sent as is
+    reply.write("ab", true);
+    reply.write(std::string(message), false);
+    EXPECT_TRUE(reply.compressed());
+
+    std::vector<struct iovec> vectors;
+    reply.append_body(&vectors);
+    std::string body = flatten(vectors);
+    std::vector<GrpcFrame::Message> messages;
+    ASSERT_TRUE(GrpcFrame::parse(body.data(), body.size(), &messages));
+    ASSERT_EQ(messages.size(), 3u);
+
+    EXPECT_TRUE(messages[0].compressed);
+    EXPECT_LT(messages[0].data.size(), message.size());
+    std::string inflated;
+    EXPECT_EQ(Compressor::ungzip(messages[0].data.data(), messages[0].data.size(), &inflated), StatusOK);
+    EXPECT_EQ(inflated, message);
+
+    EXPECT_FALSE(messages[1].compressed);
+    EXPECT_EQ(messages[1].data.as_string(), "ab");
+    EXPECT_FALSE(messages[2].compressed);
+    EXPECT_EQ(messages[2].data.size(), message.size());
+}
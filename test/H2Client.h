@@ -0,0 +1,253 @@
+#ifndef WFREST_TEST_H2CLIENT_H_
+#define WFREST_TEST_H2CLIENT_H_
+
+#include <sys/socket.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include "wfrest/Http2.h"
+
+struct H2Reply
+{
+    wfrest::Http2Headers headers;
+    std::string body;
+    wfrest::Http2Headers trailers;
+};
+
+// blocking h2c client with prior knowledge
+class H2Client
+{
+public:
+    H2Client()
+    {
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(8888);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (connect(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0)
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    ~H2Client()
+    {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    // window : of the streams and the connection, large enough for the replies
+    // by default, so the client never sends a WINDOW_UPDATE. Without ack the
+    // settings of the server are not acked.
+    bool handshake(uint32_t window = 1 << 24, bool ack = true)
+    {
+        using namespace wfrest;
+        std::string out(Http2Frame::k_preface, Http2Frame::k_preface_size);
+        Http2Frame::append_settings(&out, { { 0x4, window } });
+        if (window > 65535)
+            Http2Frame::append_window_update(&out, 0, window - 65535);
+        if (!send_all(out))
+            return false;
+        // the settings of the server first
+        Http2Frame frame;
+        std::string payload;
+        if (!read_frame(&frame, &payload) || frame.type != Http2FrameType::SETTINGS)
+            return false;
+        if (!ack)
+            return true;
+        out.clear();
+        Http2Frame::append(&out, 0, Http2FrameType::SETTINGS, Http2Frame::k_ack, 0);
+        return send_all(out);
+    }
+
+    // the stream id, 0 if the connection is lost
+    uint32_t send_request(const std::string &method, const std::string &path,
+                          const wfrest::Http2Headers &extra, const std::string &body)
+    {
+        using namespace wfrest;
+        uint32_t stream_id = next_stream_id_;
+        next_stream_id_ += 2;
+
+        std::string block;
+        HpackEncoder::encode(":method", method, &block);
+        HpackEncoder::encode(":scheme", "http", &block);
+        HpackEncoder::encode(":path", path, &block);
+        HpackEncoder::encode(":authority", "127.0.0.1:8888", &block);
+        for (const auto &header : extra)
+            HpackEncoder::encode(header.first, header.second, &block);
+        std::string out;
+        uint8_t flags = Http2Frame::k_end_headers | (body.empty() ? Http2Frame::k_end_stream : 0);
+        Http2Frame::append(&out, block.size(), Http2FrameType::HEADERS, flags, stream_id);
+        out += block;
+        // within SETTINGS_MAX_FRAME_SIZE
+        for (size_t off = 0; off < body.size(); off += 16384)
+        {
+            size_t length = std::min(body.size() - off, static_cast<size_t>(16384));
+            flags = off + length == body.size() ? Http2Frame::k_end_stream : 0;
+            Http2Frame::append(&out, length, Http2FrameType::DATA, flags, stream_id);
+            out.append(body, off, length);
+        }
+        return send_all(out) ? stream_id : 0;
+    }
+
+    // Until the end of the stream, the frames of the other ones are kept for
+    // them. false if the stream is reset or the connection is lost first.
+    bool read_reply(uint32_t stream_id, H2Reply *reply)
+    {
+        bool ok = read_stream(stream_id, static_cast<size_t>(-1)) && ended_[stream_id] == 1;
+        *reply = std::move(replies_[stream_id]);
+        replies_.erase(stream_id);
+        return ok;
+    }
+
+    // until body_size bytes of the reply body are in, false if the stream ends first
+    bool read_body(uint32_t stream_id, size_t body_size)
+    {
+        return read_stream(stream_id, body_size) && ended_[stream_id] == 0;
+    }
+
+    bool window_update(uint32_t stream_id, uint32_t increment)
+    {
+        std::string out;
+        wfrest::Http2Frame::append_window_update(&out, stream_id, increment);
+        return send_all(out);
+    }
+
+    // false if the connection is lost first
+    bool request(const std::string &method, const std::string &path,
+                 const wfrest::Http2Headers &extra, const std::string &body, H2Reply *reply)
+    {
+        uint32_t stream_id = send_request(method, path, extra, body);
+        return stream_id != 0 && read_reply(stream_id, reply);
+    }
+
+    bool request(const std::string &method, const std::string &path,
+                 const std::string &body, wfrest::Http2Headers *headers, std::string *resp_body)
+    {
+        H2Reply reply;
+        if (!this->request(method, path, {}, body, &reply))
+            return false;
+        headers->insert(headers->end(), reply.headers.begin(), reply.headers.end());
+        resp_body->append(reply.body);
+        return true;
+    }
+
+    bool goaway() const { return goaway_; }
+
+private:
+    // 1 once a stream ends, -1 once it is reset
+    bool read_stream(uint32_t stream_id, size_t body_size)
+    {
+        using namespace wfrest;
+        Http2Frame frame;
+        std::string payload;
+        while (ended_[stream_id] == 0 && replies_[stream_id].body.size() < body_size)
+        {
+            if (!read_frame(&frame, &payload))
+                return false;
+            if (frame.type == Http2FrameType::GOAWAY)
+                goaway_ = true;
+            if (frame.type == Http2FrameType::PING && !(frame.flags & Http2Frame::k_ack))
+            {
+                std::string out;
+                Http2Frame::append(&out, 8, Http2FrameType::PING, Http2Frame::k_ack, 0);
+                if (!send_all(out + payload))
+                    return false;
+            }
+            if (frame.stream_id == 0)
+                continue;
+
+            H2Reply &reply = replies_[frame.stream_id];
+            if (frame.type == Http2FrameType::RST_STREAM)
+                ended_[frame.stream_id] = -1;
+            if (frame.type == Http2FrameType::HEADERS)
+            {
+                Http2Headers *headers = reply.headers.empty() ? &reply.headers : &reply.trailers;
+                if (decoder_.decode(payload.data(), payload.size(), 65536, headers) != 0)
+                    return false;
+            }
+            if (frame.type == Http2FrameType::DATA)
+                reply.body.append(payload);
+            if ((frame.type == Http2FrameType::HEADERS || frame.type == Http2FrameType::DATA) &&
+                (frame.flags & Http2Frame::k_end_stream))
+                ended_[frame.stream_id] = 1;
+        }
+        return true;
+    }
+
+    bool send_all(const std::string &data)
+    {
+        return fd_ >= 0 && send(fd_, data.data(), data.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(data.size());
+    }
+
+    bool read_all(char *buf, size_t size)
+    {
+        while (size > 0)
+        {
+            if (!wait_readable())
+                return false;
+            ssize_t n = read(fd_, buf, size);
+            if (n <= 0)
+                return false;
+            buf += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // The server writes its frames as it reads the ones of the client,
+    // a client which waits for them pings it.
+    bool wait_readable()
+    {
+        struct pollfd pfd = { fd_, POLLIN, 0 };
+        while (true)
+        {
+            int ret = poll(&pfd, 1, 10);
+            if (ret != 0)
+                return ret > 0;
+            std::string out;
+            wfrest::Http2Frame::append(&out, 8, wfrest::Http2FrameType::PING, 0, 0);
+            out.append(8, '\0');
+            if (!send_all(out))
+                return false;
+        }
+    }
+
+    bool read_frame(wfrest::Http2Frame *frame, std::string *payload)
+    {
+        char header[wfrest::Http2Frame::k_header_size];
+        if (fd_ < 0 || !read_all(header, sizeof header))
+            return false;
+        frame->parse(header);
+        payload->resize(frame->length);
+        return frame->length == 0 || read_all(&(*payload)[0], frame->length);
+    }
+
+private:
+    int fd_;
+    uint32_t next_stream_id_ = 1;
+    wfrest::HpackDecoder decoder_;
+    bool goaway_ = false;
+    std::map<uint32_t, H2Reply> replies_;
+    std::map<uint32_t, int> ended_;
+};
+
+inline std::string header_value(const wfrest::Http2Headers &headers, const std::string &name)
+{
+    for (const auto &header : headers)
+    {
+        if (header.first == name)
+            return header.second;
+    }
+    return "";
+}
+
+#endif // WFREST_TEST_H2CLIENT_H_
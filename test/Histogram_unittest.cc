@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+#include "wfrest/Histogram.h"
+
+using namespace wfrest;
+
+TEST(Histogram, bucket)
+{
+    int last = -1;
+    for (uint64_t value = 0; value < (1 << 20); value++)
+    {
+        int idx = Histogram::bucket_of(value);
+        // buckets are contiguous and cover the value
+        EXPECT_TRUE(idx == last || idx == last + 1);
+        EXPECT_GE(Histogram::upper_bound(idx), value);
+        if (idx > 0)
+        {
+            EXPECT_LT(Histogram::upper_bound(idx - 1), value);
+        }
+        last = idx;
+    }
+    EXPECT_EQ(Histogram::bucket_of(~0ULL), Histogram::k_bucket_count - 1);
+}
+
+TEST(Histogram, quantile)
+{
+    Histogram hist;
+    for (uint64_t i = 1; i <= 1000; i++)
+        hist.record(i);
+
+    EXPECT_EQ(hist.count(), 1000);
+    EXPECT_EQ(hist.sum(), 500500);
+
+    std::vector<uint64_t> counts(Histogram::k_bucket_count, 0);
+    hist.merge_to(counts);
+    uint64_t p50 = Histogram::quantile(counts, 0.5);
+    uint64_t p99 = Histogram::quantile(counts, 0.99);
+    // at most 12.5% above the exact value
+    EXPECT_GE(p50, 500);
+    EXPECT_LE(p50, 500 * 1.125);
+    EXPECT_GE(p99, 990);
+    EXPECT_LE(p99, 990 * 1.125);
+}
@@ -0,0 +1,680 @@
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "wfrest/Http2.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+std::string unhex(const std::string &hex)
+{
+    std::string bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2)
+        bytes.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    return bytes;
+}
+
+struct Frame
+{
+    Http2Frame header;
+    std::string payload;
+};
+
+std::vector<Frame> parse_frames(const std::string &data)
+{
+    std::vector<Frame> frames;
+    size_t off = 0;
+    while (data.size() - off >= Http2Frame::k_header_size)
+    {
+        Frame frame;
+        frame.header.parse(data.data() + off);
+        off += Http2Frame::k_header_size;
+        frame.payload = data.substr(off, frame.header.length);
+        off += frame.header.length;
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// the socket of a connection, takes room bytes before EAGAIN
+class FakeTransport : public Http2Transport
+{
+public:
+    explicit FakeTransport(size_t room = static_cast<size_t>(-1)) : room(room), lost(false) {}
+
+    int write(const char *data, size_t size) override
+    {
+        if (room == 0 || lost)
+        {
+            errno = lost ? EPIPE : EAGAIN;
+            return -1;
+        }
+        size_t n = std::min(size, room);
+        written.append(data, n);
+        room -= n;
+        return static_cast<int>(n);
+    }
+
+    // what the reader of conn writes now
+    std::vector<Frame> frames(Http2Connection *conn)
+    {
+        conn->flush(this);
+        std::vector<Frame> frames = parse_frames(written);
+        written.clear();
+        return frames;
+    }
+
+    size_t room;
+    bool lost;
+    std::string written;
+};
+
+std::string client_preface(const std::vector<std::pair<uint16_t, uint32_t>> &settings = {})
+{
+    std::string out;
+    Http2Frame::append_settings(&out, settings);
+    return out;
+}
+
+std::string request_headers(uint32_t stream_id, const std::string &method,
+                            const std::string &path, bool end_stream,
+                            const Http2Headers &extra = {})
+{
+    std::string block;
+    HpackEncoder::encode(":method", method, &block);
+    HpackEncoder::encode(":scheme", "http", &block);
+    HpackEncoder::encode(":path", path, &block);
+    HpackEncoder::encode(":authority", "example.com", &block);
+    for (const auto &header : extra)
+        HpackEncoder::encode(header.first, header.second, &block);
+
+    std::string out;
+    uint8_t flags = Http2Frame::k_end_headers | (end_stream ? Http2Frame::k_end_stream : 0);
+    Http2Frame::append(&out, block.size(), Http2FrameType::HEADERS, flags, stream_id);
+    return out + block;
+}
+
+std::string data_frame(uint32_t stream_id, const std::string &data, bool end_stream)
+{
+    std::string out;
+    Http2Frame::append(&out, data.size(), Http2FrameType::DATA,
+                       end_stream ? Http2Frame::k_end_stream : 0, stream_id);
+    return out + data;
+}
+
+}  // namespace
+
+TEST(Hpack, rfc7541_huffman_requests)
+{
+    // RFC 7541 appendix C.4, one dynamic table for the three requests
+    HpackDecoder decoder;
+    Http2Headers headers;
+    std::string block = unhex("828684418cf1e3c2e5f23a6ba0ab90f4ff");
+    EXPECT_EQ(decoder.decode(block.data(), block.size(), 4096, &headers), 0);
+    Http2Headers expected = { { ":method", "GET" }, { ":scheme", "http" },
+                              { ":path", "/" }, { ":authority", "www.example.com" } };
+    EXPECT_EQ(headers, expected);
+
+    headers.clear();
+    block = unhex("828684be5886a8eb10649cbf");
+    EXPECT_EQ(decoder.decode(block.data(), block.size(), 4096, &headers), 0);
+    expected.emplace_back("cache-control", "no-cache");
+    EXPECT_EQ(headers, expected);
+
+    headers.clear();
+    block = unhex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf");
+    EXPECT_EQ(decoder.decode(block.data(), block.size(), 4096, &headers), 0);
+    expected = { { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" },
+                 { ":authority", "www.example.com" }, { "custom-key", "custom-value" } };
+    EXPECT_EQ(headers, expected);
+}
+
+TEST(Hpack, huffman_padding)
+{
+    std::string out;
+    // "a" is 00011, padded with ones
+    EXPECT_TRUE(HpackDecoder::huffman_decode("\x1f", 1, &out));
+    EXPECT_EQ(out, "a");
+    // padding with a zero bit
+    out.clear();
+    EXPECT_FALSE(HpackDecoder::huffman_decode("\x1e", 1, &out));
+    // more than 7 bits of padding
+    out.clear();
+    EXPECT_FALSE(HpackDecoder::huffman_decode("\x1f\xff", 2, &out));
+}
+
+TEST(Hpack, errors)
+{
+    HpackDecoder decoder;
+    Http2Headers headers;
+    // index 0, then an index past the tables
+    EXPECT_EQ(decoder.decode("\x80", 1, 4096, &headers), -1);
+    EXPECT_EQ(decoder.decode("\xff\x00", 2, 4096, &headers), -1);
+    // a string longer than the block
+    EXPECT_EQ(decoder.decode("\x00\x05""ab", 4, 4096, &headers), -1);
+    // a table size update over SETTINGS_HEADER_TABLE_SIZE
+    EXPECT_EQ(decoder.decode("\x3f\xe2\x1f", 3, 4096, &headers), -1);
+
+    // past the header list size the block is still decoded
+    std::string block;
+    HpackEncoder::encode("x-long", std::string(100, 'a'), &block);
+    EXPECT_EQ(decoder.decode(block.data(), block.size(), 64, &headers), 1);
+    EXPECT_TRUE(headers.empty());
+}
+
+TEST(Hpack, encoder)
+{
+    std::string out;
+    HpackEncoder::encode_status(200, &out);
+    EXPECT_EQ(out, "\x88");
+    out.clear();
+    HpackEncoder::encode_status(404, &out);
+    EXPECT_EQ(out, "\x8d");
+    out.clear();
+    HpackEncoder::encode_status(302, &out);
+    EXPECT_EQ(out, std::string("\x08\x03""302", 5));
+
+    // static table entries with a value are one byte
+    out.clear();
+    HpackEncoder::encode(":method", "GET", &out);
+    EXPECT_EQ(out, "\x82");
+
+    Http2Headers headers = { { "content-type", "application/json" },
+                             { "x-custom", std::string(300, 'v') },
+                             { ":path", "/index.html" },
+                             { "accept-encoding", "gzip, deflate" } };
+    std::string block;
+    HpackEncoder::encode_status(503, &block);
+    for (const auto &header : headers)
+        HpackEncoder::encode(header.first, header.second, &block);
+
+    HpackDecoder decoder;
+    Http2Headers decoded;
+    EXPECT_EQ(decoder.decode(block.data(), block.size(), 65536, &decoded), 0);
+    ASSERT_EQ(decoded.size(), headers.size() + 1);
+    EXPECT_EQ(decoded[0], std::make_pair(std::string(":status"), std::string("503")));
+    for (size_t i = 0; i < headers.size(); i++)
+        EXPECT_EQ(decoded[i + 1], headers[i]);
+}
+
+
+TEST(Http2Connection, request_and_reply)
+{
+    Http2Service service{Http2Params()};
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+
+    // served before the client acks the settings
+    std::string in = client_preface();
+    in += request_headers(1, "POST", "/echo?a=1", false,
+                          { { "cookie", "a=1" }, { "cookie", "b=2" } });
+    in += data_frame(1, "hello", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_EQ(requests[0].stream_id, 1u);
+    EXPECT_EQ(requests[0].message, "POST /echo?a=1 HTTP/1.1\r\n"
+                                   "host: example.com\r\n"
+                                   "cookie: a=1; b=2\r\n"
+                                   "content-length: 5\r\n\r\nhello");
+
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_GE(frames.size(), 2u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::SETTINGS);
+    EXPECT_EQ(frames[0].header.flags, 0);
+    // SETTINGS_MAX_CONCURRENT_STREAMS
+    EXPECT_EQ(frames[0].payload.substr(6, 6), std::string("\0\x03\0\0\0\x64", 6));
+    EXPECT_EQ(frames.back().header.type, Http2FrameType::SETTINGS);
+    EXPECT_EQ(frames.back().header.flags, Http2Frame::k_ack);
+
+    Http2Headers headers = { { "content-type", "text/plain" } };
+    std::string body = "world";
+    struct iovec body_vec = { &body[0], body.size() };
+    EXPECT_EQ(conn.reply(1, 200, headers, &body_vec, 1, nullptr), 0);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::HEADERS);
+    EXPECT_EQ(frames[0].header.stream_id, 1u);
+    EXPECT_EQ(frames[0].header.flags, Http2Frame::k_end_headers);
+    EXPECT_EQ(frames[1].header.type, Http2FrameType::DATA);
+    EXPECT_EQ(frames[1].header.flags, Http2Frame::k_end_stream);
+    EXPECT_EQ(frames[1].payload, "world");
+
+    HpackDecoder decoder;
+    Http2Headers decoded;
+    EXPECT_EQ(decoder.decode(frames[0].payload.data(), frames[0].payload.size(), 65536, &decoded), 0);
+    Http2Headers expected = { { ":status", "200" }, { "content-type", "text/plain" } };
+    EXPECT_EQ(decoded, expected);
+    EXPECT_EQ(conn.open_streams(), 0u);
+
+    // the next stream, with trailers in the reply
+    requests.clear();
+    in = request_headers(3, "GET", "/b", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_EQ(requests[0].message, "GET /b HTTP/1.1\r\nhost: example.com\r\n\r\n");
+    Http2Headers trailers = { { "grpc-status", "0" } };
+    EXPECT_EQ(conn.reply(3, 204, {}, nullptr, 0, &trailers), 0);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0].payload, "\x89");
+    EXPECT_EQ(frames[1].header.type, Http2FrameType::HEADERS);
+    EXPECT_EQ(frames[1].header.flags, Http2Frame::k_end_headers | Http2Frame::k_end_stream);
+
+    // a status out of the static table
+    requests.clear();
+    in = request_headers(5, "GET", "/c", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    EXPECT_EQ(conn.reply(5, 503, {}, nullptr, 0, nullptr), 0);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].payload, std::string("\x08\x03" "503"));
+
+    Http2Stats stats = service.stats();
+    EXPECT_EQ(stats.connections, 1u);
+    EXPECT_EQ(stats.streams, 3u);
+}
+
+TEST(Http2Connection, concurrent_streams)
+{
+    Http2Params params;
+    params.max_concurrent_streams = 3;
+    Http2Service service(params);
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+
+    std::string in = client_preface();
+    in += request_headers(1, "GET", "/a", true);
+    in += request_headers(3, "GET", "/b", true);
+    in += request_headers(5, "POST", "/c", false);
+    // over SETTINGS_MAX_CONCURRENT_STREAMS
+    in += request_headers(7, "GET", "/d", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    ASSERT_EQ(requests.size(), 2u);
+    EXPECT_EQ(requests[0].stream_id, 1u);
+    EXPECT_EQ(requests[1].stream_id, 3u);
+    EXPECT_EQ(conn.open_streams(), 3u);
+
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_FALSE(frames.empty());
+    EXPECT_EQ(frames.back().header.type, Http2FrameType::RST_STREAM);
+    EXPECT_EQ(frames.back().header.stream_id, 7u);
+    EXPECT_EQ(frames.back().payload, std::string("\0\0\0\x07", 4));
+    EXPECT_EQ(service.stats().refused_streams, 1u);
+
+    // the replies in any order, each on its stream
+    std::string body = "b";
+    struct iovec body_vec = { &body[0], body.size() };
+    EXPECT_EQ(conn.reply(3, 200, {}, &body_vec, 1, nullptr), 0);
+    requests.clear();
+    in = data_frame(5, "c", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_EQ(requests[0].stream_id, 5u);
+    EXPECT_EQ(conn.reply(5, 204, {}, nullptr, 0, nullptr), 0);
+    EXPECT_EQ(conn.reply(1, 404, {}, nullptr, 0, nullptr), 0);
+    // replied already
+    EXPECT_EQ(conn.reply(1, 200, {}, nullptr, 0, nullptr), -1);
+
+    // the headers as they are queued, the DATA when the reader writes
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 4u);
+    EXPECT_EQ(frames[0].header.stream_id, 3u);
+    EXPECT_EQ(frames[1].header.stream_id, 5u);
+    EXPECT_EQ(frames[1].payload, "\x89");
+    EXPECT_EQ(frames[2].header.stream_id, 1u);
+    EXPECT_EQ(frames[2].payload, "\x8d");
+    EXPECT_EQ(frames[3].header.stream_id, 3u);
+    EXPECT_EQ(frames[3].payload, "b");
+    EXPECT_EQ(conn.open_streams(), 0u);
+
+    // the stream ids only go up
+    in = request_headers(3, "GET", "/b", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), -1);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::GOAWAY);
+}
+
+TEST(Http2Connection, flow_control)
+{
+    Http2Service service{Http2Params()};
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+
+    // the client allows 100 bytes per stream
+    std::string in = client_preface({ { 0x4, 100 } });
+    in += request_headers(1, "GET", "/big", true);
+    in += request_headers(3, "GET", "/small", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    ASSERT_EQ(requests.size(), 2u);
+    transport.frames(&conn);
+
+    std::string body(250, 'x');
+    struct iovec body_vec = { &body[0], body.size() };
+    EXPECT_EQ(conn.reply(1, 200, {}, &body_vec, 1, nullptr), 0);
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[1].header.type, Http2FrameType::DATA);
+    EXPECT_EQ(frames[1].payload.size(), 100u);
+    EXPECT_EQ(frames[1].header.flags, 0);
+    body.assign(250, 'y');      // copied
+
+    // a stream held by its window does not hold the others
+    std::string small = "small";
+    body_vec = { &small[0], small.size() };
+    EXPECT_EQ(conn.reply(3, 200, {}, &body_vec, 1, nullptr), 0);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[1].header.stream_id, 3u);
+    EXPECT_EQ(frames[1].header.flags, Http2Frame::k_end_stream);
+
+    in.clear();
+    Http2Frame::append_window_update(&in, 1, 1000);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::DATA);
+    EXPECT_EQ(frames[0].header.flags, Http2Frame::k_end_stream);
+    EXPECT_EQ(frames[0].payload, std::string(150, 'x'));
+
+    // a stream never opened
+    in.clear();
+    Http2Frame::append_window_update(&in, 9, 1000);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), -1);
+}
+
+TEST(Http2Connection, large_window_update)
+{
+    Http2Service service{Http2Params()};
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+
+    // the default windows of 65535 bytes, then one update for the whole body
+    std::string in = client_preface();
+    in += request_headers(1, "GET", "/big", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    transport.frames(&conn);
+
+    std::string body(300 * 1024, 'x');
+    for (size_t i = 0; i < body.size(); i++)
+        body[i] = static_cast<char>('a' + i % 26);
+    struct iovec body_vec = { &body[0], body.size() };
+    EXPECT_EQ(conn.reply(1, 200, {}, &body_vec, 1, nullptr), 0);
+    std::string data;
+    for (const Frame &frame : transport.frames(&conn))
+    {
+        if (frame.header.type == Http2FrameType::DATA)
+            data += frame.payload;
+    }
+    EXPECT_EQ(data.size(), 65535u);
+
+    in.clear();
+    Http2Frame::append_window_update(&in, 0, 16 << 20);
+    Http2Frame::append_window_update(&in, 1, 16 << 20);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_FALSE(frames.empty());
+    for (const Frame &frame : frames)
+    {
+        EXPECT_EQ(frame.header.type, Http2FrameType::DATA);
+        EXPECT_LE(frame.payload.size(), 16384u);
+        data += frame.payload;
+    }
+    EXPECT_EQ(frames.back().header.flags, Http2Frame::k_end_stream);
+    EXPECT_EQ(data, body);
+}
+
+TEST(Http2Connection, backpressure)
+{
+    Http2Service service{Http2Params()};
+    Http2Connection conn(&service, 1 << 20);
+    // a client which reads slowly
+    FakeTransport transport(1000);
+    std::vector<Http2Request> requests;
+
+    std::string in = client_preface({ { 0x4, 16 << 20 } });
+    Http2Frame::append_window_update(&in, 0, 16 << 20);
+    in += request_headers(1, "GET", "/a", true);
+    in += request_headers(3, "GET", "/b", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    ASSERT_EQ(requests.size(), 2u);
+
+    std::string a(1 << 20, 'a');
+    std::string b(1 << 20, 'b');
+    struct iovec vec = { &a[0], a.size() };
+    EXPECT_EQ(conn.reply(1, 200, {}, &vec, 1, nullptr), 0);
+    vec = { &b[0], b.size() };
+    EXPECT_EQ(conn.reply(3, 200, {}, &vec, 1, nullptr), 0);
+
+    // what the socket did not take waits for the next read
+    EXPECT_EQ(conn.flush(&transport), 0);
+    EXPECT_EQ(transport.written.size(), 1000u);
+    EXPECT_EQ(conn.flush(&transport), 0);
+    EXPECT_EQ(transport.written.size(), 1000u);
+
+    in.clear();
+    Http2Frame::append(&in, 8, Http2FrameType::PING, 0, 0);
+    in.append(8, '\0');
+    transport.room = 1 << 30;
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+
+    // the two replies share the connection
+    std::vector<Frame> frames = transport.frames(&conn);
+    std::string data[2];
+    std::vector<uint32_t> order;
+    bool ping_ack = false;
+    for (const Frame &frame : frames)
+    {
+        if (frame.header.type == Http2FrameType::PING)
+            ping_ack = frame.header.flags == Http2Frame::k_ack;
+        if (frame.header.type != Http2FrameType::DATA)
+            continue;
+        data[frame.header.stream_id == 1 ? 0 : 1] += frame.payload;
+        order.push_back(frame.header.stream_id);
+    }
+    EXPECT_TRUE(ping_ack);
+    EXPECT_EQ(data[0], a);
+    EXPECT_EQ(data[1], b);
+    // the first reply filled the queue alone, then they alternate
+    size_t second = std::find(order.begin(), order.end(), 3u) - order.begin();
+    ASSERT_LT(second + 3, order.size());
+    EXPECT_LT(second, 20u);
+    EXPECT_EQ(order[second + 1], 1u);
+    EXPECT_EQ(order[second + 2], 3u);
+    EXPECT_EQ(order[second + 3], 1u);
+    EXPECT_EQ(conn.open_streams(), 0u);
+}
+
+TEST(Http2Connection, streamed_reply)
+{
+    Http2Service service{Http2Params()};
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+
+    std::string in = client_preface();
+    in += request_headers(1, "POST", "/stream", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    transport.frames(&conn);
+
+    EXPECT_EQ(conn.reply_headers(1, 200, { { "content-type", "application/grpc" } }), 0);
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::HEADERS);
+    EXPECT_EQ(frames[0].header.flags, Http2Frame::k_end_headers);
+
+    // each part goes out with the next write of the reader
+    std::string part = "one";
+    struct iovec vec = { &part[0], part.size() };
+    EXPECT_EQ(conn.reply_data(1, &vec, 1), 0);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].payload, "one");
+    EXPECT_EQ(frames[0].header.flags, 0);
+
+    part = "two";
+    EXPECT_EQ(conn.reply_data(1, &vec, 1), 0);
+    Http2Headers trailers = { { "grpc-status", "0" } };
+    EXPECT_EQ(conn.reply_end(1, &trailers), 0);
+    EXPECT_EQ(conn.reply_data(1, &vec, 1), -1);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0].payload, "two");
+    EXPECT_EQ(frames[1].header.type, Http2FrameType::HEADERS);
+    EXPECT_EQ(frames[1].header.flags, Http2Frame::k_end_headers | Http2Frame::k_end_stream);
+}
+
+TEST(Http2Connection, resets)
+{
+    Http2Service service{Http2Params()};
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+
+    std::string in = client_preface();
+    in += request_headers(1, "GET", "/a", true);
+    in += request_headers(3, "GET", "/b", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    transport.frames(&conn);
+
+    // the client gave up on its request while it was handled
+    in.clear();
+    Http2Frame::append_rst_stream(&in, 1, 0x8);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    EXPECT_EQ(conn.reply(1, 200, {}, nullptr, 0, nullptr), -1);
+    EXPECT_EQ(service.stats().resets, 1u);
+
+    // a request which is not replied
+    conn.reset(3);
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::RST_STREAM);
+    EXPECT_EQ(frames[0].header.stream_id, 3u);
+    EXPECT_EQ(frames[0].payload, std::string("\0\0\0\x08", 4));
+    EXPECT_EQ(conn.open_streams(), 0u);
+
+    // the connection is lost
+    in = request_headers(5, "GET", "/c", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    conn.detach();
+    EXPECT_EQ(conn.reply(5, 200, {}, nullptr, 0, nullptr), -1);
+}
+
+TEST(Http2Connection, malformed_requests)
+{
+    std::string message;
+    // upper case name, connection-specific header, no :path
+    EXPECT_FALSE(Http2Connection::to_message({ { ":method", "GET" }, { ":path", "/" }, { "Host", "a" } },
+                                             "", &message));
+    EXPECT_FALSE(Http2Connection::to_message({ { ":method", "GET" }, { ":path", "/" },
+                                               { "connection", "close" } }, "", &message));
+    EXPECT_FALSE(Http2Connection::to_message({ { ":method", "GET" } }, "", &message));
+    // what would split the request line or the headers
+    EXPECT_FALSE(Http2Connection::to_message({ { ":method", "GET" }, { ":path", "/a b" } },
+                                             "", &message));
+    EXPECT_FALSE(Http2Connection::to_message({ { ":method", "GET" }, { ":path", "/" },
+                                               { "x-a", "1\r\nx-b: 2" } }, "", &message));
+
+    Http2Service service{Http2Params()};
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+    std::string in = client_preface();
+    in += request_headers(1, "GET", "/a", true, { { "x-a", "1\r\nx-b: 2" } });
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    EXPECT_TRUE(requests.empty());
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_FALSE(frames.empty());
+    EXPECT_EQ(frames.back().header.type, Http2FrameType::RST_STREAM);
+    EXPECT_EQ(frames.back().payload, std::string("\0\0\0\x01", 4));
+
+    // a bad header block loses the connection
+    in.clear();
+    Http2Frame::append(&in, 1, Http2FrameType::HEADERS, Http2Frame::k_end_headers, 3);
+    in.push_back('\x80');
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), -1);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::GOAWAY);
+    EXPECT_EQ(service.stats().protocol_errors, 1u);
+}
+
+TEST(Http2Connection, max_streams)
+{
+    Http2Params params;
+    params.max_streams = 1;
+    Http2Service service(params);
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+
+    std::string in = client_preface();
+    in += request_headers(1, "GET", "/a", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    EXPECT_EQ(requests.size(), 1u);
+    EXPECT_TRUE(conn.going_away());
+
+    // the GOAWAY goes before the reply
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_FALSE(frames.empty());
+    EXPECT_EQ(frames.back().header.type, Http2FrameType::GOAWAY);
+    EXPECT_EQ(frames.back().payload, std::string("\0\0\0\x01\0\0\0\0", 8));
+
+    // the streams after it are refused
+    in = request_headers(3, "GET", "/b", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    EXPECT_EQ(requests.size(), 1u);
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::RST_STREAM);
+
+    EXPECT_FALSE(conn.finished());
+    EXPECT_EQ(conn.reply(1, 200, {}, nullptr, 0, nullptr), 0);
+    EXPECT_FALSE(conn.finished());
+    transport.frames(&conn);
+    EXPECT_TRUE(conn.finished());
+}
+
+TEST(Http2Connection, written_by_the_reader)
+{
+    Http2Service service{Http2Params()};
+    Http2Connection conn(&service, 1 << 20);
+    FakeTransport transport;
+    std::vector<Http2Request> requests;
+
+    std::string in = client_preface();
+    in += request_headers(1, "GET", "/a", true);
+    in += request_headers(3, "GET", "/b", true);
+    in += request_headers(5, "GET", "/c", true);
+    EXPECT_EQ(conn.feed(in.data(), in.size(), &requests), 0);
+    EXPECT_TRUE(transport.written.empty());
+    std::vector<Frame> frames = transport.frames(&conn);
+    ASSERT_FALSE(frames.empty());
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::SETTINGS);
+
+    // a handler only queues its reply, the reader writes it
+    EXPECT_EQ(conn.reply(1, 200, {}, nullptr, 0, nullptr), 0);
+    conn.go_away();
+    EXPECT_TRUE(transport.written.empty());
+    frames = transport.frames(&conn);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0].header.type, Http2FrameType::HEADERS);
+    EXPECT_EQ(frames[0].header.stream_id, 1u);
+    EXPECT_EQ(frames[1].header.type, Http2FrameType::GOAWAY);
+    EXPECT_FALSE(conn.finished());
+
+    // the connection is lost on a write
+    EXPECT_EQ(conn.reply(3, 200, {}, nullptr, 0, nullptr), 0);
+    transport.lost = true;
+    EXPECT_EQ(conn.flush(&transport), -1);
+    EXPECT_TRUE(conn.finished());
+    EXPECT_EQ(conn.reply(5, 200, {}, nullptr, 0, nullptr), -1);
+}
@@ -1,6 +1,8 @@
 #include <unordered_map>
 #include <gtest/gtest.h>
+#include <stdio.h>
 #include "wfrest/HttpDef.h"
+#include "wfrest/ErrorCode.h"
 
 using namespace wfrest;
 
@@ -25,3 +27,71 @@ TEST(ContentType, to_enum_by_suffix)
 {
     EXPECT_EQ(ContentType::to_enum_by_suffix("mp"), MULTIPART_FORM_DATA);
 }
+
+TEST(ContentType, to_enum_params)
+{
+    EXPECT_EQ(ContentType::to_enum("text/html; charset=utf-8"), TEXT_HTML);
+    EXPECT_EQ(ContentType::to_enum("Application/JSON;charset=utf-8"), APPLICATION_JSON);
+    EXPECT_EQ(ContentType::to_enum("multipart/form-data; boundary=abc"), MULTIPART_FORM_DATA);
+    EXPECT_EQ(ContentType::to_enum("application/grpc+proto"), APPLICATION_GRPC);
+    EXPECT_EQ(ContentType::to_enum(" text/plain "), TEXT_PLAIN);
+    EXPECT_EQ(ContentType::to_enum("application/jsonx"), CONTENT_TYPE_UNDEFINED);
+    EXPECT_EQ(ContentType::to_enum("video/mp4"), CONTENT_TYPE_UNDEFINED);
+    EXPECT_EQ(ContentType::to_enum(""), CONTENT_TYPE_NONE);
+}
+
+TEST(ContentType, view)
+{
+    EXPECT_EQ(ContentType::view(APPLICATION_JSON), "application/json");
+    EXPECT_TRUE(ContentType::view(CONTENT_TYPE_UNDEFINED).empty());
+    EXPECT_EQ(ContentType::to_str(CONTENT_TYPE_NONE), "<unknown>");
+
+    // every entry of the enum round trips
+#define XX(name, string, suffix) \
+    EXPECT_EQ(ContentType::to_enum(ContentType::view(name)), name); \
+    EXPECT_EQ(ContentType::to_enum_by_suffix(#suffix), name);
+    HTTP_CONTENT_TYPE_MAP(XX)
+#undef XX
+}
+
+TEST(ContentType, view_by_suffix)
+{
+    EXPECT_EQ(ContentType::view_by_suffix("html"), "text/html");
+    EXPECT_EQ(ContentType::view_by_suffix("HTM"), "text/html");
+    EXPECT_EQ(ContentType::view_by_suffix("woff2"), "font/woff2");
+    EXPECT_EQ(ContentType::view_by_suffix("wasm"), "application/wasm");
+    EXPECT_EQ(ContentType::view_by_suffix("svg"), "image/svg+xml");
+    EXPECT_EQ(ContentType::view_by_suffix("mp4"), "video/mp4");
+    EXPECT_EQ(ContentType::view_by_suffix("kv"), "application/x-www-form-urlencoded");
+    EXPECT_TRUE(ContentType::view_by_suffix("no-such-suffix").empty());
+    EXPECT_TRUE(ContentType::view_by_suffix("").empty());
+    EXPECT_EQ(ContentType::to_str_by_suffix("no-such-suffix"), "");
+}
+
+TEST(ContentType, load_mime_types)
+{
+    const char *path = "./test.mime.types";
+    FILE *fp = fopen(path, "w");
+    ASSERT_TRUE(fp != nullptr);
+    fputs("# custom\n"
+          "text/x-custom\t\tcust cst\n"
+          "application/x-empty\n"
+          "types {\n"
+          "    text/x-markdown  md;\n"
+          "    application/x-nginx  ngx;  # inline\n"
+          "}\n", fp);
+    fclose(fp);
+
+    EXPECT_EQ(ContentType::load_mime_types("./no/such/file"), StatusFileReadError);
+    EXPECT_EQ(ContentType::load_mime_types(path), StatusOK);
+    remove(path);
+
+    EXPECT_EQ(ContentType::view_by_suffix("cust"), "text/x-custom");
+    EXPECT_EQ(ContentType::view_by_suffix("CST"), "text/x-custom");
+    EXPECT_EQ(ContentType::view_by_suffix("ngx"), "application/x-nginx");
+    // over the built-in text/markdown
+    EXPECT_EQ(ContentType::view_by_suffix("md"), "text/x-markdown");
+    // the other built-in ones stay
+    EXPECT_EQ(ContentType::view_by_suffix("png"), "image/png");
+    EXPECT_EQ(ContentType::to_enum_by_suffix("txt"), TEXT_PLAIN);
+}
@@ -0,0 +1,107 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+std::string read_file(const std::string &path)
+{
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+TEST(HttpServer, access_log)
+{
+    std::string path = "/tmp/wfrest_access_log_test.log";
+    unlink(path.c_str());
+    {
+        HttpServer svr;
+        WFFacilities::WaitGroup wait_group(1);
+
+        AccessLogParams params;
+        params.path = path;
+        params.format = AccessLogFormat::COMBINED;
+        svr.access_log(params);
+        svr.GET("/user/{id}", [](const HttpReq *req, HttpResp *resp)
+        {
+            resp->String("user");
+        });
+
+        EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+        SeriesWork *series = Workflow::create_series_work(ClientUtil::create_http_task("user/1?a=b"), nullptr);
+        series->push_back(ClientUtil::create_http_task("not_found"));
+        series->set_callback([&wait_group](const SeriesWork *)
+        {
+            wait_group.done();
+        });
+
+        series->start();
+        wait_group.wait();
+        svr.stop();
+        EXPECT_EQ(svr.access_log_dropped(), 0);
+    }
+    // the records are all written once the server is destroyed
+    std::string res = read_file(path);
+    EXPECT_TRUE(res.find("127.0.0.1 - - [") == 0) << res;
+    EXPECT_TRUE(res.find("\"GET /user/1?a=b HTTP/1.1\" 200 4 \"-\" \"") != std::string::npos) << res;
+    EXPECT_TRUE(res.find("\"GET /not_found HTTP/1.1\" 404 ") != std::string::npos) << res;
+    unlink(path.c_str());
+}
+
+TEST(HttpServer, track_last_wins)
+{
+    std::string path = "/tmp/wfrest_track_test.log";
+    // stderr, the output of track(), goes to the file
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+
+    std::atomic<int> tracked(0);
+    {
+        HttpServer svr;
+        WFFacilities::WaitGroup wait_group(1);
+
+        svr.track();
+        svr.track([&tracked](HttpTask *)
+        {
+            ++tracked;
+        });
+        svr.GET("/test", [](const HttpReq *req, HttpResp *resp)
+        {
+            resp->String("test");
+        });
+
+        EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+        WFHttpTask *client_task = ClientUtil::create_http_task("test");
+        client_task->set_callback([&wait_group](WFHttpTask *)
+        {
+            wait_group.done();
+        });
+        client_task->start();
+        wait_group.wait();
+        svr.stop();
+    }
+
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+
+    EXPECT_EQ(tracked, 1);
+    std::string res = read_file(path);
+    EXPECT_TRUE(res.find("[WFREST]") == std::string::npos) << res;
+    unlink(path.c_str());
+}
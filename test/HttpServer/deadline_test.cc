@@ -0,0 +1,191 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/HttpUtil.h"
+#include <gtest/gtest.h>
+#include <time.h>
+#include <atomic>
+#include "wfrest/HttpServer.h"
+#include "wfrest/DeadlineAspect.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+struct Reply
+{
+    std::string status;
+    std::string body;
+    long long elapsed_ms;
+};
+
+long long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+Reply request(const std::string &path, const std::string &timeout_header = "")
+{
+    WFFacilities::WaitGroup wait_group(1);
+    Reply reply;
+    long long start = now_ms();
+    WFHttpTask *task = ClientUtil::create_http_task(path);
+    if (!timeout_header.empty())
+        task->get_req()->add_header_pair("X-Request-Timeout", timeout_header.c_str());
+    task->set_callback([&wait_group, &reply, start](WFHttpTask *task)
+    {
+        const void *body;
+        size_t len;
+        reply.status = task->get_resp()->get_status_code();
+        task->get_resp()->get_parsed_body(&body, &len);
+        reply.body.assign(static_cast<const char *>(body), len);
+        reply.elapsed_ms = now_ms() - start;
+        wait_group.done();
+    });
+    task->start();
+    wait_group.wait();
+    return reply;
+}
+
+TEST(HttpServer, request_timeout)
+{
+    HttpServer svr;
+    svr.request_timeout(100);
+
+    bool fired = false;
+    svr.GET("/sleep", [&fired](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(500 * 1000, [resp, &fired]()
+        {
+            fired = true;
+            resp->String("awake");
+        });
+    });
+    svr.GET("/fast", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("fast");
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // the sleep is cut at the deadline
+    Reply reply = request("sleep");
+    EXPECT_EQ(reply.status, "504");
+    EXPECT_EQ(reply.body, "Gateway Timeout\n");
+    EXPECT_LT(reply.elapsed_ms, 400);
+    EXPECT_TRUE(fired);
+
+    reply = request("fast");
+    EXPECT_EQ(reply.status, "200");
+    EXPECT_EQ(reply.body, "fast");
+
+    svr.stop();
+}
+
+TEST(HttpServer, route_deadline)
+{
+    HttpServer svr;
+
+    svr.GET("/sleep", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(200 * 1000, [resp]()
+        {
+            resp->String("awake");
+        });
+    }, DeadlineAop(50));
+    svr.GET("/patient", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(100 * 1000, [resp]()
+        {
+            resp->String("awake");
+        });
+    }, DeadlineAop(1000));
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    EXPECT_EQ(request("sleep").status, "504");
+    EXPECT_EQ(request("patient").body, "awake");
+
+    svr.stop();
+}
+
+TEST(HttpServer, timeout_header)
+{
+    HttpServer svr;
+    svr.request_timeout_header();
+
+    svr.GET("/sleep", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(200 * 1000, [resp]()
+        {
+            resp->String("awake");
+        });
+    }, DeadlineAop(1000));
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // shorter than the route budget
+    EXPECT_EQ(request("sleep", "50").status, "504");
+    // but never longer
+    EXPECT_EQ(request("sleep", "5000").body, "awake");
+    EXPECT_EQ(request("sleep").body, "awake");
+
+    svr.stop();
+}
+
+TEST(HttpServer, backend_deadline)
+{
+    HttpServer backend;
+    backend.GET("/slow", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(1000 * 1000, [resp]()
+        {
+            resp->String("slow");
+        });
+    });
+    EXPECT_TRUE(backend.start("127.0.0.1", 8889) == 0) << "http server start failed";
+
+    HttpServer svr;
+    svr.request_timeout(100);
+    svr.GET("/proxy", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Http("http://127.0.0.1:8889/slow");
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // the proxy task times out with the budget left, not the backend
+    Reply reply = request("proxy");
+    EXPECT_EQ(reply.status, "504");
+    EXPECT_LT(reply.elapsed_ms, 800);
+
+    svr.stop();
+    backend.stop();
+}
+
+TEST(HttpServer, deadline_timer)
+{
+    HttpServer svr;
+    svr.request_timeout(100);
+
+    std::atomic<bool> next_run(false);
+    svr.GET("/series", [&next_run](const HttpReq *req, HttpResp *resp)
+    {
+        // pushed as is, neither cut short nor checked after
+        **task_of(resp) << WFTaskFactory::create_timer_task(200 * 1000, nullptr);
+        **task_of(resp) << WFTaskFactory::create_timer_task(0, [resp, &next_run](WFTimerTask *)
+        {
+            next_run = true;
+            resp->String("late");
+        });
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // the tasks after the one running at the deadline are cancelled
+    Reply reply = request("series");
+    EXPECT_EQ(reply.status, "504");
+    EXPECT_FALSE(next_run);
+    EXPECT_LT(reply.elapsed_ms, 400);
+
+    svr.stop();
+}
@@ -0,0 +1,141 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include "wfrest/HttpServer.h"
+#include "wfrest/DebugBluePrint.h"
+#include "wfrest/json.hpp"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+std::string get_body(WFHttpTask *task)
+{
+    const void *body;
+    size_t body_len;
+    task->get_resp()->get_parsed_body(&body, &body_len);
+    return std::string(static_cast<const char *>(body), body_len);
+}
+
+TEST(HttpServer, debug_profile)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    DebugBluePrint admin_bp;
+    svr.register_blueprint(admin_bp, "/debug");
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *profile_task = ClientUtil::create_http_task("debug/profile?seconds=1&hz=999");
+    profile_task->set_callback([](WFHttpTask *task)
+    {
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "200");
+        EXPECT_FALSE(CpuProfiler::running());
+    });
+
+    // one profile at a time
+    WFHttpTask *conflict_task = ClientUtil::create_http_task("debug/profile?seconds=1");
+    conflict_task->set_callback([](WFHttpTask *task)
+    {
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "409");
+    });
+    WFTimerTask *timer = WFTaskFactory::create_timer_task(200 * 1000, nullptr);
+    SeriesWork *conflict_series = Workflow::create_series_work(timer, nullptr);
+    conflict_series->push_back(conflict_task);
+
+    WFHttpTask *alloc_task = ClientUtil::create_http_task("debug/alloc");
+    alloc_task->set_callback([](WFHttpTask *task)
+    {
+        std::string body = get_body(task);
+        if (AllocProfiler::enabled())
+            EXPECT_TRUE(body.find("route\tallocations\tbytes") == 0) << body;
+        else
+            EXPECT_TRUE(body.find("not compiled in") != std::string::npos) << body;
+    });
+
+    ParallelWork *pwork = Workflow::create_parallel_work([&wait_group](const ParallelWork *)
+    {
+        wait_group.done();
+    });
+    pwork->add_series(Workflow::create_series_work(profile_task, nullptr));
+    pwork->add_series(conflict_series);
+    pwork->add_series(Workflow::create_series_work(alloc_task, nullptr));
+    pwork->start();
+
+    wait_group.wait();
+    svr.stop();
+}
+
+TEST(HttpServer, debug_profile_low_hz)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    DebugBluePrint admin_bp;
+    svr.register_blueprint(admin_bp, "/debug");
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // a whole second between two samples
+    WFHttpTask *profile_task = ClientUtil::create_http_task("debug/profile?seconds=1&hz=1");
+    profile_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "200");
+        wait_group.done();
+    });
+    profile_task->start();
+
+    wait_group.wait();
+    svr.stop();
+}
+
+TEST(HttpServer, debug_threads)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    DebugBluePrint admin_bp;
+    svr.register_blueprint(admin_bp, "/debug");
+
+    svr.GET("/compute", 3, [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("compute");
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *compute_task = ClientUtil::create_http_task("compute");
+    WFHttpTask *threads_task = ClientUtil::create_http_task("debug/threads");
+    threads_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "200");
+        Json json = Json::parse(get_body(task), nullptr, false);
+        ASSERT_TRUE(json.is_object());
+        EXPECT_TRUE(json["enabled"].get<bool>());
+        EXPECT_GT(json["pools"]["handler"]["threads"].get<int>(), 0);
+        // the request of this reply is being handled
+        EXPECT_GE(json["pools"]["handler"]["active"].get<int>(), 1);
+        EXPECT_GE(json["pools"]["handler"]["completed"].get<int>(), 1);
+
+        bool found = false;
+        for (const auto &queue : json["compute_queues"])
+        {
+            if (queue["name"] == "wfrest3")
+            {
+                found = true;
+                EXPECT_EQ(queue["completed"].get<int>(), 1);
+                EXPECT_EQ(queue["active"].get<int>(), 0);
+                EXPECT_EQ(queue["wait_us"]["count"].get<int>(), 1);
+            }
+        }
+        EXPECT_TRUE(found) << json.dump();
+        wait_group.done();
+    });
+
+    SeriesWork *series = Workflow::create_series_work(compute_task, nullptr);
+    series->push_back(threads_task);
+    series->start();
+
+    wait_group.wait();
+    svr.stop();
+}
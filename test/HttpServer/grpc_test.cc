@@ -0,0 +1,211 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include "wfrest/HttpServer.h"
+#include "wfrest/Compress.h"
+#include "wfrest/ErrorCode.h"
+#include "../ClientUtil.h"
+#include "../H2Client.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+namespace
+{
+
+const Http2Headers k_grpc_headers = { { "content-type", "application/grpc" }, { "te", "trailers" } };
+
+std::string framed(const std::string &message, bool compressed = false)
+{
+    std::string out;
+    GrpcFrame::append_prefix(compressed, message.size(), &out);
+    return out + message;
+}
+
+Http2Headers with(Http2Headers headers, const std::string &name, const std::string &value)
+{
+    headers.emplace_back(name, value);
+    return headers;
+}
+
+}  // namespace
+
+TEST(HttpServer, grpc)
+{
+    HttpServer svr;
+    svr.http2();
+    // unary
+    svr.GRPC("/test.Echo/Say", [](const HttpReq *req, HttpResp *resp)
+    {
+        for (const StringPiece &message : req->grpc_messages())
+            resp->Grpc(message.as_string(), true);
+    });
+    // server-streaming
+    svr.GRPC("/test.Echo/Count", [](const HttpReq *req, HttpResp *resp)
+    {
+        for (int i = 0; i < 3; i++)
+            resp->Grpc(std::to_string(i));
+        resp->add_grpc_trailer("x-count", "3");
+    });
+    svr.GRPC("/test.Echo/Find", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->set_grpc_status(GrpcStatus::NOT_FOUND, "no such user");
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    H2Client client;
+    ASSERT_TRUE(client.handshake());
+
+    H2Reply reply;
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Say", k_grpc_headers, framed("hello"), &reply));
+    EXPECT_EQ(header_value(reply.headers, ":status"), "200");
+    EXPECT_EQ(header_value(reply.headers, "content-type"), "application/grpc");
+    EXPECT_EQ(header_value(reply.headers, "content-length"), "");
+    EXPECT_EQ(reply.body, framed("hello"));
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "0");
+
+    reply = H2Reply();
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Count", k_grpc_headers, framed(""), &reply));
+    EXPECT_EQ(reply.body, framed("0") + framed("1") + framed("2"));
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "0");
+    EXPECT_EQ(header_value(reply.trailers, "x-count"), "3");
+
+    reply = H2Reply();
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Find", k_grpc_headers, framed("bob"), &reply));
+    EXPECT_EQ(header_value(reply.headers, ":status"), "200");
+    EXPECT_TRUE(reply.body.empty());
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "5");
+    EXPECT_EQ(header_value(reply.trailers, "grpc-message"), "no such user");
+
+    // a gzip request, a gzip reply
+    std::string message(10000, 'a');
+    std::string gzipped;
+    ASSERT_EQ(Compressor::gzip(message.data(), message.size(), &gzipped), StatusOK);
+    Http2Headers headers = with(with(k_grpc_headers, "grpc-encoding", "gzip"),
+                                "grpc-accept-encoding", "identity,gzip");
+    reply = H2Reply();
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Say", headers, framed(gzipped, true), &reply));
+    EXPECT_EQ(header_value(reply.headers, "grpc-encoding"), "gzip");
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "0");
+    std::vector<GrpcFrame::Message> messages;
+    ASSERT_TRUE(GrpcFrame::parse(reply.body.data(), reply.body.size(), &messages));
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_TRUE(messages[0].compressed);
+    std::string inflated;
+    EXPECT_EQ(Compressor::ungzip(messages[0].data.data(), messages[0].data.size(), &inflated), StatusOK);
+    EXPECT_EQ(inflated, message);
+
+    reply = H2Reply();
+    headers = with(k_grpc_headers, "grpc-encoding", "snappy");
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Say", headers, framed("hello"), &reply));
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "12");
+    EXPECT_EQ(header_value(reply.trailers, "grpc-accept-encoding"), "identity,gzip");
+
+    // a message cut short
+    reply = H2Reply();
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Say", k_grpc_headers, framed("hello").substr(0, 7), &reply));
+    EXPECT_TRUE(reply.body.empty());
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "13");
+
+    reply = H2Reply();
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Say", { { "content-type", "application/json" } },
+                               "{}", &reply));
+    EXPECT_EQ(header_value(reply.headers, ":status"), "415");
+
+    // HTTP/1.1 is no gRPC transport
+    WFFacilities::WaitGroup wait_group(1);
+    WFHttpTask *task = ClientUtil::create_http_task("test.Echo/Say");
+    task->get_req()->set_method("POST");
+    task->get_req()->add_header_pair("Content-Type", "application/grpc");
+    task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "505");
+        wait_group.done();
+    });
+    task->start();
+    wait_group.wait();
+
+    svr.stop();
+}
+
+TEST(HttpServer, grpc_timeout)
+{
+    HttpServer svr;
+    svr.http2();
+    svr.GRPC("/test.Echo/Slow", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(500000, [resp]()
+        {
+            resp->Grpc("late");
+        });
+    });
+    svr.GRPC("/test.Echo/Partial", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Grpc("early");
+        resp->Timer(500000, [resp]()
+        {
+            resp->Grpc("late");
+        });
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    H2Client client;
+    ASSERT_TRUE(client.handshake());
+
+    H2Reply reply;
+    Http2Headers headers = with(k_grpc_headers, "grpc-timeout", "100m");
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Slow", headers, framed(""), &reply));
+    EXPECT_EQ(header_value(reply.headers, ":status"), "200");
+    EXPECT_TRUE(reply.body.empty());
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "4");
+
+    // the messages sent before the deadline stay, the stream ends with the status
+    reply = H2Reply();
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Partial", headers, framed(""), &reply));
+    EXPECT_EQ(header_value(reply.headers, ":status"), "200");
+    EXPECT_EQ(reply.body, framed("early"));
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "4");
+
+    // within the deadline
+    reply = H2Reply();
+    headers = with(k_grpc_headers, "grpc-timeout", "5S");
+    ASSERT_TRUE(client.request("POST", "/test.Echo/Slow", headers, framed(""), &reply));
+    EXPECT_EQ(reply.body, framed("late"));
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "0");
+
+    svr.stop();
+}
+
+TEST(HttpServer, grpc_streaming)
+{
+    HttpServer svr;
+    svr.http2();
+    svr.GRPC("/test.Echo/Large", [](const HttpReq *req, HttpResp *resp)
+    {
+        for (int i = 0; i < 16; i++)
+            resp->Grpc(std::string(100000, 'a' + i));
+        resp->Timer(300 * 1000, [resp]()
+        {
+            resp->Grpc("end");
+        });
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    H2Client client;
+    ASSERT_TRUE(client.handshake());
+
+    // the messages written so far come before the end of the call
+    uint32_t id = client.send_request("POST", "/test.Echo/Large", k_grpc_headers, framed(""));
+    ASSERT_NE(id, 0u);
+    ASSERT_TRUE(client.read_body(id, 16 * (100000 + GrpcFrame::k_prefix_size)));
+
+    H2Reply reply;
+    ASSERT_TRUE(client.read_reply(id, &reply));
+    EXPECT_EQ(header_value(reply.headers, ":status"), "200");
+    EXPECT_EQ(header_value(reply.trailers, "grpc-status"), "0");
+    std::string expected;
+    for (int i = 0; i < 16; i++)
+        expected += framed(std::string(100000, 'a' + i));
+    EXPECT_EQ(reply.body, expected + framed("end"));
+
+    svr.stop();
+}
@@ -0,0 +1,167 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+#include "../H2Client.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+TEST(HttpServer, http2)
+{
+    HttpServer svr;
+    svr.http2();
+    svr.GET("/hello", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->headers["X-Host"] = req->header("Host");
+        resp->String("hello");
+    });
+    svr.POST("/echo", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String(req->body());
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    H2Client client;
+    ASSERT_TRUE(client.handshake());
+
+    Http2Headers headers;
+    std::string body;
+    ASSERT_TRUE(client.request("GET", "/hello", "", &headers, &body));
+    EXPECT_EQ(header_value(headers, ":status"), "200");
+    EXPECT_EQ(header_value(headers, "x-host"), "127.0.0.1:8888");
+    EXPECT_EQ(header_value(headers, "connection"), "");
+    EXPECT_EQ(body, "hello");
+
+    // the next stream on the same connection
+    headers.clear();
+    body.clear();
+    std::string large(100000, 'x');
+    ASSERT_TRUE(client.request("POST", "/echo", large, &headers, &body));
+    EXPECT_EQ(header_value(headers, ":status"), "200");
+    EXPECT_EQ(body, large);
+
+    headers.clear();
+    body.clear();
+    ASSERT_TRUE(client.request("GET", "/missing", "", &headers, &body));
+    EXPECT_EQ(header_value(headers, ":status"), "404");
+
+    // the clients without the preface still speak HTTP/1.1
+    WFFacilities::WaitGroup wait_group(1);
+    WFHttpTask *task = ClientUtil::create_http_task("hello");
+    task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        const void *body;
+        size_t len;
+        task->get_resp()->get_parsed_body(&body, &len);
+        EXPECT_EQ(std::string(static_cast<const char *>(body), len), "hello");
+        EXPECT_STREQ(task->get_resp()->get_http_version(), "HTTP/1.1");
+        wait_group.done();
+    });
+    task->start();
+    wait_group.wait();
+
+    Http2Stats stats = svr.http2_stats();
+    EXPECT_EQ(stats.connections, 1);
+    EXPECT_EQ(stats.streams, 3);
+    EXPECT_EQ(stats.protocol_errors, 0);
+
+    svr.stop();
+}
+
+TEST(HttpServer, http2_max_streams)
+{
+    HttpServer svr;
+    Http2Params params;
+    params.max_streams = 2;
+    svr.http2(params);
+    svr.GET("/hello", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("hello");
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    H2Client client;
+    ASSERT_TRUE(client.handshake());
+    Http2Headers headers;
+    std::string body;
+    ASSERT_TRUE(client.request("GET", "/hello", "", &headers, &body));
+    EXPECT_FALSE(client.goaway());
+    // the GOAWAY goes out once the last stream is in, the next one is refused
+    ASSERT_TRUE(client.request("GET", "/hello", "", &headers, &body));
+    EXPECT_FALSE(client.request("GET", "/hello", "", &headers, &body));
+    EXPECT_TRUE(client.goaway());
+
+    svr.stop();
+}
+
+TEST(HttpServer, http2_concurrent_streams)
+{
+    HttpServer svr;
+    svr.http2();
+    svr.GET("/slow", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(200 * 1000, [resp]()
+        {
+            resp->String("done");
+        });
+    });
+    svr.GET("/large", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String(std::string(200000, 'x'));
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // the first request goes before the settings of the server are acked
+    H2Client client;
+    ASSERT_TRUE(client.handshake(1 << 24, false));
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t ids[4];
+    for (uint32_t &id : ids)
+    {
+        id = client.send_request("GET", "/slow", {}, "");
+        ASSERT_NE(id, 0u);
+    }
+    for (uint32_t id : ids)
+    {
+        H2Reply reply;
+        ASSERT_TRUE(client.read_reply(id, &reply));
+        EXPECT_EQ(header_value(reply.headers, ":status"), "200");
+        EXPECT_EQ(reply.body, "done");
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 600);
+
+    // a reply larger than the default windows waits for the WINDOW_UPDATE
+    H2Client small;
+    ASSERT_TRUE(small.handshake(65535));
+    uint32_t id = small.send_request("GET", "/large", {}, "");
+    ASSERT_NE(id, 0u);
+    ASSERT_TRUE(small.read_body(id, 65535));
+    ASSERT_TRUE(small.window_update(0, 1 << 24));
+    ASSERT_TRUE(small.window_update(id, 1 << 24));
+    H2Reply reply;
+    ASSERT_TRUE(small.read_reply(id, &reply));
+    EXPECT_EQ(reply.body, std::string(200000, 'x'));
+
+    svr.stop();
+}
+
+TEST(HttpServer, http2_off)
+{
+    HttpServer svr;
+    svr.GET("/hello", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("hello");
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // the preface is a bad HTTP/1.1 request
+    H2Client client;
+    EXPECT_FALSE(client.handshake());
+    EXPECT_EQ(svr.http2_stats().connections, 0);
+
+    svr.stop();
+}
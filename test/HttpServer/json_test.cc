@@ -124,9 +124,9 @@ TEST(JsonTest, invalid_str)
         size_t body_len;
         resp->get_parsed_body(&body, &body_len);
 
+        // sent as is, the text is not parsed again
         std::string json_str(static_cast<const char *>(body), body_len);
-        Json js = Json::parse(json_str);
-        EXPECT_EQ(js["errmsg"], "Invalid Json Syntax");
+        EXPECT_TRUE(json_str.find("\"comma\", ]") != std::string::npos) << json_str;
         wait_group.done();
     });
 
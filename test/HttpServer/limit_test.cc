@@ -0,0 +1,149 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/HttpUtil.h"
+#include <gtest/gtest.h>
+#include "wfrest/HttpServer.h"
+#include "wfrest/LimitAspect.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+std::string get_header(WFHttpTask *task, const std::string &name)
+{
+    HttpHeaderCursor cursor(task->get_resp());
+    std::string value;
+    cursor.find(name, value);
+    return value;
+}
+
+TEST(HttpServer, rate_limit)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    RateLimitParams params;
+    params.rate = 1;
+    params.burst = 2;
+    params.key = LimitKey::ROUTE;
+    RateLimitAop rate_limit(params);
+
+    bool handled[3] = { false, false, false };
+    svr.GET("/limited", [&handled](const HttpReq *req, HttpResp *resp)
+    {
+        handled[atoi(req->query("i").c_str())] = true;
+        resp->String("limited");
+    }, rate_limit);
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    std::vector<std::string> status;
+    std::string retry_after;
+    SeriesWork *series = Workflow::create_series_work(WFTaskFactory::create_empty_task(), nullptr);
+    for (int i = 0; i < 3; i++)
+    {
+        WFHttpTask *task = ClientUtil::create_http_task("limited?i=" + std::to_string(i));
+        task->set_callback([&status, &retry_after](WFHttpTask *task)
+        {
+            status.push_back(task->get_resp()->get_status_code());
+            retry_after = get_header(task, "Retry-After");
+        });
+        series->push_back(task);
+    }
+    series->set_callback([&wait_group](const SeriesWork *)
+    {
+        wait_group.done();
+    });
+    series->start();
+    wait_group.wait();
+
+    // the burst, then no token left
+    ASSERT_EQ(status.size(), 3);
+    EXPECT_EQ(status[0], "200");
+    EXPECT_EQ(status[1], "200");
+    EXPECT_EQ(status[2], "429");
+    EXPECT_EQ(retry_after, "1");
+    EXPECT_TRUE(handled[0] && handled[1]);
+    EXPECT_FALSE(handled[2]);
+    // a copy of the aspect shares its buckets
+    EXPECT_EQ(rate_limit.size(), 1);
+
+    svr.stop();
+}
+
+TEST(HttpServer, concurrency_limit)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    ConcurrencyLimitParams params;
+    params.max_concurrency = 1;
+    ConcurrencyLimitAop concurrency_limit(params);
+
+    svr.GET("/slow", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(200 * 1000, [resp]()
+        {
+            resp->String("slow");
+        });
+    }, concurrency_limit);
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    std::vector<std::string> status;
+    ParallelWork *pwork = Workflow::create_parallel_work([&wait_group](const ParallelWork *)
+    {
+        wait_group.done();
+    });
+    for (int i = 0; i < 2; i++)
+    {
+        WFHttpTask *task = ClientUtil::create_http_task("slow");
+        task->set_callback([&status](WFHttpTask *task)
+        {
+            status.push_back(task->get_resp()->get_status_code());
+        });
+        // the second request starts while the first one waits on its timer
+        SeriesWork *series = Workflow::create_series_work(
+                WFTaskFactory::create_timer_task(i * 50 * 1000, nullptr), nullptr);
+        series->push_back(task);
+        pwork->add_series(series);
+    }
+    pwork->start();
+    wait_group.wait();
+
+    ASSERT_EQ(status.size(), 2);
+    EXPECT_EQ(status[0], "429");
+    EXPECT_EQ(status[1], "200");
+    EXPECT_EQ(concurrency_limit.inflight("/slow"), 0);
+
+    svr.stop();
+}
+
+TEST(HttpServer, global_limit)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    // global aspects stop the request too
+    AdaptiveConcurrencyParams params;
+    params.initial_limit = 0;
+    params.min_limit = 0;
+    svr.Use(AdaptiveConcurrencyAop(params));
+
+    svr.GET("/global", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("global");
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *task = ClientUtil::create_http_task("global");
+    task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "429");
+        wait_group.done();
+    });
+    task->start();
+    wait_group.wait();
+
+    svr.stop();
+}
@@ -0,0 +1,112 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string.h>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+static const char *k_unix_path = "./wfrest_listen_test.sock";
+
+// blocking request over the unix socket, returns the raw response
+static std::string unix_request(const std::string &request)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, k_unix_path, sizeof addr.sun_path - 1);
+    std::string res;
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0 &&
+        write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()))
+    {
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof buf)) > 0)
+            res.append(buf, n);
+    }
+    close(fd);
+    return res;
+}
+
+TEST(HttpServer, listen_unix)
+{
+    HttpServer svr;
+    svr.GET("/hello", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("hello");
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+    EXPECT_TRUE(svr.listen_unix(k_unix_path) == 0) << "unix listener failed";
+
+    std::string res = unix_request("GET /hello HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+    EXPECT_TRUE(res.find("HTTP/1.1 200") == 0) << res;
+    EXPECT_TRUE(res.find("\r\n\r\nhello") != std::string::npos) << res;
+
+    std::vector<ListenerStats> stats = svr.listener_stats();
+    ASSERT_EQ(stats.size(), 2);
+    EXPECT_EQ(stats[0].name, "main");
+    EXPECT_EQ(stats[0].requests, 0);
+    EXPECT_EQ(stats[1].name, std::string("unix:") + k_unix_path);
+    EXPECT_EQ(stats[1].requests, 1);
+
+    svr.stop();
+    EXPECT_TRUE(access(k_unix_path, F_OK) < 0);
+}
+
+TEST(HttpServer, listen_params)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(2);
+    svr.POST("/echo", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String(req->body());
+    });
+
+    // only the extra endpoint, with a small size limit
+    ListenerParams params;
+    params.name = "small";
+    params.server_params.request_size_limit = 256;
+    EXPECT_TRUE(svr.listen("127.0.0.1", 8888, params) == 0) << "listener failed";
+    EXPECT_TRUE(svr.listen_unix(k_unix_path) == 0) << "unix listener failed";
+
+    WFHttpTask *small_task = ClientUtil::create_http_task("echo");
+    small_task->get_req()->set_method("POST");
+    small_task->get_req()->append_output_body("small");
+    small_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "200");
+        wait_group.done();
+    });
+    small_task->start();
+
+    WFHttpTask *large_task = ClientUtil::create_http_task("echo");
+    large_task->get_req()->set_method("POST");
+    std::string large(4096, 'x');
+    large_task->get_req()->append_output_body(large.data(), large.size());
+    large_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        const char *status = task->get_resp()->get_status_code();
+        // replied 413 or the connection is closed
+        EXPECT_TRUE(task->get_state() != WFT_STATE_SUCCESS || strcmp(status, "413") == 0);
+        wait_group.done();
+    });
+    large_task->start();
+    wait_group.wait();
+
+    // the same routes over the unix socket, with the default limit
+    std::string res = unix_request("POST /echo HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n"
+                                   "Content-Length: 4096\r\n\r\n" + large);
+    EXPECT_TRUE(res.find("HTTP/1.1 200") == 0) << res.substr(0, 64);
+
+    std::vector<ListenerStats> stats = svr.listener_stats();
+    ASSERT_EQ(stats.size(), 3);
+    EXPECT_EQ(stats[1].name, "small");
+
+    svr.stop();
+}
@@ -0,0 +1,57 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+std::string get_body(WFHttpTask *task)
+{
+    const void *body;
+    size_t body_len;
+    task->get_resp()->get_parsed_body(&body, &body_len);
+    return std::string(static_cast<const char *>(body), body_len);
+}
+
+TEST(HttpServer, metrics)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    svr.metrics("/metrics");
+    svr.GET("/user/{id}", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("user");
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    SeriesWork *series = Workflow::create_series_work(ClientUtil::create_http_task("user/1"), nullptr);
+    series->push_back(ClientUtil::create_http_task("user/2"));
+    series->push_back(ClientUtil::create_http_task("not_found"));
+
+    WFHttpTask *scrape_task = ClientUtil::create_http_task("metrics");
+    scrape_task->set_callback([](WFHttpTask *task)
+    {
+        std::string res = get_body(task);
+        EXPECT_TRUE(res.find("wfrest_http_requests_total{route=\"/user/{id}\",verb=\"GET\",code=\"200\"} 2")
+                    != std::string::npos) << res;
+        EXPECT_TRUE(res.find("wfrest_http_requests_total{route=\"unmatched\",verb=\"GET\",code=\"404\"} 1")
+                    != std::string::npos) << res;
+        EXPECT_TRUE(res.find("wfrest_http_response_body_bytes_total{route=\"/user/{id}\",verb=\"GET\"} 8")
+                    != std::string::npos) << res;
+        EXPECT_TRUE(res.find("wfrest_http_request_duration_seconds_count{route=\"/user/{id}\",verb=\"GET\"} 2")
+                    != std::string::npos) << res;
+        EXPECT_TRUE(res.find("le=\"+Inf\"") != std::string::npos);
+    });
+    series->push_back(scrape_task);
+    series->set_callback([&wait_group](const SeriesWork *)
+    {
+        wait_group.done();
+    });
+
+    series->start();
+    wait_group.wait();
+    svr.stop();
+}
@@ -0,0 +1,245 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include "wfrest/HttpServer.h"
+#include "wfrest/FileUtil.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+static const char *kBoundary = "----WebKitFormBoundary7MA4YWxkTrZu0gW";
+
+std::string read_file(const std::string &path)
+{
+    std::ifstream file(path);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+WFHttpTask *create_upload_task(const std::string &file_body)
+{
+    WFHttpTask *task = ClientUtil::create_http_task("upload");
+    HttpRequest *req = task->get_req();
+    req->set_method("POST");
+    req->add_header_pair("Content-Type",
+                         (std::string("multipart/form-data; boundary=") + kBoundary).c_str());
+
+    std::string body;
+    body.append("--").append(kBoundary).append("\r\n");
+    body.append("Content-Disposition: form-data; name=\"user\"\r\n\r\n");
+    body.append("wfrest\r\n");
+    body.append("--").append(kBoundary).append("\r\n");
+    body.append("Content-Disposition: form-data; name=\"file\"; filename=\"test.txt\"\r\n");
+    body.append("Content-Type: text/plain\r\n\r\n");
+    body.append(file_body).append("\r\n");
+    body.append("--").append(kBoundary).append("--\r\n");
+    req->append_output_body(body.data(), body.size());
+    return task;
+}
+
+TEST(HttpServer, multipart_stream)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    MultiPartStreamParams params;
+    params.temp_dir = ".";
+    params.write_buffer_size = 16;      // several pwrite for one part
+    svr.stream_multipart(params);
+
+    std::string temp_path;
+    svr.POST("/upload", [&temp_path](const HttpReq *req, HttpResp *resp)
+    {
+        EXPECT_TRUE(req->body().empty());
+        EXPECT_EQ(req->form()["user"].second, "wfrest");
+
+        const MultiPartFiles &files = req->files();
+        EXPECT_EQ(files.size(), 1);
+        const MultiPartFile &file = files[0];
+        EXPECT_EQ(file.name, "file");
+        EXPECT_EQ(file.filename, "test.txt");
+        EXPECT_EQ(file.error, 0);
+        EXPECT_FALSE(file.truncated);
+        temp_path = file.path;
+        resp->String(read_file(file.path));
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    std::string file_body;
+    for (int i = 0; i < 100; i++)
+        file_body.append(std::to_string(i));
+
+    WFHttpTask *client_task = create_upload_task(file_body);
+    client_task->set_callback([&wait_group, &file_body](WFHttpTask *task)
+    {
+        const void *body;
+        size_t body_len;
+        task->get_resp()->get_parsed_body(&body, &body_len);
+        EXPECT_EQ(std::string(static_cast<const char *>(body), body_len), file_body);
+        wait_group.done();
+    });
+
+    client_task->start();
+    wait_group.wait();
+    svr.stop();
+    // removed with the request
+    EXPECT_FALSE(FileUtil::file_exists(temp_path));
+}
+
+TEST(HttpServer, multipart_stream_limit)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    MultiPartStreamParams params;
+    params.part_size_limit = 10;
+    std::string received;
+    params.part_func = [&received](const MultiPartFile &part, const char *data, size_t len)
+    {
+        received.append(data, len);
+    };
+    svr.stream_multipart(params);
+
+    svr.POST("/upload", [](const HttpReq *req, HttpResp *resp)
+    {
+        const MultiPartFiles &files = req->files();
+        EXPECT_EQ(files.size(), 1);
+        EXPECT_TRUE(files[0].path.empty());
+        EXPECT_TRUE(files[0].truncated);
+        EXPECT_EQ(files[0].size, 10);
+        resp->set_status(HttpStatusRequestEntityTooLarge);
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *client_task = create_upload_task("0123456789abcdef");
+    client_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "413");
+        wait_group.done();
+    });
+
+    client_task->start();
+    wait_group.wait();
+    svr.stop();
+    EXPECT_EQ(received, "0123456789");
+}
+
+TEST(HttpServer, multipart_stream_refused)
+{
+    MultiPartStreamParams params;
+    params.temp_dir = ".";
+    params.max_parts = 1;
+    std::atomic<int> handled(0);
+
+    auto refused = [](WFHttpTask *task)
+    {
+        WFFacilities::WaitGroup wait_group(1);
+        task->set_callback([&wait_group](WFHttpTask *task)
+        {
+            // the connection is closed without a reply
+            EXPECT_NE(task->get_state(), WFT_STATE_SUCCESS);
+            wait_group.done();
+        });
+        task->start();
+        wait_group.wait();
+    };
+
+    {
+        HttpServer svr;
+        svr.stream_multipart(params);
+        svr.POST("/upload", [&handled](const HttpReq *req, HttpResp *resp)
+        {
+            handled++;
+        });
+        EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+        // over max_parts
+        refused(create_upload_task("0123456789"));
+
+        // not a multipart body
+        WFHttpTask *task = ClientUtil::create_http_task("upload");
+        task->get_req()->set_method("POST");
+        task->get_req()->add_header_pair("Content-Type",
+                                         (std::string("multipart/form-data; boundary=") + kBoundary).c_str());
+        task->get_req()->append_output_body("garbage", 7);
+        refused(task);
+        svr.stop();
+    }
+
+    {
+        HttpServer svr;
+        params.max_parts = 256;
+        svr.stream_multipart(params);
+        svr.request_size_limit(600);     // the header fits
+        svr.POST("/upload", [&handled](const HttpReq *req, HttpResp *resp)
+        {
+            handled++;
+        });
+        EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+        refused(create_upload_task(std::string(1000, 'x')));
+        svr.stop();
+    }
+
+    {
+        HttpServer svr;
+        params.field_size_limit = 3;    // the "user" field is 6 bytes
+        svr.stream_multipart(params);
+        svr.POST("/upload", [&handled](const HttpReq *req, HttpResp *resp)
+        {
+            handled++;
+        });
+        EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+        refused(create_upload_task("0123456789"));
+        svr.stop();
+    }
+    EXPECT_EQ(handled, 0);
+}
+
+TEST(HttpServer, multipart_stream_backpressure)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    // far more buffers than may wait, the body is slowed down, not refused
+    MultiPartStreamParams params;
+    params.temp_dir = ".";
+    params.write_buffer_size = 4096;
+    params.max_pending_writes = 1;
+    svr.stream_multipart(params);
+
+    std::string file_body;
+    for (int i = 0; file_body.size() < 4 * 1024 * 1024; i++)
+        file_body.append(std::to_string(i));
+
+    svr.POST("/upload", [&file_body](const HttpReq *req, HttpResp *resp)
+    {
+        const MultiPartFiles &files = req->files();
+        EXPECT_EQ(files.size(), 1);
+        EXPECT_EQ(files[0].error, 0);
+        EXPECT_EQ(files[0].size, file_body.size());
+        EXPECT_TRUE(read_file(files[0].path) == file_body);
+        resp->String("OK");
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *client_task = create_upload_task(file_body);
+    client_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        EXPECT_EQ(task->get_state(), WFT_STATE_SUCCESS);
+        EXPECT_STREQ(task->get_resp()->get_status_code(), "200");
+        wait_group.done();
+    });
+
+    client_task->start();
+    wait_group.wait();
+    svr.stop();
+}
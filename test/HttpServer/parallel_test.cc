@@ -0,0 +1,277 @@
+#include "workflow/WFFacilities.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "wfrest/HttpServer.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+WFHttpTask *create_http_task(const std::string &path)
+{
+    return WFTaskFactory::create_http_task("http://127.0.0.1:8888/" + path, 4, 2, nullptr);
+}
+
+void backend_routes(HttpServer &backend)
+{
+    backend.GET("/fast", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("fast");
+    });
+
+    backend.GET("/slow", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Timer(1, 0, [resp] { resp->String("slow"); });
+    });
+}
+
+TEST(HttpServer, parallel_deadline)
+{
+    HttpServer backend;
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    backend_routes(backend);
+
+    svr.GET("/test", [](const HttpReq *req, HttpResp *resp)
+    {
+        std::vector<ParallelCall> calls;
+        calls.emplace_back("127.0.0.1:8887/fast");
+        calls.emplace_back("127.0.0.1:8887/slow", 100);
+        resp->Parallel(calls, [](std::vector<ParallelResult> &results, HttpResp *resp)
+        {
+            for (auto &result : results)
+            {
+                if (result.timeout)
+                {
+                    resp->append_output_body("timeout|");
+                    continue;
+                }
+                const void *body;
+                size_t len;
+                result.resp.get_parsed_body(&body, &len);
+                resp->append_output_body_nocopy(body, len);
+                resp->append_output_body("|");
+            }
+        });
+    });
+
+    EXPECT_TRUE(backend.start("127.0.0.1", 8887) == 0) << "http server start failed";
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *client_task = create_http_task("test");
+    client_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        const void *body;
+        size_t body_len;
+        task->get_resp()->get_parsed_body(&body, &body_len);
+        std::string res(static_cast<const char *>(body), body_len);
+        EXPECT_EQ(res, "fast|timeout|");
+        wait_group.done();
+    });
+
+    client_task->start();
+    wait_group.wait();
+    svr.stop();
+    backend.stop();
+}
+
+TEST(HttpServer, parallel_hedge)
+{
+    HttpServer backend;
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    backend_routes(backend);
+
+    svr.GET("/test", [](const HttpReq *req, HttpResp *resp)
+    {
+        ParallelCall call("127.0.0.1:8887/slow");
+        call.hedge_url = "127.0.0.1:8887/fast";
+        call.hedge_delay = 50;
+        resp->Parallel({call}, [](std::vector<ParallelResult> &results, HttpResp *resp)
+        {
+            EXPECT_EQ(results.size(), 1);
+            EXPECT_TRUE(results[0].hedged);
+            const void *body;
+            size_t len;
+            results[0].resp.get_parsed_body(&body, &len);
+            resp->append_output_body_nocopy(body, len);
+        });
+    });
+
+    EXPECT_TRUE(backend.start("127.0.0.1", 8887) == 0) << "http server start failed";
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *client_task = create_http_task("test");
+    client_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        const void *body;
+        size_t body_len;
+        task->get_resp()->get_parsed_body(&body, &body_len);
+        std::string res(static_cast<const char *>(body), body_len);
+        EXPECT_EQ(res, "fast");
+        wait_group.done();
+    });
+
+    client_task->start();
+    wait_group.wait();
+    svr.stop();
+    backend.stop();
+}
+
+TEST(HttpServer, parallel_no_late_hedge)
+{
+    HttpServer backend;
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+    std::atomic<int> hedges(0);
+
+    backend_routes(backend);
+    backend.GET("/hedge", [&hedges](const HttpReq *req, HttpResp *resp)
+    {
+        ++hedges;
+        resp->String("hedge");
+    });
+
+    svr.GET("/test", [](const HttpReq *req, HttpResp *resp)
+    {
+        ParallelCall call("127.0.0.1:8887/fast");
+        call.hedge_url = "127.0.0.1:8887/hedge";
+        call.hedge_delay = 100;
+        resp->Parallel({call}, [](std::vector<ParallelResult> &results, HttpResp *resp)
+        {
+            EXPECT_FALSE(results[0].hedged);
+            const void *body;
+            size_t len;
+            results[0].resp.get_parsed_body(&body, &len);
+            resp->append_output_body_nocopy(body, len);
+        });
+    });
+
+    EXPECT_TRUE(backend.start("127.0.0.1", 8887) == 0) << "http server start failed";
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *client_task = create_http_task("test");
+    client_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        const void *body;
+        size_t body_len;
+        task->get_resp()->get_parsed_body(&body, &body_len);
+        std::string res(static_cast<const char *>(body), body_len);
+        EXPECT_EQ(res, "fast");
+        wait_group.done();
+    });
+
+    client_task->start();
+    wait_group.wait();
+    // well past the hedge delay, the cancelled hedge timer sent nothing
+    usleep(300 * 1000);
+    EXPECT_EQ(hedges, 0);
+    svr.stop();
+    backend.stop();
+}
+
+TEST(HttpServer, parallel_hedge_p95)
+{
+    HttpServer backend;
+    HttpServer svr;
+
+    backend_routes(backend);
+
+    // no hedge_delay : the p95 of the target once it has enough answers
+    svr.GET("/test", [](const HttpReq *req, HttpResp *resp)
+    {
+        std::string path = req->query("path");
+        std::vector<ParallelCall> calls(req->query("n") == "" ? 1 : atoi(req->query("n").c_str()),
+                                        ParallelCall("127.0.0.1:8887/" + path));
+        for (auto &call : calls)
+            call.hedge_url = "127.0.0.1:8887/fast";
+        resp->Parallel(calls, [](std::vector<ParallelResult> &results, HttpResp *resp)
+        {
+            for (auto &result : results)
+                resp->append_output_body(result.hedged ? "h" : "-");
+        });
+    });
+
+    EXPECT_TRUE(backend.start("127.0.0.1", 8887) == 0) << "http server start failed";
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    auto request = [](const std::string &query)
+    {
+        WFFacilities::WaitGroup wait_group(1);
+        std::string res;
+        WFHttpTask *client_task = create_http_task("test?" + query);
+        client_task->set_callback([&wait_group, &res](WFHttpTask *task)
+        {
+            const void *body;
+            size_t body_len;
+            task->get_resp()->get_parsed_body(&body, &body_len);
+            res.assign(static_cast<const char *>(body), body_len);
+            wait_group.done();
+        });
+        client_task->start();
+        wait_group.wait();
+        return res;
+    };
+
+    // no latency known yet, the slow primary is not hedged
+    EXPECT_EQ(request("path=slow"), "-");
+    // fast answers of the target
+    EXPECT_EQ(request("path=fast&n=60"), std::string(60, '-'));
+    // then the slow primary is beaten by the hedge
+    EXPECT_EQ(request("path=slow"), "h");
+
+    svr.stop();
+    backend.stop();
+}
+
+TEST(HttpServer, parallel_protocols)
+{
+    HttpServer backend;
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    backend_routes(backend);
+
+    svr.GET("/test", [](const HttpReq *req, HttpResp *resp)
+    {
+        std::vector<ParallelCall> calls;
+        calls.emplace_back("127.0.0.1:8887/fast");
+        // nothing listens there
+        ParallelCall redis("redis://127.0.0.1:8886");
+        redis.command = "GET";
+        redis.params = { "key" };
+        calls.push_back(std::move(redis));
+        resp->Parallel(calls, [](std::vector<ParallelResult> &results, HttpResp *resp)
+        {
+            EXPECT_EQ(results[0].state, WFT_STATE_SUCCESS);
+            EXPECT_NE(results[1].state, WFT_STATE_SUCCESS);
+            EXPECT_FALSE(results[1].timeout);
+            const void *body;
+            size_t len;
+            results[0].resp.get_parsed_body(&body, &len);
+            resp->append_output_body_nocopy(body, len);
+        });
+    });
+
+    EXPECT_TRUE(backend.start("127.0.0.1", 8887) == 0) << "http server start failed";
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *client_task = create_http_task("test");
+    client_task->set_callback([&wait_group](WFHttpTask *task)
+    {
+        const void *body;
+        size_t body_len;
+        task->get_resp()->get_parsed_body(&body, &body_len);
+        EXPECT_EQ(std::string(static_cast<const char *>(body), body_len), "fast");
+        wait_group.done();
+    });
+
+    client_task->start();
+    wait_group.wait();
+    svr.stop();
+    backend.stop();
+}
@@ -0,0 +1,200 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/HttpUtil.h"
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+struct Reply
+{
+    std::string status;
+    std::string body;
+};
+
+Reply request(const std::string &path)
+{
+    WFFacilities::WaitGroup wait_group(1);
+    Reply reply;
+    WFHttpTask *task = ClientUtil::create_http_task(path);
+    task->set_callback([&wait_group, &reply](WFHttpTask *task)
+    {
+        const void *body;
+        size_t len;
+        reply.status = task->get_resp()->get_status_code();
+        task->get_resp()->get_parsed_body(&body, &len);
+        reply.body.assign(static_cast<const char *>(body), len);
+        wait_group.done();
+    });
+    task->start();
+    wait_group.wait();
+    return reply;
+}
+
+TEST(HttpServer, reload)
+{
+    HttpServer svr;
+    svr.GET("/a", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("v1");
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+    EXPECT_EQ(svr.routes_version(), 1);
+
+    BluePrint bp;
+    bp.GET("/a", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("v2");
+    });
+    bp.GET("/b", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("b");
+    });
+    EXPECT_EQ(svr.reload(bp), 2);
+    EXPECT_EQ(request("a").body, "v2");
+    EXPECT_EQ(request("b").body, "b");
+
+    // the routes of the last reload are gone, the ones before start() are back
+    BluePrint bp2;
+    bp2.GET("/c", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("c");
+    });
+    EXPECT_EQ(svr.reload(bp2), 3);
+    EXPECT_EQ(request("a").body, "v1");
+    EXPECT_EQ(request("b").status, "404");
+    EXPECT_EQ(request("c").body, "c");
+    EXPECT_EQ(svr.routes_version(), 3);
+
+    svr.stop();
+}
+
+TEST(HttpServer, reload_without_startup_routes)
+{
+    HttpServer svr;
+    svr.GET("/a", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("a");
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // a startup route disabled by a flag
+    BluePrint bp;
+    bp.GET("/b", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("b");
+    });
+    EXPECT_EQ(svr.reload(bp, false), 2);
+    EXPECT_EQ(request("a").status, "404");
+    EXPECT_EQ(request("b").body, "b");
+
+    // and enabled again
+    EXPECT_EQ(svr.reload(bp), 3);
+    EXPECT_EQ(request("a").body, "a");
+    EXPECT_EQ(request("b").body, "b");
+
+    svr.stop();
+}
+
+TEST(HttpServer, reload_nested_routes)
+{
+    HttpServer svr;
+    svr.GET("/", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("root");
+    });
+    svr.GET("/api", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("api");
+    });
+    svr.GET("/api/users/{id}", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("user " + req->param("id"));
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    svr.reload(BluePrint());
+    EXPECT_EQ(request("").body, "root");
+    EXPECT_EQ(request("api").body, "api");
+    EXPECT_EQ(request("api/users/7").body, "user 7");
+
+    svr.stop();
+}
+
+TEST(HttpServer, reload_in_flight)
+{
+    HttpServer svr;
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    std::shared_ptr<std::string> msg = std::make_shared<std::string>("old");
+    std::weak_ptr<std::string> expired = msg;
+    BluePrint bp;
+    bp.GET("/slow", [msg](const HttpReq *req, HttpResp *resp)
+    {
+        // only alive with the routes
+        const std::string *body = msg.get();
+        resp->Timer(200 * 1000, [resp, body]()
+        {
+            resp->String(*body);
+        });
+    });
+    svr.reload(bp);
+    msg.reset();
+
+    WFFacilities::WaitGroup wait_group(1);
+    Reply reply;
+    WFHttpTask *task = ClientUtil::create_http_task("slow");
+    task->set_callback([&wait_group, &reply](WFHttpTask *task)
+    {
+        const void *body;
+        size_t len;
+        task->get_resp()->get_parsed_body(&body, &len);
+        reply.body.assign(static_cast<const char *>(body), len);
+        wait_group.done();
+    });
+    task->start();
+
+    usleep(50 * 1000);
+    svr.reload(BluePrint());
+    EXPECT_EQ(request("slow").status, "404");
+    EXPECT_FALSE(expired.expired());
+
+    wait_group.wait();
+    EXPECT_EQ(reply.body, "old");
+    // deleted with the server task, once the reply is sent
+    usleep(100 * 1000);
+    EXPECT_TRUE(expired.expired());
+
+    svr.stop();
+}
+
+TEST(HttpServer, reload_metrics)
+{
+    HttpServer svr;
+    svr.metrics("/metrics");
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // the routes of the versions gone are counted apart from the ones after them
+    for (int i = 0; i < 20; i++)
+    {
+        BluePrint bp;
+        bp.GET("/r" + std::to_string(i), [](const HttpReq *req, HttpResp *resp)
+        {
+            resp->String("r");
+        });
+        svr.reload(bp);
+        EXPECT_EQ(request("r" + std::to_string(i)).body, "r");
+    }
+
+    std::string res = request("metrics").body;
+    for (int i = 0; i < 20; i++)
+    {
+        std::string line = "wfrest_http_requests_total{route=\"/r" + std::to_string(i) +
+                           "\",verb=\"GET\",code=\"200\"} 1\n";
+        EXPECT_TRUE(res.find(line) != std::string::npos) << line;
+    }
+
+    svr.stop();
+}
@@ -1,5 +1,6 @@
 #include "workflow/WFFacilities.h"
 #include <gtest/gtest.h>
+#include <unistd.h>
 #include "wfrest/HttpServer.h"
 #include "wfrest/ErrorCode.h"
 #include "wfrest/PathUtil.h"
@@ -112,3 +113,56 @@ TEST_F(MultiPartEncoderTest, multi_part_form_test)
     wait_group.wait();
     svr.stop();
 }
+
+TEST_F(MultiPartEncoderTest, multi_part_large_file_test)
+{
+    // larger than the read ahead, kept out of the source tree
+    std::string large;
+    for (size_t i = 0; large.size() < 8 * 1024 * 1024; i++)
+        large.append(std::to_string(i));
+    const char *large_path = "/tmp/wfrest_multipart_large.txt";
+    ASSERT_TRUE(FileTestUtil::write_file(large_path, large));
+
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    svr.GET("/form", [large_path](const HttpReq *req, HttpResp *resp)
+    {
+        MultiPartEncoder encoder;
+        encoder.add_file("large.txt", large_path);
+        encoder.add_file("missing.txt", "./www/missing.txt");
+        encoder.add_file("test_1.txt", "./www/test_1.txt");
+        resp->String(std::move(encoder));
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    WFHttpTask *client_task = ClientUtil::create_http_task("form");
+    client_task->set_callback([&wait_group, &large](WFHttpTask *task)
+    {
+        const void *body;
+        size_t body_len;
+        task->get_resp()->get_parsed_body(&body, &body_len);
+        std::string content;
+        content.append("\r\n--");
+        content.append("----WebKitFormBoundary7MA4YWxkTrZu0gW");
+        content.append("\r\nContent-Disposition: form-data; name=\"large.txt\"; filename=\"wfrest_multipart_large.txt\"");
+        content.append("\r\nContent-Type: text/plain\r\n\r\n");
+        content.append(large);
+        content.append("\r\n--");
+        content.append("----WebKitFormBoundary7MA4YWxkTrZu0gW");
+        content.append("\r\nContent-Disposition: form-data; name=\"test_1.txt\"; filename=\"test_1.txt\"");
+        content.append("\r\nContent-Type: text/plain\r\n\r\n");
+        content.append("file_body");
+        content.append("\r\n--");
+        content.append("----WebKitFormBoundary7MA4YWxkTrZu0gW");
+        content.append("--\r\n");
+        EXPECT_EQ(std::string(static_cast<const char *>(body), body_len), content);
+        wait_group.done();
+    });
+
+    client_task->start();
+    wait_group.wait();
+    svr.stop();
+    unlink(large_path);
+}
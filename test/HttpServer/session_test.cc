@@ -0,0 +1,108 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/HttpUtil.h"
+#include <gtest/gtest.h>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+struct Reply
+{
+    std::string body;
+    std::string set_cookie;
+};
+
+Reply request(const std::string &path, const std::string &cookie = "")
+{
+    WFFacilities::WaitGroup wait_group(1);
+    Reply reply;
+    WFHttpTask *task = ClientUtil::create_http_task(path);
+    if (!cookie.empty())
+        task->get_req()->add_header_pair("Cookie", cookie.c_str());
+    task->set_callback([&wait_group, &reply](WFHttpTask *task)
+    {
+        const void *body;
+        size_t len;
+        task->get_resp()->get_parsed_body(&body, &len);
+        reply.body.assign(static_cast<const char *>(body), len);
+        HttpHeaderCursor cursor(task->get_resp());
+        cursor.find("Set-Cookie", reply.set_cookie);
+        wait_group.done();
+    });
+    task->start();
+    wait_group.wait();
+    return reply;
+}
+
+// "name=value; Path=/; ..." to "name=value"
+std::string cookie_pair(const std::string &set_cookie)
+{
+    return set_cookie.substr(0, set_cookie.find(';'));
+}
+
+TEST(HttpServer, session)
+{
+    HttpServer svr;
+    svr.session();
+    svr.GET("/login", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Session([resp](Session *session)
+        {
+            session->set("user", "alice");
+            resp->String("logged in");
+        });
+    });
+    svr.GET("/me", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Session([resp](Session *session)
+        {
+            resp->String(session->is_new() ? "anonymous" : session->get("user"));
+        });
+    });
+    svr.GET("/logout", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->Session([resp](Session *session)
+        {
+            session->destroy();
+            resp->String("bye");
+        });
+    });
+    svr.GET("/plain", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("plain");
+    });
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    // reading an unknown session creates nothing
+    Reply reply = request("me");
+    EXPECT_EQ(reply.body, "anonymous");
+    EXPECT_TRUE(reply.set_cookie.empty());
+
+    reply = request("login");
+    ASSERT_EQ(reply.set_cookie.find("wfrest_session="), 0);
+    EXPECT_NE(reply.set_cookie.find("HttpOnly"), std::string::npos);
+    std::string cookie = cookie_pair(reply.set_cookie);
+
+    reply = request("me", cookie);
+    EXPECT_EQ(reply.body, "alice");
+    EXPECT_TRUE(reply.set_cookie.empty());
+
+    // the signature does not match
+    std::string forged = cookie;
+    forged[forged.size() - 1] = forged.back() == '0' ? '1' : '0';
+    EXPECT_EQ(request("me", forged).body, "anonymous");
+
+    EXPECT_EQ(request("plain", cookie).body, "plain");
+
+    reply = request("logout", cookie);
+    EXPECT_NE(reply.set_cookie.find("Expires="), std::string::npos);
+    EXPECT_EQ(request("me", cookie).body, "anonymous");
+
+    SessionStats stats = svr.session_stats();
+    EXPECT_EQ(stats.sessions, 0);
+    EXPECT_EQ(stats.created, 1);
+    EXPECT_EQ(stats.hits, 2);
+
+    svr.stop();
+}
@@ -0,0 +1,84 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+static void run_requests(int n)
+{
+    WFFacilities::WaitGroup wait_group(1);
+    ParallelWork *pwork = Workflow::create_parallel_work([&wait_group](const ParallelWork *)
+    {
+        wait_group.done();
+    });
+    for (int i = 0; i < n; i++)
+    {
+        WFHttpTask *task = ClientUtil::create_http_task("shard");
+        // a new connection for every request
+        task->get_req()->add_header_pair("Connection", "close");
+        task->set_callback([](WFHttpTask *task)
+        {
+            const void *body;
+            size_t body_len;
+            task->get_resp()->get_parsed_body(&body, &body_len);
+            EXPECT_EQ(std::string(static_cast<const char *>(body), body_len), "shard");
+        });
+        pwork->add_series(Workflow::create_series_work(task, nullptr));
+    }
+    pwork->start();
+    wait_group.wait();
+}
+
+TEST(HttpServer, start_sharded)
+{
+    HttpServer svr;
+    svr.GET("/shard", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("shard");
+    });
+
+    ShardParams params = { 4, false, {} };
+    EXPECT_TRUE(svr.start_sharded("127.0.0.1", 8888, params) == 0) << "http server start failed";
+
+    run_requests(32);
+
+    std::vector<ListenerStats> stats = svr.listener_stats();
+    EXPECT_EQ(stats.size(), 4);
+    EXPECT_EQ(stats[0].name, "shard0");
+    unsigned long long accepted = 0;
+    unsigned long long requests = 0;
+    for (const auto &listener : stats)
+    {
+        accepted += listener.accepted;
+        requests += listener.requests;
+    }
+    EXPECT_EQ(accepted, 32);
+    EXPECT_EQ(requests, 32);
+
+    svr.stop();
+    EXPECT_EQ(svr.listener_stats().size(), 1);
+}
+
+TEST(HttpServer, start_sharded_steer_by_cpu)
+{
+    HttpServer svr;
+    svr.GET("/shard", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("shard");
+    });
+
+    // every cpu to the last socket
+    ShardParams params = { 2, true, std::vector<int>(1024, 1) };
+    EXPECT_TRUE(svr.start_sharded("127.0.0.1", 8888, params) == 0) << "http server start failed";
+
+    run_requests(8);
+
+    std::vector<ListenerStats> stats = svr.listener_stats();
+    EXPECT_EQ(stats.size(), 2);
+    EXPECT_EQ(stats[0].accepted, 0);
+    EXPECT_EQ(stats[1].accepted, 8);
+
+    svr.stop();
+}
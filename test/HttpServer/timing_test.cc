@@ -0,0 +1,78 @@
+#include "workflow/WFFacilities.h"
+#include "workflow/HttpUtil.h"
+#include <gtest/gtest.h>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+std::string get_header(WFHttpTask *task, const std::string &name)
+{
+    HttpHeaderCursor cursor(task->get_resp());
+    std::string value;
+    cursor.find(name, value);
+    return value;
+}
+
+TEST(HttpServer, timing)
+{
+    HttpServer svr;
+    WFFacilities::WaitGroup wait_group(1);
+
+    RequestTimingParams params;
+    params.sample_every = 2;
+    svr.timing(params);
+
+    int timed = 0;
+    svr.track([&timed](HttpTask *task)
+    {
+        const RequestTiming *timing = static_cast<HttpServerTask *>(task)->timing();
+        if (timing)
+        {
+            timed++;
+            EXPECT_TRUE(timing->span_us(RequestTiming::SPAN_HANDLER) >= 0);
+            EXPECT_TRUE(timing->span_us(RequestTiming::SPAN_TOTAL) >= 0);
+        }
+    });
+    svr.GET("/compute", 1, [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("compute");
+    });
+
+    EXPECT_TRUE(svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+
+    std::vector<std::string> server_timing;
+    SeriesWork *series = Workflow::create_series_work(WFTaskFactory::create_empty_task(), nullptr);
+    for (int i = 0; i < 4; i++)
+    {
+        WFHttpTask *task = ClientUtil::create_http_task("compute");
+        task->set_callback([&server_timing](WFHttpTask *task)
+        {
+            server_timing.push_back(get_header(task, "Server-Timing"));
+        });
+        series->push_back(task);
+    }
+    series->set_callback([&wait_group](const SeriesWork *)
+    {
+        wait_group.done();
+    });
+
+    series->start();
+    wait_group.wait();
+    svr.stop();
+
+    EXPECT_EQ(timed, 2);
+    ASSERT_EQ(server_timing.size(), 4);
+    int with_header = 0;
+    for (const auto &value : server_timing)
+    {
+        if (value.empty())
+            continue;
+        with_header++;
+        EXPECT_TRUE(value.find("queue;dur=") != std::string::npos) << value;
+        EXPECT_TRUE(value.find("handler;dur=") != std::string::npos) << value;
+        EXPECT_TRUE(value.find("app;dur=") != std::string::npos) << value;
+    }
+    EXPECT_EQ(with_header, 2);
+}
@@ -0,0 +1,80 @@
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include "wfrest/HttpServer.h"
+#include "../ClientUtil.h"
+
+using namespace wfrest;
+using namespace protocol;
+
+static const char *k_upgrade_path = "./wfrest_upgrade_test.sock";
+
+static std::string get_body(const std::string &path, std::string *connection = nullptr)
+{
+    WFFacilities::WaitGroup wait_group(1);
+    std::string body;
+    WFHttpTask *task = ClientUtil::create_http_task(path);
+    task->set_callback([&wait_group, &body, connection](WFHttpTask *task)
+    {
+        const void *data;
+        size_t len;
+        if (task->get_resp()->get_parsed_body(&data, &len))
+            body.assign(static_cast<const char *>(data), len);
+        if (connection)
+        {
+            HttpHeaderCursor cursor(task->get_resp());
+            cursor.find("Connection", *connection);
+        }
+        wait_group.done();
+    });
+    task->start();
+    wait_group.wait();
+    return body;
+}
+
+// both processes in one : the new server takes the socket of the old one
+TEST(HttpServer, upgrade)
+{
+    HttpServer old_svr;
+    old_svr.GET("/version", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("old");
+    });
+    // the first process : nothing to inherit
+    EXPECT_EQ(old_svr.inherit_sockets(k_upgrade_path), 0);
+    EXPECT_TRUE(old_svr.start("127.0.0.1", 8888) == 0) << "http server start failed";
+    EXPECT_EQ(old_svr.serve_upgrades(k_upgrade_path), 0);
+    EXPECT_EQ(get_body("version"), "old");
+
+    bool drained = false;
+    std::thread old_main([&old_svr, &drained]()
+    {
+        drained = old_svr.wait_upgraded(5000);
+    });
+
+    HttpServer new_svr;
+    new_svr.GET("/version", [](const HttpReq *req, HttpResp *resp)
+    {
+        resp->String("new");
+    });
+    EXPECT_EQ(new_svr.inherit_sockets(k_upgrade_path), 0);
+    // the port is still bound by the old server, the socket is shared instead
+    EXPECT_TRUE(new_svr.start("127.0.0.1", 8888) == 0) << "inherited start failed";
+    EXPECT_EQ(new_svr.serve_upgrades(k_upgrade_path), 0);
+
+    old_main.join();
+    EXPECT_TRUE(drained);
+    EXPECT_EQ(old_svr.upgrade_stats().handed_over, 1);
+    EXPECT_GE(old_svr.upgrade_stats().drain_us, 0);
+
+    UpgradeStats stats = new_svr.upgrade_stats();
+    EXPECT_EQ(stats.inherited, 1);
+    EXPECT_GE(stats.handoff_us, 0);
+    EXPECT_GE(stats.startup_us, 0);
+
+    std::string connection;
+    EXPECT_EQ(get_body("version", &connection), "new");
+    EXPECT_EQ(connection, "Keep-Alive");
+
+    new_svr.stop();
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include "wfrest/JsonStruct.h"
+#include "wfrest/json.hpp"
+
+using namespace wfrest;
+
+namespace app
+{
+
+struct Item
+{
+    std::string sku;
+    double price;
+};
+WFREST_JSON_STRUCT(Item, sku, price)
+
+struct Reply
+{
+    int id = 0;
+    unsigned long long uid = 0;
+    bool ok = false;
+    std::string name;
+    std::vector<Item> items;
+    std::map<std::string, int> counts;
+};
+WFREST_JSON_STRUCT(Reply, id, uid, ok, name, items, counts)
+
+}  // namespace app
+
+TEST(JsonStruct, dump)
+{
+    app::Reply reply;
+    reply.id = -7;
+    reply.uid = 18446744073709551615ULL;
+    reply.ok = true;
+    reply.name = "a\"b\n\x01";
+    reply.items = {{"x1", 1.5}, {"x2", 0.1}};
+    reply.counts["a"] = 1;
+
+    std::string out = json_dump(reply);
+    EXPECT_EQ(out, R"({"id":-7,"uid":18446744073709551615,"ok":true,"name":"a\"b\n\u0001",)"
+                   R"("items":[{"sku":"x1","price":1.5},{"sku":"x2","price":0.1}],"counts":{"a":1}})");
+    EXPECT_GE(json_estimate(reply), out.size());
+
+    nlohmann::json js = nlohmann::json::parse(out);
+    EXPECT_EQ(js["name"], reply.name);
+    EXPECT_EQ(js["items"][1]["price"], 0.1);
+}
+
+TEST(JsonStruct, read)
+{
+    std::string text = R"({"unknown" : {"x" : [1]}, "name" : "wfrest", "id" : 3,
+                           "items" : [{"sku" : "x1", "price" : 2}], "counts" : {"a" : 1, "b" : 2}})";
+    app::Reply reply;
+    EXPECT_TRUE(json_read(JsonView(StringPiece(text)), reply));
+    EXPECT_EQ(reply.id, 3);
+    EXPECT_EQ(reply.name, "wfrest");
+    EXPECT_FALSE(reply.ok);
+    ASSERT_EQ(reply.items.size(), 1);
+    EXPECT_EQ(reply.items[0].sku, "x1");
+    EXPECT_DOUBLE_EQ(reply.items[0].price, 2.0);
+    EXPECT_EQ(reply.counts["b"], 2);
+}
+
+TEST(JsonStruct, round_trip)
+{
+    app::Reply reply;
+    reply.id = 42;
+    reply.name = "\xE4\xBD\xA0\xE5\xA5\xBD";
+    reply.items = {{"x", 1e300}};
+
+    std::string out = json_dump(reply);
+    app::Reply parsed;
+    EXPECT_TRUE(json_read(JsonView(StringPiece(out)), parsed));
+    EXPECT_EQ(parsed.id, 42);
+    EXPECT_EQ(parsed.name, reply.name);
+    EXPECT_DOUBLE_EQ(parsed.items[0].price, 1e300);
+}
+
+TEST(JsonStruct, mismatch)
+{
+    app::Reply reply;
+    EXPECT_FALSE(json_read(JsonView(StringPiece(R"({"id" : "3"})")), reply));
+    EXPECT_FALSE(json_read(JsonView(StringPiece("[1, 2]")), reply));
+    EXPECT_FALSE(is_json_struct<std::string>::value);
+    EXPECT_TRUE(is_json_struct<app::Reply>::value);
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include "wfrest/JsonView.h"
+#include "wfrest/json.hpp"
+
+using namespace wfrest;
+
+static const char *kDoc = R"({
+    "name" : "wfrest",
+    "version" : 3,
+    "ratio" : -1.5e2,
+    "ok" : true,
+    "none" : null,
+    "tags" : ["http", "json", {"nested" : "]}"}],
+    "esc\"key" : "a\"b\\cé😀",
+    "obj" : {"a" : {"b" : [1, 2, 3]}}
+})";
+
+TEST(JsonView, lookup)
+{
+    JsonView doc{StringPiece(kDoc)};
+    EXPECT_TRUE(doc.is_object());
+    EXPECT_EQ(doc.size(), 8);
+
+    EXPECT_EQ(doc["name"].as_string(), "wfrest");
+    EXPECT_EQ(doc["version"].as_int(), 3);
+    EXPECT_EQ(doc["version"].as_uint(), 3);
+    EXPECT_DOUBLE_EQ(doc["ratio"].as_double(), -150.0);
+    EXPECT_TRUE(doc["ok"].is_bool());
+    EXPECT_TRUE(doc["ok"].as_bool());
+    EXPECT_TRUE(doc["none"].is_null());
+
+    EXPECT_FALSE(doc["missing"].valid());
+    EXPECT_FALSE(doc.has("missing"));
+    EXPECT_FALSE(doc["name"]["x"].valid());
+}
+
+TEST(JsonView, array)
+{
+    JsonView doc{StringPiece(kDoc)};
+    JsonView tags = doc["tags"];
+    EXPECT_TRUE(tags.is_array());
+    EXPECT_EQ(tags.size(), 3);
+    EXPECT_EQ(tags[1].as_string(), "json");
+    EXPECT_EQ(tags[2]["nested"].as_string(), "]}");
+    EXPECT_FALSE(tags[3].valid());
+    EXPECT_FALSE(tags[-1].valid());
+
+    EXPECT_EQ(doc["obj"]["a"]["b"][2].as_int(), 3);
+    EXPECT_EQ(doc["obj"]["a"]["b"].raw(), "[1, 2, 3]");
+
+    int sum = 0;
+    EXPECT_TRUE(doc["obj"]["a"]["b"].for_each_element([&sum](const JsonView &val)
+    {
+        sum += val.as_int();
+    }));
+    EXPECT_EQ(sum, 6);
+}
+
+TEST(JsonView, escape)
+{
+    JsonView doc{StringPiece(kDoc)};
+    JsonView val = doc["esc\"key"];
+    EXPECT_TRUE(val.is_string());
+    EXPECT_EQ(val.as_string(), "a\"b\\c\xC3\xA9\xF0\x9F\x98\x80");
+}
+
+TEST(JsonView, for_each_member)
+{
+    JsonView doc{StringPiece(kDoc)};
+    std::vector<std::string> keys;
+    EXPECT_TRUE(doc.for_each_member([&keys](const StringPiece &key, const JsonView &)
+    {
+        keys.push_back(key.as_string());
+    }));
+    ASSERT_EQ(keys.size(), 8);
+    EXPECT_EQ(keys[0], "name");
+    EXPECT_EQ(keys[7], "obj");
+}
+
+TEST(JsonView, materialize)
+{
+    JsonView doc{StringPiece(kDoc)};
+    nlohmann::json obj = doc["obj"].materialize();
+    EXPECT_EQ(obj["a"]["b"][1], 2);
+
+    nlohmann::json all = doc.materialize();
+    EXPECT_EQ(all["tags"][0], "http");
+}
+
+TEST(JsonView, malformed)
+{
+    JsonView empty{StringPiece("   ")};
+    EXPECT_FALSE(empty.valid());
+
+    JsonView broken{StringPiece(R"({"a" : 1, "b" : "unterminated)")};
+    EXPECT_EQ(broken["a"].as_int(), 1);
+    EXPECT_FALSE(broken["b"].raw().size());
+    EXPECT_TRUE(broken.materialize().is_discarded());
+
+    JsonView bad{StringPiece(R"({"a" 1})")};
+    EXPECT_FALSE(bad["a"].valid());
+    EXPECT_FALSE(bad.for_each_member([](const StringPiece &, const JsonView &) {}));
+}
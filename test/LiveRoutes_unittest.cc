@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include "wfrest/LiveRoutes.h"
+#include "wfrest/BluePrint.h"
+#include "wfrest/Router.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+// the handler holds token, which expires with the blueprint
+BluePrint *new_blueprint(const std::string &route, const std::shared_ptr<int> &token)
+{
+    BluePrint *bp = new BluePrint;
+    bp->GET(route, [token](const HttpReq *req, HttpResp *resp) {});
+    return bp;
+}
+
+}  // namespace
+
+TEST(LiveRoutes, publish)
+{
+    BluePrint initial;
+    initial.GET("/a", [](const HttpReq *req, HttpResp *resp) {});
+    LiveRoutes live_routes(&initial);
+    EXPECT_EQ(live_routes.version(), 1);
+
+    RoutesVersion *v1 = live_routes.acquire();
+    EXPECT_EQ(v1->version(), 1);
+    EXPECT_EQ(&v1->router(), &initial.router());
+
+    std::shared_ptr<int> token = std::make_shared<int>(0);
+    EXPECT_EQ(live_routes.publish(std::unique_ptr<BluePrint>(new_blueprint("/b", token))), 2);
+    EXPECT_EQ(live_routes.version(), 2);
+
+    RoutesVersion *v2 = live_routes.acquire();
+    EXPECT_EQ(v2->version(), 2);
+    auto routes = v2->router().all_routes();
+    ASSERT_EQ(routes.size(), 1);
+    EXPECT_EQ(routes[0].second, "b");
+
+    // still in use by a request
+    std::weak_ptr<int> expired = token;
+    token.reset();
+    live_routes.publish(std::unique_ptr<BluePrint>(new BluePrint));
+    EXPECT_FALSE(expired.expired());
+    EXPECT_EQ(v2->router().all_routes().size(), 1);
+
+    v2->unref();
+    EXPECT_TRUE(expired.expired());
+    // the initial routes are not owned
+    v1->unref();
+    EXPECT_EQ(initial.router().all_routes().size(), 1);
+}
+
+TEST(LiveRoutes, merge)
+{
+    BluePrint base;
+    base.GET("/a", [](const HttpReq *req, HttpResp *resp) {});
+    base.POST("/a", [](const HttpReq *req, HttpResp *resp) {});
+    base.GET("/b", [](const HttpReq *req, HttpResp *resp) {});
+
+    BluePrint update;
+    update.GET("/a", [](const HttpReq *req, HttpResp *resp) {});
+    update.GET("/c", [](const HttpReq *req, HttpResp *resp) {});
+
+    BluePrint merged;
+    merged.merge(base);
+    merged.merge(update);
+
+    auto routes = merged.router().all_routes();
+    ASSERT_EQ(routes.size(), 4);
+    EXPECT_EQ(routes[0], std::make_pair(std::string("GET"), std::string("a")));
+    EXPECT_EQ(routes[1], std::make_pair(std::string("POST"), std::string("a")));
+    EXPECT_EQ(routes[2], std::make_pair(std::string("GET"), std::string("b")));
+    EXPECT_EQ(routes[3], std::make_pair(std::string("GET"), std::string("c")));
+}
+
+TEST(LiveRoutes, concurrent_readers)
+{
+    BluePrint initial;
+    LiveRoutes live_routes(&initial);
+
+    const int k_versions = 200;
+    std::vector<std::weak_ptr<int>> tokens;
+    std::atomic<bool> done(false);
+    std::atomic<bool> ordered(true);
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++)
+    {
+        readers.emplace_back([&live_routes, &done, &ordered]
+        {
+            unsigned long long last = 0;
+            while (!done.load())
+            {
+                RoutesVersion *routes = live_routes.acquire();
+                if (routes->version() < last)
+                    ordered = false;
+                last = routes->version();
+                routes->router().all_routes();
+                routes->unref();
+            }
+        });
+    }
+
+    for (int i = 0; i < k_versions; i++)
+    {
+        std::shared_ptr<int> token = std::make_shared<int>(i);
+        tokens.push_back(token);
+        live_routes.publish(std::unique_ptr<BluePrint>(new_blueprint("/v" + std::to_string(i), token)));
+    }
+    done = true;
+    for (auto &reader : readers)
+        reader.join();
+
+    EXPECT_TRUE(ordered.load());
+    EXPECT_EQ(live_routes.version(), k_versions + 1);
+    // all but the current one
+    for (int i = 0; i < k_versions - 1; i++)
+        EXPECT_TRUE(tokens[i].expired());
+    EXPECT_FALSE(tokens.back().expired());
+}
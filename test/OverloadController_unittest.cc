@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include "wfrest/OverloadController.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+const long long k_ms = 1000;
+
+// requests waiting delay_ms each, over a whole interval of 100ms from now
+void run_interval(OverloadController &overload, long long &now, long long delay_ms)
+{
+    for (int i = 0; i < 10; i++)
+    {
+        if (overload.admit(delay_ms * k_ms, RoutePriority::NORMAL, now))
+            overload.release();
+        now += 10 * k_ms;
+    }
+}
+
+}  // namespace
+
+TEST(OverloadController, codel)
+{
+    OverloadParams params;
+    params.target_delay_ms = 5;
+    params.interval_ms = 100;
+    OverloadController overload(params);
+    long long now = 1000 * k_ms;
+
+    // a wait over the target is fine while it does not last
+    run_interval(overload, now, 1);
+    EXPECT_TRUE(overload.admit(50 * k_ms, RoutePriority::NORMAL, now));
+    overload.release();
+    EXPECT_FALSE(overload.stats().overloaded);
+
+    // over the interval, the request is shed anyway
+    EXPECT_FALSE(overload.admit(150 * k_ms, RoutePriority::NORMAL, now));
+
+    // a standing queue : overloaded once the interval is over
+    run_interval(overload, now, 20);
+    run_interval(overload, now, 20);
+    EXPECT_TRUE(overload.stats().overloaded);
+    EXPECT_FALSE(overload.admit(20 * k_ms, RoutePriority::NORMAL, now));
+    EXPECT_TRUE(overload.admit(1 * k_ms, RoutePriority::NORMAL, now));
+    overload.release();
+    EXPECT_FALSE(overload.admit(1 * k_ms, RoutePriority::SHEDDABLE, now));
+    EXPECT_TRUE(overload.admit(500 * k_ms, RoutePriority::CRITICAL, now));
+    overload.release();
+
+    // the queue drained
+    run_interval(overload, now, 1);
+    run_interval(overload, now, 1);
+    EXPECT_FALSE(overload.stats().overloaded);
+    EXPECT_TRUE(overload.admit(20 * k_ms, RoutePriority::NORMAL, now));
+    overload.release();
+
+    OverloadStats stats = overload.stats();
+    EXPECT_EQ(stats.inflight, 0);
+    EXPECT_GT(stats.shed, 0);
+}
+
+TEST(OverloadController, max_inflight)
+{
+    OverloadParams params;
+    params.max_inflight = 4;
+    OverloadController overload(params);
+    long long now = 1000 * k_ms;
+
+    // the sheddable routes get 3 of the 4
+    for (int i = 0; i < 3; i++)
+        EXPECT_TRUE(overload.admit(0, RoutePriority::SHEDDABLE, now));
+    EXPECT_FALSE(overload.admit(0, RoutePriority::SHEDDABLE, now));
+    EXPECT_TRUE(overload.admit(0, RoutePriority::NORMAL, now));
+    EXPECT_FALSE(overload.admit(0, RoutePriority::NORMAL, now));
+    EXPECT_TRUE(overload.admit(0, RoutePriority::CRITICAL, now));
+    EXPECT_EQ(overload.stats().inflight, 5);
+
+    overload.release();
+    overload.release();
+    EXPECT_TRUE(overload.admit(0, RoutePriority::NORMAL, now));
+}
+
+TEST(OverloadController, priorities)
+{
+    OverloadParams params;
+    params.priorities["/health"] = RoutePriority::CRITICAL;
+    params.priorities["/batch/*"] = RoutePriority::SHEDDABLE;
+    params.priorities["/batch/urgent/*"] = RoutePriority::NORMAL;
+    OverloadController overload(params);
+
+    EXPECT_EQ(overload.priority("/health"), RoutePriority::CRITICAL);
+    EXPECT_EQ(overload.priority("/health/deep"), RoutePriority::NORMAL);
+    EXPECT_EQ(overload.priority("/batch/1"), RoutePriority::SHEDDABLE);
+    EXPECT_EQ(overload.priority("/batch/urgent/1"), RoutePriority::NORMAL);
+    EXPECT_EQ(overload.priority("/"), RoutePriority::NORMAL);
+}
+
+TEST(OverloadController, connections)
+{
+    OverloadParams params;
+    params.connection_high_water = 0.5;
+    OverloadController overload(params);
+    long long now = 1000 * k_ms;
+
+    // refused only while overloaded
+    EXPECT_TRUE(overload.accept_connection(90, 100));
+    run_interval(overload, now, 20);
+    run_interval(overload, now, 20);
+    EXPECT_TRUE(overload.accept_connection(40, 100));
+    EXPECT_FALSE(overload.accept_connection(60, 100));
+    EXPECT_EQ(overload.stats().refused_connections, 1);
+}
@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "wfrest/PerfectHash.h"
+
+using namespace wfrest;
+
+TEST(PerfectHash, find)
+{
+    std::vector<std::string> strs;
+    for (int i = 0; i < 5000; i++)
+        strs.push_back("key" + std::to_string(i));
+    std::vector<StringPiece> keys(strs.begin(), strs.end());
+
+    PerfectHash hash;
+    hash.build(keys);
+    EXPECT_EQ(hash.size(), 5000u);
+    for (int i = 0; i < 5000; i++)
+        EXPECT_EQ(hash.find(keys[i]), i);
+
+    EXPECT_EQ(hash.find("KEY42"), 42);
+    EXPECT_EQ(hash.find("key5000"), -1);
+    EXPECT_EQ(hash.find("key"), -1);
+    EXPECT_EQ(hash.find(""), -1);
+}
+
+TEST(PerfectHash, duplicates)
+{
+    PerfectHash hash;
+    EXPECT_EQ(hash.find("a"), -1);
+
+    std::vector<StringPiece> keys = { "html", "htm", "HTML", "" };
+    hash.build(keys);
+    EXPECT_EQ(hash.size(), 3u);
+    // the first of equal keys
+    EXPECT_EQ(hash.find("Html"), 0);
+    EXPECT_EQ(hash.find("htm"), 1);
+    EXPECT_EQ(hash.find(""), 3);
+
+    hash.build({});
+    EXPECT_EQ(hash.size(), 0u);
+    EXPECT_EQ(hash.find("html"), -1);
+}
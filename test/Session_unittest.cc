@@ -0,0 +1,222 @@
+#include "workflow/WFTaskFactory.h"
+#include "workflow/WFFacilities.h"
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <mutex>
+#include "wfrest/Session.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+// in memory, as if it were remote
+class MapBackend : public SessionBackend
+{
+public:
+    SubTask *create_load_task(const std::string &id, LoadCallback callback) override
+    {
+        return WFTaskFactory::create_go_task("session_test", [this, id, callback]
+        {
+            std::string data;
+            bool found = this->get(id, &data);
+            callback(found, data);
+        });
+    }
+
+    SubTask *create_store_task(const std::string &id, const std::string &data,
+                               int ttl_seconds) override
+    {
+        return WFTaskFactory::create_go_task("session_test", [this, id, data]
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            map_[id] = data;
+            stores_++;
+        });
+    }
+
+    SubTask *create_remove_task(const std::string &id) override
+    {
+        return WFTaskFactory::create_go_task("session_test", [this, id]
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            map_.erase(id);
+        });
+    }
+
+    bool get(const std::string &id, std::string *data)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = map_.find(id);
+        if (it == map_.end())
+            return false;
+        *data = it->second;
+        return true;
+    }
+
+    int stores()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stores_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::string> map_;
+    int stores_ = 0;
+};
+
+bool load(SessionStore *store, const std::string &id)
+{
+    WFFacilities::WaitGroup wait_group(1);
+    bool result = false;
+    SubTask *task = store->create_load_task(id, [&result](bool found)
+    {
+        result = found;
+    });
+    Workflow::start_series_work(task, [&wait_group](const SeriesWork *)
+    {
+        wait_group.done();
+    });
+    wait_group.wait();
+    return result;
+}
+
+}  // namespace
+
+TEST(Session, sign_verify)
+{
+    SessionParams params;
+    params.secret = "secret";
+    auto store = std::make_shared<SessionStore>(params);
+
+    std::string id = store->new_id();
+    EXPECT_EQ(id.size(), 32);
+    EXPECT_NE(id, store->new_id());
+
+    std::string cookie_value = store->sign(id);
+    std::string verified;
+    EXPECT_TRUE(store->verify(cookie_value, &verified));
+    EXPECT_EQ(verified, id);
+
+    std::string tampered = cookie_value;
+    tampered[0] = tampered[0] == 'a' ? 'b' : 'a';
+    EXPECT_FALSE(store->verify(tampered, &verified));
+    EXPECT_FALSE(store->verify("", &verified));
+    EXPECT_FALSE(store->verify(id, &verified));
+
+    params.secret = "another";
+    auto other = std::make_shared<SessionStore>(params);
+    EXPECT_FALSE(other->verify(cookie_value, &verified));
+
+    HttpCookie cookie = store->cookie(id);
+    EXPECT_EQ(cookie.key(), "wfrest_session");
+    EXPECT_EQ(cookie.value(), cookie_value);
+    EXPECT_TRUE(cookie.is_http_only());
+}
+
+TEST(Session, values)
+{
+    auto store = std::make_shared<SessionStore>(SessionParams());
+    std::string id = store->new_id();
+    EXPECT_FALSE(store->touch(id));
+
+    store->set(id, "user", "alice");
+    store->set(id, "role", "admin");
+    EXPECT_TRUE(store->touch(id));
+
+    std::string value;
+    EXPECT_TRUE(store->get(id, "user", &value));
+    EXPECT_EQ(value, "alice");
+    EXPECT_EQ(store->values(id).size(), 2);
+
+    store->erase(id, "role");
+    EXPECT_FALSE(store->get(id, "role", &value));
+
+    store->destroy(id);
+    EXPECT_FALSE(store->touch(id));
+
+    SessionStats stats = store->stats();
+    EXPECT_EQ(stats.sessions, 0);
+    EXPECT_EQ(stats.created, 1);
+    EXPECT_EQ(stats.updates, 3);
+}
+
+TEST(Session, lru)
+{
+    SessionParams params;
+    params.max_sessions = 2;
+    params.shards = 1;
+    auto store = std::make_shared<SessionStore>(params);
+
+    store->set("a", "k", "1");
+    store->set("b", "k", "2");
+    EXPECT_TRUE(store->touch("a"));
+    store->set("c", "k", "3");
+
+    EXPECT_TRUE(store->touch("a"));
+    EXPECT_FALSE(store->touch("b"));
+    EXPECT_TRUE(store->touch("c"));
+    EXPECT_EQ(store->stats().evicted, 1);
+}
+
+TEST(Session, write_back)
+{
+    auto backend = std::make_shared<MapBackend>();
+    SessionParams params;
+    params.secret = "secret";
+    params.write_back_ms = 50;
+    params.backend = backend;
+    auto store = std::make_shared<SessionStore>(params);
+
+    std::string id = store->new_id();
+    for (int i = 0; i < 100; i++)
+        store->set(id, "count", std::to_string(i));
+    store->flush(true);
+
+    // coalesced in one write
+    EXPECT_EQ(backend->stores(), 1);
+    EXPECT_EQ(store->stats().writes, 1);
+    std::string data;
+    ASSERT_TRUE(backend->get(id, &data));
+    SessionValues values;
+    ASSERT_TRUE(SessionStore::deserialize(data, &values));
+    EXPECT_EQ(values["count"], "99");
+
+    // by the timer
+    store->set(id, "count", "100");
+    usleep(200 * 1000);
+    EXPECT_EQ(backend->stores(), 2);
+
+    // another process with the same backend
+    auto other = std::make_shared<SessionStore>(params);
+    EXPECT_FALSE(other->touch(id));
+    EXPECT_TRUE(load(other.get(), id));
+    std::string value;
+    EXPECT_TRUE(other->get(id, "count", &value));
+    EXPECT_EQ(value, "100");
+    EXPECT_FALSE(load(other.get(), other->new_id()));
+}
+
+TEST(Session, evicted_before_write_back)
+{
+    auto backend = std::make_shared<MapBackend>();
+    SessionParams params;
+    params.max_sessions = 1;
+    params.shards = 1;
+    params.write_back_ms = 10000;
+    params.backend = backend;
+    auto store = std::make_shared<SessionStore>(params);
+
+    store->set("a", "k", "1");
+    store->set("b", "k", "2");
+    // still pending, not lost
+    EXPECT_TRUE(store->touch("a"));
+    std::string value;
+    EXPECT_TRUE(store->get("a", "k", &value));
+    EXPECT_EQ(value, "1");
+
+    store->flush(true);
+    EXPECT_TRUE(backend->get("a", &value));
+    EXPECT_TRUE(backend->get("b", &value));
+}
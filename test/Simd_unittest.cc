@@ -0,0 +1,261 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <random>
+#include <string>
+#include "wfrest/Simd.h"
+#include "wfrest/StrUtil.h"
+#include "wfrest/CodeUtil.h"
+#include "wfrest/base64.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+// the byte by byte versions the kernels replaced, for the behavior on any input
+
+std::string url_encode_reference(const std::string &value)
+{
+    static auto hex_chars = "0123456789ABCDEF";
+    std::string result;
+    for (auto &chr : value)
+    {
+        if (!((chr >= '0' && chr <= '9') || (chr >= 'A' && chr <= 'Z') ||
+            (chr >= 'a' && chr <= 'z') || chr == '-' || chr == '.' ||
+            chr == '_' || chr == '~' || chr == '/'))
+        {
+            result += std::string("%") +
+                    hex_chars[static_cast<unsigned char>(chr) >> 4] +
+                    hex_chars[static_cast<unsigned char>(chr) & 15];
+        }
+        else
+            result += chr;
+    }
+    return result;
+}
+
+std::string url_decode_reference(const std::string &value)
+{
+    std::string result;
+    for (std::size_t i = 0; i < value.size(); ++i)
+    {
+        auto &chr = value[i];
+        if (chr == '%' && i + 2 < value.size())
+        {
+            auto hex = value.substr(i + 1, 2);
+            result += static_cast<char>(std::strtol(hex.c_str(), nullptr, 16));
+            i += 2;
+        }
+        else if (chr == '+')
+            result += ' ';
+        else
+            result += chr;
+    }
+    return result;
+}
+
+std::string base64_decode_reference(const std::string &encoded)
+{
+    static const std::string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string ret;
+    unsigned char group[4];
+    int i = 0;
+    for (char c : encoded)
+    {
+        if (c == '=' || !(isalnum(static_cast<unsigned char>(c)) || c == '+' || c == '/'))
+            break;
+        group[i++] = chars.find(c);
+        if (i == 4)
+        {
+            ret += static_cast<char>((group[0] << 2) + ((group[1] & 0x30) >> 4));
+            ret += static_cast<char>(((group[1] & 0xf) << 4) + ((group[2] & 0x3c) >> 2));
+            ret += static_cast<char>(((group[2] & 0x3) << 6) + group[3]);
+            i = 0;
+        }
+    }
+    if (i)
+    {
+        for (int j = i; j < 4; j++)
+            group[j] = static_cast<unsigned char>(chars.find('\0'));
+        unsigned char bytes[3];
+        bytes[0] = (group[0] << 2) + ((group[1] & 0x30) >> 4);
+        bytes[1] = ((group[1] & 0xf) << 4) + ((group[2] & 0x3c) >> 2);
+        bytes[2] = ((group[2] & 0x3) << 6) + group[3];
+        ret.append(reinterpret_cast<const char *>(bytes), i - 1);
+    }
+    return ret;
+}
+
+std::vector<std::string> split_reference(const std::string &str, char sep)
+{
+    std::vector<std::string> res;
+    if (str.empty())
+        return res;
+    size_t cursor = 0;
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        if (str[i] == sep)
+        {
+            res.push_back(str.substr(cursor, i - cursor));
+            cursor = i + 1;
+        }
+    }
+    res.push_back(str.substr(cursor));
+    return res;
+}
+
+// random strings drawn mostly from alphabet, up to max_len bytes
+std::string random_string(std::mt19937 &rng, const std::string &alphabet, size_t max_len)
+{
+    std::string str(rng() % (max_len + 1), '\0');
+    for (char &c : str)
+        c = rng() % 16 == 0 ? static_cast<char>(rng()) : alphabet[rng() % alphabet.size()];
+    return str;
+}
+
+class SimdLevels : public testing::Test
+{
+protected:
+    void TearDown() override { Simd::set_level(Simd::detected()); }
+
+    // each level of the cpu above the scalar one
+    std::vector<SimdLevel> vector_levels() const
+    {
+        std::vector<SimdLevel> levels;
+        for (int level = 1; level <= static_cast<int>(Simd::detected()); level++)
+            levels.push_back(static_cast<SimdLevel>(level));
+        return levels;
+    }
+};
+
+}  // namespace
+
+TEST_F(SimdLevels, set_level)
+{
+    EXPECT_EQ(Simd::level(), Simd::detected());
+    EXPECT_EQ(Simd::set_level(SimdLevel::SCALAR), SimdLevel::SCALAR);
+    EXPECT_EQ(Simd::level(), SimdLevel::SCALAR);
+    EXPECT_EQ(Simd::set_level(SimdLevel::AVX2), Simd::detected());
+    EXPECT_STREQ(Simd::level_name(SimdLevel::SSE42), "sse4.2");
+}
+
+TEST_F(SimdLevels, kernels)
+{
+    std::mt19937 rng(42);
+    const std::string text = "abcXYZ019-._~/%+&=; ";
+    const std::string base64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (int round = 0; round < 20000; round++)
+    {
+        std::string str = random_string(rng, text, 100);
+        std::string other = str;
+        for (char &c : other)
+        {
+            if (rng() % 2 && isalpha(static_cast<unsigned char>(c)))
+                c ^= 0x20;
+        }
+        if (!other.empty() && rng() % 2)
+            other[rng() % other.size()] = static_cast<char>(rng());
+        std::string encoded = random_string(rng, base64, 100);
+        const char *begin = str.data();
+        const char *end = begin + str.size();
+        char sep = text[rng() % text.size()];
+
+        Simd::set_level(SimdLevel::SCALAR);
+        const char *found = Simd::find_char(begin, end, sep);
+        const char *unsafe = Simd::find_url_unsafe(begin, end);
+        const char *escape = Simd::find_url_escape(begin, end);
+        size_t mismatch = Simd::mismatch_nocase(str.data(), other.data(), str.size());
+        std::string encode_out(str.size() / 3 * 4, '\0');
+        size_t encoded_len = Simd::base64_encode(reinterpret_cast<const unsigned char *>(begin),
+                                                 str.size(), &encode_out[0]);
+        std::string decode_out(encoded.size() / 4 * 3 + Simd::k_base64_decode_slack, '\0');
+        size_t decoded_len = Simd::base64_decode(encoded.data(), encoded.size(),
+                                                 reinterpret_cast<unsigned char *>(&decode_out[0]));
+        decode_out.resize(decoded_len / 4 * 3);
+
+        for (SimdLevel level : vector_levels())
+        {
+            Simd::set_level(level);
+            SCOPED_TRACE(Simd::level_name(level));
+            ASSERT_EQ(Simd::find_char(begin, end, sep), found);
+            ASSERT_EQ(Simd::find_url_unsafe(begin, end), unsafe);
+            ASSERT_EQ(Simd::find_url_escape(begin, end), escape);
+            ASSERT_EQ(Simd::mismatch_nocase(str.data(), other.data(), str.size()), mismatch);
+
+            std::string out(encode_out.size(), '\0');
+            ASSERT_EQ(Simd::base64_encode(reinterpret_cast<const unsigned char *>(begin),
+                                          str.size(), &out[0]), encoded_len);
+            ASSERT_EQ(out, encode_out);
+
+            out.assign(encoded.size() / 4 * 3 + Simd::k_base64_decode_slack, '\0');
+            ASSERT_EQ(Simd::base64_decode(encoded.data(), encoded.size(),
+                                          reinterpret_cast<unsigned char *>(&out[0])), decoded_len);
+            out.resize(decoded_len / 4 * 3);
+            ASSERT_EQ(out, decode_out);
+        }
+    }
+}
+
+TEST_F(SimdLevels, codecs)
+{
+    std::mt19937 rng(7);
+    const std::string url = "az AZ09-._~/%+?&=%2f%41%zz%4";
+    const std::string base64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
+    std::vector<SimdLevel> levels = vector_levels();
+    levels.push_back(SimdLevel::SCALAR);
+    for (int round = 0; round < 5000; round++)
+    {
+        std::string value = random_string(rng, url, 200);
+        std::string bytes = random_string(rng, url, 200);
+        std::string encoded = random_string(rng, base64, 200);
+        for (SimdLevel level : levels)
+        {
+            Simd::set_level(level);
+            SCOPED_TRACE(Simd::level_name(level));
+            ASSERT_EQ(CodeUtil::url_encode(value), url_encode_reference(value));
+            ASSERT_EQ(CodeUtil::url_decode(value), url_decode_reference(value));
+
+            std::string b64 = Base64::encode(reinterpret_cast<const unsigned char *>(bytes.data()),
+                                             bytes.size());
+            ASSERT_EQ(Base64::decode(b64), bytes);
+            ASSERT_EQ(Base64::decode(encoded), base64_decode_reference(encoded));
+
+            std::vector<StringPiece> pieces = StrUtil::split_piece<StringPiece>(value, '&');
+            std::vector<std::string> strs = split_reference(value, '&');
+            ASSERT_EQ(pieces.size(), strs.size());
+            for (size_t i = 0; i < pieces.size(); i++)
+                ASSERT_EQ(pieces[i].as_string(), strs[i]);
+        }
+    }
+}
+
+TEST_F(SimdLevels, compare_nocase)
+{
+    std::mt19937 rng(11);
+    const std::string header = "Content-Type-Length-Encoding";
+    std::vector<SimdLevel> levels = vector_levels();
+    levels.push_back(SimdLevel::SCALAR);
+    for (int round = 0; round < 5000; round++)
+    {
+        std::string lhs = random_string(rng, header, 60);
+        std::string rhs = rng() % 2 ? random_string(rng, header, 60) : lhs;
+        for (char &c : rhs)
+        {
+            if (rng() % 2 && isalpha(static_cast<unsigned char>(c)))
+                c ^= 0x20;
+        }
+        // strcasecmp() stops at a '\0'
+        if (lhs.find('\0') != std::string::npos || rhs.find('\0') != std::string::npos)
+            continue;
+        int expected = strcasecmp(lhs.c_str(), rhs.c_str());
+        for (SimdLevel level : levels)
+        {
+            Simd::set_level(level);
+            SCOPED_TRACE(Simd::level_name(level));
+            int res = StrUtil::compare_nocase(lhs.data(), lhs.size(), rhs.data(), rhs.size());
+            ASSERT_EQ(res < 0, expected < 0);
+            ASSERT_EQ(res == 0, expected == 0);
+            ASSERT_EQ(StrUtil::equals_nocase(lhs, rhs), expected == 0);
+        }
+    }
+}
@@ -0,0 +1,314 @@
+#include <gtest/gtest.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/rsa.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "wfrest/TlsContext.h"
+
+using namespace wfrest;
+
+// Handshakes over a BIO pair, no sockets.
+class TlsContextTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+        EVP_PKEY_keygen_init(key_ctx);
+        EVP_PKEY_CTX_set_rsa_keygen_bits(key_ctx, 2048);
+        EVP_PKEY_keygen(key_ctx, &key_);
+        EVP_PKEY_CTX_free(key_ctx);
+
+        cert_ = X509_new();
+        ASN1_INTEGER_set(X509_get_serialNumber(cert_), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert_), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert_), 3600);
+        X509_set_pubkey(cert_, key_);
+        X509_NAME *name = X509_get_subject_name(cert_);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(cert_, name);
+        X509_sign(cert_, key_, EVP_sha256());
+
+        client_ctx_ = SSL_CTX_new(TLS_client_method());
+    }
+
+    void TearDown() override
+    {
+        SSL_CTX_free(client_ctx_);
+        X509_free(cert_);
+        EVP_PKEY_free(key_);
+    }
+
+    SSL_CTX *new_server_ctx(TlsContext &tls)
+    {
+        SSL_CTX *ssl_ctx = SSL_CTX_new(TLS_server_method());
+        SSL_CTX_use_certificate(ssl_ctx, cert_);
+        SSL_CTX_use_PrivateKey(ssl_ctx, key_);
+        EXPECT_EQ(tls.configure(ssl_ctx), 0);
+        return ssl_ctx;
+    }
+
+    // returns the session of the client, resumed or not in *resumed
+    SSL_SESSION *connect(SSL_CTX *server_ctx, SSL_SESSION *session, bool *resumed,
+                         std::string *alpn = nullptr)
+    {
+        SSL *client = SSL_new(client_ctx_);
+        SSL *server = SSL_new(server_ctx);
+        BIO *client_bio;
+        BIO *server_bio;
+        BIO_new_bio_pair(&client_bio, 0, &server_bio, 0);
+        SSL_set_bio(client, client_bio, client_bio);
+        SSL_set_bio(server, server_bio, server_bio);
+        SSL_set_connect_state(client);
+        SSL_set_accept_state(server);
+        if (session)
+            SSL_set_session(client, session);
+
+        bool done = false;
+        for (int i = 0; i < 32 && !done; i++)
+        {
+            int client_ret = SSL_do_handshake(client);
+            int server_ret = SSL_do_handshake(server);
+            done = client_ret == 1 && server_ret == 1;
+        }
+        EXPECT_TRUE(done);
+
+        // TLS 1.3 tickets come after the handshake
+        char buf[1];
+        SSL_read(client, buf, sizeof buf);
+
+        *resumed = SSL_session_reused(server) == 1;
+        if (alpn)
+        {
+            const unsigned char *proto;
+            unsigned int len;
+            SSL_get0_alpn_selected(client, &proto, &len);
+            alpn->assign(reinterpret_cast<const char *>(proto), len);
+        }
+
+        SSL_SESSION *res = SSL_get1_session(client);
+        // freed without a shutdown, the sessions are not resumable
+        SSL_shutdown(client);
+        SSL_shutdown(server);
+        SSL_free(client);
+        SSL_free(server);
+        return res;
+    }
+
+    EVP_PKEY *key_ = nullptr;
+    X509 *cert_ = nullptr;
+    SSL_CTX *client_ctx_ = nullptr;
+};
+
+TEST_F(TlsContextTest, ticket_resumption)
+{
+    TlsContext tls{TlsParams()};
+    SSL_CTX *server_ctx = new_server_ctx(tls);
+    // a second endpoint of the same server
+    SSL_CTX *other_ctx = new_server_ctx(tls);
+
+    bool resumed;
+    SSL_SESSION *session = connect(server_ctx, nullptr, &resumed);
+    EXPECT_FALSE(resumed);
+    SSL_SESSION *next = connect(other_ctx, session, &resumed);
+    EXPECT_TRUE(resumed);
+
+    TlsStats stats = tls.stats();
+    EXPECT_EQ(stats.full_handshakes, 1);
+    EXPECT_EQ(stats.resumed_handshakes, 1);
+    EXPECT_EQ(stats.failed_handshakes, 0);
+    EXPECT_GT(stats.handshake_max_us, 0);
+
+    SSL_SESSION_free(next);
+    SSL_SESSION_free(session);
+    SSL_CTX_free(other_ctx);
+    SSL_CTX_free(server_ctx);
+}
+
+TEST_F(TlsContextTest, ticket_key_rotation)
+{
+    TlsParams params;
+    params.ticket_keys_kept = 2;
+    TlsContext tls(params);
+    SSL_CTX *server_ctx = new_server_ctx(tls);
+
+    bool resumed;
+    SSL_SESSION *session = connect(server_ctx, nullptr, &resumed);
+
+    // still accepted with the previous key
+    tls.rotate_ticket_keys();
+    SSL_SESSION *next = connect(server_ctx, session, &resumed);
+    EXPECT_TRUE(resumed);
+    SSL_SESSION_free(next);
+
+    // the key of the ticket is gone
+    tls.rotate_ticket_keys();
+    next = connect(server_ctx, session, &resumed);
+    EXPECT_FALSE(resumed);
+    SSL_SESSION_free(next);
+
+    SSL_SESSION_free(session);
+    SSL_CTX_free(server_ctx);
+}
+
+TEST_F(TlsContextTest, session_cache)
+{
+    TlsParams params;
+    params.session_tickets = false;
+    params.session_cache_size = 1;
+    TlsContext tls(params);
+    SSL_CTX *server_ctx = new_server_ctx(tls);
+    SSL_CTX_set_max_proto_version(client_ctx_, TLS1_2_VERSION);
+
+    bool resumed;
+    SSL_SESSION *session = connect(server_ctx, nullptr, &resumed);
+    EXPECT_FALSE(resumed);
+    EXPECT_EQ(tls.stats().cached_sessions, 1);
+
+    SSL_SESSION *next = connect(server_ctx, session, &resumed);
+    EXPECT_TRUE(resumed);
+    SSL_SESSION_free(next);
+
+    // evicted by a new session
+    SSL_SESSION *other = connect(server_ctx, nullptr, &resumed);
+    EXPECT_EQ(tls.stats().cached_sessions, 1);
+    next = connect(server_ctx, session, &resumed);
+    EXPECT_FALSE(resumed);
+
+    SSL_SESSION_free(next);
+    SSL_SESSION_free(other);
+    SSL_SESSION_free(session);
+    SSL_CTX_free(server_ctx);
+}
+
+TEST_F(TlsContextTest, session_cache_lru)
+{
+    TlsParams params;
+    params.session_tickets = false;
+    params.session_cache_size = 2;
+    TlsContext tls(params);
+    SSL_CTX *server_ctx = new_server_ctx(tls);
+    SSL_CTX_set_max_proto_version(client_ctx_, TLS1_2_VERSION);
+
+    bool resumed;
+    SSL_SESSION *first = connect(server_ctx, nullptr, &resumed);
+    SSL_SESSION *second = connect(server_ctx, nullptr, &resumed);
+
+    // the hit makes the first session the most recent one
+    SSL_SESSION *next = connect(server_ctx, first, &resumed);
+    EXPECT_TRUE(resumed);
+    SSL_SESSION_free(next);
+
+    // so the second one is evicted
+    SSL_SESSION *third = connect(server_ctx, nullptr, &resumed);
+    next = connect(server_ctx, first, &resumed);
+    EXPECT_TRUE(resumed);
+    SSL_SESSION_free(next);
+    next = connect(server_ctx, second, &resumed);
+    EXPECT_FALSE(resumed);
+    SSL_SESSION_free(next);
+
+    SSL_SESSION_free(third);
+    SSL_SESSION_free(second);
+    SSL_SESSION_free(first);
+    SSL_CTX_free(server_ctx);
+}
+
+TEST_F(TlsContextTest, ticket_key_file)
+{
+    char path[] = "/tmp/wfrest_ticket_keys_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    unsigned char keys[2 * 80];
+    for (size_t i = 0; i < sizeof keys; i++)
+        keys[i] = static_cast<unsigned char>(i * 7);
+    ASSERT_EQ(write(fd, keys, sizeof keys), static_cast<ssize_t>(sizeof keys));
+    close(fd);
+
+    TlsParams params;
+    params.ticket_key_file = path;
+    // the running process and the upgraded one
+    TlsContext old_tls(params);
+    TlsContext new_tls(params);
+    SSL_CTX *old_ctx = new_server_ctx(old_tls);
+    SSL_CTX *new_ctx = new_server_ctx(new_tls);
+
+    bool resumed;
+    SSL_SESSION *session = connect(old_ctx, nullptr, &resumed);
+    EXPECT_FALSE(resumed);
+    SSL_SESSION *next = connect(new_ctx, session, &resumed);
+    EXPECT_TRUE(resumed);
+    SSL_SESSION_free(next);
+
+    // a rewritten file drops the key of the ticket
+    fd = open(path, O_WRONLY | O_TRUNC);
+    ASSERT_EQ(write(fd, keys + 80, 80), 80);
+    close(fd);
+    new_tls.rotate_ticket_keys();
+    next = connect(new_ctx, session, &resumed);
+    EXPECT_FALSE(resumed);
+    SSL_SESSION_free(next);
+
+    // a truncated key is refused
+    fd = open(path, O_WRONLY | O_TRUNC);
+    ASSERT_EQ(write(fd, keys, 40), 40);
+    close(fd);
+    TlsContext bad_tls(params);
+    SSL_CTX *bad_ctx = SSL_CTX_new(TLS_server_method());
+    EXPECT_EQ(bad_tls.configure(bad_ctx), -1);
+    SSL_CTX_free(bad_ctx);
+
+    unlink(path);
+    SSL_SESSION_free(session);
+    SSL_CTX_free(new_ctx);
+    SSL_CTX_free(old_ctx);
+}
+
+TEST_F(TlsContextTest, alpn)
+{
+    TlsContext tls{TlsParams()};
+    SSL_CTX *server_ctx = new_server_ctx(tls);
+
+    static const unsigned char protos[] = "\x02h2\x08http/1.1";
+    SSL_CTX_set_alpn_protos(client_ctx_, protos, sizeof protos - 1);
+
+    bool resumed;
+    std::string alpn;
+    SSL_SESSION *session = connect(server_ctx, nullptr, &resumed, &alpn);
+    EXPECT_EQ(alpn, "http/1.1");
+
+    SSL_SESSION_free(session);
+    SSL_CTX_free(server_ctx);
+}
+
+TEST_F(TlsContextTest, alpn_no_h2)
+{
+    TlsParams params;
+    params.alpn = { "h2", "http/1.1" };
+    TlsContext tls(params);
+    SSL_CTX *server_ctx = new_server_ctx(tls);
+
+    static const unsigned char protos[] = "\x02h2\x08http/1.1";
+    SSL_CTX_set_alpn_protos(client_ctx_, protos, sizeof protos - 1);
+
+    bool resumed;
+    std::string alpn;
+    SSL_SESSION *session = connect(server_ctx, nullptr, &resumed, &alpn);
+    EXPECT_EQ(alpn, "http/1.1");
+
+    SSL_SESSION_free(session);
+    SSL_CTX_free(server_ctx);
+}
+
+TEST_F(TlsContextTest, bad_ciphers)
+{
+    TlsParams params;
+    params.ciphers = "NOT-A-CIPHER";
+    TlsContext tls(params);
+    SSL_CTX *ssl_ctx = SSL_CTX_new(TLS_server_method());
+    EXPECT_EQ(tls.configure(ssl_ctx), -1);
+    SSL_CTX_free(ssl_ctx);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "wfrest/Upgrade.h"
+
+using namespace wfrest;
+
+namespace
+{
+
+int listen_tcp(unsigned short *port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr);
+    listen(fd, 16);
+
+    socklen_t len = sizeof addr;
+    getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+unsigned short port_of(int fd)
+{
+    struct sockaddr_in addr = {};
+    socklen_t len = sizeof addr;
+    getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len);
+    return ntohs(addr.sin_port);
+}
+
+const char *k_upgrade_path = "/tmp/wfrest_upgrade_test.sock";
+
+}  // namespace
+
+TEST(Upgrade, send_recv_sockets)
+{
+    int pair[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+
+    unsigned short port;
+    int fd = listen_tcp(&port);
+    std::vector<UpgradeSocket> sent = { { "main", fd }, { "unix:/tmp/x.sock", fd } };
+    EXPECT_EQ(Upgrade::send_sockets(pair[0], sent), 0);
+
+    std::vector<UpgradeSocket> received;
+    EXPECT_EQ(Upgrade::recv_sockets(pair[1], 1000, &received), 0);
+    ASSERT_EQ(received.size(), 2);
+    EXPECT_EQ(received[0].name, "main");
+    EXPECT_EQ(received[1].name, "unix:/tmp/x.sock");
+    // the same socket, another fd
+    EXPECT_NE(received[0].fd, fd);
+    EXPECT_EQ(port_of(received[0].fd), port);
+
+    // nothing to read
+    std::vector<UpgradeSocket> none;
+    EXPECT_EQ(Upgrade::recv_sockets(pair[1], 10, &none), -1);
+
+    for (auto &socket : received)
+        close(socket.fd);
+    close(fd);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+TEST(Upgrade, handoff)
+{
+    unsigned short port;
+    int fd = listen_tcp(&port);
+
+    Upgrade running;
+    ASSERT_EQ(running.serve(k_upgrade_path, [fd]()
+    {
+        return std::vector<UpgradeSocket>{ { "main", fd }, { "old", fd } };
+    }), 0);
+
+    Upgrade next;
+    ASSERT_EQ(next.inherit(k_upgrade_path, 1000), 0);
+    EXPECT_TRUE(next.has("main"));
+    int inherited = next.take("main");
+    EXPECT_EQ(port_of(inherited), port);
+    EXPECT_FALSE(next.has("main"));
+    EXPECT_EQ(next.take("other"), -1);
+
+    // the previous process drains once the next one is ready
+    next.ready();
+    EXPECT_TRUE(running.wait_handoff());
+    EXPECT_FALSE(next.has("old"));
+
+    UpgradeStats stats = next.stats();
+    EXPECT_EQ(stats.inherited, 2);
+    EXPECT_GE(stats.handoff_us, 0);
+    EXPECT_GE(stats.startup_us, 0);
+    EXPECT_EQ(running.stats().handed_over, 2);
+
+    // the path is the one of the next process now
+    EXPECT_EQ(next.serve(k_upgrade_path, []() { return std::vector<UpgradeSocket>(); }), 0);
+    running.stop();
+    EXPECT_EQ(access(k_upgrade_path, F_OK), 0);
+    next.stop();
+    EXPECT_NE(access(k_upgrade_path, F_OK), 0);
+
+    close(inherited);
+    close(fd);
+}
+
+TEST(Upgrade, failed_start)
+{
+    unsigned short port;
+    int fd = listen_tcp(&port);
+
+    Upgrade running;
+    ASSERT_EQ(running.serve(k_upgrade_path, [fd]()
+    {
+        return std::vector<UpgradeSocket>{ { "main", fd } };
+    }), 0);
+
+    // gone before it is ready : the sockets are still served by the running process
+    {
+        Upgrade next;
+        ASSERT_EQ(next.inherit(k_upgrade_path, 1000), 0);
+    }
+
+    Upgrade retry;
+    ASSERT_EQ(retry.inherit(k_upgrade_path, 1000), 0);
+    EXPECT_TRUE(retry.has("main"));
+    retry.ready();
+    EXPECT_TRUE(running.wait_handoff());
+    close(fd);
+}
+
+TEST(Upgrade, first_start)
+{
+    unlink(k_upgrade_path);
+    Upgrade next;
+    EXPECT_EQ(next.inherit(k_upgrade_path, 1000), 0);
+    EXPECT_EQ(next.stats().inherited, 0);
+    EXPECT_FALSE(next.wait_handoff());
+}